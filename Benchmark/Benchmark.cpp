@@ -0,0 +1,348 @@
+/*
+* Microbenchmarks of the routing core, on a fixed synthetic GTFS feed so runs are comparable across changes:
+*     Benchmark.exe [name filter] [GTFS directory]
+* Without a directory the fixture feed is written to the temp directory first. Every random choice is seeded,
+* so two builds run exactly the same work. Each benchmark runs batches of operations for at least
+* MinSecondsPerBenchmark and reports the mean, median and 99th percentile time per operation over the batches.
+*/
+#include "../Routify/Graph.h"
+#include "../Routify/Logger.h"
+#include "../Routify/Population.h"
+#include "../Routify/Route.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr double MinSecondsPerBenchmark = 1.0;
+    constexpr double MinBatchSeconds = 0.0002;  // Batches are scaled up to this, so clock reads don't dominate
+    constexpr uint64_t Seed = 42;
+
+    // Fixture: a grid of stops, with lines along every other row, every third column and both diagonals.
+    constexpr int FixtureRows = 24;
+    constexpr int FixtureCols = 24;
+    constexpr double FixtureLat = 32.05;
+    constexpr double FixtureLong = 34.76;
+    constexpr double FixtureSpacingDeg = 0.004;          // About 400m
+    constexpr int FixtureFirstDeparture = 6 * 60;
+    constexpr int FixtureLastDeparture = 22 * 60;
+    constexpr int FixtureHeadwayMinutes = 20;
+    constexpr int FixtureMinutesPerStop = 2;
+    constexpr int FixtureReturnLineOffset = 1000;
+
+    // GA settings of the evolve benchmark, the web app's defaults.
+    constexpr int PopulationSize = 100;
+    constexpr int Generations = 150;
+    constexpr double MutationRate = 0.5;
+    constexpr double DepartureTime = 8 * 60;
+    constexpr size_t TripCount = 8;
+    constexpr double MinTripKm = 3.0;
+
+    // Stores to a volatile, so the optimizer can't drop the work that computed the value.
+    volatile double sink = 0.0;
+    void keep(const double value) { sink = sink + value; }
+
+    int fixtureCode(const int row, const int col) {
+        return 10000 + row * FixtureCols + col;
+    }
+
+    void writeFixture(const std::filesystem::path& directory) {
+        std::filesystem::create_directories(directory);
+
+        std::ofstream stops(directory / Graph::GTFSStopsFileName, std::ios::binary);
+        stops << "stop_id,stop_code,stop_name,stop_desc,stop_lat,stop_lon,location_type,parent_station,zone_id\n";
+        stops << std::fixed << std::setprecision(6);
+        for (int row = 0; row < FixtureRows; ++row) {
+            for (int col = 0; col < FixtureCols; ++col) {
+                stops << row * FixtureCols + col << ',' << fixtureCode(row, col) << ",\"Stop " << row << '-' << col
+                    << "\",," << FixtureLat + row * FixtureSpacingDeg << ',' << FixtureLong + col * FixtureSpacingDeg
+                    << ",0,,1\n";
+            }
+        }
+
+        std::ofstream stopTimes(directory / Graph::GTFSLinesFileName, std::ios::binary);
+        stopTimes << "route_code,route_id,arrival_time,stop_code\n";
+        int tripId = 1;
+        // Each line runs both ways, the return trips under their own line code like in the real feed.
+        auto writeLine = [&](const int lineCode, std::vector<int> stopCodes) {
+            for (const int directionCode : { lineCode, lineCode + FixtureReturnLineOffset }) {
+                for (int departure = FixtureFirstDeparture; departure <= FixtureLastDeparture;
+                    departure += FixtureHeadwayMinutes, ++tripId) {
+                    int minutes = departure;
+                    for (const int stopCode : stopCodes) {
+                        char time[16];
+                        std::snprintf(time, sizeof(time), "%02d:%02d:00", minutes / 60, minutes % 60);
+                        stopTimes << directionCode << ',' << tripId << ',' << time << ',' << stopCode << '\n';
+                        minutes += FixtureMinutesPerStop;
+                    }
+                }
+                std::reverse(stopCodes.begin(), stopCodes.end());
+            }
+        };
+
+        std::vector<int> stopCodes;
+        for (int row = 0; row < FixtureRows; row += 2) {
+            stopCodes.clear();
+            for (int col = 0; col < FixtureCols; ++col) stopCodes.push_back(fixtureCode(row, col));
+            writeLine(1 + row, stopCodes);
+        }
+        for (int col = 0; col < FixtureCols; col += 3) {
+            stopCodes.clear();
+            for (int row = 0; row < FixtureRows; ++row) stopCodes.push_back(fixtureCode(row, col));
+            writeLine(100 + col, stopCodes);
+        }
+        stopCodes.clear();
+        for (int i = 0; i < std::min(FixtureRows, FixtureCols); ++i) stopCodes.push_back(fixtureCode(i, i));
+        writeLine(200, stopCodes);
+        stopCodes.clear();
+        for (int i = 0; i < std::min(FixtureRows, FixtureCols); ++i) stopCodes.push_back(fixtureCode(i, FixtureCols - 1 - i));
+        writeLine(201, stopCodes);
+
+        if (!stops || !stopTimes) {
+            throw std::runtime_error("Failed to write the benchmark fixture to " + directory.string());
+        }
+    }
+
+    struct Trip {
+        int startCode;
+        int endCode;
+        Utilities::Coordinates startCoords;
+        Utilities::Coordinates endCoords;
+    };
+
+    // Station pairs picked by a seeded generator, far enough apart to need a few rides and connected by lines.
+    std::vector<Trip> pickTrips(const Graph& graph) {
+        std::mt19937 gen(Seed);
+        std::uniform_int_distribution<int> pick(0, static_cast<int>(graph.getStationCount()) - 1);
+        std::vector<Trip> trips;
+        for (int attempt = 0; trips.size() < TripCount && attempt < 1000; ++attempt) {
+            const int startIndex = pick(gen);
+            const int endIndex = pick(gen);
+            if (graph.getLinesFromIndex(startIndex).empty()) continue;
+            const Graph::Station& start = graph.getStationByIndex(startIndex);
+            const Graph::Station& end = graph.getStationByIndex(endIndex);
+            if (Utilities::calculateHaversineDistance(start.coordinates, end.coordinates) < MinTripKm) continue;
+            try {
+                // Throws when no path connects the pair
+                Population(1, start.code, end.code, graph, start.coordinates, end.coordinates, DepartureTime, {}, Seed);
+            }
+            catch (const std::exception&) {
+                continue;
+            }
+            trips.push_back(Trip{ start.code, end.code, start.coordinates, end.coordinates });
+        }
+        if (trips.empty()) {
+            throw std::runtime_error("The graph has no station pairs far enough apart to benchmark.");
+        }
+        return trips;
+    }
+
+    class Runner {
+    public:
+        explicit Runner(std::string filter) : _filter(std::move(filter)) {
+            std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(12) << "ops"
+                << std::setw(14) << "mean" << std::setw(14) << "p50" << std::setw(14) << "p99" << "\n";
+        }
+
+        bool wants(const std::string& name) const {
+            return name.find(_filter) != std::string::npos;
+        }
+
+        // Times op(i) for i = 0, 1, 2... op gets a running counter to cycle through its inputs.
+        void run(const std::string& name, const std::function<void(size_t)>& op) {
+            if (!wants(name)) return;
+            using Clock = std::chrono::steady_clock;
+
+            size_t counter = 0;
+            size_t batchSize = 1;
+            op(counter++);  // Warm up caches and lazily built state
+            for (;;) {
+                const Clock::time_point start = Clock::now();
+                for (size_t i = 0; i < batchSize; ++i) op(counter++);
+                if (std::chrono::duration<double>(Clock::now() - start).count() >= MinBatchSeconds) break;
+                batchSize *= 2;
+            }
+
+            std::vector<double> nanosPerOp;
+            size_t ops = 0;
+            const Clock::time_point benchmarkStart = Clock::now();
+            while (std::chrono::duration<double>(Clock::now() - benchmarkStart).count() < MinSecondsPerBenchmark) {
+                const Clock::time_point start = Clock::now();
+                for (size_t i = 0; i < batchSize; ++i) op(counter++);
+                nanosPerOp.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / batchSize);
+                ops += batchSize;
+            }
+
+            double mean = 0.0;
+            for (const double nanos : nanosPerOp) mean += nanos;
+            mean /= nanosPerOp.size();
+            std::sort(nanosPerOp.begin(), nanosPerOp.end());
+            const double p50 = nanosPerOp[nanosPerOp.size() / 2];
+            const double p99 = nanosPerOp[std::min(nanosPerOp.size() - 1, nanosPerOp.size() * 99 / 100)];
+
+            std::cout << std::left << std::setw(28) << name << std::right << std::setw(12) << ops
+                << std::setw(14) << format(mean) << std::setw(14) << format(p50) << std::setw(14) << format(p99) << "\n";
+        }
+
+    private:
+        static std::string format(const double nanos) {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(nanos < 10'000.0 ? 1 : 0);
+            if (nanos < 10'000.0) out << nanos << " ns";
+            else if (nanos < 10'000'000.0) out << nanos / 1e3 << " us";
+            else out << nanos / 1e6 << " ms";
+            return out.str();
+        }
+
+        std::string _filter;
+    };
+}
+
+int main(int argc, char* argv[]) {
+    Logger::shared().setLevel(Logger::Level::Warning);  // Graph loads would log on every iteration
+    const std::string filter = (argc > 1) ? argv[1] : "";
+
+    try {
+        std::filesystem::path gtfsDirectory;
+        if (argc > 2) {
+            gtfsDirectory = argv[2];
+        }
+        else {
+            gtfsDirectory = std::filesystem::temp_directory_path() / "RoutifyBenchmark";
+            writeFixture(gtfsDirectory);
+        }
+        const std::string gtfsPath = gtfsDirectory.string() + "/";
+        const std::string binaryPath = (gtfsDirectory / "graph.bin").string();
+
+        const Graph graph(gtfsPath, "");
+        if (graph.getStationCount() == 0) {
+            LOG_ERROR(General, "No stations were loaded from " << gtfsPath << ".");
+            return 1;
+        }
+        graph.saveBinary(binaryPath);
+        std::cout << "Graph: " << graph.getStationCount() << " stations, " << graph.getEdgeCount() << " edges, "
+            << graph.getLineIdCount() << " lines, from " << gtfsPath << "\n\n";
+
+        const std::vector<Trip> trips = pickTrips(graph);
+        Runner runner(filter);
+
+        // --- Graph ---
+        runner.run("graph/parse_gtfs", [&](size_t) {
+            const Graph parsed(gtfsPath, "");
+            keep(static_cast<double>(parsed.getEdgeCount()));
+        });
+        runner.run("graph/load_binary", [&](size_t) {
+            const Graph loaded(binaryPath);
+            keep(static_cast<double>(loaded.getEdgeCount()));
+        });
+
+        std::vector<Utilities::Coordinates> points;
+        {
+            std::mt19937 gen(Seed);
+            std::uniform_int_distribution<int> pick(0, static_cast<int>(graph.getStationCount()) - 1);
+            std::uniform_real_distribution<double> jitter(-0.003, 0.003);
+            for (int i = 0; i < 1024; ++i) {
+                const Utilities::Coordinates& near = graph.getStationByIndex(pick(gen)).coordinates;
+                points.emplace_back(near.latitude + jitter(gen), near.longitude + jitter(gen));
+            }
+        }
+        runner.run("graph/nearby_stations", [&](const size_t i) {
+            keep(static_cast<double>(graph.getNearbyStations(points[i % points.size()]).size()));
+        });
+
+        // --- Population seeding (diverse shortest paths, then mutations of them) ---
+        runner.run("population/seed", [&](const size_t i) {
+            const Trip& trip = trips[i % trips.size()];
+            const Population population(PopulationSize, trip.startCode, trip.endCode, graph,
+                trip.startCoords, trip.endCoords, DepartureTime, {}, Seed);
+            keep(population.getBestSolution().getFitness(trip.startCode, trip.endCode, graph,
+                trip.startCoords, trip.endCoords, DepartureTime));
+        });
+
+        // --- Route operators, on the seeded routes of every trip ---
+        struct Sample {
+            const Trip* trip;
+            Route route;
+        };
+        std::vector<Sample> samples;
+        for (const Trip& trip : trips) {
+            const Population population(PopulationSize, trip.startCode, trip.endCode, graph,
+                trip.startCoords, trip.endCoords, DepartureTime, {}, Seed);
+            for (Route& route : population.getBestSolutions(16)) samples.push_back(Sample{ &trip, std::move(route) });
+        }
+
+        runner.run("route/fitness", [&](const size_t i) {
+            Sample& sample = samples[i % samples.size()];
+            sample.route.getMutableVisitedStations();   // Drops the cached scores
+            keep(sample.route.getFitness(sample.trip->startCode, sample.trip->endCode, graph,
+                sample.trip->startCoords, sample.trip->endCoords, DepartureTime));
+        });
+        runner.run("route/fitness_cached", [&](const size_t i) {
+            const Sample& sample = samples[i % samples.size()];
+            keep(sample.route.getFitness(sample.trip->startCode, sample.trip->endCode, graph,
+                sample.trip->startCoords, sample.trip->endCoords, DepartureTime));
+        });
+        runner.run("route/is_valid", [&](const size_t i) {
+            Sample& sample = samples[i % samples.size()];
+            sample.route.getMutableVisitedStations();   // Drops the cached validity
+            keep(sample.route.isValid(sample.trip->startCode, sample.trip->endCode, graph) ? 1.0 : 0.0);
+        });
+        runner.run("route/is_valid_cached", [&](const size_t i) {
+            const Sample& sample = samples[i % samples.size()];
+            keep(sample.route.isValid(sample.trip->startCode, sample.trip->endCode, graph) ? 1.0 : 0.0);
+        });
+
+        std::mt19937 gen(Seed);
+        Route::Workspace workspace;
+        Route child;
+        runner.run("route/crossover", [&](const size_t i) {
+            // Parents of the same trip, as in a generation
+            const size_t first = i % samples.size();
+            const size_t second = (first % 16 == 15) ? first - 15 : first + 1;
+            Route::crossover(samples[first].route, samples[second].route, gen, workspace, child);
+            keep(static_cast<double>(child.getVisitedStations().size()));
+        });
+        runner.run("route/mutate", [&](const size_t i) {
+            // Includes copying the parent into the reused child, like breeding does
+            const Sample& sample = samples[i % samples.size()];
+            child = sample.route;
+            child.mutate(MutationRate, gen, sample.trip->startCode, sample.trip->endCode, graph, workspace);
+            keep(static_cast<double>(child.getVisitedStations().size()));
+        });
+
+        // --- Full GA runs, seeded, on the calling thread ---
+        std::vector<double> tripFitness(trips.size(), -1.0);
+        runner.run("population/evolve", [&](const size_t i) {
+            const Trip& trip = trips[i % trips.size()];
+            Population population(PopulationSize, trip.startCode, trip.endCode, graph,
+                trip.startCoords, trip.endCoords, DepartureTime, {}, Seed);
+            population.evolve(Generations, MutationRate, Population::StopCriteria{});
+            const double fitness = population.getBestSolution().getFitness(trip.startCode, trip.endCode, graph,
+                trip.startCoords, trip.endCoords, DepartureTime);
+            keep(fitness);
+            tripFitness[i % trips.size()] = fitness;
+        });
+        if (runner.wants("population/evolve")) {
+            // Seeded runs are deterministic, so a change in these values means the search itself changed.
+            std::cout << "\nBest fitness per trip:";
+            for (const double fitness : tripFitness) std::cout << " " << std::setprecision(6) << fitness;
+            std::cout << "\n";
+        }
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR(General, "Benchmark failed: " << e.what());
+        return 1;
+    }
+    return 0;
+}
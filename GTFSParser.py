@@ -31,7 +31,7 @@ with open('stop_times.txt', mode='r', encoding='utf-8-sig') as stop_times_file,
      open('stop_times_filtered.txt', mode='w', encoding='utf-8-sig', newline='') as output_file:
 
     reader = csv.DictReader(stop_times_file)
-    fieldnames = ['route_code', 'route_id', 'arrival_time', 'stop_code']
+    fieldnames = ['route_code', 'route_id', 'arrival_time', 'stop_code', 'trip_id']
     writer = csv.DictWriter(output_file, fieldnames=fieldnames)
     writer.writeheader()
 
@@ -43,7 +43,8 @@ with open('stop_times.txt', mode='r', encoding='utf-8-sig') as stop_times_file,
                 'route_code': route_info['route_code'],
                 'route_id': route_info['route_id'],
                 'arrival_time': row['arrival_time'],
-                'stop_code': stop_code
+                'stop_code': stop_code,
+                'trip_id': row['trip_id']
             })
         if i % 100000 == 0:
             print(f"Processed {i:,} lines...")
\ No newline at end of file
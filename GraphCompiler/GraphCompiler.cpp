@@ -0,0 +1,44 @@
+/*
+* Offline step that turns the GTFS text files into a binary graph file, and precomputes its hub labels.
+* Run it after GTFSParser.py whenever the feed changes:
+*     GraphCompiler.exe [output path]
+* The labels are written next to the graph, with the extension .hubs.
+* The server maps both on startup instead of re-parsing the feed.
+*/
+#include "../Routify/Graph.h"
+#include "../Routify/HubLabels.h"
+#include "../Routify/Logger.h"
+#include <chrono>
+#include <exception>
+#include <filesystem>
+
+int main(int argc, char* argv[]) {
+    Logger::shared(); // Destroyed last, so everything logged gets written before exiting
+    const std::string outputPath = (argc > 1) ? argv[1] : Graph::DefaultBinaryGraphFile;
+
+    try {
+        auto parseStart = std::chrono::steady_clock::now();
+        Graph graph;
+        auto parseEnd = std::chrono::steady_clock::now();
+        LOG_INFO(General, "Parsed GTFS feed in "
+            << std::chrono::duration_cast<std::chrono::seconds>(parseEnd - parseStart).count() << "s.");
+
+        if (graph.getStationCount() == 0) {
+            LOG_ERROR(General, "No stations were loaded, refusing to write an empty graph.");
+            return 1;
+        }
+        graph.saveBinary(outputPath);
+
+        auto labelStart = std::chrono::steady_clock::now();
+        HubLabels labels(graph);
+        auto labelEnd = std::chrono::steady_clock::now();
+        LOG_INFO(General, "Built hub labels in "
+            << std::chrono::duration_cast<std::chrono::seconds>(labelEnd - labelStart).count() << "s.");
+        labels.save(std::filesystem::path(outputPath).replace_extension(".hubs").string());
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR(General, "Graph compilation failed: " << e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+"""
+Replays recorded route requests against the routing server at a fixed rate and reports latency and route quality.
+
+    python LoadTest.py requests.jsonl --qps 20 --duration 60
+
+The requests file holds one JSON request per line. Lines of the Flask proxy's log ("Frontend Payload (parsed): {...}")
+work as they are, other lines are skipped, so a proxy log can be replayed directly. Requests are sent open-loop: each
+one leaves at its scheduled time whether or not earlier ones were answered, and its latency is measured from that
+time, so a server falling behind shows up as growing latency instead of a lower sending rate.
+"""
+import argparse
+import itertools
+import json
+import socket
+import struct
+import sys
+import threading
+import time
+from collections import Counter
+
+DEFAULT_HOST = '127.0.0.1'
+DEFAULT_PORT = 8200
+FLASK_LOG_PREFIX = 'Frontend Payload (parsed):'
+REQUEST_ID_KEY = 'requestId'
+
+
+def load_requests(path):
+    requests = []
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith(FLASK_LOG_PREFIX): line = line[len(FLASK_LOG_PREFIX):].strip()
+            if not line.startswith('{'): continue
+            try: request = json.loads(line)
+            except ValueError: continue
+            if isinstance(request, dict) and request.get('type') == 2: requests.append(request)
+    return requests
+
+
+def percentile(sorted_values, fraction):
+    if not sorted_values: return float('nan')
+    return sorted_values[min(len(sorted_values) - 1, int(fraction * len(sorted_values)))]
+
+
+class Connection:
+    """A framed connection; a reader thread records each reply against the scheduled time of its request."""
+
+    def __init__(self, host, port, results):
+        self.sock = socket.create_connection((host, port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.reader = self.sock.makefile('rb')
+        self.results = results
+        self.thread = threading.Thread(target=self._read_responses, daemon=True)
+        self.thread.start()
+
+    def send(self, request, request_id, scheduled_at):
+        self.results.sent(request_id, scheduled_at)
+        body = json.dumps(dict(request, **{REQUEST_ID_KEY: request_id, 'format': 'json'}), separators=(',', ':')).encode()
+        self.sock.sendall(struct.pack('>I', len(body)) + body)
+
+    def _read_responses(self):
+        try:
+            while True:
+                header = self.reader.read(4)
+                if len(header) < 4: return
+                body = self.reader.read(struct.unpack('>I', header)[0])
+                self.results.received(json.loads(body.decode('utf-8')), time.perf_counter())
+        except (OSError, ValueError) as e:
+            print(f"Connection lost: {e}", file=sys.stderr)
+
+    def close(self):
+        try: self.sock.close()
+        except OSError: pass
+
+
+class Results:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.pending = {}           # request id -> scheduled send time
+        self.latencies = []         # seconds
+        self.fitness = []
+        self.statuses = Counter()
+        self.engines = Counter()
+        self.all_answered = threading.Event()
+        self.done_sending = False
+
+    def sent(self, request_id, scheduled_at):
+        with self.lock: self.pending[request_id] = scheduled_at
+
+    def received(self, response, now):
+        with self.lock:
+            scheduled_at = self.pending.pop(response.get(REQUEST_ID_KEY), None)
+            if scheduled_at is None: return
+            self.latencies.append(now - scheduled_at)
+            self.statuses[response.get('error') and 'error: ' + str(response['error']) or response.get('status', '?')] += 1
+            summary = response.get('summary')
+            if isinstance(summary, dict):
+                if 'fitness' in summary: self.fitness.append(summary['fitness'])
+                self.engines[summary.get('engine', '?')] += 1
+            if self.done_sending and not self.pending: self.all_answered.set()
+
+    def finish_sending(self):
+        with self.lock:
+            self.done_sending = True
+            if not self.pending: self.all_answered.set()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('requests', help='file of recorded type 2 requests, one JSON object per line')
+    parser.add_argument('--qps', type=float, default=10.0, help='requests sent per second (default 10)')
+    parser.add_argument('--duration', type=float, default=30.0, help='seconds to send for (default 30)')
+    parser.add_argument('--connections', type=int, default=4, help='framed connections to spread requests over')
+    parser.add_argument('--timeout', type=float, default=60.0, help='seconds to wait for the last replies')
+    parser.add_argument('--no-cache', action='store_true', help='ask the server not to answer from its route cache')
+    parser.add_argument('--host', default=DEFAULT_HOST)
+    parser.add_argument('--port', type=int, default=DEFAULT_PORT)
+    args = parser.parse_args()
+
+    requests = load_requests(args.requests)
+    if not requests: sys.exit(f"No type 2 requests found in {args.requests}")
+    if args.no_cache: requests = [dict(request, cache=False) for request in requests]
+    count = max(1, int(args.qps * args.duration))
+    print(f"Replaying {count} requests ({len(requests)} recorded) at {args.qps:g} qps "
+          f"over {args.connections} connections to {args.host}:{args.port}")
+
+    results = Results()
+    connections = [Connection(args.host, args.port, results) for _ in range(args.connections)]
+    start = time.perf_counter()
+    for i, request in zip(range(count), itertools.cycle(requests)):
+        scheduled_at = start + i / args.qps
+        delay = scheduled_at - time.perf_counter()
+        if delay > 0: time.sleep(delay)
+        connections[i % len(connections)].send(request, i, scheduled_at)
+    send_seconds = time.perf_counter() - start
+    results.finish_sending()
+    answered_in_time = results.all_answered.wait(args.timeout)
+    total_seconds = time.perf_counter() - start
+    for connection in connections: connection.close()
+
+    with results.lock:
+        latencies = sorted(results.latencies)
+        fitness = sorted(results.fitness)
+        unanswered = len(results.pending)
+        statuses, engines = dict(results.statuses), dict(results.engines)
+
+    print(f"Sent {count} in {send_seconds:.1f}s ({count / send_seconds:.1f} qps), "
+          f"{len(latencies)} answered in {total_seconds:.1f}s, {unanswered} unanswered"
+          + ("" if answered_in_time else f" after the {args.timeout:g}s timeout"))
+    if latencies:
+        print("Latency ms: " + "  ".join(f"{name} {value * 1000:.1f}" for name, value in (
+            ('p50', percentile(latencies, 0.5)), ('p90', percentile(latencies, 0.9)),
+            ('p99', percentile(latencies, 0.99)), ('max', latencies[-1]))))
+    if fitness:
+        print(f"Fitness of {len(fitness)} routes: mean {sum(fitness) / len(fitness):.6g}  "
+              f"p50 {percentile(fitness, 0.5):.6g}  min {fitness[0]:.6g}  max {fitness[-1]:.6g}")
+    print(f"Statuses: {statuses}")
+    if engines: print(f"Engines: {engines}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+/*
+* Tells long running work (GA runs, queued tasks) that its answer is no longer wanted, so it can stop early.
+* A token is cancelled explicitly, once its deadline passes, or when the token it was created from is, so a
+* request's token fires when its connection's does and a search's when its request's does.
+* Copies share the same state. The default token is never cancelled and costs a null check.
+*/
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Reason : uint8_t {
+        None,
+        Disconnected,   // The client went away
+        Deadline,       // The time budget ran out
+        TargetReached   // Another search already found a good enough route
+    };
+
+    static const char* toString(const Reason reason) {
+        switch (reason) {
+        case Reason::Disconnected: return "disconnected";
+        case Reason::Deadline: return "deadline";
+        case Reason::TargetReached: return "target";
+        case Reason::None:
+        default: return "none";
+        }
+    }
+
+    CancellationToken() = default;
+
+    // A new token, cancelled with cancel(), at the deadline, or along with parent.
+    static CancellationToken create(const CancellationToken& parent = {},
+        const Clock::time_point deadline = Clock::time_point::max())
+    {
+        CancellationToken token;
+        token._state = std::make_shared<State>();
+        token._state->deadline = deadline;
+        token._state->parent = parent._state;
+        return token;
+    }
+
+    // Cancels the token and every token created from it. The first reason sticks. Does nothing on a default token.
+    void cancel(const Reason reason) const {
+        if (!_state || reason == Reason::None) return;
+        Reason expected = Reason::None;
+        _state->reason.compare_exchange_strong(expected, reason, std::memory_order_relaxed);
+    }
+
+    // Why the token is cancelled, None while it isn't. Checks the deadline, so it reads the clock when one is set.
+    Reason getReason() const {
+        for (const State* state = _state.get(); state; state = state->parent.get()) {
+            const Reason reason = state->reason.load(std::memory_order_relaxed);
+            if (reason != Reason::None) return reason;
+            if (state->deadline != Clock::time_point::max() && Clock::now() >= state->deadline) return Reason::Deadline;
+        }
+        return Reason::None;
+    }
+
+    bool isCancelled() const { return getReason() != Reason::None; }
+
+private:
+    struct State {
+        std::atomic<Reason> reason = Reason::None;
+        Clock::time_point deadline = Clock::time_point::max();
+        std::shared_ptr<const State> parent;
+    };
+
+    std::shared_ptr<State> _state;
+};
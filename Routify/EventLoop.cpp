@@ -0,0 +1,698 @@
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <array>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <Windows.h>
+#else
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+    // Requests are small JSON documents, so one read rarely needs more than one buffer.
+    constexpr size_t ReceiveBufferSize = 16 * 1024;
+}
+
+#ifdef _WIN32
+// One overlapped receive or send. The OVERLAPPED comes first, so the pointer the port returns converts back.
+struct EventLoop::IoOperation {
+    OVERLAPPED overlapped;
+    enum class Kind { Receive, Send } kind;
+    ConnectionPtr connection;   // Keeps the connection alive while the operation is pending
+};
+#endif
+
+struct EventLoop::Connection {
+    ConnectionId id = 0;
+    NativeSocket socket;
+
+    std::mutex mutex;                       // Guards everything below; the decoder is only used by the reading thread
+    FrameDecoder decoder;
+    std::vector<std::string> completed;     // Messages completed by the last read, reused
+    std::string outgoing;                   // Bytes being written
+    size_t outgoingOffset = 0;              // How much of outgoing is already written
+    int awaitingReplies = 0;                // Messages handed out that weren't answered yet
+    uint64_t nextSequence = 0;              // Sequence of the next received message
+    uint64_t nextReplySequence = 0;         // Sequence of the next reply to write
+    std::map<uint64_t, std::optional<std::string>> heldReplies; // Replies that finished before an earlier one, empty if already written
+    bool peerClosed = false;                // The peer shut down its sending side
+    bool closed = false;
+    CancellationToken disconnected = CancellationToken::create();  // Cancelled once replies can't reach the peer
+    std::chrono::steady_clock::time_point readStartedAt{};     // First byte of the message being read
+    std::chrono::steady_clock::time_point writeStartedAt{};    // When outgoing stopped being empty, zero while idle
+
+#ifdef _WIN32
+    std::string queued;                     // Replies that arrived while a send was pending
+    bool sendInFlight = false;
+    IoOperation receiveOperation{};
+    IoOperation sendOperation{};
+    std::array<char, ReceiveBufferSize> receiveBuffer{};
+#else
+    bool wantWrite = false;                 // Registered for EPOLLOUT
+#endif
+};
+
+EventLoop::ConnectionPtr EventLoop::findConnection(const ConnectionId id) const {
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    auto it = _connections.find(id);
+    return (it == _connections.end()) ? nullptr : it->second;
+}
+
+size_t EventLoop::getOpenConnectionCount() const {
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    return _connections.size();
+}
+
+bool EventLoop::isFinished(const Connection& connection) {
+    bool writesDone = connection.outgoingOffset >= connection.outgoing.size();
+#ifdef _WIN32
+    writesDone = writesDone && connection.queued.empty() && !connection.sendInFlight;
+#endif
+    // A legacy client may wait for its reply without shutting down its side, its request is all it sends.
+    const bool doneSending = connection.peerClosed || connection.decoder.isDone();
+    return doneSending && connection.awaitingReplies == 0 && writesDone;
+}
+
+bool EventLoop::handleReceived(const ConnectionPtr& connection, const char* data, const size_t size) {
+    bool ok;
+    uint64_t firstSequence;
+    const auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (size > 0) {
+            Metrics::shared().increment(Metrics::Counter::BytesReceived, size);
+            if (!connection->decoder.hasPartialMessage()) connection->readStartedAt = now;
+            ok = connection->decoder.feed(data, size, connection->completed);
+        }
+        else {
+            connection->peerClosed = true;
+            ok = connection->decoder.finish(connection->completed);
+            // A legacy request ends with the stream, a framed client doing so gave up on what it asked.
+            if (connection->decoder.getMode() == FrameDecoder::Mode::Framed && connection->awaitingReplies > 0) {
+                LOG_DEBUG(Server, "Connection " << connection->id << " ended its stream with "
+                    << connection->awaitingReplies << " replies owed, cancelling them.");
+                connection->disconnected.cancel(CancellationToken::Reason::Disconnected);
+            }
+        }
+        // Only the first message can have started in an earlier read, the others came whole in this one.
+        for (size_t i = 0; i < connection->completed.size(); ++i) {
+            Metrics::shared().record(Metrics::Stage::SocketRead,
+                i == 0 ? now - connection->readStartedAt : std::chrono::steady_clock::duration::zero());
+        }
+        if (connection->decoder.hasPartialMessage() && !connection->completed.empty()) connection->readStartedAt = now;
+        connection->awaitingReplies += static_cast<int>(connection->completed.size());
+        firstSequence = connection->nextSequence;
+        connection->nextSequence += connection->completed.size();
+    }
+
+    // Outside the lock, the callback may reply right away. Only this thread reads the connection, so
+    // completed isn't touched by anyone else meanwhile.
+    for (size_t i = 0; i < connection->completed.size(); ++i) {
+        _onMessage(MessageId{ connection->id, firstSequence + i }, std::move(connection->completed[i]));
+    }
+    connection->completed.clear();
+
+    if (!ok) {
+        LOG_WARNING(Server, "Dropping connection " << connection->id << ": malformed or oversized message.");
+    }
+    return ok;
+}
+
+void EventLoop::queueReply(Connection& connection, const uint64_t sequence, std::string_view message,
+    const bool inOrder, std::string& out) {
+    connection.awaitingReplies--;
+    const bool legacy = connection.decoder.getMode() == FrameDecoder::Mode::Legacy;
+    auto append = [&](std::string_view reply) {
+        if (legacy) out.append(reply);
+        else MessageFraming::appendFrame(out, reply);
+    };
+
+    if (!inOrder) {
+        // Written right away; only its place in the order is remembered for the replies waiting on it.
+        append(message);
+        if (sequence != connection.nextReplySequence) {
+            connection.heldReplies.emplace(sequence, std::nullopt);
+            return;
+        }
+    }
+    else if (sequence != connection.nextReplySequence) {
+        connection.heldReplies.emplace(sequence, std::string(message));
+        return;
+    }
+    else {
+        append(message);
+    }
+
+    connection.nextReplySequence++;
+    for (auto it = connection.heldReplies.begin();
+        it != connection.heldReplies.end() && it->first == connection.nextReplySequence;
+        it = connection.heldReplies.erase(it)) {
+        if (it->second) append(*it->second);
+        connection.nextReplySequence++;
+    }
+}
+
+void EventLoop::queuePartialReply(Connection& connection, std::string_view message, std::string& out) {
+    // Legacy clients read a single reply up to the end of the stream, there's no way to mark a partial one.
+    if (connection.decoder.getMode() != FrameDecoder::Mode::Framed) return;
+    MessageFraming::appendFrame(out, message);
+}
+
+bool EventLoop::canSendPartial(const MessageId id) const {
+    ConnectionPtr connection = findConnection(id.connection);
+    if (!connection) return false;
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    return !connection->closed && connection->decoder.getMode() == FrameDecoder::Mode::Framed;
+}
+
+CancellationToken EventLoop::getDisconnectToken(const MessageId id) const {
+    ConnectionPtr connection = findConnection(id.connection);
+    if (!connection) {
+        CancellationToken gone = CancellationToken::create();
+        gone.cancel(CancellationToken::Reason::Disconnected);
+        return gone;
+    }
+    // Set at construction and never replaced, the token itself is thread safe.
+    return connection->disconnected;
+}
+
+#ifdef _WIN32
+
+// --- Windows: I/O completion port ---
+
+EventLoop::EventLoop(NativeSocket listenSocket, MessageCallback onMessage)
+    : _listenSocket(listenSocket), _onMessage(std::move(onMessage))
+{
+    _completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+    if (_completionPort == nullptr) {
+        throw std::runtime_error("Failed to create I/O completion port: " + std::to_string(GetLastError()));
+    }
+}
+
+EventLoop::~EventLoop() {
+    stop();
+    for (auto& thread : _ioThreads) {
+        if (thread.joinable()) thread.join();
+    }
+    CloseHandle(_completionPort);
+}
+
+void EventLoop::run() {
+    _running = true;
+    for (size_t i = 0; i < IoThreadCount; ++i) {
+        _ioThreads.emplace_back(&EventLoop::completionLoop, this);
+    }
+
+    acceptLoop();
+
+    // Shutting down: drop every connection, then tell each completion thread to exit.
+    std::vector<ConnectionPtr> open;
+    {
+        std::lock_guard<std::mutex> lock(_connectionsMutex);
+        for (auto& [id, connection] : _connections) open.push_back(connection);
+    }
+    for (auto& connection : open) closeConnection(connection);
+    for (size_t i = 0; i < _ioThreads.size(); ++i) {
+        PostQueuedCompletionStatus(_completionPort, 0, 0, nullptr);
+    }
+    for (auto& thread : _ioThreads) {
+        if (thread.joinable()) thread.join();
+    }
+    _ioThreads.clear();
+}
+
+void EventLoop::stop() {
+    _running = false;
+}
+
+void EventLoop::acceptLoop() {
+    while (_running) {
+        // Wait for a client with a timeout, so stop() is noticed without closing the caller's socket.
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(_listenSocket, &readSet);
+        timeval timeout{ 0, 200 * 1000 };
+        int ready = select(0, &readSet, nullptr, nullptr, &timeout);
+        if (ready == SOCKET_ERROR) {
+            LOG_WARNING(Server, "select on the listening socket failed with error: " << WSAGetLastError());
+            Sleep(10);
+            continue;
+        }
+        if (ready == 0) continue;
+
+        SOCKET clientSocket = accept(_listenSocket, nullptr, nullptr);
+        if (clientSocket == INVALID_SOCKET) {
+            int error = WSAGetLastError();
+            if (error != WSAEWOULDBLOCK) {
+                LOG_WARNING(Server, "Accept failed with error: " << error);
+            }
+            continue;
+        }
+        addConnection(clientSocket);
+    }
+}
+
+void EventLoop::addConnection(NativeSocket socket) {
+    if (CreateIoCompletionPort(reinterpret_cast<HANDLE>(socket), _completionPort, 0, 0) == nullptr) {
+        LOG_ERROR(Server, "Failed to attach connection to the completion port: " << GetLastError());
+        closesocket(socket);
+        return;
+    }
+
+    auto connection = std::make_shared<Connection>();
+    connection->id = _nextConnectionId++;
+    connection->socket = socket;
+    Metrics::shared().increment(Metrics::Counter::ConnectionsAccepted);
+    connection->receiveOperation.kind = IoOperation::Kind::Receive;
+    connection->sendOperation.kind = IoOperation::Kind::Send;
+    {
+        std::lock_guard<std::mutex> lock(_connectionsMutex);
+        _connections.emplace(connection->id, connection);
+    }
+    postReceive(connection);
+}
+
+void EventLoop::closeConnection(const ConnectionPtr& connection) {
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (connection->closed) return;
+        connection->closed = true;
+        // Pending operations complete with an error and release their reference.
+        closesocket(connection->socket);
+        connection->disconnected.cancel(CancellationToken::Reason::Disconnected);
+    }
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    _connections.erase(connection->id);
+}
+
+void EventLoop::postReceive(const ConnectionPtr& connection) {
+    IoOperation& operation = connection->receiveOperation;
+    ZeroMemory(&operation.overlapped, sizeof(operation.overlapped));
+    operation.connection = connection;
+
+    WSABUF buffer;
+    buffer.len = static_cast<ULONG>(connection->receiveBuffer.size());
+    buffer.buf = connection->receiveBuffer.data();
+    DWORD flags = 0;
+    if (WSARecv(connection->socket, &buffer, 1, nullptr, &flags, &operation.overlapped, nullptr) == SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        operation.connection.reset();
+        closeConnection(connection);
+    }
+}
+
+// Starts writing whatever is left in outgoing, or the queued replies. If the send can't be started, the
+// connection is marked finished so the caller closes it once the mutex is released.
+void EventLoop::postSend(const ConnectionPtr& connection) {
+    if (connection->outgoingOffset >= connection->outgoing.size()) {
+        if (connection->queued.empty()) {
+            connection->sendInFlight = false;
+            if (connection->writeStartedAt != std::chrono::steady_clock::time_point{}) {
+                Metrics::shared().record(Metrics::Stage::SocketWrite, std::chrono::steady_clock::now() - connection->writeStartedAt);
+                connection->writeStartedAt = {};
+            }
+            return;
+        }
+        if (connection->writeStartedAt == std::chrono::steady_clock::time_point{}) {
+            connection->writeStartedAt = std::chrono::steady_clock::now();
+        }
+        std::swap(connection->outgoing, connection->queued);
+        connection->queued.clear();
+        connection->outgoingOffset = 0;
+    }
+
+    IoOperation& operation = connection->sendOperation;
+    ZeroMemory(&operation.overlapped, sizeof(operation.overlapped));
+    operation.connection = connection;
+
+    WSABUF buffer;
+    buffer.len = static_cast<ULONG>(connection->outgoing.size() - connection->outgoingOffset);
+    buffer.buf = connection->outgoing.data() + connection->outgoingOffset;
+    connection->sendInFlight = true;
+    if (WSASend(connection->socket, &buffer, 1, nullptr, 0, &operation.overlapped, nullptr) == SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        operation.connection.reset();
+        connection->sendInFlight = false;
+        connection->outgoing.clear();
+        connection->outgoingOffset = 0;
+        connection->queued.clear();
+        connection->awaitingReplies = 0;
+        connection->peerClosed = true;
+    }
+}
+
+void EventLoop::completionLoop() {
+    while (true) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = nullptr;
+        BOOL ok = GetQueuedCompletionStatus(_completionPort, &bytes, &key, &overlapped, INFINITE);
+        if (overlapped == nullptr) {
+            return; // Stop signal from run(), or the port was closed
+        }
+
+        IoOperation* operation = reinterpret_cast<IoOperation*>(overlapped);
+        ConnectionPtr connection = std::move(operation->connection);
+        if (!connection) continue;
+        if (!ok) {
+            closeConnection(connection);
+            continue;
+        }
+
+        if (operation->kind == IoOperation::Kind::Receive) {
+            // A successful zero-byte receive means the peer shut down its sending side.
+            if (!handleReceived(connection, connection->receiveBuffer.data(), bytes)) {
+                closeConnection(connection);
+                continue;
+            }
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                finished = isFinished(*connection);
+            }
+            if (finished) {
+                closeConnection(connection);
+            }
+            else if (bytes > 0) {
+                postReceive(connection);
+            }
+        }
+        else {
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                Metrics::shared().increment(Metrics::Counter::BytesSent, bytes);
+                connection->outgoingOffset += bytes;
+                connection->sendInFlight = false;
+                postSend(connection);
+                finished = isFinished(*connection);
+            }
+            if (finished) {
+                closeConnection(connection);
+            }
+        }
+    }
+}
+
+void EventLoop::send(const MessageId id, std::string_view message, const bool inOrder) {
+    ConnectionPtr connection = findConnection(id.connection);
+    if (!connection) return;
+
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (connection->closed) return;
+        queueReply(*connection, id.sequence, message, inOrder, connection->queued);
+        if (!connection->sendInFlight) {
+            postSend(connection);
+        }
+        finished = isFinished(*connection);
+    }
+    if (finished) {
+        closeConnection(connection);
+    }
+}
+
+void EventLoop::sendPartial(const MessageId id, std::string_view message) {
+    ConnectionPtr connection = findConnection(id.connection);
+    if (!connection) return;
+
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    if (connection->closed) return;
+    queuePartialReply(*connection, message, connection->queued);
+    if (!connection->sendInFlight) {
+        postSend(connection);
+    }
+}
+
+#else
+
+// --- Linux: epoll ---
+
+namespace {
+    // epoll keys that aren't connection ids (those start at 1 and never reach these).
+    constexpr uint64_t ListenerKey = 0;
+    constexpr uint64_t WakeKey = UINT64_MAX;
+    constexpr int MaxEventsPerWait = 64;
+}
+
+EventLoop::EventLoop(NativeSocket listenSocket, MessageCallback onMessage)
+    : _readBuffer(ReceiveBufferSize), _listenSocket(listenSocket), _onMessage(std::move(onMessage))
+{
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_epollFd < 0 || _wakeFd < 0) {
+        throw std::runtime_error("Failed to create epoll instance: " + std::to_string(errno));
+    }
+
+    epoll_event wakeEvent{};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.u64 = WakeKey;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeFd, &wakeEvent);
+}
+
+EventLoop::~EventLoop() {
+    stop();
+    if (_epollFd >= 0) close(_epollFd);
+    if (_wakeFd >= 0) close(_wakeFd);
+}
+
+void EventLoop::run() {
+    fcntl(_listenSocket, F_SETFL, fcntl(_listenSocket, F_GETFL, 0) | O_NONBLOCK);
+    epoll_event listenEvent{};
+    listenEvent.events = EPOLLIN;
+    listenEvent.data.u64 = ListenerKey;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenSocket, &listenEvent);
+
+    _running = true;
+    epoll_event events[MaxEventsPerWait];
+    while (_running) {
+        int count = epoll_wait(_epollFd, events, MaxEventsPerWait, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR(Server, "epoll_wait failed with error: " << errno);
+            break;
+        }
+
+        for (int i = 0; i < count && _running; ++i) {
+            const uint64_t key = events[i].data.u64;
+            if (key == ListenerKey) {
+                while (true) {
+                    int clientSocket = accept4(_listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (clientSocket < 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                            LOG_WARNING(Server, "Accept failed with error: " << errno);
+                        }
+                        break;
+                    }
+                    addConnection(clientSocket);
+                }
+                continue;
+            }
+            if (key == WakeKey) {
+                uint64_t signalled;
+                while (read(_wakeFd, &signalled, sizeof(signalled)) > 0) {}
+                drainOutbox();
+                continue;
+            }
+
+            ConnectionPtr connection = findConnection(key);
+            if (!connection) continue;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                handleReadable(connection);
+            }
+            if (events[i].events & EPOLLOUT) {
+                bool ok, finished;
+                {
+                    std::lock_guard<std::mutex> lock(connection->mutex);
+                    if (connection->closed) continue;
+                    flushWrites(connection);
+                    ok = !connection->closed;
+                    finished = isFinished(*connection);
+                }
+                if (!ok || finished) closeConnection(connection);
+            }
+        }
+    }
+
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, _listenSocket, nullptr);
+    std::vector<ConnectionPtr> open;
+    {
+        std::lock_guard<std::mutex> lock(_connectionsMutex);
+        for (auto& [id, connection] : _connections) open.push_back(connection);
+    }
+    for (auto& connection : open) closeConnection(connection);
+}
+
+void EventLoop::stop() {
+    _running = false;
+    if (_wakeFd >= 0) {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(_wakeFd, &one, sizeof(one));
+    }
+}
+
+void EventLoop::addConnection(NativeSocket socket) {
+    auto connection = std::make_shared<Connection>();
+    connection->id = _nextConnectionId++;
+    connection->socket = socket;
+    Metrics::shared().increment(Metrics::Counter::ConnectionsAccepted);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = connection->id;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, socket, &event) < 0) {
+        LOG_WARNING(Server, "Failed to watch connection: " << errno);
+        close(socket);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    _connections.emplace(connection->id, connection);
+}
+
+void EventLoop::closeConnection(const ConnectionPtr& connection) {
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (connection->socket >= 0) {
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, connection->socket, nullptr);
+            close(connection->socket);
+            connection->socket = -1;
+        }
+        connection->closed = true;
+        connection->disconnected.cancel(CancellationToken::Reason::Disconnected);
+    }
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    _connections.erase(connection->id);
+}
+
+void EventLoop::handleReadable(const ConnectionPtr& connection) {
+    // Level-triggered, so stopping early is fine, but reading until EAGAIN saves wakeups.
+    while (true) {
+        ssize_t received = recv(connection->socket, _readBuffer.data(), _readBuffer.size(), 0);
+        if (received > 0) {
+            if (!handleReceived(connection, _readBuffer.data(), static_cast<size_t>(received))) {
+                closeConnection(connection);
+                return;
+            }
+            continue;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+        // End of stream (or a reset): no more reads, but replies still owed are written.
+        if (received < 0 || !handleReceived(connection, nullptr, 0)) {
+            closeConnection(connection);
+            return;
+        }
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            finished = isFinished(*connection);
+            if (!finished) updateInterest(*connection);
+        }
+        if (finished) closeConnection(connection);
+        return;
+    }
+}
+
+void EventLoop::flushWrites(const ConnectionPtr& connection) {
+    std::string& outgoing = connection->outgoing;
+    if (connection->outgoingOffset < outgoing.size() && connection->writeStartedAt == std::chrono::steady_clock::time_point{}) {
+        connection->writeStartedAt = std::chrono::steady_clock::now();
+    }
+    while (connection->outgoingOffset < outgoing.size()) {
+        ssize_t sent = ::send(connection->socket, outgoing.data() + connection->outgoingOffset,
+            outgoing.size() - connection->outgoingOffset, MSG_NOSIGNAL);
+        if (sent > 0) {
+            Metrics::shared().increment(Metrics::Counter::BytesSent, static_cast<uint64_t>(sent));
+            connection->outgoingOffset += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // Write error: nothing more can be delivered on this connection.
+        outgoing.clear();
+        connection->outgoingOffset = 0;
+        connection->closed = true;
+        return;
+    }
+
+    if (connection->outgoingOffset >= outgoing.size()) {
+        outgoing.clear(); // Keeps the capacity for the next reply
+        connection->outgoingOffset = 0;
+        if (connection->writeStartedAt != std::chrono::steady_clock::time_point{}) {
+            Metrics::shared().record(Metrics::Stage::SocketWrite, std::chrono::steady_clock::now() - connection->writeStartedAt);
+            connection->writeStartedAt = {};
+        }
+    }
+    const bool wantWrite = !outgoing.empty();
+    if (wantWrite != connection->wantWrite) {
+        connection->wantWrite = wantWrite;
+        updateInterest(*connection);
+    }
+}
+
+void EventLoop::updateInterest(const Connection& connection) {
+    epoll_event event{};
+    if (!connection.peerClosed) event.events |= EPOLLIN;
+    if (connection.wantWrite) event.events |= EPOLLOUT;
+    event.data.u64 = connection.id;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection.socket, &event);
+}
+
+void EventLoop::send(const MessageId id, std::string_view message, const bool inOrder) {
+    {
+        std::lock_guard<std::mutex> lock(_outboxMutex);
+        _outbox.push_back({ id, std::string(message), inOrder });
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = write(_wakeFd, &one, sizeof(one));
+}
+
+void EventLoop::sendPartial(const MessageId id, std::string_view message) {
+    {
+        std::lock_guard<std::mutex> lock(_outboxMutex);
+        _outbox.push_back({ id, std::string(message), false, true });
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = write(_wakeFd, &one, sizeof(one));
+}
+
+void EventLoop::drainOutbox() {
+    {
+        std::lock_guard<std::mutex> lock(_outboxMutex);
+        std::swap(_outbox, _outboxInProgress);
+    }
+
+    for (auto& reply : _outboxInProgress) {
+        ConnectionPtr connection = findConnection(reply.id.connection);
+        if (!connection) continue;
+
+        bool ok, finished;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->closed) continue;
+            if (reply.partial) queuePartialReply(*connection, reply.message, connection->outgoing);
+            else queueReply(*connection, reply.id.sequence, reply.message, reply.inOrder, connection->outgoing);
+            flushWrites(connection);
+            ok = !connection->closed;
+            finished = isFinished(*connection);
+        }
+        if (!ok || finished) closeConnection(connection);
+    }
+    _outboxInProgress.clear();
+}
+
+#endif
@@ -0,0 +1,142 @@
+#pragma once
+#include "MessageFraming.h"
+#include "CancellationToken.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#endif
+
+/*
+* Asynchronous connection layer under Server: accepts clients on a listening socket, reads framed
+* messages (see MessageFraming.h) and writes replies, without a thread per connection.
+* Windows uses an I/O completion port serviced by a few threads; Linux uses a single epoll thread with
+* non-blocking sockets. Partial reads and writes are handled, and every connection reuses its buffers.
+*/
+class EventLoop {
+public:
+#ifdef _WIN32
+    using NativeSocket = SOCKET;
+#else
+    using NativeSocket = int;
+#endif
+    using ConnectionId = uint64_t;
+
+    // Identifies one received message; its reply is sent with the same id.
+    struct MessageId {
+        ConnectionId connection = 0;
+        uint64_t sequence = 0;      // Position of the message on its connection
+    };
+
+    // Called for every complete message, on an I/O thread. Must be quick: queue the work and reply later through send().
+    using MessageCallback = std::function<void(MessageId id, std::string message)>;
+
+    // Number of completion threads on Windows. Linux always uses one epoll thread.
+    static constexpr size_t IoThreadCount = 2;
+
+    // listenSocket must already be bound and listening; the caller keeps owning it.
+    EventLoop(NativeSocket listenSocket, MessageCallback onMessage);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Serves connections on the calling thread until stop() is called.
+    void run();
+
+    // Makes run() return and closes every connection. Safe to call from any thread.
+    void stop();
+
+    // Queues the reply to one message. Safe to call from any thread; replies to connections that are gone are
+    // dropped. Each message must get exactly one reply. In-order replies are written in the order their
+    // messages arrived; the others (tagged with a request id the client matches on) are written as soon as
+    // they're ready. Legacy (unframed) connections are closed once their reply is written.
+    void send(const MessageId id, std::string_view message, const bool inOrder = true);
+
+    // Writes an extra frame for a message ahead of its reply, e.g. one result of a batch, as soon as possible.
+    // Doesn't count as the message's reply. Only framed connections can take these, see canSendPartial.
+    void sendPartial(const MessageId id, std::string_view message);
+
+    // True if the message's connection is still open and framed, so partial replies can be told apart.
+    bool canSendPartial(const MessageId id) const;
+
+    // Fires (Disconnected) when the message's connection closes, or when a framed client ends its stream while
+    // replies are still owed: framed clients keep sending open until they're done reading. Already cancelled if
+    // the connection is gone.
+    CancellationToken getDisconnectToken(const MessageId id) const;
+
+    // Number of connections currently open.
+    size_t getOpenConnectionCount() const;
+
+private:
+    struct Connection;
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    ConnectionPtr findConnection(const ConnectionId id) const;
+    void addConnection(NativeSocket socket);
+    void closeConnection(const ConnectionPtr& connection);
+
+    // Feeds received bytes (or the end of the stream, when size is 0) to the connection's decoder and
+    // hands out the completed messages. Returns false if the connection should be closed.
+    bool handleReceived(const ConnectionPtr& connection, const char* data, const size_t size);
+
+    // Adds the reply to the connection's output, along with any later replies it was holding back.
+    // Needs the connection's mutex.
+    static void queueReply(Connection& connection, const uint64_t sequence, std::string_view message,
+        const bool inOrder, std::string& out);
+
+    // Adds a partial reply to the connection's output. Needs the connection's mutex.
+    static void queuePartialReply(Connection& connection, std::string_view message, std::string& out);
+
+    // True when nothing more can happen on the connection: the peer is done sending and every reply was written.
+    static bool isFinished(const Connection& connection);
+
+#ifdef _WIN32
+    struct IoOperation;
+
+    void acceptLoop();
+    void completionLoop();
+    void postReceive(const ConnectionPtr& connection);
+    void postSend(const ConnectionPtr& connection);     // Needs the connection's mutex
+
+    HANDLE _completionPort = nullptr;
+    std::vector<std::thread> _ioThreads;
+#else
+    void handleReadable(const ConnectionPtr& connection);
+    void flushWrites(const ConnectionPtr& connection);  // Needs the connection's mutex
+    void updateInterest(const Connection& connection);
+    void drainOutbox();
+
+    int _epollFd = -1;
+    int _wakeFd = -1;                           // eventfd, signalled by send() and stop()
+
+    // Replies queued by other threads, moved to their connections on the loop thread.
+    struct OutgoingReply {
+        MessageId id;
+        std::string message;
+        bool inOrder;
+        bool partial = false;
+    };
+    std::mutex _outboxMutex;
+    std::vector<OutgoingReply> _outbox;
+    std::vector<OutgoingReply> _outboxInProgress;
+    std::vector<char> _readBuffer;              // Shared by all connections, they're read on one thread
+#endif
+
+    NativeSocket _listenSocket;
+    MessageCallback _onMessage;
+    std::atomic<bool> _running = false;
+    std::atomic<ConnectionId> _nextConnectionId = 1;
+
+    mutable std::mutex _connectionsMutex;
+    std::unordered_map<ConnectionId, ConnectionPtr> _connections;
+};
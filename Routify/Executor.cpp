@@ -0,0 +1,193 @@
+#include "Executor.h"
+#include "Logger.h"
+#include <algorithm>
+#include <atomic>
+
+thread_local Executor* Executor::_currentExecutor = nullptr;
+thread_local size_t Executor::_currentWorker = 0;
+
+Executor::Executor(size_t workerCount) {
+    if (workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    _concurrencyLimit = workerCount;
+
+    _workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        _workers[i]->thread = std::thread(&Executor::workerLoop, this, i);
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeUp.notify_all();
+    for (auto& worker : _workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+Executor& Executor::shared() {
+    static Executor executor;
+    return executor;
+}
+
+uint64_t Executor::newGroup() {
+    static std::atomic<uint64_t> nextGroup = 1;
+    return nextGroup++;
+}
+
+void Executor::setConcurrencyLimit(size_t limit) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _concurrencyLimit = (limit == 0 || limit > _workers.size()) ? _workers.size() : limit;
+    }
+    _wakeUp.notify_all();
+}
+
+size_t Executor::getConcurrencyLimit() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _concurrencyLimit;
+}
+
+size_t Executor::getWorkerCount() const {
+    return _workers.size();
+}
+
+size_t Executor::getQueuedTaskCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _queued;
+}
+
+void Executor::FairQueue::push(Task task, const uint64_t group) {
+    auto& tasks = groups[group];
+    if (tasks.empty()) {
+        groupOrder.push_back(group);
+    }
+    tasks.push_back(std::move(task));
+}
+
+bool Executor::FairQueue::pop(Task& task) {
+    if (groupOrder.empty()) return false;
+
+    // Serve the group at the front, then send it to the back of the line if it has more tasks.
+    const uint64_t group = groupOrder.front();
+    groupOrder.pop_front();
+    auto it = groups.find(group);
+    task = std::move(it->second.front());
+    it->second.pop_front();
+    if (it->second.empty()) {
+        groups.erase(it);
+    }
+    else {
+        groupOrder.push_back(group);
+    }
+    return true;
+}
+
+void Executor::enqueue(Task task, const Priority priority, const uint64_t group) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_currentExecutor == this) {
+            // Spawned by a running task: keep it local, it is likely to need the same data.
+            _workers[_currentWorker]->tasks.push_back(std::move(task));
+        }
+        else {
+            _queues[static_cast<int>(priority)].push(std::move(task), group);
+        }
+        _queued++;
+    }
+    _wakeUp.notify_one();
+}
+
+bool Executor::takeTask(const size_t workerIndex, Task& task) {
+    auto& ownTasks = _workers[workerIndex]->tasks;
+    bool found = false;
+    if (!ownTasks.empty()) {
+        task = std::move(ownTasks.back());
+        ownTasks.pop_back();
+        found = true;
+    }
+    for (auto& queue : _queues) {
+        if (found) break;
+        found = queue.pop(task);
+    }
+    if (!found) {
+        found = stealTask(workerIndex, task);
+    }
+    if (found) {
+        _queued--;
+    }
+    return found;
+}
+
+bool Executor::stealTask(const size_t workerIndex, Task& task) {
+    for (size_t offset = 1; offset < _workers.size(); ++offset) {
+        auto& victimTasks = _workers[(workerIndex + offset) % _workers.size()]->tasks;
+        if (!victimTasks.empty()) {
+            task = std::move(victimTasks.front());
+            victimTasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Executor::workerLoop(const size_t workerIndex) {
+    _currentExecutor = this;
+    _currentWorker = workerIndex;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _wakeUp.wait(lock, [this]() {
+            return (_queued > 0 && _running < _concurrencyLimit) || (_stopping && _queued == 0);
+        });
+        if (_queued == 0) {
+            return; // Stopping and drained
+        }
+
+        Task task;
+        if (!takeTask(workerIndex, task)) continue;
+
+        _running++;
+        lock.unlock();
+        runTask(task);
+        lock.lock();
+        _running--;
+
+        // A slot is free again, let a worker held back by the limit start. When stopping, idle workers
+        // have to see the drained queue too.
+        if (_stopping) _wakeUp.notify_all();
+        else _wakeUp.notify_one();
+    }
+}
+
+bool Executor::runOneTask(const size_t workerIndex) {
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!takeTask(workerIndex, task)) return false;
+    }
+    runTask(task);
+    return true;
+}
+
+void Executor::runTask(Task& task) {
+    // Submitted tasks report their exceptions through their futures, this only guards the pool itself.
+    try {
+        task();
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR(Executor, "Task threw: " << e.what());
+    }
+    catch (...) {
+        LOG_ERROR(Executor, "Task threw an unknown exception.");
+    }
+}
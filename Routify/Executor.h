@@ -0,0 +1,125 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/*
+* Process-wide work-stealing thread pool for CPU-bound request work (GA tasks).
+* Tasks submitted from outside the pool go to a shared queue per priority. Within a priority, every
+* group (normally one request) takes turns, so a request with many tasks can't starve the others.
+* Tasks submitted from a worker go to that worker's own deque and idle workers steal from it.
+* At most getConcurrencyLimit() tasks run at the same time.
+* Tasks are coarse (a whole GA population each), so a single lock guards all the queues.
+*/
+class Executor {
+public:
+    enum class Priority { High, Normal, Low };
+
+    // Creates workerCount workers, 0 means one per hardware thread.
+    explicit Executor(size_t workerCount = 0);
+
+    // Runs the tasks still queued, then joins the workers.
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // The executor shared by the whole process, sized to the hardware.
+    static Executor& shared();
+
+    // Returns a new id for grouping the tasks of one request.
+    static uint64_t newGroup();
+
+    // Queues a task and returns a future for its result. Exceptions are delivered through the future.
+    template <typename F>
+    auto submit(F&& task, const Priority priority = Priority::Normal, const uint64_t group = 0)
+        -> std::future<std::invoke_result_t<std::decay_t<F>>>;
+
+    // Waits for a future. On a worker thread it runs other tasks meanwhile, so waiting can't deadlock the pool.
+    template <typename T>
+    T wait(std::future<T>& future);
+
+    // Caps how many tasks run at once. Values above the worker count (or 0) mean no cap besides the workers.
+    void setConcurrencyLimit(size_t limit);
+    size_t getConcurrencyLimit() const;
+
+    size_t getWorkerCount() const;
+
+    // Number of tasks waiting to run.
+    size_t getQueuedTaskCount() const;
+
+private:
+    using Task = std::function<void()>;
+
+    // Tasks of one priority, grouped so groups can be served round-robin.
+    struct FairQueue {
+        std::deque<uint64_t> groupOrder;                        // Groups with queued tasks, next to serve first
+        std::unordered_map<uint64_t, std::deque<Task>> groups;
+
+        void push(Task task, const uint64_t group);
+        bool pop(Task& task);
+    };
+
+    struct Worker {
+        std::thread thread;
+        std::deque<Task> tasks;     // Owner pops from the back, thieves from the front
+    };
+
+    void enqueue(Task task, const Priority priority, const uint64_t group);
+    void workerLoop(const size_t workerIndex);
+
+    // Takes the next task for a worker: its own deque, then the shared queues, then other workers. Needs _mutex.
+    bool takeTask(const size_t workerIndex, Task& task);
+    bool stealTask(const size_t workerIndex, Task& task);
+
+    // Runs one queued task on the calling worker while it waits. The waiting task already holds a slot,
+    // so this ignores the concurrency limit. Returns false if nothing ran.
+    bool runOneTask(const size_t workerIndex);
+    void runTask(Task& task);
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    FairQueue _queues[3];                       // Indexed by Priority
+    mutable std::mutex _mutex;                  // Guards the queues, the worker deques and the counters below
+    std::condition_variable _wakeUp;
+    size_t _queued = 0;
+    size_t _running = 0;
+    size_t _concurrencyLimit = 0;
+    bool _stopping = false;
+
+    // Set on worker threads, so tasks can find their pool.
+    static thread_local Executor* _currentExecutor;
+    static thread_local size_t _currentWorker;
+};
+
+template <typename F>
+auto Executor::submit(F&& task, const Priority priority, const uint64_t group)
+    -> std::future<std::invoke_result_t<std::decay_t<F>>>
+{
+    using Result = std::invoke_result_t<std::decay_t<F>>;
+    // std::function needs a copyable target, so the packaged task is shared.
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> future = packaged->get_future();
+    enqueue([packaged]() { (*packaged)(); }, priority, group);
+    return future;
+}
+
+template <typename T>
+T Executor::wait(std::future<T>& future) {
+    if (_currentExecutor == this) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!runOneTask(_currentWorker)) {
+                future.wait_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+    return future.get();
+}
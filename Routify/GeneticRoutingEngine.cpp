@@ -0,0 +1,238 @@
+#include "GeneticRoutingEngine.h"
+#include "Population.h"
+#include "IslandModel.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <future>
+
+uint64_t GeneticRoutingEngine::EliteArchive::pairKey(const int startId, const int endId) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(startId)) << 32) | static_cast<uint32_t>(endId);
+}
+
+std::vector<Route> GeneticRoutingEngine::EliteArchive::get(const int startId, const int endId, const Graph& graph) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(pairKey(startId, endId));
+    if (it == _entries.end() || it->second.graph != &graph) return {};
+    return it->second.routes;
+}
+
+void GeneticRoutingEngine::EliteArchive::put(const int startId, const int endId, const Graph& graph, std::vector<Route> routes) {
+    const uint64_t key = pairKey(startId, endId);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto [it, inserted] = _entries.try_emplace(key);
+    it->second.graph = &graph;
+    it->second.routes = std::move(routes);
+    if (!inserted) return;
+
+    _insertionOrder.push_back(key);
+    while (_entries.size() > MaxElitePairs) {
+        _entries.erase(_insertionOrder.front());
+        _insertionOrder.pop_front();
+    }
+}
+
+void GeneticRoutingEngine::EliteArchive::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _insertionOrder.clear();
+}
+
+void GeneticRoutingEngine::clearEliteRoutes() {
+    _eliteArchive.clear();
+}
+
+GeneticRoutingEngine::GaTaskResult GeneticRoutingEngine::runSingleGaTask(
+    const int startId,
+    const int endId,
+    const Params& gaParams,
+    const Graph& graph,
+    const bool parallelEvolution) const
+{
+    Metrics::Timer timer(Metrics::Stage::GaTask);
+    GaTaskResult result;
+    result.startStationId = startId;
+    result.endStationId = endId;
+
+    // Nobody wants a route once the client is gone or a sibling task met the target, so a task still queued by
+    // then doesn't start. Past the deadline it still seeds, the seeds are the best answer there is.
+    const CancellationToken::Reason cancelled = gaParams.cancellation.getReason();
+    if (cancelled == CancellationToken::Reason::Disconnected || cancelled == CancellationToken::Reason::TargetReached) {
+        LOG_DEBUG(Genetic, "Skipping GA task for pair (" << startId << " -> " << endId << "): " << CancellationToken::toString(cancelled));
+        result.outcome.stopReason = toStopReason(cancelled);
+        return result;
+    }
+
+    try {
+        Population::StopCriteria criteria;
+        criteria.stallGenerations = gaParams.stallGenerations;
+        criteria.improvementEpsilon = gaParams.improvementEpsilon;
+        criteria.deadline = gaParams.deadline;
+        criteria.cancellation = gaParams.cancellation;
+        criteria.targetMinutes = gaParams.targetMinutes;
+
+        // Seeded runs are reproducible, so they don't start from whatever earlier requests left in the archive.
+        std::optional<uint64_t> seed;
+        std::vector<Route> seedRoutes;
+        if (gaParams.seed) {
+            seed = Population::deriveSeed(*gaParams.seed, static_cast<uint32_t>(startId));
+        }
+        else {
+            seedRoutes = _eliteArchive.get(startId, endId, graph);
+        }
+
+        // Fittest first
+        std::vector<Route> elites;
+        if (gaParams.islands > 1) {
+            IslandModel::Settings settings;
+            settings.islandCount = gaParams.islands;
+            settings.migrationInterval = gaParams.migrationInterval;
+            settings.migrantCount = gaParams.migrants;
+            IslandModel islands(settings, gaParams.populationSize, startId, endId, graph,
+                gaParams.startCoords, gaParams.endCoords, gaParams.departureTime, seedRoutes, seed, gaParams.cancellation);
+            result.outcome = islands.evolve(gaParams.generations, gaParams.mutationRate, criteria, gaParams.priority);
+            elites = islands.getBestSolutions(EliteRoutesPerPair);
+        }
+        else {
+            Population pop(gaParams.populationSize, startId, endId, graph,
+                gaParams.startCoords, gaParams.endCoords, gaParams.departureTime, std::move(seedRoutes), seed, gaParams.cancellation);
+            pop.setParallel(parallelEvolution, gaParams.priority);
+            result.outcome = pop.evolve(gaParams.generations, gaParams.mutationRate, criteria);
+            elites = pop.getBestSolutions(EliteRoutesPerPair);
+        }
+        if (elites.empty()) {
+            throw std::runtime_error("Error: Attempted to get best solution from an empty or extinct population.");
+        }
+        _eliteArchive.put(startId, endId, graph, elites);
+
+        const Route& pairBestRoute = elites.front();
+
+        double fitness = pairBestRoute.getFitness(startId, endId, graph,
+            gaParams.startCoords, gaParams.endCoords, gaParams.departureTime);
+
+        // Check validity and fitness
+        if (pairBestRoute.isValid(startId, endId, graph) && fitness > 0.0 && !std::isnan(fitness)) {
+            result.route = pairBestRoute;   // Copy the valid route
+            result.fitness = fitness;
+            result.success = true;
+            LOG_DEBUG(Genetic, "[Thread " << std::this_thread::get_id() << "] Pair (" << startId << " -> " << endId << ") succeeded. Fitness: " << fitness);
+        }
+        else {
+            LOG_WARNING(Genetic, "[Thread " << std::this_thread::get_id() << "] GA produced invalid/zero fitness route for pair (" << startId << " -> " << endId << ") Fitness: " << fitness);
+            result.success = false;
+        }
+    }
+    catch (const std::runtime_error& ga_error) {
+        LOG_DEBUG(Genetic, "[Thread " << std::this_thread::get_id() << "] GA Runtime Error pair (" << startId << " -> " << endId << "): " << ga_error.what());
+        result.success = false;
+    }
+    catch (const std::exception& e) {
+        LOG_WARNING(Genetic, "[Thread " << std::this_thread::get_id() << "] GA Exception pair (" << startId << " -> " << endId << "): " << e.what());
+        result.success = false;
+    }
+    catch (...) {
+        LOG_WARNING(Genetic, "[Thread " << std::this_thread::get_id() << "] Unknown GA Error pair (" << startId << " -> " << endId << ")");
+        result.success = false;
+    }
+
+    return result;
+}
+
+// Iterate through pairs and find the best route
+std::optional<RoutingEngine::Result> GeneticRoutingEngine::findBestRoute(
+    const std::vector<Graph::Station>& selectedStartStations,
+    const Graph::Station& endStationPair,
+    const Params& gaParams,
+    const Graph& graph) const
+{
+    Result overallBest;
+    overallBest.fitness = -1.0;
+    int endCode = endStationPair.code;
+
+    std::vector<std::future<GaTaskResult>> futures;
+
+    // All tasks of this request share a group, so the executor interleaves them fairly with other requests.
+    Executor& executor = Executor::shared();
+    const uint64_t requestGroup = Executor::newGroup();
+
+    // The tasks share a token of their own, so the first one to meet the target stops the rest of this search
+    // without cancelling the request's other searches. It also fires on the request's token and at the deadline.
+    Params searchParams = gaParams;
+    searchParams.cancellation = CancellationToken::create(gaParams.cancellation, gaParams.deadline);
+
+    LOG_DEBUG(Genetic, "Queueing GA tasks on the executor for " << selectedStartStations.size() << " start stations...");
+
+    const size_t pairCount = static_cast<size_t>(std::count_if(selectedStartStations.begin(), selectedStartStations.end(),
+        [endCode](const Graph::Station& station) { return station.code != endCode; }));
+    const bool parallelEvolution = gaParams.islands <= 1 && gaParams.populationSize >= ParallelEvolutionMinPopulation &&
+        pairCount < executor.getWorkerCount();
+    if (parallelEvolution) {
+        LOG_DEBUG(Genetic, "Breeding in parallel: " << pairCount << " pairs on " << executor.getWorkerCount() << " workers.");
+    }
+
+    // --- Launch Phase ---
+    for (const auto& startPair : selectedStartStations) {
+        int startCode = startPair.code;
+        if (startCode == endCode) {
+            LOG_DEBUG(Genetic, "Skipping GA task for start=end station: " << startCode);
+            continue;
+        }
+
+        futures.push_back(executor.submit(
+            [this, startCode, endCode, &searchParams, &graph, parallelEvolution]() {
+                return runSingleGaTask(startCode, endCode, searchParams, graph, parallelEvolution);
+            },
+            gaParams.priority, requestGroup));
+        LOG_DEBUG(Genetic, "Queued GA task for pair (" << startCode << " -> " << endCode << ")");
+    }
+
+    if (futures.empty()) {
+        LOG_DEBUG(Genetic, "No GA tasks were queued.");
+        return std::nullopt; // No tasks to run
+    }
+
+    LOG_DEBUG(Genetic, "Waiting for " << futures.size() << " GA tasks to complete...");
+
+    // --- Collect Results Phase ---
+    for (size_t i = 0; i < futures.size(); ++i) {
+        try {
+            GaTaskResult currentResult = executor.wait(futures[i]);
+
+            LOG_DEBUG(Genetic, "Task completed for start station " << currentResult.startStationId << ". Success: " << currentResult.success << ", Fitness: " << currentResult.fitness);
+
+            // Check if this result is valid and better than the current overall best
+            if (currentResult.success && currentResult.fitness > overallBest.fitness) {
+                overallBest.fitness = currentResult.fitness;
+                overallBest.route = std::move(currentResult.route); 
+                overallBest.startStationCode = currentResult.startStationId; 
+                overallBest.endStationId = currentResult.endStationId;     
+                overallBest.stopReason = currentResult.outcome.stopReason;
+                overallBest.generations = currentResult.outcome.generationsRun;
+                LOG_DEBUG(Genetic, "*** New overall best route found! Start: " << overallBest.startStationCode << ", Fitness: " << overallBest.fitness << " ***");
+            }
+            else if (!currentResult.success) {
+                LOG_DEBUG(Genetic, "Task for start station " << currentResult.startStationId << " failed or produced invalid result.");
+            }
+
+        }
+        catch (const std::exception& e) {
+            LOG_WARNING(Genetic, "Exception caught while getting result from future #" << i << ": " << e.what());
+        }
+        catch (...) {
+            LOG_WARNING(Genetic, "Unknown exception caught while getting result from future #" << i << ".");
+        }
+    } // End of collecting results
+
+    LOG_INFO(Genetic, "Finished collecting results. Overall best fitness found: " << overallBest.fitness);
+
+    // Check if a valid route was actually found (fitness > 0 and startId assigned)
+    if (overallBest.fitness > 0.0 && overallBest.startStationCode != -1) {
+        return overallBest; // Return the best result found across all threads
+    }
+    else {
+        LOG_INFO(Genetic, "No valid route found across all successful GA tasks.");
+        return std::nullopt; // No valid route found
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "RoutingEngine.h"
+#include "Population.h"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+/*
+* Runs one genetic algorithm population per start station, in parallel on the shared executor, and keeps the fittest route.
+* The best routes of every run are kept per (start, end) station pair and seed the next population for that pair,
+* so corridors that were solved before start close to their previous answer.
+*/
+class GeneticRoutingEngine : public RoutingEngine {
+public:
+    static constexpr size_t EliteRoutesPerPair = 5;
+    static constexpr size_t MaxElitePairs = 4096;   // Oldest pairs are forgotten first
+
+    // A single population at least this large breeds and scores in parallel when there are fewer start
+    // stations than executor workers, so the idle workers help each generation instead.
+    static constexpr int ParallelEvolutionMinPopulation = 200;
+
+    std::optional<Result> findBestRoute(
+        const std::vector<Graph::Station>& startStations,
+        const Graph::Station& endStation,
+        const Params& params,
+        const Graph& graph) const override;
+
+    // Forgets every stored elite route. Call it when the graph is replaced.
+    void clearEliteRoutes();
+
+private:
+    struct GaTaskResult {
+        Route route;
+        double fitness = -1.0;
+        bool success = false;       // Indicate if GA completed successfully and produced a valid route
+        int startStationId = -1;    // Store which start station this result is for
+        int endStationId = -1;
+        Population::EvolveOutcome outcome;
+    };
+
+    // Elite routes of earlier runs, by station pair. Thread safe.
+    class EliteArchive {
+    public:
+        std::vector<Route> get(const int startId, const int endId, const Graph& graph) const;
+        void put(const int startId, const int endId, const Graph& graph, std::vector<Route> routes);
+        void clear();
+
+    private:
+        struct Entry {
+            const Graph* graph;     // Routes are only handed out for the graph they were found on
+            std::vector<Route> routes;
+        };
+
+        static uint64_t pairKey(const int startId, const int endId);
+
+        mutable std::mutex _mutex;
+        std::unordered_map<uint64_t, Entry> _entries;
+        std::deque<uint64_t> _insertionOrder;   // Oldest pair first
+    };
+
+    GaTaskResult runSingleGaTask(const int startId, const int endId, const Params& gaParams, const Graph& graph,
+        const bool parallelEvolution) const;
+
+    mutable EliteArchive _eliteArchive;
+};
@@ -1,331 +1,949 @@
 #include "Graph.h"
+#include "Logger.h"
 #include <stdexcept>
-#include <iostream>
+#include <cstring>
 #include <sstream>
 #include <fstream>
 #include <vector>
 #include <algorithm>
 #include <cctype>
 #include <locale>
+#include <set>
 #include <unordered_set>
+#include <limits>
+#include <functional>
+#include <cmath>
+#include <array>
+#include <charconv>
+#include <exception>
+#include <thread>
+#include <filesystem>
+
+namespace {
+    // Smallest byte range worth giving its own thread when parsing stop_times.
+    constexpr size_t MinStopTimesChunkBytes = 4 * 1024 * 1024;
+
+    // Most columns any of the parsed files uses, later ones are ignored.
+    constexpr size_t MaxCSVFields = 9;
+
+    std::string_view trim(std::string_view s) {
+        while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+        while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+        return s;
+    }
+
+    /*
+    * Splits a row into views of its fields and returns how many it has. Surrounding quotes are stripped, quoted
+    * delimiters aren't supported. Fields past MaxCSVFields are counted but not kept.
+    * Delimiters are found with memchr, which the C runtimes vectorize.
+    */
+    size_t splitCSV(std::string_view line, std::array<std::string_view, MaxCSVFields>& fields) {
+        size_t count = 0;
+        while (true) {
+            const void* found = std::memchr(line.data(), ',', line.size());
+            const size_t length = found ? static_cast<const char*>(found) - line.data() : line.size();
+            std::string_view token = line.substr(0, length);
+            if (!token.empty() && token.front() == '"') token.remove_prefix(1);
+            if (!token.empty() && token.back() == '"') token.remove_suffix(1);
+            if (count < MaxCSVFields) fields[count] = token;
+            ++count;
+            if (!found) return count;
+            line.remove_prefix(length + 1);
+        }
+    }
+
+    template <typename Number>
+    bool parseNumber(std::string_view token, Number& value) {
+        token = trim(token);
+        const char* end = token.data() + token.size();
+        auto [ptr, error] = std::from_chars(token.data(), end, value);
+        return error == std::errc() && ptr == end && !token.empty();
+    }
+
+    // Parses "HH:MM:SS" into minutes after midnight, seconds dropped. Hours can go past 24 for trips after midnight.
+    bool parseMinutes(std::string_view token, int& minutes) {
+        token = trim(token);
+        const char* end = token.data() + token.size();
+        int hours = 0;
+        int mins = 0;
+        auto [colon, error] = std::from_chars(token.data(), end, hours);
+        if (error != std::errc() || colon == end || *colon != ':') return false;
+        auto [rest, minuteError] = std::from_chars(colon + 1, end, mins);
+        if (minuteError != std::errc() || rest == colon + 1) return false;
+        minutes = hours * 60 + mins;
+        return true;
+    }
+
+    // Calls visit(row) for every row in [begin, end), without its line break.
+    template <typename Visit>
+    void forEachRow(const char* begin, const char* end, Visit&& visit) {
+        while (begin < end) {
+            const void* found = std::memchr(begin, '\n', end - begin);
+            const char* rowEnd = found ? static_cast<const char*>(found) : end;
+            std::string_view row(begin, rowEnd - begin);
+            if (!row.empty() && row.back() == '\r') row.remove_suffix(1);
+            if (!row.empty()) visit(row);
+            begin = rowEnd + 1;
+        }
+    }
+
+    // Returns where the data starts in a mapped file, past its format header.
+    const char* skipHeader(const MappedFile& file) {
+        const char* end = file.data() + file.size();
+        const void* found = std::memchr(file.data(), '\n', file.size());
+        return found ? static_cast<const char*>(found) + 1 : end;
+    }
+
+    /*
+    * What one thread parsed from a byte range of stop_times: the lines it saw per station, the trips it saw
+    * from start to end, and its first and last rows and half-seen trips, so the merge can stitch it to its
+    * neighbours as if the rows had been read in one go. Views point into the mapped file.
+    */
+    struct StopTimesChunk {
+        struct Row {
+            std::string_view lineId;
+            int routeId = -1;
+            int time = -1;
+            int stationCode = 0;
+            bool hasTripId = false;
+            std::string_view tripId;
+        };
+
+        struct Line {
+            int stationCode;
+            std::string_view id;
+            bool hasTo = false;
+            int to = 0;
+            std::vector<int> arrivalTimes{};
+        };
+
+        std::vector<Line> lines;                        // In order of first appearance
+        std::optional<Row> firstRow;
+        std::optional<Row> lastRow;
+        std::vector<int> headStops;                     // Stops up to the first trip boundary after firstRow
+        bool hasTripBoundary = false;
+        std::string_view tailLine;                      // Line and stops of the trip lastRow belongs to, if it
+        std::vector<int> tailStops;                     // started in this chunk
+        std::set<std::pair<std::string_view, std::vector<int>>> patterns;     // Trips seen whole
+        size_t rowCount = 0;
+        size_t skippedRowCount = 0;
+        size_t replacedRowCount = 0;                    // Rows of trips a delta feed replaces
+    };
+
+    /*
+    * Parses the rows of [begin, end). Rows with missing or malformed fields or an unknown stop are skipped, and
+    * so are the rows of replaced trips. Each line keeps the same 'to' it would get if the rows were read one by
+    * one: the stop of the row that followed its last row with the same route_id.
+    */
+    StopTimesChunk parseStopTimes(const char* begin, const char* end, const std::unordered_map<int, size_t>& knownStations,
+        const std::unordered_set<std::string_view>& replacedTrips) {
+        StopTimesChunk chunk;
+        std::unordered_map<int, std::vector<size_t>> stationLines;     // Station code -> positions in chunk.lines
+        std::array<std::string_view, MaxCSVFields> fields;
+        size_t lastLine = 0;
+        std::string_view tripId;
+        std::vector<int>* tripStops = &chunk.headStops;
+
+        forEachRow(begin, end, [&](const std::string_view text) {
+            ++chunk.rowCount;
+            const size_t fieldCount = splitCSV(text, fields);
+            if (fieldCount > 4 && replacedTrips.contains(fields[4])) {
+                ++chunk.replacedRowCount;
+                return;
+            }
+            StopTimesChunk::Row row;
+            if (fieldCount < 4 || !parseNumber(fields[1], row.routeId) || !parseMinutes(fields[2], row.time) ||
+                !parseNumber(fields[3], row.stationCode) || !knownStations.contains(row.stationCode)) {
+                ++chunk.skippedRowCount;
+                return;
+            }
+            row.lineId = fields[0];
+            row.hasTripId = fieldCount > 4;
+            if (row.hasTripId) row.tripId = fields[4];
+
+            const std::optional<StopTimesChunk::Row>& previous = chunk.lastRow;
+            if (previous && row.routeId == previous->routeId) {
+                StopTimesChunk::Line& line = chunk.lines[lastLine];
+                line.hasTo = true;
+                line.to = row.stationCode;
+            }
+
+            std::vector<size_t>& lines = stationLines[row.stationCode];
+            auto it = std::find_if(lines.begin(), lines.end(),
+                [&](const size_t position) { return chunk.lines[position].id == row.lineId; });
+            if (it != lines.end()) {
+                lastLine = *it;
+            }
+            else {
+                lastLine = chunk.lines.size();
+                lines.push_back(lastLine);
+                chunk.lines.push_back(StopTimesChunk::Line{ row.stationCode, row.lineId });
+            }
+            chunk.lines[lastLine].arrivalTimes.push_back(row.time);
 
-static std::string trim(const std::string& s) {
-    auto start = s.begin();
-    while (start != s.end() && std::isspace(static_cast<unsigned char>(*start)))
-        start++;
-    if (start == s.end())
-        return "";
-    auto end = s.end() - 1;
-    while (end != start && std::isspace(static_cast<unsigned char>(*end)))
-        end--;
-    return std::string(start, end + 1);
+            // The first row is matched against the previous chunk by the merge.
+            if (!previous) {
+                chunk.firstRow = row;
+                tripId = row.tripId;
+            }
+            else if (row.hasTripId ? row.tripId != tripId : (row.routeId != previous->routeId || row.time < previous->time)) {
+                if (chunk.hasTripBoundary && chunk.tailStops.size() >= 2) chunk.patterns.emplace(chunk.tailLine, chunk.tailStops);
+                chunk.hasTripBoundary = true;
+                chunk.tailStops.clear();
+                chunk.tailLine = row.lineId;
+                tripStops = &chunk.tailStops;
+                tripId = row.hasTripId ? row.tripId : std::string_view();
+            }
+            tripStops->push_back(row.stationCode);
+            chunk.lastRow = row;
+        });
+        return chunk;
+    }
+
+    // Splits [begin, end) into up to count ranges of whole rows, returned as count + 1 boundaries.
+    std::vector<const char*> splitRows(const char* begin, const char* end, const size_t count) {
+        std::vector<const char*> boundaries{ begin };
+        const size_t size = end - begin;
+        for (size_t i = 1; i < count; ++i) {
+            const char* at = std::max(begin + size * i / count, boundaries.back());
+            if (at > begin && at < end && at[-1] != '\n') {
+                const void* found = std::memchr(at, '\n', end - at);
+                at = found ? static_cast<const char*>(found) + 1 : end;
+            }
+            boundaries.push_back(at);
+        }
+        boundaries.push_back(end);
+        return boundaries;
+    }
 }
 
-static std::vector<std::string> splitCSV(const std::string& line, char delimiter = ',') {
-    std::vector<std::string> tokens;
-    std::stringstream ss(line);
-    std::string token;
-    while (std::getline(ss, token, delimiter)) {
-        if (!token.empty() && token.front() == '"') token.erase(0, 1);
-        if (!token.empty() && token.back() == '"') token.pop_back();
-        tokens.push_back(token);
+// Parsed but not yet frozen graph data. Lines are kept per station until every row has been read.
+struct Graph::Builder {
+    struct PendingLine {
+        std::string id;
+        int to = 0;
+        std::vector<int> arrivalTimes;
+    };
+
+    struct PendingStation {
+        int code;
+        std::string name;
+        Utilities::Coordinates coordinates;
+        std::vector<PendingLine> lines;
+    };
+
+    std::vector<PendingStation> stations;
+    std::unordered_map<int, size_t> codeToStation;  // Station code -> position in stations.
+    std::set<std::pair<std::string, std::vector<int>>> patterns;   // Distinct (line id, stop codes) trip sequences.
+
+    // Records the stops of a finished trip, then clears them for the next one.
+    void addPattern(const std::string& lineId, std::vector<int>& stopCodes) {
+        if (stopCodes.size() >= 2) patterns.emplace(lineId, stopCodes);
+        stopCodes.clear();
+    }
+
+    // Adds a station. A station already added with the same code is kept, or updated when replace is set.
+    void addStation(const int code, const std::string& name, const Utilities::Coordinates& coords, const bool replace = false) {
+        if (!coords.isValid()) {
+            LOG_WARNING(Graph, "Invalid coords for " << code << ": " << coords.latitude << " " << coords.longitude);
+        }
+        auto [it, added] = codeToStation.try_emplace(code, stations.size());
+        if (added) {
+            stations.push_back(PendingStation{ code, name, coords, {} });
+        }
+        else if (replace) {
+            stations[it->second].name = name;
+            stations[it->second].coordinates = coords;
+        }
+    }
+
+    // Grants a muteable reference to a station's line, added on first use. Throws if the station wasn't added.
+    PendingLine& getLineRef(const int stationCode, const std::string_view lineId) {
+        auto it = codeToStation.find(stationCode);
+        if (it == codeToStation.end()) {
+            throw std::out_of_range("Station with the given ID not found: " + std::to_string(stationCode));
+        }
+        std::vector<PendingLine>& lines = stations[it->second].lines;
+        auto line = std::find_if(lines.begin(), lines.end(), [&](const PendingLine& l) { return l.id == lineId; });
+        if (line != lines.end()) return *line;
+        PendingLine& newLine = lines.emplace_back();
+        newLine.id = lineId;
+        return newLine;
     }
-    return tokens;
+
+    /*
+    * Adds the stop time chunks of one file, in file order. Applies the 'to' link and the trip boundary between
+    * neighbouring chunks, so the lines and patterns come out the same as from one pass over the rows.
+    */
+    void mergeStopTimes(std::vector<StopTimesChunk>& chunks) {
+        std::optional<StopTimesChunk::Row> lastRow;
+        std::string tripId;
+        std::string tripLine;
+        std::vector<int> tripStops;
+        for (StopTimesChunk& chunk : chunks) {
+            if (!chunk.firstRow) continue;
+            const StopTimesChunk::Row& first = *chunk.firstRow;
+
+            // If the first row continues the previous chunk's transportation line, update its 'to' field.
+            if (lastRow && first.routeId == lastRow->routeId) {
+                getLineRef(lastRow->stationCode, lastRow->lineId).to = first.stationCode;
+            }
+            for (StopTimesChunk::Line& line : chunk.lines) {
+                PendingLine& pending = getLineRef(line.stationCode, line.id);
+                pending.arrivalTimes.insert(pending.arrivalTimes.end(), line.arrivalTimes.begin(), line.arrivalTimes.end());
+                if (line.hasTo) pending.to = line.to;
+            }
+
+            // Rows of a trip are consecutive. Files without the trip_id column end a trip when the route
+            // changes or the clock goes backwards.
+            const bool startsTrip = !lastRow ||
+                (first.hasTripId ? first.tripId != tripId : (first.routeId != lastRow->routeId || first.time < lastRow->time));
+            if (startsTrip) {
+                addPattern(tripLine, tripStops);
+                tripId = first.hasTripId ? first.tripId : "";
+                tripLine = first.lineId;
+            }
+            tripStops.insert(tripStops.end(), chunk.headStops.begin(), chunk.headStops.end());
+            if (chunk.hasTripBoundary) {
+                addPattern(tripLine, tripStops);
+                for (const auto& [lineId, stops] : chunk.patterns) {
+                    patterns.emplace(std::string(lineId), stops);
+                }
+                tripId = chunk.lastRow->hasTripId ? chunk.lastRow->tripId : "";
+                tripLine = chunk.tailLine;
+                tripStops = std::move(chunk.tailStops);
+            }
+            lastRow = chunk.lastRow;
+        }
+        addPattern(tripLine, tripStops);
+    }
+};
+
+Graph::Graph() {
+    fetchAPIData(DefaultGTFSDirectory, "");
 }
 
-static int convertTimeToMinutes(const std::string& timeStr) {
-    int h, m, s;
-    char colon;
-    std::istringstream iss(timeStr);
-    iss >> h >> colon >> m >> colon >> s;
-    return h * 60 + m;
+Graph::Graph(const std::string& gtfsDirectory, const std::string& deltaDirectory) {
+    fetchAPIData(gtfsDirectory, deltaDirectory);
 }
 
-Graph::Graph() {
-    fetchAPIData();
+Graph::Graph(const std::string& binaryGraphPath) {
+    loadBinary(binaryGraphPath);
 }
 
 Graph::~Graph() = default;
 
-void Graph::addStation(const int code, const std::string& name, const Utilities::Coordinates& coords) {
-    if (!coords.isValid()) {
-		std::cout << "Invalid coords for " << code << ": " << coords.latitude << " " << coords.longitude << std::endl;
-    }
+int Graph::TransportationLine::nextArrivalAtOrAfter(const double minutes) const {
+    if (minutes > std::numeric_limits<uint16_t>::max()) return -1;
+    const double threshold = std::max(0.0, std::ceil(minutes));
+    auto it = std::lower_bound(arrivalTimes.begin(), arrivalTimes.end(), static_cast<uint16_t>(threshold));
+    return it == arrivalTimes.end() ? -1 : *it;
+}
+
+std::span<const Graph::TransportationLine> Graph::getLinesFrom(const int nodeId) const {
+    auto it = this->_codeToIndex.find(nodeId);
+    if (it != this->_codeToIndex.end())
+        return _stations[it->second].lines;
+    return {};
+}
+
+std::span<const Graph::TransportationLine> Graph::getLinesFromIndex(const int stationIndex) const {
+    return _stations[stationIndex].lines;
+}
+
+const Graph::TransportationLine& Graph::getEdge(const int edgeIndex) const
+{
+    return _lines[edgeIndex];
+}
 
-    this->_map.emplace(code, Station(code, name, coords));
+int Graph::getEdgeIndex(const TransportationLine& line) const
+{
+    const TransportationLine* first = _lines.data();
+    if (&line < first || &line >= first + _lines.size()) return -1;
+    return static_cast<int>(&line - first);
 }
 
-const std::vector<Graph::TransportationLine>& Graph::getLinesFrom(const int nodeId) const {
-    auto it = this->_map.find(nodeId);
-    if (it != this->_map.end())
-        return it->second.lines;
-    static std::vector<TransportationLine> empty;
-    return empty;
+bool Graph::isEdgeFrom(const int stationIndex, const int edgeIndex) const
+{
+    if (stationIndex < 0 || static_cast<size_t>(stationIndex) >= _stations.size()) return false;
+    if (edgeIndex < 0 || static_cast<size_t>(edgeIndex) >= _lines.size()) return false;
+    const auto lines = _stations[stationIndex].lines;
+    const TransportationLine* edge = &_lines[edgeIndex];
+    return edge >= lines.data() && edge < lines.data() + lines.size();
+}
+
+size_t Graph::getEdgeCount() const
+{
+    return _lines.size();
 }
 
 const Graph::Station& Graph::getStationByCode(const int id) const
 {
-    auto it = _map.find(id);
-    if (it == _map.end()) {
-        throw std::out_of_range("Station with the given ID not found: " + id);
+    auto it = _codeToIndex.find(id);
+    if (it == _codeToIndex.end()) {
+        throw std::out_of_range("Station with the given ID not found: " + std::to_string(id));
     }
-    return it->second;
+    return _stations[it->second];
+}
+
+const Graph::Station& Graph::getStationByIndex(const int index) const
+{
+    return _stations[index];
+}
+
+int Graph::getStationIndex(const int code) const
+{
+    auto it = _codeToIndex.find(code);
+    return (it == _codeToIndex.end()) ? -1 : it->second;
 }
 
 bool Graph::hasStation(const int id) const
 {
-    return _map.contains(id);
+    return _codeToIndex.contains(id);
 }
 
 size_t Graph::getStationCount() const
 {
-    return this->_map.size();
+    return this->_stations.size();
+}
+
+size_t Graph::getLineIdCount() const
+{
+    return _lineIds.size();
+}
+
+std::string_view Graph::getLineId(const int lineIndex) const
+{
+    return _lineIds[lineIndex];
+}
+
+int Graph::findLineIndex(std::string_view lineId) const
+{
+    auto it = _lineIdToIndex.find(lineId);
+    return (it == _lineIdToIndex.end()) ? -1 : it->second;
 }
 
 /*
 * Returns the nearby stations, sorted by distance
 */
-std::vector<Graph::Station> Graph::getNearbyStations(const Utilities::Coordinates& userCoords) const {
+std::vector<Graph::Station> Graph::getNearbyStations(const Utilities::Coordinates& userCoords, const double radiusKm) const {
     std::vector<Station> nearbyStations;
-    for (const auto& [id, station] : _map) {
-        double distance = Utilities::calculateHaversineDistance(station.coordinates, userCoords);
-        if (distance <= this->maxNearbyDistance) {
-            nearbyStations.push_back(station);
-        }
+    for (const auto& [distance, index] : _spatialIndex.queryRadius(userCoords, radiusKm)) {
+        nearbyStations.push_back(_stations[index]);
     }
-
-    // Sort by distance
-    std::sort(nearbyStations.begin(), nearbyStations.end(),
-        [&userCoords](const auto& a, const auto& b) {
-            double distA = Utilities::calculateHaversineDistance(a.coordinates, userCoords);
-            double distB = Utilities::calculateHaversineDistance(b.coordinates, userCoords);
-            return distA < distB;
-        });
-
     return nearbyStations;
 }
 
+std::vector<Graph::Station> Graph::getNearestStations(const Utilities::Coordinates& userCoords,
+    const size_t k, const double maxRadiusKm) const
+{
+    std::vector<Station> nearestStations;
+    for (const auto& [distance, index] : _spatialIndex.queryNearest(userCoords, k, maxRadiusKm)) {
+        nearestStations.push_back(_stations[index]);
+    }
+    return nearestStations;
+}
+
 std::vector<Graph::Station> Graph::getStationsAlongLineSegment(
-    const std::string& lineId,
+    std::string_view lineId,
     int segmentStartStationId,
     int segmentEndStationId) const
 {
+    const int startIndex = getStationIndex(segmentStartStationId);
+    if (startIndex < 0) {
+        LOG_DEBUG(Graph, "getStationsAlongLineSegment: Start station ID " << segmentStartStationId << " not found.");
+        return {};
+    }
+    if (segmentStartStationId == segmentEndStationId) {
+        return { _stations[startIndex] };
+    }
+
+    const auto segment = getLineSegment(findLineIndex(lineId), startIndex, getStationIndex(segmentEndStationId));
+    if (segment.empty()) {
+        LOG_DEBUG(Graph, "getStationsAlongLineSegment: No pattern of line " << lineId << " goes from "
+            << segmentStartStationId << " to " << segmentEndStationId << ".");
+        return { _stations[startIndex] };
+    }
+
     std::vector<Graph::Station> pathStations;
-    const int MAX_STEPS = 150; // Safety limit against potential cycles or errors
-    int stepCount = 0;
+    pathStations.reserve(segment.size());
+    for (const int index : segment) {
+        pathStations.push_back(_stations[index]);
+    }
+    return pathStations;
+}
 
-    // 1. Get Start Station & Add to Path
-    try {
-        const Station& startStation = getStationByCode(segmentStartStationId);
-        pathStations.push_back(startStation);
+std::span<const int> Graph::getLineSegment(const int lineIndex, const int startIndex, const int endIndex) const
+{
+    const int stationCount = static_cast<int>(_stations.size());
+    if (lineIndex < 0 || startIndex < 0 || startIndex >= stationCount || endIndex < 0 || endIndex >= stationCount) {
+        return {};
+    }
+    const std::span<const PatternVisit> visits(_visits);
+    const auto startVisits = visits.subspan(_firstVisit[startIndex], _firstVisit[startIndex + 1] - _firstVisit[startIndex]);
+    const auto endVisits = visits.subspan(_firstVisit[endIndex], _firstVisit[endIndex + 1] - _firstVisit[endIndex]);
+
+    std::span<const int> best;
+    for (const PatternVisit& from : startVisits) {
+        const LinePattern& pattern = _patterns[from.pattern];
+        if (pattern.lineIndex != lineIndex) continue;
+
+        // Visits are sorted, so the first one after 'from' is the closest visit of end on the same pattern.
+        auto to = std::upper_bound(endVisits.begin(), endVisits.end(), from);
+        if (to == endVisits.end() || to->pattern != from.pattern) continue;
+
+        auto slice = pattern.stops.subspan(from.position, to->position - from.position + 1);
+        if (best.empty() || slice.size() < best.size()) best = slice;
+    }
+    return best;
+}
+
+size_t Graph::getPatternCount() const
+{
+    return _patterns.size();
+}
 
-        if (segmentStartStationId == segmentEndStationId) {
-            return pathStations;
+void Graph::fetchAPIData(const std::string& gtfsDirectory, const std::string& deltaDirectory) {
+    const std::filesystem::path directory(gtfsDirectory);
+    Builder builder;
+    fetchGTFSStops(builder, (directory / GTFSStopsFileName).string(), false);
+    std::string deltaLinesPath;
+    if (!deltaDirectory.empty()) {
+        const std::filesystem::path delta(deltaDirectory);
+        if (std::filesystem::exists(delta / GTFSStopsFileName)) {
+            fetchGTFSStops(builder, (delta / GTFSStopsFileName).string(), true);
+        }
+        if (std::filesystem::exists(delta / GTFSLinesFileName)) {
+            deltaLinesPath = (delta / GTFSLinesFileName).string();
         }
     }
-    catch (const std::out_of_range& oor) {
-        std::cerr << "Error [getStationsAlongLineSegment Simple]: Start station ID "
-            << segmentStartStationId << " not found. " << oor.what() << std::endl;
-        return {};
+    fetchGTFSTransportationLines(builder, (directory / GTFSLinesFileName).string(), deltaLinesPath);
+    freeze(builder);
+}
+
+void Graph::fetchGTFSStops(Builder& builder, const std::string& path, const bool replace) const {
+    std::optional<MappedFile> file;
+    try {
+        file.emplace(path);
     }
-    catch (const std::exception& e) {
-        std::cerr << "Error [getStationsAlongLineSegment Simple]: Exception getting start station " << segmentStartStationId << ": " << e.what() << std::endl;
-        return {};
+    catch (const std::runtime_error& e) {
+        LOG_ERROR(Graph, "Failed to open GTFS stops file: " << e.what());
+        return;
     }
 
+    size_t rows = 0;
+    size_t skipped = 0;
+    std::array<std::string_view, MaxCSVFields> fields;
+    forEachRow(skipHeader(*file), file->data() + file->size(), [&](const std::string_view row) {
+        ++rows;
+        int stopCode = 0;
+        double stopLat = 0.0;
+        double stopLon = 0.0;
+        if (splitCSV(row, fields) < 6 || !parseNumber(fields[1], stopCode) ||
+            !parseNumber(fields[4], stopLat) || !parseNumber(fields[5], stopLon)) {
+            ++skipped;
+            return;
+        }
+        builder.addStation(stopCode, std::string(fields[2]), Utilities::Coordinates(stopLat, stopLon), replace);
+    });
+    if (skipped > 0) {
+        LOG_WARNING(Graph, "Skipped " << skipped << " stops of " << path << " with missing or malformed fields.");
+    }
+    LOG_INFO(Graph, "Done! Read " << rows << " stops from " << path << ", " << builder.stations.size() << " stations in total.");
+}
 
-    // 2. Trace the Path Step-by-Step
-    int currentStationId = segmentStartStationId;
-    int previousStationId = -1; // Track just the immediate previous to avoid simple A->B->A loops
+void Graph::fetchGTFSTransportationLines(Builder& builder, const std::string& path, const std::string& deltaPath) const {
+    std::optional<MappedFile> file;
+    std::optional<MappedFile> deltaFile;
+    try {
+        file.emplace(path);
+        if (!deltaPath.empty()) deltaFile.emplace(deltaPath);
+    }
+    catch (const std::runtime_error& e) {
+        LOG_ERROR(Graph, "Failed to open GTFS stop times file: " << e.what());
+        return;
+    }
 
-    while (currentStationId != segmentEndStationId && stepCount < MAX_STEPS) {
-        stepCount++;
-        const Graph::TransportationLine* chosenLine = nullptr;
+    // The rows of every trip the delta mentions are dropped from the feed, the delta's rows take their place.
+    std::unordered_set<std::string_view> replacedTrips;
+    if (deltaFile) {
+        std::array<std::string_view, MaxCSVFields> fields;
+        forEachRow(skipHeader(*deltaFile), deltaFile->data() + deltaFile->size(), [&](const std::string_view row) {
+            if (splitCSV(row, fields) > 4) replacedTrips.insert(fields[4]);
+        });
+    }
 
-        // Find *one* appropriate outgoing edge for the lineId
-        try {
-            // Ensure current station is valid before proceeding
-            if (!hasStation(currentStationId)) {
-                std::cerr << "Error [getStationsAlongLineSegment Simple]: Current station " << currentStationId << " became invalid during trace." << std::endl;
-                break;
+    // Every thread parses its own byte range into a partial graph, without touching the builder.
+    const char* begin = skipHeader(*file);
+    const char* end = file->data() + file->size();
+    const size_t threadCount = std::clamp<size_t>(static_cast<size_t>(end - begin) / MinStopTimesChunkBytes,
+        1, std::max(1u, std::thread::hardware_concurrency()));
+    const std::vector<const char*> boundaries = splitRows(begin, end, threadCount);
+    LOG_INFO(Graph, "Parsing " << file->size() / (1024 * 1024) << " MB of stop times on " << threadCount << " threads.");
+
+    std::vector<StopTimesChunk> chunks(threadCount);
+    std::vector<std::exception_ptr> errors(threadCount);
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back([&, i]() {
+            try {
+                chunks[i] = parseStopTimes(boundaries[i], boundaries[i + 1], builder.codeToStation, replacedTrips);
             }
-            const std::vector<TransportationLine>& linesFromCurrent = getLinesFrom(currentStationId);
-
-            // Search strategy:
-            // 1. Look for the line going directly to the target end station.
-            // 2. If not found, look for *any* line with the matching ID that doesn't immediately go back.
-            const Graph::TransportationLine* fallbackLine = nullptr;
-
-            for (const auto& line : linesFromCurrent) {
-                if (line.id == lineId) {
-                    if (line.to == segmentEndStationId) {
-                        chosenLine = &line; // Found direct path to end
-                        break;
-                    }
-                    // Check if it's a valid fallback (doesn't go back to immediate previous)
-                    if (line.to != previousStationId && fallbackLine == nullptr) {
-                        fallbackLine = &line;
-                    }
-                }
+            catch (...) {
+                errors[i] = std::current_exception();
             }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    for (const std::exception_ptr& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
 
-            // If direct target wasn't found, use the fallback if one exists
-            if (chosenLine == nullptr && fallbackLine != nullptr) {
-                chosenLine = fallbackLine;
-            }
+    // The delta is small, and is read as a file of its own after the feed.
+    std::vector<StopTimesChunk> deltaChunks;
+    if (deltaFile) {
+        deltaChunks.push_back(parseStopTimes(skipHeader(*deltaFile), deltaFile->data() + deltaFile->size(),
+            builder.codeToStation, {}));
+    }
 
+    size_t rows = 0;
+    size_t skipped = 0;
+    size_t replaced = 0;
+    for (const std::vector<StopTimesChunk>* fileChunks : { &chunks, &deltaChunks }) {
+        for (const StopTimesChunk& chunk : *fileChunks) {
+            rows += chunk.rowCount;
+            skipped += chunk.skippedRowCount;
+            replaced += chunk.replacedRowCount;
         }
-        catch (const std::out_of_range& oor) {
-            std::cerr << "Error [getStationsAlongLineSegment Simple]: Cannot get lines from station " << currentStationId << ". " << oor.what() << std::endl;
-            break; // Stop if we can't get lines
-        }
-        catch (const std::exception& e) {
-            std::cerr << "Error [getStationsAlongLineSegment Simple]: Exception getting lines from " << currentStationId << ": " << e.what() << std::endl;
-            break;
-        }
+    }
+    builder.mergeStopTimes(chunks);
+    builder.mergeStopTimes(deltaChunks);
 
+    if (skipped > 0) {
+        LOG_WARNING(Graph, "Skipped " << skipped << " stop times with unknown stops or missing or malformed fields.");
+    }
+    if (deltaFile) {
+        LOG_INFO(Graph, "Delta replaced " << replacedTrips.size() << " trips, " << replaced << " stop times of the feed.");
+    }
+    LOG_INFO(Graph, "Done! Read " << rows << " stop times, found " << builder.patterns.size() << " line patterns.");
+}
 
-        // 3. Process the chosen edge (or lack thereof)
-        if (chosenLine != nullptr) {
-            int nextStationId = chosenLine->to;
-            try {
-                // Get the station object for the next stop
-                const Station& nextStation = getStationByCode(nextStationId);
-                // Add it to our path result
-                pathStations.push_back(nextStation);
+void Graph::freeze(Builder& builder) {
+    // Dense indices follow station code order, matching the binary format.
+    std::sort(builder.stations.begin(), builder.stations.end(),
+        [](const Builder::PendingStation& a, const Builder::PendingStation& b) { return a.code < b.code; });
 
-                // Update state for the next iteration
-                previousStationId = currentStationId;
-                currentStationId = nextStationId;
+    std::unordered_map<int, int> codeToIndex;
+    codeToIndex.reserve(builder.stations.size());
+    for (size_t s = 0; s < builder.stations.size(); ++s) {
+        codeToIndex.emplace(builder.stations[s].code, static_cast<int>(s));
+    }
 
+    std::vector<GraphFormat::StationRecord> stationRecords;
+    std::vector<GraphFormat::LineRecord> lineRecords;
+    std::vector<GraphFormat::LineIdRecord> lineIdRecords;
+    std::unordered_map<std::string, uint32_t> lineIdIndices;
+    stationRecords.reserve(builder.stations.size());
+
+    auto appendString = [this](const std::string& str) {
+        GraphFormat::LineIdRecord ref{ static_cast<uint32_t>(_ownedStrings.size()), static_cast<uint32_t>(str.size()) };
+        _ownedStrings.insert(_ownedStrings.end(), str.begin(), str.end());
+        return ref;
+    };
+
+    for (Builder::PendingStation& station : builder.stations) {
+        GraphFormat::StationRecord record{};
+        GraphFormat::LineIdRecord name = appendString(station.name);
+        record.code = station.code;
+        record.nameOffset = name.offset;
+        record.nameLength = name.length;
+        record.latitude = station.coordinates.latitude;
+        record.longitude = station.coordinates.longitude;
+        record.firstLine = static_cast<uint32_t>(lineRecords.size());
+        record.lineCount = static_cast<uint32_t>(station.lines.size());
+
+        for (Builder::PendingLine& line : station.lines) {
+            auto [idIt, inserted] = lineIdIndices.try_emplace(line.id, static_cast<uint32_t>(lineIdRecords.size()));
+            if (inserted) lineIdRecords.push_back(appendString(line.id));
+
+            auto toIt = codeToIndex.find(line.to);
+            GraphFormat::LineRecord lineRecord{};
+            lineRecord.lineIndex = idIt->second;
+            lineRecord.to = line.to;
+            lineRecord.toIndex = (toIt == codeToIndex.end()) ? -1 : toIt->second;
+            lineRecord.type = static_cast<uint32_t>(TransportMethod::Bus);
+            lineRecord.travelTime = 0;
+            // Rows come in file order, one per trip; lookups need each line's times sorted and unique.
+            std::sort(line.arrivalTimes.begin(), line.arrivalTimes.end());
+            line.arrivalTimes.erase(std::unique(line.arrivalTimes.begin(), line.arrivalTimes.end()), line.arrivalTimes.end());
+            lineRecord.timetableOffset = static_cast<uint32_t>(_ownedTimetables.size());
+            for (const int time : line.arrivalTimes) {
+                if (time < 0 || time > std::numeric_limits<uint16_t>::max()) {
+                    LOG_WARNING(Graph, "Dropping arrival time " << time << " of line " << line.id << ", out of range.");
+                    continue;
+                }
+                _ownedTimetables.push_back(static_cast<uint16_t>(time));
             }
-            catch (const std::out_of_range& oor) {
-                std::cerr << "Error [getStationsAlongLineSegment Simple]: Next station ID " << nextStationId
-                    << " (on line " << lineId << ") not found. " << oor.what() << std::endl;
-                break; // Stop if the graph data points to a non-existent station
-            }
-            catch (const std::exception& e) {
-                std::cerr << "Error [getStationsAlongLineSegment Simple]: Exception getting next station " << nextStationId << ": " << e.what() << std::endl;
-                break;
-            }
-        }
-        else {
-            // Dead end: No valid outgoing edge found for this line from the current station
-            std::cerr << "Warning [getStationsAlongLineSegment Simple]: No onward path found for line " << lineId
-                << " from station " << currentStationId << " towards " << segmentEndStationId << ". Stopping trace." << std::endl;
-            break; // Stop tracing
-        }
-    } // End while loop
+            lineRecord.timetableCount = static_cast<uint32_t>(_ownedTimetables.size() - lineRecord.timetableOffset);
+            lineRecords.push_back(lineRecord);
 
-    // 4. Log warnings if trace didn't complete as expected
-    if (stepCount >= MAX_STEPS) {
-        std::cerr << "Warning [getStationsAlongLineSegment Simple]: Exceeded MAX_STEPS (" << MAX_STEPS << ") for "
-            << segmentStartStationId << " -> " << segmentEndStationId << " on line " << lineId << "." << std::endl;
+            std::vector<int>().swap(line.arrivalTimes); // Release staging memory as we go.
+        }
+        stationRecords.push_back(record);
     }
-    // Check if loop finished but didn't reach the end (implies dead end was hit)
-    if (currentStationId != segmentEndStationId && stepCount < MAX_STEPS) {
-        std::cerr << "Warning [getStationsAlongLineSegment Simple]: Trace did not reach target " << segmentEndStationId
-            << " from " << segmentStartStationId << " on line " << lineId << ". Returning partial path." << std::endl;
+
+    std::vector<GraphFormat::PatternRecord> patternRecords;
+    patternRecords.reserve(builder.patterns.size());
+    for (const auto& [lineId, stopCodes] : builder.patterns) {
+        auto [idIt, inserted] = lineIdIndices.try_emplace(lineId, static_cast<uint32_t>(lineIdRecords.size()));
+        if (inserted) lineIdRecords.push_back(appendString(lineId));
+
+        patternRecords.push_back({ idIt->second, static_cast<uint32_t>(_ownedPatternStops.size()),
+            static_cast<uint32_t>(stopCodes.size()) });
+        for (const int code : stopCodes) {
+            _ownedPatternStops.push_back(codeToIndex.at(code));
+        }
     }
+    builder.patterns.clear();
 
-    // 5. Return the collected path
-    return pathStations;
+    _strings = _ownedStrings;
+    _timetables = _ownedTimetables;
+    _patternStops = _ownedPatternStops;
+    buildViews(stationRecords, lineRecords, lineIdRecords, patternRecords);
 }
 
-Graph::Station& Graph::getStationRefById(const int id) {
-    auto it = _map.find(id);
-    if (it == _map.end()) {
-        throw std::out_of_range("Station with the given ID not found");
+void Graph::buildViews(std::span<const GraphFormat::StationRecord> stationRecords,
+    std::span<const GraphFormat::LineRecord> lineRecords,
+    std::span<const GraphFormat::LineIdRecord> lineIdRecords,
+    std::span<const GraphFormat::PatternRecord> patternRecords)
+{
+    auto poolString = [this](uint32_t offset, uint32_t length) {
+        if (offset > _strings.size() || length > _strings.size() - offset) {
+            throw std::runtime_error("Graph has a string outside the string pool.");
+        }
+        return std::string_view(_strings.data() + offset, length);
+    };
+
+    _lineIds.clear();
+    _lineIdToIndex.clear();
+    _lineIds.reserve(lineIdRecords.size());
+    _lineIdToIndex.reserve(lineIdRecords.size());
+    for (const GraphFormat::LineIdRecord& record : lineIdRecords) {
+        std::string_view id = poolString(record.offset, record.length);
+        _lineIdToIndex.emplace(id, static_cast<int>(_lineIds.size()));
+        _lineIds.push_back(id);
     }
-    return it->second;
-}
 
-void Graph::fetchAPIData() {
-    fetchGTFSStops();
-    fetchGTFSTransportationLines();
-}
+    _lines.clear();
+    _lines.reserve(lineRecords.size());
+    for (const GraphFormat::LineRecord& record : lineRecords) {
+        if (record.lineIndex >= _lineIds.size()) {
+            throw std::runtime_error("Graph has a line with an unknown line id.");
+        }
+        if (record.toIndex >= static_cast<int32_t>(stationRecords.size())) {
+            throw std::runtime_error("Graph has a line to a station outside the station section.");
+        }
+        if (record.timetableOffset > _timetables.size() || record.timetableCount > _timetables.size() - record.timetableOffset) {
+            throw std::runtime_error("Graph has a line with times outside the timetable section.");
+        }
 
-void Graph::fetchGTFSStops() {
-    std::ifstream file(GTFSStopsFile);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open GTFS stops.txt file.\n";
-        return;
+        TransportationLine& line = _lines.emplace_back(_lineIds[record.lineIndex], record.to,
+            record.travelTime, static_cast<TransportMethod>(record.type));
+        line.lineIndex = static_cast<int>(record.lineIndex);
+        line.toIndex = record.toIndex;
+        line.arrivalTimes = _timetables.subspan(record.timetableOffset, record.timetableCount);
+        if (std::adjacent_find(line.arrivalTimes.begin(), line.arrivalTimes.end(), std::greater_equal<uint16_t>()) !=
+            line.arrivalTimes.end()) {
+            throw std::runtime_error("Graph has a line whose times aren't sorted.");
+        }
     }
 
-    std::string header;
-    std::getline(file, header); // Skipping the format header
+    _stations.clear();
+    _codeToIndex.clear();
+    _stations.reserve(stationRecords.size());
+    _codeToIndex.reserve(stationRecords.size());
+    for (const GraphFormat::StationRecord& record : stationRecords) {
+        if (record.firstLine > _lines.size() || record.lineCount > _lines.size() - record.firstLine) {
+            throw std::runtime_error("Graph has a station with lines outside the line section.");
+        }
+        const int index = static_cast<int>(_stations.size());
+        if (!_codeToIndex.emplace(record.code, index).second) {
+            throw std::runtime_error("Graph has duplicate station code " + std::to_string(record.code) + ".");
+        }
+
+        Station& station = _stations.emplace_back(record.code, index, poolString(record.nameOffset, record.nameLength),
+            Utilities::Coordinates(record.latitude, record.longitude));
+        station.lines = std::span<const TransportationLine>(_lines).subspan(record.firstLine, record.lineCount);
+    }
+
+    _patterns.clear();
+    _patterns.reserve(patternRecords.size());
+    _firstVisit.assign(_stations.size() + 1, 0);
+    for (const GraphFormat::PatternRecord& record : patternRecords) {
+        if (record.lineIndex >= _lineIds.size()) {
+            throw std::runtime_error("Graph has a pattern with an unknown line id.");
+        }
+        if (record.firstStop > _patternStops.size() || record.stopCount > _patternStops.size() - record.firstStop) {
+            throw std::runtime_error("Graph has a pattern with stops outside the pattern stop section.");
+        }
+        const LinePattern& pattern = _patterns.emplace_back(LinePattern{ static_cast<int>(record.lineIndex),
+            _patternStops.subspan(record.firstStop, record.stopCount) });
+        for (const int stop : pattern.stops) {
+            if (stop < 0 || static_cast<size_t>(stop) >= _stations.size()) {
+                throw std::runtime_error("Graph has a pattern stop outside the station section.");
+            }
+            _firstVisit[stop + 1]++;
+        }
+    }
+    for (size_t s = 1; s < _firstVisit.size(); ++s) {
+        _firstVisit[s] += _firstVisit[s - 1];
+    }
+    // Filling in pattern order, then stop order, leaves every station's visits sorted.
+    _visits.resize(_firstVisit.back());
+    std::vector<uint32_t> nextVisit(_firstVisit.begin(), _firstVisit.end() - 1);
+    for (size_t p = 0; p < _patterns.size(); ++p) {
+        const auto stops = _patterns[p].stops;
+        for (size_t position = 0; position < stops.size(); ++position) {
+            _visits[nextVisit[stops[position]]++] = PatternVisit{ static_cast<int>(p), static_cast<int>(position) };
+        }
+    }
 
-    int i = 0;
-    std::string line;
-    while (std::getline(file, line)) {
-        auto tokens = splitCSV(line);
-        if (tokens.size() < 6) continue;
-        int stop_code = std::stoi(tokens[1]);
-        std::string stop_name = tokens[2];
-        double stop_lat = std::stod(tokens[4]);
-        double stop_lon = std::stod(tokens[5]);
-        addStation(stop_code, stop_name, Utilities::Coordinates(stop_lat, stop_lon));
-        if (i % 10000 == 0)
-            std::cout << "Added " << i << " stations out of 34.5K" << std::endl;
-        i++;
+    std::vector<Utilities::Coordinates> coordinates;
+    coordinates.reserve(_stations.size());
+    for (const Station& station : _stations) {
+        coordinates.push_back(station.coordinates);
     }
-    std::cout << "Done!" << std::endl;
-    file.close();
+    _spatialIndex.build(coordinates);
 }
 
-void Graph::fetchGTFSTransportationLines() {
-    std::ifstream stopTimesFile(GTFSLinesFile);
-    if (!stopTimesFile.is_open()) {
-        std::cerr << "Failed to open " << GTFSLinesFile << " file." << std::endl;
-        return;
+namespace {
+    // Returns a typed view of a section of the mapping, after checking it lies inside the file.
+    template <typename T>
+    std::span<const T> sectionAt(const MappedFile& file, uint64_t offset, uint64_t count, const char* sectionName) {
+        if (offset > file.size() || count > (file.size() - offset) / sizeof(T)) {
+            throw std::runtime_error(std::string("Binary graph file is truncated (section: ") + sectionName + ").");
+        }
+        return std::span<const T>(reinterpret_cast<const T*>(file.data() + offset), static_cast<size_t>(count));
     }
 
-    std::string header;
-    std::getline(stopTimesFile, header);
-    std::string line;
-    int i = 0;
-    int lastId = -1;
-    TransportationLine* lastLine = nullptr;
+    template <typename T>
+    void writeSection(std::ofstream& out, std::span<const T> section) {
+        out.write(reinterpret_cast<const char*>(section.data()), section.size() * sizeof(T));
+    }
+}
 
-    while (std::getline(stopTimesFile, line)) {
-        auto tokens = splitCSV(line);
-        if (tokens.size() < 4) continue;
+void Graph::loadBinary(const std::string& path) {
+    MappedFile& file = _mappedFile.emplace(path);
 
-        std::string line_code = tokens[0];
-        int id = std::stoi(tokens[1]);
-        int time = convertTimeToMinutes(tokens[2]);
-        int stationCode = std::stoi(tokens[3]);
+    if (file.size() < sizeof(GraphFormat::FileHeader)) {
+        throw std::runtime_error("Binary graph file " + path + " is too small to hold a header.");
+    }
+    GraphFormat::FileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, GraphFormat::Magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a binary graph file.");
+    }
+    if (header.version != GraphFormat::Version) {
+        throw std::runtime_error("Binary graph file " + path + " has version " + std::to_string(header.version) +
+            ", expected " + std::to_string(GraphFormat::Version) + ". Recompile it with GraphCompiler.");
+    }
 
-        // If this row continues the previous transportation line, update its 'to' field.
-        if (id == lastId && lastLine != nullptr) {
-            lastLine->to = stationCode;
-        }
+    auto stations = sectionAt<GraphFormat::StationRecord>(file, header.stationsOffset, header.stationCount, "stations");
+    auto lines = sectionAt<GraphFormat::LineRecord>(file, header.linesOffset, header.lineCount, "lines");
+    auto lineIds = sectionAt<GraphFormat::LineIdRecord>(file, header.lineIdsOffset, header.lineIdCount, "lineIds");
+    auto patterns = sectionAt<GraphFormat::PatternRecord>(file, header.patternsOffset, header.patternCount, "patterns");
+    _timetables = sectionAt<uint16_t>(file, header.timetablesOffset, header.timetableCount, "timetables");
+    _patternStops = sectionAt<int>(file, header.patternStopsOffset, header.patternStopCount, "patternStops");
+    _strings = sectionAt<char>(file, header.stringPoolOffset, header.stringPoolSize, "strings");
+
+    buildViews(stations, lines, lineIds, patterns);
+    LOG_INFO(Graph, "Loaded " << _stations.size() << " stations and " << _patterns.size()
+        << " line patterns from binary graph " << path << ".");
+}
 
-        auto& station = getStationRefById(stationCode);
-        // Use a temporary TransportationLine with the same id to find an existing one.
-        TransportationLine tempLine;
-        tempLine.id = line_code;
+void Graph::saveBinary(const std::string& path) const {
+    // Views hold pointers into the pools, so offsets are recovered by subtracting the pool bases.
+    auto stringRef = [this](std::string_view str) {
+        return GraphFormat::LineIdRecord{ static_cast<uint32_t>(str.data() - _strings.data()), static_cast<uint32_t>(str.size()) };
+    };
+
+    std::vector<GraphFormat::StationRecord> stationRecords;
+    stationRecords.reserve(_stations.size());
+    for (const Station& station : _stations) {
+        GraphFormat::StationRecord record{};
+        GraphFormat::LineIdRecord name = stringRef(station.name);
+        record.code = station.code;
+        record.nameOffset = name.offset;
+        record.nameLength = name.length;
+        record.firstLine = static_cast<uint32_t>(station.lines.data() - _lines.data());
+        record.latitude = station.coordinates.latitude;
+        record.longitude = station.coordinates.longitude;
+        record.lineCount = static_cast<uint32_t>(station.lines.size());
+        stationRecords.push_back(record);
+    }
 
-        auto it = std::find(station.lines.begin(), station.lines.end(), tempLine);
-        if (it != station.lines.end()) {
-            // Found an existing line, add the arrival time.
-            it->arrivalTimes.push_back(time);
-            lastLine = std::to_address(it);  // Update lastLine to point to the actual element in the vector.
-        }
-        else {
-            TransportationLine newLine;
-            newLine.id = line_code;
-            newLine.arrivalTimes.push_back(time);
-            station.lines.push_back(newLine);
-            lastLine = &station.lines.back();
-        }
+    std::vector<GraphFormat::LineRecord> lineRecords;
+    lineRecords.reserve(_lines.size());
+    for (const TransportationLine& line : _lines) {
+        GraphFormat::LineRecord record{};
+        record.lineIndex = static_cast<uint32_t>(line.lineIndex);
+        record.to = line.to;
+        record.toIndex = line.toIndex;
+        record.type = static_cast<uint32_t>(line.type);
+        record.travelTime = line.travelTime;
+        record.timetableOffset = static_cast<uint32_t>(line.arrivalTimes.data() - _timetables.data());
+        record.timetableCount = static_cast<uint32_t>(line.arrivalTimes.size());
+        lineRecords.push_back(record);
+    }
 
-        lastId = id;
+    std::vector<GraphFormat::LineIdRecord> lineIdRecords;
+    lineIdRecords.reserve(_lineIds.size());
+    for (std::string_view id : _lineIds) {
+        lineIdRecords.push_back(stringRef(id));
+    }
 
-        if (i % 1000000 == 0)
-            std::cout << "Processed " << i / 1000000 << "B lines, out of 20.6B" << std::endl;
-        i++;
+    std::vector<GraphFormat::PatternRecord> patternRecords;
+    patternRecords.reserve(_patterns.size());
+    for (const LinePattern& pattern : _patterns) {
+        patternRecords.push_back({ static_cast<uint32_t>(pattern.lineIndex),
+            static_cast<uint32_t>(pattern.stops.data() - _patternStops.data()), static_cast<uint32_t>(pattern.stops.size()) });
+    }
+
+    GraphFormat::FileHeader header{};
+    std::memcpy(header.magic, GraphFormat::Magic, sizeof(header.magic));
+    header.version = GraphFormat::Version;
+    header.stationCount = static_cast<uint32_t>(stationRecords.size());
+    header.lineCount = static_cast<uint32_t>(lineRecords.size());
+    header.lineIdCount = static_cast<uint32_t>(lineIdRecords.size());
+    header.timetableCount = static_cast<uint32_t>(_timetables.size());
+    header.stringPoolSize = static_cast<uint32_t>(_strings.size());
+    header.patternCount = static_cast<uint32_t>(patternRecords.size());
+    header.patternStopCount = static_cast<uint32_t>(_patternStops.size());
+    header.stationsOffset = sizeof(header);
+    header.linesOffset = header.stationsOffset + stationRecords.size() * sizeof(GraphFormat::StationRecord);
+    header.lineIdsOffset = header.linesOffset + lineRecords.size() * sizeof(GraphFormat::LineRecord);
+    // The 16-bit timetables come after every 4-byte aligned section, so none of those needs padding.
+    header.patternsOffset = header.lineIdsOffset + lineIdRecords.size() * sizeof(GraphFormat::LineIdRecord);
+    header.patternStopsOffset = header.patternsOffset + patternRecords.size() * sizeof(GraphFormat::PatternRecord);
+    header.timetablesOffset = header.patternStopsOffset + _patternStops.size() * sizeof(int);
+    header.stringPoolOffset = header.timetablesOffset + _timetables.size() * sizeof(uint16_t);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open " + path + " for writing.");
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection<GraphFormat::StationRecord>(out, stationRecords);
+    writeSection<GraphFormat::LineRecord>(out, lineRecords);
+    writeSection<GraphFormat::LineIdRecord>(out, lineIdRecords);
+    writeSection<GraphFormat::PatternRecord>(out, patternRecords);
+    writeSection(out, _patternStops);
+    writeSection(out, _timetables);
+    writeSection(out, _strings);
+    if (!out) {
+        throw std::runtime_error("Failed while writing binary graph file " + path + ".");
     }
-    std::cout << "Done!" << std::endl;
-    stopTimesFile.close();
+    LOG_INFO(Graph, "Wrote " << header.stationCount << " stations, " << header.lineCount << " lines, "
+        << header.timetableCount << " arrival times and " << header.patternCount << " line patterns to " << path << ".");
 }
@@ -1,95 +1,226 @@
 #pragma once
 #include "Utilities.hpp"
+#include "GraphFormat.h"
+#include "MappedFile.h"
+#include "SpatialIndex.h"
 #include <string>
+#include <string_view>
+#include <span>
 #include <vector>
 #include <unordered_map>
-
+#include <optional>
+
+/*
+* The transit network, stored in compressed-sparse-row form:
+* stations are renumbered to dense indices, every station's outgoing lines sit next to each other in one edge array,
+* line ids are interned, and names, ids and timetables live in flat pools.
+* Station and TransportationLine are lightweight views into those arrays, so they are cheap to copy and
+* stay valid for the lifetime of the graph. The graph is immutable once built.
+*/
 class Graph {
 public:
     enum class TransportMethod { Bus, Train, LightTrain, Walk };
 
+    // Where GraphCompiler writes the precompiled graph, and where the server looks for it on startup.
+    inline static const std::string DefaultBinaryGraphFile = "../GTFS/graph.bin";
+
+    // Where the GTFS text files (stops.txt and stop_times_filtered.txt) are parsed from by default.
+    inline static const std::string DefaultGTFSDirectory = "../GTFS/";
+    inline static const std::string GTFSStopsFileName = "stops.txt";
+    inline static const std::string GTFSLinesFileName = "stop_times_filtered.txt";
+
+    // Default search radius for stations near a user location, in km.
+    static constexpr double DefaultNearbyDistanceKm = 0.6;
+
     // Represents an edge to a destination station.
     struct TransportationLine {
-        std::string id;                 // Bus number. Is a string for cases where letters indicate different routes.
-        int to;                         // Destination station id.
-        double travelTime;              // Travel time (in minutes).
-        TransportMethod type;           // Type of the connection.
-        std::vector<int> arrivalTimes;  // Times of the day the bus arrives, in minutes since midnight. 0 is midnight, 90 is 1:30, etc.
+        std::string_view id;                // Bus number. Is a string for cases where letters indicate different routes.
+        int lineIndex;                      // Interned line id, -1 for lines that aren't part of the graph (walks, route start).
+        int to;                             // Destination station code.
+        int toIndex;                        // Dense index of the destination station, -1 if unknown.
+        double travelTime;                  // Travel time (in minutes).
+        TransportMethod type;               // Type of the connection.
+        std::span<const uint16_t> arrivalTimes; // Times of the day the bus arrives, in minutes since midnight. 0 is midnight, 90 is 1:30, etc. Sorted, no duplicates.
 
 
-        TransportationLine(const std::string& id, int to, double travelTime, TransportMethod type)
-            : id(id), to(to), travelTime(travelTime), type(type) {
+        TransportationLine(std::string_view id, int to, double travelTime, TransportMethod type)
+            : id(id), lineIndex(-1), to(to), toIndex(-1), travelTime(travelTime), type(type) {
         }
-        TransportationLine() : id(""), to(0), travelTime(0), type(TransportMethod::Bus) {}
+        TransportationLine() : id(""), lineIndex(-1), to(0), toIndex(-1), travelTime(0), type(TransportMethod::Bus) {}
 
         bool operator==(const TransportationLine& other) const {
             return this->id == other.id;
         }
+
+        // Returns the first arrival at or after a time (minutes since midnight), or -1 if there is none. O(log n).
+        int nextArrivalAtOrAfter(const double minutes) const;
     };
 
     // Represents a node (station) in the graph.
     struct Station {
-		int code;                               // Station code. Also the map key.
-        std::string name;                       // Station name.
-        Utilities::Coordinates coordinates;     // Station location.
-        std::vector<TransportationLine> lines;  // Lines going through the station.
-
-        Station(const int code, const std::string& name, const Utilities::Coordinates& coords)
-            : code(code), name(name), coordinates(coords) {
+		int code;                                       // Station code, as used by GTFS and the API.
+        int index;                                      // Dense index, position in the graph's station array.
+        std::string_view name;                          // Station name.
+        Utilities::Coordinates coordinates;             // Station location.
+        std::span<const TransportationLine> lines;      // Lines going through the station.
+
+        Station(const int code, const int index, std::string_view name, const Utilities::Coordinates& coords)
+            : code(code), index(index), name(name), coordinates(coords) {
         }
 
-        Station() : code(-1), name(""), coordinates() {}
+        Station() : code(-1), index(-1), name(""), coordinates() {}
 
         bool operator==(const Station& other) const {
             return this->code == other.code;
         }
     };
 
+    // Builds the graph by parsing the GTFS text files in DefaultGTFSDirectory.
     Graph();
+
+    /*
+    * Builds the graph by parsing the GTFS text files in a directory, updated by a delta feed when deltaDirectory
+    * isn't empty. The delta holds the same files, either may be missing: its stops add stations or replace them
+    * by code, and its stop times replace every row of the trips (by trip_id) they mention.
+    */
+    Graph(const std::string& gtfsDirectory, const std::string& deltaDirectory);
+
+    // Builds the graph from a precompiled binary graph file (see GraphFormat.h) without any text parsing.
+    // Names and timetables are served straight from the file mapping.
+    explicit Graph(const std::string& binaryGraphPath);
+
     ~Graph();
 
-    // Adds a station to the graph.
-    void addStation(const int code, const std::string& name, const Utilities::Coordinates& coords);
+    // Stations and lines point into the graph's own arrays, so a graph is never copied or moved.
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    // Writes the graph in the binary format read by Graph(binaryGraphPath).
+    void saveBinary(const std::string& path) const;
 
     // Returns the edges from a given station id.
-    const std::vector<TransportationLine>& getLinesFrom(const int stationCode) const;
+    std::span<const TransportationLine> getLinesFrom(const int stationCode) const;
+
+    // Returns the edges from a given dense station index.
+    std::span<const TransportationLine> getLinesFromIndex(const int stationIndex) const;
+
+    // Returns an edge by its position in the edge array.
+    const TransportationLine& getEdge(const int edgeIndex) const;
+
+    // Returns the position of an edge in the edge array, or -1 for lines that aren't part of the graph.
+    int getEdgeIndex(const TransportationLine& line) const;
+
+    // Checks if an edge leaves a given station.
+    bool isEdgeFrom(const int stationIndex, const int edgeIndex) const;
+
+    // Returns the number of edges.
+    size_t getEdgeCount() const;
 
     // Returns a station from the graph.
     const Station& getStationByCode(const int code) const;
 
+    // Returns a station by its dense index.
+    const Station& getStationByIndex(const int index) const;
+
+    // Returns the dense index of a station, or -1 if it doesn't exist.
+    int getStationIndex(const int code) const;
+
     // Checks if a certain station exists.
     bool hasStation(const int code) const;
 
     // Returns the size of the map.
     size_t getStationCount() const;
 
-    // Finds stations within maxNearbyDistance from given coords.
-    std::vector<Graph::Station> getNearbyStations(const Utilities::Coordinates& userCoords) const;
+    // Returns the number of distinct line ids.
+    size_t getLineIdCount() const;
+
+    // Returns the interned line id for a line index.
+    std::string_view getLineId(const int lineIndex) const;
+
+    // Returns the line index of a line id, or -1 if no line uses it.
+    int findLineIndex(std::string_view lineId) const;
+
+    // Finds stations within radiusKm from given coords, sorted by distance.
+    std::vector<Graph::Station> getNearbyStations(const Utilities::Coordinates& userCoords,
+        const double radiusKm = DefaultNearbyDistanceKm) const;
+
+    // Finds the k stations closest to given coords, sorted by distance. Never looks further than maxRadiusKm.
+    std::vector<Graph::Station> getNearestStations(const Utilities::Coordinates& userCoords,
+        const size_t k, const double maxRadiusKm) const;
 
     /*
-    * Finds stations between two stations that a certain line visits.
+    * Finds stations between two stations that a certain line visits, both included.
     * Used after the GA - that only outputs action stations (stations where an action has to be done, like start, end and line transfers) -
     * To show the route in a better way on the frontend.
+    * Returns just the start station if no pattern of the line goes from start to end.
     */
-    std::vector<Graph::Station> getStationsAlongLineSegment( 
-        const std::string& lineId,
+    std::vector<Graph::Station> getStationsAlongLineSegment(
+        std::string_view lineId,
         int segmentStartStationId,
         int segmentEndStationId) const;
 
+    /*
+    * Returns the dense station indices a line visits from one station to another, both included.
+    * Uses the shortest slice of the line's stop patterns (the distinct stop sequences its trips run) that passes
+    * through start and then end, so loops and branches come out right. Empty if no pattern does.
+    */
+    std::span<const int> getLineSegment(const int lineIndex, const int startIndex, const int endIndex) const;
+
+    // Returns the number of distinct line stop patterns.
+    size_t getPatternCount() const;
+
 private:
-    // Data parsers
-    void fetchAPIData();
-    void fetchGTFSStops();                   // Parses stops.txt to extract station code, name, and coordinates.
-    void fetchGTFSTransportationLines();     // Parses stop_files_filtered.txt to extract line stations and timings.
+    // Mutable staging area used while parsing GTFS, frozen into the flat arrays afterwards.
+    struct Builder;
 
-    // Grants a muteable reference to a station object from the map.
-    Station& getStationRefById(const int id);
+    // Data parsers
+    void fetchAPIData(const std::string& gtfsDirectory, const std::string& deltaDirectory);
+    void fetchGTFSStops(Builder& builder, const std::string& path, const bool replace) const;     // Parses stops.txt to extract station code, name, and coordinates.
+    void fetchGTFSTransportationLines(Builder& builder, const std::string& path,
+        const std::string& deltaPath) const;                                                        // Parses stop_times_filtered.txt to extract line stations and timings.
+    void loadBinary(const std::string& path);
+
+    // Turns the parsed stations into records and owned pools, then builds the views over them.
+    void freeze(Builder& builder);
+
+    // Builds the station/line/pattern views over a set of records. Validates every offset against the pools.
+    void buildViews(std::span<const GraphFormat::StationRecord> stationRecords,
+        std::span<const GraphFormat::LineRecord> lineRecords,
+        std::span<const GraphFormat::LineIdRecord> lineIdRecords,
+        std::span<const GraphFormat::PatternRecord> patternRecords);
+
+    // A distinct stop sequence of a line.
+    struct LinePattern {
+        int lineIndex;
+        std::span<const int> stops;     // Dense station indices, in visiting order.
+    };
 
-    const std::string GTFSPath = "../GTFS/";
-	const std::string GTFSStopsFile = GTFSPath + "stops.txt";
-	const std::string GTFSLinesFile = GTFSPath + "stop_times_filtered.txt";
+    // One visit of a station by a pattern.
+    struct PatternVisit {
+        int pattern;                    // Position in _patterns.
+        int position;                   // Position of the station in the pattern's stops.
 
-	const double maxNearbyDistance = 0.6; // km
+        bool operator<(const PatternVisit& other) const {
+            return pattern != other.pattern ? pattern < other.pattern : position < other.position;
+        }
+    };
 
-    std::unordered_map<int, Station> _map;
+    std::vector<Station> _stations;                         // Indexed by dense station index, sorted by code.
+    std::unordered_map<int, int> _codeToIndex;              // Station code -> dense index.
+    std::vector<TransportationLine> _lines;                 // All edges, grouped by source station.
+    std::vector<std::string_view> _lineIds;                 // Interned line ids, indexed by lineIndex.
+    std::unordered_map<std::string_view, int> _lineIdToIndex;
+    SpatialIndex _spatialIndex;                             // Station coordinates, by dense index.
+    std::vector<LinePattern> _patterns;
+    std::vector<PatternVisit> _visits;                      // Grouped by station, sorted within a station.
+    std::vector<uint32_t> _firstVisit;                      // Dense index -> first of its _visits, plus an end sentinel.
+
+    // Pools the views point into. They either reference the owned vectors below or the mapped binary file.
+    std::span<const char> _strings;
+    std::span<const uint16_t> _timetables;
+    std::span<const int> _patternStops;
+    std::vector<char> _ownedStrings;
+    std::vector<uint16_t> _ownedTimetables;
+    std::vector<int> _ownedPatternStops;
+    std::optional<MappedFile> _mappedFile;
 };
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+
+/*
+* On-disk layout of a precompiled graph file (graph.bin).
+* Written offline by GraphCompiler and memory-mapped by Graph at startup, so every record is plain data
+* with explicit padding. The file is a header followed by seven sections, each located by its offset:
+*   stations     - StationRecord[stationCount], sorted by station code. A station's position is its dense index.
+*   lines        - LineRecord[lineCount], grouped by source station (StationRecord::firstLine/lineCount).
+*   lineIds      - LineIdRecord[lineIdCount], the interned line ids referenced by LineRecord::lineIndex.
+*   patterns     - PatternRecord[patternCount], the distinct stop sequences each line's trips follow.
+*   patternStops - int32_t[patternStopCount], dense station indices referenced by the patterns.
+*   timetables   - uint16_t[timetableCount], arrival times (minutes since midnight) referenced by the lines.
+*                  Each line's times are sorted ascending without duplicates, so lookups can binary search them.
+*   strings      - char[stringPoolSize], station names and line ids (not null terminated).
+* Integers are stored in native (little-endian) byte order.
+* The same records are used in memory while building a graph, so both load paths share one code path.
+*/
+namespace GraphFormat {
+
+    constexpr char Magic[8] = { 'R', 'T', 'F', 'Y', 'G', 'R', 'P', 'H' };
+
+    // Bump whenever a record layout or section meaning changes. Older files are rejected, not migrated.
+    constexpr uint32_t Version = 4;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t stationCount;
+        uint32_t lineCount;
+        uint32_t lineIdCount;
+        uint32_t timetableCount;
+        uint32_t stringPoolSize;
+        uint32_t patternCount;
+        uint32_t patternStopCount;
+        uint64_t stationsOffset;
+        uint64_t linesOffset;
+        uint64_t lineIdsOffset;
+        uint64_t timetablesOffset;
+        uint64_t patternsOffset;
+        uint64_t patternStopsOffset;
+        uint64_t stringPoolOffset;
+    };
+
+    struct StationRecord {
+        int32_t code;
+        uint32_t nameOffset;        // Into the string pool.
+        uint32_t nameLength;
+        uint32_t firstLine;         // Index of the station's first LineRecord.
+        double latitude;
+        double longitude;
+        uint32_t lineCount;
+        uint32_t reserved;
+    };
+
+    struct LineRecord {
+        uint32_t lineIndex;         // Into the lineIds section.
+        int32_t to;                 // Destination station code.
+        int32_t toIndex;            // Dense index of the destination station, -1 if it isn't in the graph.
+        uint32_t type;              // Graph::TransportMethod.
+        double travelTime;
+        uint32_t timetableOffset;   // Index of the first arrival time.
+        uint32_t timetableCount;
+    };
+
+    struct LineIdRecord {
+        uint32_t offset;            // Into the string pool.
+        uint32_t length;
+    };
+
+    struct PatternRecord {
+        uint32_t lineIndex;         // Into the lineIds section.
+        uint32_t firstStop;         // Index of the pattern's first stop in the patternStops section.
+        uint32_t stopCount;
+    };
+
+    static_assert(sizeof(FileHeader) == 96, "FileHeader layout changed, bump Version");
+    static_assert(sizeof(StationRecord) == 40, "StationRecord layout changed, bump Version");
+    static_assert(sizeof(LineRecord) == 32, "LineRecord layout changed, bump Version");
+    static_assert(sizeof(LineIdRecord) == 8, "LineIdRecord layout changed, bump Version");
+    static_assert(sizeof(PatternRecord) == 12, "PatternRecord layout changed, bump Version");
+
+} // namespace GraphFormat
@@ -0,0 +1,127 @@
+#include "HubLabelRoutingEngine.h"
+#include "TimetableRoutingEngine.h"
+#include "Utilities.hpp"
+#include "Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+static_assert(HubLabels::WalkEdge == Route::VisitedStation::WalkEdge, "Hub label walks must use Route's walk edge");
+static_assert(HubLabels::MaxWalkKm == TimetableRoutingEngine::MaxTransferWalkKm, "Hub labels walk as far as transfers do");
+
+namespace {
+    // Label times are floats summed along the path, the edge that continues it can be off by rounding.
+    bool continuesPath(const float candidate, const float best) {
+        return candidate <= best + 1e-3f + 1e-5f * best;
+    }
+
+    /*
+    * Unrolls the fastest static path from one station to another. Every step takes the edge minimizing its time
+    * plus the labelled time of the rest, so each hop costs one label merge per edge of the current station.
+    */
+    bool unrollPath(const HubLabels& labels, const int fromIndex, const int toIndex, const Graph& graph, Route& route) {
+        struct Candidate {
+            int toIndex;
+            int edgeIndex;
+            float minutes;
+        };
+        std::vector<Candidate> candidates;
+
+        route.addVisitedStation(Route::VisitedStation(fromIndex, Route::VisitedStation::StartEdge, -1));
+        int current = fromIndex;
+        int currentLine = -1;
+        for (size_t steps = 0; current != toIndex; ++steps) {
+            if (steps > graph.getStationCount()) return false; // Safety against rounding loops
+
+            candidates.clear();
+            float best = std::numeric_limits<float>::infinity();
+            HubLabels::forEachEdge(graph, current, [&](const int next, const int edgeIndex, const float edgeMinutes) {
+                const float minutes = std::max(edgeMinutes, HubLabels::MinEdgeMinutes) + labels.getMinutes(next, toIndex);
+                if (std::isinf(minutes)) return;
+                candidates.push_back(Candidate{ next, edgeIndex, minutes });
+                best = std::min(best, minutes);
+            });
+            if (candidates.empty()) return false;
+
+            // Ties are common where lines share stops, staying on board saves a transfer.
+            const Candidate* chosen = nullptr;
+            for (const Candidate& candidate : candidates) {
+                if (!continuesPath(candidate.minutes, best)) continue;
+                const int line = candidate.edgeIndex >= 0 ? graph.getEdge(candidate.edgeIndex).lineIndex : -1;
+                if (!chosen || (line != -1 && line == currentLine)) chosen = &candidate;
+                if (line != -1 && line == currentLine) break;
+            }
+
+            route.addVisitedStation(Route::VisitedStation(chosen->toIndex, chosen->edgeIndex, current));
+            currentLine = chosen->edgeIndex >= 0 ? graph.getEdge(chosen->edgeIndex).lineIndex : -1;
+            current = chosen->toIndex;
+        }
+        return true;
+    }
+}
+
+std::optional<RoutingEngine::Result> HubLabelRoutingEngine::findBestRoute(
+    const std::vector<Graph::Station>& startStations,
+    const Graph::Station& endStation,
+    const Params& params,
+    const Graph& graph) const
+{
+    const std::shared_ptr<const Attachment> attachment = _attachment.load();
+    if (!attachment || attachment->graph != &graph) {
+        throw std::runtime_error("No hub labels are loaded for the current graph.");
+    }
+    const HubLabels& labels = *attachment->labels;
+
+    const int endIndex = graph.getStationIndex(endStation.code);
+    if (endIndex < 0 || startStations.empty()) return std::nullopt;
+
+    // The walk to each start station counts, like in the timetable search.
+    const Graph::Station* bestStart = nullptr;
+    double bestMinutes = std::numeric_limits<double>::infinity();
+    for (const Graph::Station& start : startStations) {
+        const double walk = Utilities::calculateHaversineDistance(params.startCoords, start.coordinates) /
+            Utilities::WALK_SPEED_KPH * 60.0;
+        const double minutes = walk + labels.getMinutes(start.index, endIndex);
+        if (minutes < bestMinutes) {
+            bestMinutes = minutes;
+            bestStart = &start;
+        }
+    }
+    if (!bestStart) {
+        LOG_DEBUG(Hub, "Hub labels connect no start station to station " << endStation.code << ".");
+        return std::nullopt;
+    }
+
+    Result result;
+    if (!unrollPath(labels, bestStart->index, endIndex, graph, result.route)) {
+        LOG_WARNING(Hub, "Failed to unroll the labelled path " << bestStart->code << " -> " << endStation.code << ".");
+        return std::nullopt;
+    }
+    result.startStationCode = bestStart->code;
+    result.endStationId = endStation.code;
+    result.fitness = result.route.getFitness(result.startStationCode, result.endStationId, graph,
+        params.startCoords, params.endCoords, params.departureTime);
+    LOG_DEBUG(Hub, "Hub labels routed " << bestStart->code << " -> " << endStation.code << " in "
+        << result.route.getVisitedStations().size() << " stops, about " << bestMinutes << " minutes.");
+    return result;
+}
+
+void HubLabelRoutingEngine::setLabels(std::shared_ptr<const HubLabels> labels, const Graph& graph) {
+    if (!labels) {
+        throw std::invalid_argument("Cannot set empty hub labels.");
+    }
+    if (!labels->isFor(graph)) {
+        throw std::invalid_argument("Hub labels were built from another graph.");
+    }
+    _attachment.store(std::make_shared<const Attachment>(Attachment{ std::move(labels), &graph }));
+}
+
+void HubLabelRoutingEngine::clearLabels() {
+    _attachment.store(nullptr);
+}
+
+bool HubLabelRoutingEngine::hasLabelsFor(const Graph& graph) const {
+    const std::shared_ptr<const Attachment> attachment = _attachment.load();
+    return attachment && attachment->graph == &graph;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "RoutingEngine.h"
+#include "HubLabels.h"
+#include <atomic>
+#include <memory>
+
+/*
+* Answers route requests from precomputed hub labels (see HubLabels.h) instead of searching.
+* The start station is picked by its walk plus its labelled time to the end station, and the route is unrolled
+* one stop at a time by taking the edge whose time plus the labelled rest equals the remaining time, preferring
+* to stay on the previous line. Fast for trips of any length, but blind to timetables.
+*/
+class HubLabelRoutingEngine : public RoutingEngine {
+public:
+    // Throws std::runtime_error if no labels are set for this graph.
+    std::optional<Result> findBestRoute(
+        const std::vector<Graph::Station>& startStations,
+        const Graph::Station& endStation,
+        const Params& params,
+        const Graph& graph) const override;
+
+    // Uses labels for a graph. Throws std::invalid_argument if they were built from another graph.
+    void setLabels(std::shared_ptr<const HubLabels> labels, const Graph& graph);
+
+    // Drops the labels. Called when the graph is swapped.
+    void clearLabels();
+
+    // Checks if labels are set for this graph.
+    bool hasLabelsFor(const Graph& graph) const;
+
+private:
+    // The labels and the graph they were checked against, replaced as a whole so readers never see a mix.
+    struct Attachment {
+        std::shared_ptr<const HubLabels> labels;
+        const Graph* graph;
+    };
+
+    std::atomic<std::shared_ptr<const Attachment>> _attachment;
+};
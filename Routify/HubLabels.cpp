@@ -0,0 +1,364 @@
+#include "HubLabels.h"
+#include "Logger.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr float Infinity = std::numeric_limits<float>::infinity();
+
+    using Adjacency = std::vector<std::vector<std::pair<int, float>>>;
+
+    // Stations whose shortest path trees decide the hub order.
+    constexpr int RankingSamples = 64;
+
+    // Returns a typed view of a section of the mapping, after checking it lies inside the file.
+    template <typename T>
+    std::span<const T> sectionAt(const MappedFile& file, uint64_t offset, uint64_t count, const char* sectionName) {
+        if (offset > file.size() || count > (file.size() - offset) / sizeof(T)) {
+            throw std::runtime_error(std::string("Hub label file is truncated (section: ") + sectionName + ").");
+        }
+        return std::span<const T>(reinterpret_cast<const T*>(file.data() + offset), static_cast<size_t>(count));
+    }
+
+    template <typename T>
+    void writeSection(std::ofstream& out, std::span<const T> section) {
+        out.write(reinterpret_cast<const char*>(section.data()), section.size() * sizeof(T));
+    }
+
+    // Keeps the shortest of parallel edges, several lines often serve the same pair of stops.
+    void deduplicate(std::vector<std::pair<int, float>>& edges) {
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end(),
+            [](const auto& a, const auto& b) { return a.first == b.first; }), edges.end());
+    }
+
+    /*
+    * Pruned Dijkstra from one hub. Every station it settles gets a label entry for the hub, unless the labels
+    * built so far already give a path at least as short, in which case its subtree isn't explored either.
+    * hubMinutes holds the hub's own opposite label by hub rank, so the pruning test is one pass over a label.
+    */
+    void prunedSearch(const int hub, const uint32_t rank, const Adjacency& edges,
+        std::vector<std::vector<HubLabels::Entry>>& labels, std::vector<float>& hubMinutes,
+        std::vector<float>& minutes, std::vector<int>& touched)
+    {
+        using QueueItem = std::pair<float, int>;
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+        minutes[hub] = 0.0f;
+        touched.push_back(hub);
+        queue.push({ 0.0f, hub });
+
+        while (!queue.empty()) {
+            const auto [time, station] = queue.top();
+            queue.pop();
+            if (time > minutes[station]) continue;
+
+            bool covered = false;
+            for (const HubLabels::Entry& entry : labels[station]) {
+                if (hubMinutes[entry.hub] + entry.minutes <= time) {
+                    covered = true;
+                    break;
+                }
+            }
+            if (covered) continue;
+            labels[station].push_back(HubLabels::Entry{ rank, time });
+
+            for (const auto& [next, edgeMinutes] : edges[station]) {
+                const float nextTime = time + edgeMinutes;
+                if (nextTime < minutes[next]) {
+                    if (minutes[next] == Infinity) touched.push_back(next);
+                    minutes[next] = nextTime;
+                    queue.push({ nextTime, next });
+                }
+            }
+        }
+
+        for (const int station : touched) minutes[station] = Infinity;
+        touched.clear();
+    }
+
+    /*
+    * Orders stations by how many shortest paths run through them, estimated from the shortest path trees of a
+    * sample of stations: a station's score is the size of its subtrees. Hubs that cover many paths first keep
+    * every later label short, degree alone does poorly once walks make the network grid-like.
+    */
+    std::vector<int> rankStations(const Adjacency& forward) {
+        const int stationCount = static_cast<int>(forward.size());
+        std::vector<double> coverage(stationCount, 0.0);
+        std::vector<float> minutes(stationCount);
+        std::vector<int> parent(stationCount);
+        std::vector<int> settled;
+        std::vector<double> descendants(stationCount);
+        std::mt19937 gen(0x48554253); // Fixed, so the same graph always gets the same labels
+
+        const int samples = std::min(stationCount, RankingSamples);
+        for (int sample = 0; sample < samples; ++sample) {
+            const int root = static_cast<int>(gen() % stationCount);
+            std::fill(minutes.begin(), minutes.end(), Infinity);
+            settled.clear();
+
+            using QueueItem = std::pair<float, int>;
+            std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+            minutes[root] = 0.0f;
+            parent[root] = -1;
+            queue.push({ 0.0f, root });
+            while (!queue.empty()) {
+                const auto [time, station] = queue.top();
+                queue.pop();
+                if (time > minutes[station]) continue;
+                settled.push_back(station);
+                for (const auto& [next, edgeMinutes] : forward[station]) {
+                    if (time + edgeMinutes < minutes[next]) {
+                        minutes[next] = time + edgeMinutes;
+                        parent[next] = station;
+                        queue.push({ minutes[next], next });
+                    }
+                }
+            }
+
+            // Stations settle after their parent, so one reverse pass sums every subtree.
+            for (const int station : settled) descendants[station] = 1.0;
+            for (auto it = settled.rbegin(); it != settled.rend(); ++it) {
+                coverage[*it] += descendants[*it];
+                if (parent[*it] >= 0) descendants[parent[*it]] += descendants[*it];
+            }
+        }
+
+        std::vector<int> order(stationCount);
+        for (int station = 0; station < stationCount; ++station) order[station] = station;
+        std::stable_sort(order.begin(), order.end(), [&](const int a, const int b) {
+            if (coverage[a] != coverage[b]) return coverage[a] > coverage[b];
+            return forward[a].size() > forward[b].size();
+        });
+        return order;
+    }
+
+    // Concatenates per-station labels into one entry array and its offsets.
+    void flatten(std::vector<std::vector<HubLabels::Entry>>& labels, std::vector<uint32_t>& first,
+        std::vector<HubLabels::Entry>& entries)
+    {
+        size_t total = 0;
+        for (const auto& label : labels) total += label.size();
+        if (total > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Hub labels have too many entries for the file format.");
+        }
+
+        first.clear();
+        first.reserve(labels.size() + 1);
+        entries.clear();
+        entries.reserve(total);
+        for (auto& label : labels) {
+            first.push_back(static_cast<uint32_t>(entries.size()));
+            entries.insert(entries.end(), label.begin(), label.end());
+            std::vector<HubLabels::Entry>().swap(label);
+        }
+        first.push_back(static_cast<uint32_t>(entries.size()));
+    }
+}
+
+HubLabels::HubLabels(const Graph& graph)
+    : _stationCount(static_cast<uint32_t>(graph.getStationCount())), _graphFingerprint(fingerprint(graph))
+{
+    const int stationCount = static_cast<int>(_stationCount);
+    Adjacency forward(stationCount);
+    Adjacency backward(stationCount);
+    for (int station = 0; station < stationCount; ++station) {
+        forEachEdge(graph, station, [&](const int to, int, const float minutes) {
+            forward[station].emplace_back(to, std::max(minutes, MinEdgeMinutes));
+        });
+        deduplicate(forward[station]);
+        for (const auto& [to, minutes] : forward[station]) backward[to].emplace_back(station, minutes);
+    }
+
+    const std::vector<int> order = rankStations(forward);
+
+    std::vector<std::vector<Entry>> outLabels(stationCount);
+    std::vector<std::vector<Entry>> inLabels(stationCount);
+    std::vector<float> hubMinutes(stationCount, Infinity);
+    std::vector<float> minutes(stationCount, Infinity);
+    std::vector<int> touched;
+
+    for (int rank = 0; rank < stationCount; ++rank) {
+        const int hub = order[rank];
+
+        // Forward search: minutes from the hub, which go into in labels and are pruned against the hub's out label.
+        for (const Entry& entry : outLabels[hub]) hubMinutes[entry.hub] = entry.minutes;
+        prunedSearch(hub, static_cast<uint32_t>(rank), forward, inLabels, hubMinutes, minutes, touched);
+        for (const Entry& entry : outLabels[hub]) hubMinutes[entry.hub] = Infinity;
+
+        // Backward search: minutes to the hub, the other way around.
+        for (const Entry& entry : inLabels[hub]) hubMinutes[entry.hub] = entry.minutes;
+        prunedSearch(hub, static_cast<uint32_t>(rank), backward, outLabels, hubMinutes, minutes, touched);
+        for (const Entry& entry : inLabels[hub]) hubMinutes[entry.hub] = Infinity;
+
+        if (stationCount >= 10 && (rank + 1) % (stationCount / 10) == 0) {
+            LOG_INFO(Hub, "Hub labels: processed " << (rank + 1) << " of " << stationCount << " stations.");
+        }
+    }
+
+    flatten(outLabels, _ownedOutFirst, _ownedOutEntries);
+    flatten(inLabels, _ownedInFirst, _ownedInEntries);
+    _outFirst = _ownedOutFirst;
+    _inFirst = _ownedInFirst;
+    _outEntries = _ownedOutEntries;
+    _inEntries = _ownedInEntries;
+    LOG_INFO(Hub, "Built " << getEntryCount() << " hub label entries for " << _stationCount << " stations ("
+        << static_cast<double>(getEntryCount()) / std::max<uint32_t>(_stationCount, 1) << " per station).");
+}
+
+HubLabels::HubLabels(const std::string& path) {
+    MappedFile& file = _mappedFile.emplace(path);
+
+    if (file.size() < sizeof(FileHeader)) {
+        throw std::runtime_error("Hub label file " + path + " is too small to hold a header.");
+    }
+    FileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+        throw std::runtime_error(path + " is not a hub label file.");
+    }
+    if (header.version != Version) {
+        throw std::runtime_error("Hub label file " + path + " has version " + std::to_string(header.version) +
+            ", expected " + std::to_string(Version) + ". Rerun GraphCompiler.");
+    }
+
+    _stationCount = header.stationCount;
+    _graphFingerprint = header.graphFingerprint;
+    _outFirst = sectionAt<uint32_t>(file, header.outFirstOffset, uint64_t(header.stationCount) + 1, "outFirst");
+    _inFirst = sectionAt<uint32_t>(file, header.inFirstOffset, uint64_t(header.stationCount) + 1, "inFirst");
+    _outEntries = sectionAt<Entry>(file, header.outEntriesOffset, header.outEntryCount, "outEntries");
+    _inEntries = sectionAt<Entry>(file, header.inEntriesOffset, header.inEntryCount, "inEntries");
+    validate();
+    LOG_INFO(Hub, "Loaded " << getEntryCount() << " hub label entries for " << _stationCount
+        << " stations from " << path << ".");
+}
+
+void HubLabels::save(const std::string& path) const {
+    FileHeader header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.stationCount = _stationCount;
+    header.graphFingerprint = _graphFingerprint;
+    header.outEntryCount = _outEntries.size();
+    header.inEntryCount = _inEntries.size();
+    header.outFirstOffset = sizeof(FileHeader);
+    header.inFirstOffset = header.outFirstOffset + _outFirst.size() * sizeof(uint32_t);
+    header.outEntriesOffset = header.inFirstOffset + _inFirst.size() * sizeof(uint32_t);
+    header.inEntriesOffset = header.outEntriesOffset + _outEntries.size() * sizeof(Entry);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open " + path + " for writing.");
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(out, _outFirst);
+    writeSection(out, _inFirst);
+    writeSection(out, _outEntries);
+    writeSection(out, _inEntries);
+    if (!out) {
+        throw std::runtime_error("Failed while writing hub label file " + path + ".");
+    }
+    LOG_INFO(Hub, "Wrote " << getEntryCount() << " hub label entries to " << path << ".");
+}
+
+void HubLabels::validate() const {
+    auto check = [this](std::span<const uint32_t> first, std::span<const Entry> entries, const char* name) {
+        if (first.front() != 0 || first.back() != entries.size()) {
+            throw std::runtime_error(std::string("Hub label offsets don't cover the entries (") + name + ").");
+        }
+        for (size_t i = 0; i + 1 < first.size(); ++i) {
+            if (first[i] > first[i + 1]) {
+                throw std::runtime_error(std::string("Hub label offsets aren't sorted (") + name + ").");
+            }
+            for (uint32_t e = first[i]; e < first[i + 1]; ++e) {
+                if (entries[e].hub >= _stationCount || (e > first[i] && entries[e].hub <= entries[e - 1].hub)) {
+                    throw std::runtime_error(std::string("Hub label entries are out of order (") + name + ").");
+                }
+            }
+        }
+    };
+    check(_outFirst, _outEntries, "out");
+    check(_inFirst, _inEntries, "in");
+}
+
+bool HubLabels::isFor(const Graph& graph) const {
+    return graph.getStationCount() == _stationCount && fingerprint(graph) == _graphFingerprint;
+}
+
+float HubLabels::getMinutes(const int fromIndex, const int toIndex) const {
+    if (fromIndex < 0 || toIndex < 0 || static_cast<uint32_t>(fromIndex) >= _stationCount ||
+        static_cast<uint32_t>(toIndex) >= _stationCount) {
+        return Infinity;
+    }
+    if (fromIndex == toIndex) return 0.0f;
+
+    // Both labels are sorted by hub rank, so their common hubs are found in one merge.
+    const std::span<const Entry> out = outLabel(fromIndex);
+    const std::span<const Entry> in = inLabel(toIndex);
+    float best = Infinity;
+    size_t i = 0, j = 0;
+    while (i < out.size() && j < in.size()) {
+        if (out[i].hub < in[j].hub) ++i;
+        else if (out[i].hub > in[j].hub) ++j;
+        else {
+            best = std::min(best, out[i].minutes + in[j].minutes);
+            ++i;
+            ++j;
+        }
+    }
+    return best;
+}
+
+size_t HubLabels::getEntryCount() const {
+    return _outEntries.size() + _inEntries.size();
+}
+
+uint64_t HubLabels::fingerprint(const Graph& graph) {
+    // FNV-1a over the station codes and coordinates and the edges' endpoints and lines. The coordinates set the
+    // ride and walk minutes and which walks exist, so moved stops need new labels too.
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](const int64_t value) {
+        for (int shift = 0; shift < 64; shift += 8) {
+            hash ^= static_cast<uint64_t>(value >> shift) & 0xFF;
+            hash *= 0x100000001b3ull;
+        }
+    };
+    mix(static_cast<int64_t>(graph.getStationCount()));
+    mix(static_cast<int64_t>(graph.getEdgeCount()));
+    for (size_t i = 0; i < graph.getStationCount(); ++i) {
+        const Graph::Station& station = graph.getStationByIndex(static_cast<int>(i));
+        mix(station.code);
+        mix(std::bit_cast<int64_t>(station.coordinates.latitude));
+        mix(std::bit_cast<int64_t>(station.coordinates.longitude));
+        for (const Graph::TransportationLine& line : station.lines) {
+            mix(line.toIndex);
+            mix(line.lineIndex);
+        }
+    }
+    return hash;
+}
+
+float HubLabels::rideMinutes(const Graph::Station& from, const Graph::Station& to) {
+    const double distance = Utilities::calculateHaversineDistance(from.coordinates, to.coordinates);
+    return static_cast<float>(distance / Utilities::ASSUMED_PUBLIC_TRANSPORT_SPEED_KPH * 60.0);
+}
+
+float HubLabels::walkMinutes(const Graph::Station& from, const Graph::Station& to) {
+    const double distance = Utilities::calculateHaversineDistance(from.coordinates, to.coordinates);
+    return static_cast<float>(distance / Utilities::WALK_SPEED_KPH * 60.0);
+}
+
+std::span<const HubLabels::Entry> HubLabels::outLabel(const int stationIndex) const {
+    return _outEntries.subspan(_outFirst[stationIndex], _outFirst[stationIndex + 1] - _outFirst[stationIndex]);
+}
+
+std::span<const HubLabels::Entry> HubLabels::inLabel(const int stationIndex) const {
+    return _inEntries.subspan(_inFirst[stationIndex], _inFirst[stationIndex + 1] - _inFirst[stationIndex]);
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "Graph.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+* Precomputed shortest-path distance labels (pruned landmark labeling) over a static version of the network.
+* Riding an edge costs its estimated time at ASSUMED_PUBLIC_TRANSPORT_SPEED_KPH and walking to a station within
+* MaxWalkKm costs its time at WALK_SPEED_KPH, the same estimates Route scores with; timetables are ignored.
+* Every station gets an out label (distances to hubs) and an in label (distances from hubs), so the distance
+* between two stations is one merge of two short sorted lists.
+* Built offline by GraphCompiler next to the binary graph, and memory-mapped by the server like the graph.
+*/
+class HubLabels {
+public:
+    // Where GraphCompiler writes the labels of the default graph, and where the server looks for them on startup.
+    inline static const std::string DefaultHubLabelFile = "../GTFS/graph.hubs";
+
+    static constexpr char Magic[8] = { 'R', 'T', 'F', 'Y', 'H', 'U', 'B', 'S' };
+    static constexpr uint32_t Version = 2;
+
+    // Shortest time an edge is given, so no path has a zero-length cycle.
+    static constexpr float MinEdgeMinutes = 0.01f;
+
+    // Longest walk between two stations (km), and the edge index walks get. The same as TimetableRoutingEngine's
+    // transfer walks and Route::VisitedStation::WalkEdge; kept here so GraphCompiler doesn't need the engines.
+    static constexpr double MaxWalkKm = 0.4;
+    static constexpr int WalkEdge = -2;
+
+    // A hub and the estimated minutes between it and the label's station. Labels are sorted by hub rank.
+    struct Entry {
+        uint32_t hub;
+        float minutes;
+    };
+
+    // Builds the labels of a graph. Takes seconds to minutes depending on the network size.
+    explicit HubLabels(const Graph& graph);
+
+    // Maps labels written by save. Throws std::runtime_error if the file is missing, truncated or of another version.
+    explicit HubLabels(const std::string& path);
+
+    HubLabels(const HubLabels&) = delete;
+    HubLabels& operator=(const HubLabels&) = delete;
+
+    void save(const std::string& path) const;
+
+    // Checks if the labels were built from this graph (same stations and edges).
+    bool isFor(const Graph& graph) const;
+
+    // Estimated minutes of the fastest static path between two dense station indices, infinity if there is none.
+    float getMinutes(const int fromIndex, const int toIndex) const;
+
+    // Returns the total number of label entries, out and in.
+    size_t getEntryCount() const;
+
+    // Hash of the stations and edges of a graph, stored in the file to catch labels of another graph.
+    static uint64_t fingerprint(const Graph& graph);
+
+    /*
+    * Calls visit(toIndex, edgeIndex, minutes) for every static edge leaving a station: one per ride edge
+    * (edgeIndex >= 0) and one per other station within MaxWalkKm (edgeIndex WalkEdge).
+    */
+    template <typename Visit>
+    static void forEachEdge(const Graph& graph, const int stationIndex, Visit&& visit);
+
+private:
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t stationCount;
+        uint64_t graphFingerprint;
+        uint64_t outEntryCount;
+        uint64_t inEntryCount;
+        uint64_t outFirstOffset;
+        uint64_t inFirstOffset;
+        uint64_t outEntriesOffset;
+        uint64_t inEntriesOffset;
+    };
+    static_assert(sizeof(FileHeader) == 72, "FileHeader layout changed, bump Version");
+    static_assert(sizeof(Entry) == 8, "Entry layout changed, bump Version");
+
+    static float rideMinutes(const Graph::Station& from, const Graph::Station& to);
+    static float walkMinutes(const Graph::Station& from, const Graph::Station& to);
+
+    // Checks that the label offsets are consistent with the entry arrays.
+    void validate() const;
+
+    std::span<const Entry> outLabel(const int stationIndex) const;
+    std::span<const Entry> inLabel(const int stationIndex) const;
+
+    uint32_t _stationCount = 0;
+    uint64_t _graphFingerprint = 0;
+
+    // Per station i, its entries are [first[i], first[i + 1]). Point into the owned vectors or the mapped file.
+    std::span<const uint32_t> _outFirst;
+    std::span<const uint32_t> _inFirst;
+    std::span<const Entry> _outEntries;
+    std::span<const Entry> _inEntries;
+    std::vector<uint32_t> _ownedOutFirst;
+    std::vector<uint32_t> _ownedInFirst;
+    std::vector<Entry> _ownedOutEntries;
+    std::vector<Entry> _ownedInEntries;
+    std::optional<MappedFile> _mappedFile;
+};
+
+template <typename Visit>
+void HubLabels::forEachEdge(const Graph& graph, const int stationIndex, Visit&& visit) {
+    const Graph::Station& station = graph.getStationByIndex(stationIndex);
+    for (const Graph::TransportationLine& line : station.lines) {
+        if (line.toIndex < 0 || line.toIndex == stationIndex) continue;
+        visit(line.toIndex, graph.getEdgeIndex(line), rideMinutes(station, graph.getStationByIndex(line.toIndex)));
+    }
+    for (const Graph::Station& nearby : graph.getNearbyStations(station.coordinates, MaxWalkKm)) {
+        if (nearby.index == stationIndex) continue;
+        visit(nearby.index, WalkEdge, walkMinutes(station, nearby));
+    }
+}
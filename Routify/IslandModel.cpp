@@ -0,0 +1,161 @@
+#include "IslandModel.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <future>
+#include <limits>
+#include <stdexcept>
+
+IslandModel::IslandModel(const Settings& settings, const int totalSize, const int startId, const int destinationId,
+    const Graph& graph,
+    const Utilities::Coordinates& userCoords,
+    const Utilities::Coordinates& destCoords,
+    const double departureTime,
+    const std::vector<Route>& seedRoutes,
+    const std::optional<uint64_t> seed,
+    const CancellationToken& cancellation)
+    : _settings(settings), _startId(startId), _destinationId(destinationId), _graph(graph),
+    _userCoords(userCoords), _destCoords(destCoords), _departureTime(departureTime)
+{
+    if (settings.islandCount < 1 || settings.islandCount > MaxIslands) {
+        throw std::invalid_argument("Island count must be between 1 and " + std::to_string(MaxIslands) + ".");
+    }
+    if (settings.migrationInterval <= 0 || settings.migrantCount < 0) {
+        throw std::invalid_argument("Migration interval must be positive and migrant count non-negative.");
+    }
+    if (totalSize < 2 * settings.islandCount) {
+        throw std::invalid_argument("Population is too small for " + std::to_string(settings.islandCount) + " islands.");
+    }
+
+    _islands.reserve(settings.islandCount);
+    for (int i = 0; i < settings.islandCount; ++i) {
+        // Spread the remainder over the first islands.
+        const int size = totalSize / settings.islandCount + (i < totalSize % settings.islandCount ? 1 : 0);
+        std::optional<uint64_t> islandSeed;
+        if (seed) islandSeed = Population::deriveSeed(*seed, static_cast<uint64_t>(i));
+        _islands.emplace_back(size, startId, destinationId, graph, userCoords, destCoords, departureTime, seedRoutes, islandSeed, cancellation);
+    }
+    LOG_DEBUG(Genetic, "Created " << _islands.size() << " islands for pair (" << startId << " -> " << destinationId << ").");
+}
+
+Population::EvolveOutcome IslandModel::evolve(const int generations, const double mutationRate,
+    const Population::StopCriteria& criteria, const Executor::Priority priority)
+{
+    Population::EvolveOutcome outcome;
+    Executor& executor = Executor::shared();
+    const uint64_t group = Executor::newGroup();
+
+    // Islands only watch the deadline, the token and the target, stalling is judged across all of them below.
+    // An island meeting the target cancels the shared token, which stops the others too.
+    Population::StopCriteria islandCriteria;
+    islandCriteria.deadline = criteria.deadline;
+    islandCriteria.cancellation = criteria.cancellation;
+    islandCriteria.targetMinutes = criteria.targetMinutes;
+
+    double bestSoFar = getBestFitness();
+    int stalledGenerations = 0;
+
+    while (outcome.generationsRun < generations) {
+        const int epoch = std::min(_settings.migrationInterval, generations - outcome.generationsRun);
+
+        std::vector<std::future<Population::EvolveOutcome>> futures;
+        futures.reserve(_islands.size());
+        for (Population& island : _islands) {
+            futures.push_back(executor.submit(
+                [&island, epoch, mutationRate, &islandCriteria]() { return island.evolve(epoch, mutationRate, islandCriteria); },
+                priority, group));
+        }
+
+        // Every island has to finish before anything is rethrown, they reference this object.
+        int epochGenerations = 0;
+        RoutingEngine::StopReason cutShort = RoutingEngine::StopReason::None;
+        std::exception_ptr failure;
+        for (auto& future : futures) {
+            try {
+                const Population::EvolveOutcome islandOutcome = executor.wait(future);
+                epochGenerations = std::max(epochGenerations, islandOutcome.generationsRun);
+                if (cutShort == RoutingEngine::StopReason::None && islandOutcome.stopReason != RoutingEngine::StopReason::Generations) {
+                    cutShort = islandOutcome.stopReason;
+                }
+            }
+            catch (...) {
+                if (!failure) failure = std::current_exception();
+            }
+        }
+        if (failure) std::rethrow_exception(failure);
+
+        outcome.generationsRun += epochGenerations;
+        if (cutShort != RoutingEngine::StopReason::None) {
+            outcome.stopReason = cutShort;
+            break;
+        }
+
+        const double bestFitness = getBestFitness();
+        if (bestFitness > bestSoFar + criteria.improvementEpsilon * std::abs(bestSoFar)) {
+            stalledGenerations = 0;
+        }
+        else {
+            stalledGenerations += epoch;
+        }
+        bestSoFar = std::max(bestSoFar, bestFitness);
+        if (criteria.stallGenerations > 0 && stalledGenerations >= criteria.stallGenerations) {
+            outcome.stopReason = RoutingEngine::StopReason::Stalled;
+            break;
+        }
+
+        if (outcome.generationsRun < generations) migrate();
+    }
+    LOG_DEBUG(Genetic, "Islands finished after " << outcome.generationsRun << " generations ("
+        << RoutingEngine::toString(outcome.stopReason) << "), best fitness " << bestSoFar);
+    return outcome;
+}
+
+void IslandModel::migrate() {
+    if (_islands.size() < 2 || _settings.migrantCount == 0) return;
+
+    // Pick every island's emigrants before any island receives, so routes move one hop per migration.
+    std::vector<std::vector<Route>> emigrants;
+    emigrants.reserve(_islands.size());
+    for (const Population& island : _islands) {
+        emigrants.push_back(island.getBestSolutions(static_cast<size_t>(_settings.migrantCount)));
+    }
+    for (size_t i = 0; i < _islands.size(); ++i) {
+        _islands[(i + 1) % _islands.size()].replaceWorst(std::move(emigrants[i]));
+    }
+}
+
+std::vector<Route> IslandModel::getBestSolutions(const size_t count) const {
+    std::vector<std::pair<double, Route>> candidates;
+    for (const Population& island : _islands) {
+        for (Route& route : island.getBestSolutions(count)) {
+            const double fitness = route.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime);
+            candidates.emplace_back(std::isnan(fitness) ? -std::numeric_limits<double>::infinity() : fitness, std::move(route));
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    // Migration copies routes between islands, so the same route can come from several of them.
+    std::vector<Route> best;
+    for (auto& [fitness, route] : candidates) {
+        if (best.size() >= count) break;
+        if (std::none_of(best.begin(), best.end(), [&route](const Route& other) { return route.hasSameSteps(other); })) {
+            best.push_back(std::move(route));
+        }
+    }
+    return best;
+}
+
+size_t IslandModel::getIslandCount() const {
+    return _islands.size();
+}
+
+double IslandModel::getBestFitness() const {
+    double best = 0.0;
+    for (const Population& island : _islands) {
+        for (const Route& route : island.getBestSolutions(1)) {
+            best = std::max(best, route.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime));
+        }
+    }
+    return best;
+}
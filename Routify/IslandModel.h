@@ -0,0 +1,59 @@
+#pragma once
+#include "Population.h"
+#include "Executor.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*
+* Island-model GA for one station pair.
+* The population is split into islands that evolve in parallel as executor tasks, each with its own random
+* generator. Every migrationInterval generations the islands stop, and each one sends copies of its best
+* routes to the next island in a ring, where they replace the least fit routes.
+* Stalling is judged on the best route of all islands, once per migration interval.
+*/
+class IslandModel {
+public:
+    static constexpr int MaxIslands = 64;
+
+    struct Settings {
+        int islandCount = 4;
+        int migrationInterval = 10;     // Generations between migrations
+        int migrantCount = 2;           // Routes each island sends per migration
+    };
+
+    // Splits totalSize routes over the islands, at least two per island. Every island gets all the seed routes.
+    // With a seed, island i is seeded with Population::deriveSeed(seed, i). Seeding stops early once cancellation fires.
+    IslandModel(const Settings& settings, const int totalSize, const int startId, const int destinationId, const Graph& graph,
+        const Utilities::Coordinates& userCoords,
+        const Utilities::Coordinates& destCoords,
+        const double departureTime,
+        const std::vector<Route>& seedRoutes,
+        const std::optional<uint64_t> seed = std::nullopt,
+        const CancellationToken& cancellation = {});
+
+    IslandModel(const IslandModel&) = delete;
+    IslandModel& operator=(const IslandModel&) = delete;
+
+    // Like Population::evolve, for all islands at once. The islands' tasks run at the given priority.
+    Population::EvolveOutcome evolve(const int generations, const double mutationRate,
+        const Population::StopCriteria& criteria, const Executor::Priority priority);
+
+    // Returns up to count distinct routes over all islands, fittest first.
+    std::vector<Route> getBestSolutions(const size_t count) const;
+
+    size_t getIslandCount() const;
+
+private:
+    void migrate();
+    double getBestFitness() const;
+
+    Settings _settings;
+    std::vector<Population> _islands;
+    int _startId;
+    int _destinationId;
+    const Graph& _graph;
+    Utilities::Coordinates _userCoords;
+    Utilities::Coordinates _destCoords;
+    double _departureTime;
+};
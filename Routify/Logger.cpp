@@ -0,0 +1,202 @@
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <stdexcept>
+
+namespace {
+    constexpr std::string_view LevelNames[] = { "debug", "info", "warning", "error", "off" };
+    constexpr std::string_view ModuleNames[] = { "general", "server", "request", "graph", "genetic", "timetable", "hub", "executor" };
+    constexpr const char* EnvironmentVariable = "ROUTIFY_LOG";
+
+    // How long the writer sleeps when the ring is empty. Messages show up at most this late.
+    constexpr auto IdleWait = std::chrono::milliseconds(5);
+
+    Logger::Level parseLevel(std::string_view name) {
+        for (size_t i = 0; i < std::size(LevelNames); ++i) {
+            if (LevelNames[i] == name) return static_cast<Logger::Level>(i);
+        }
+        throw std::invalid_argument("Unknown log level: " + std::string(name));
+    }
+
+    Logger::Module parseModule(std::string_view name) {
+        for (size_t i = 0; i < std::size(ModuleNames); ++i) {
+            if (ModuleNames[i] == name) return static_cast<Logger::Module>(i);
+        }
+        throw std::invalid_argument("Unknown log module: " + std::string(name));
+    }
+
+    std::string readEnvironment(const char* name) {
+#ifdef _WIN32
+        char* value = nullptr;
+        size_t length = 0;
+        if (_dupenv_s(&value, &length, name) != 0 || value == nullptr) return "";
+        std::string result(value);
+        free(value);
+        return result;
+#else
+        const char* value = std::getenv(name);
+        return value ? value : "";
+#endif
+    }
+}
+
+static_assert((Logger::RingCapacity & (Logger::RingCapacity - 1)) == 0, "RingCapacity must be a power of two");
+static_assert(std::size(ModuleNames) == static_cast<size_t>(Logger::Module::Count), "Every module needs a name");
+
+Logger& Logger::shared() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : _ring(std::make_unique<Slot[]>(RingCapacity)) {
+    for (size_t i = 0; i < RingCapacity; ++i) {
+        _ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    setLevel(DefaultLevel);
+
+    const std::string spec = readEnvironment(EnvironmentVariable);
+    if (!spec.empty()) {
+        try {
+            configure(spec);
+        }
+        catch (const std::invalid_argument& e) {
+            // The writer isn't running yet, and this must be seen.
+            std::fprintf(stderr, "Ignoring %s: %s\n", EnvironmentVariable, e.what());
+        }
+    }
+    _writer = std::thread(&Logger::writerLoop, this);
+}
+
+Logger::~Logger() {
+    _stopping = true;
+    if (_writer.joinable()) _writer.join();
+    if (_dropped.load() > 0) {
+        std::fprintf(stderr, "Logger dropped %llu messages.\n", static_cast<unsigned long long>(_dropped.load()));
+    }
+}
+
+void Logger::setLevel(const Level level) {
+    for (auto& moduleLevel : _levels) moduleLevel.store(level, std::memory_order_relaxed);
+}
+
+void Logger::setLevel(const Module module, const Level level) {
+    _levels[static_cast<size_t>(module)].store(level, std::memory_order_relaxed);
+}
+
+Logger::Level Logger::getLevel(const Module module) const {
+    return _levels[static_cast<size_t>(module)].load(std::memory_order_relaxed);
+}
+
+void Logger::configure(std::string_view spec) {
+    // Parse everything first, so a bad spec changes nothing.
+    std::array<Level, static_cast<size_t>(Module::Count)> levels;
+    for (size_t i = 0; i < levels.size(); ++i) levels[i] = getLevel(static_cast<Module>(i));
+
+    while (!spec.empty()) {
+        const size_t comma = spec.find(',');
+        const std::string_view entry = spec.substr(0, comma);
+        spec = (comma == std::string_view::npos) ? std::string_view() : spec.substr(comma + 1);
+        if (entry.empty()) continue;
+
+        const size_t equals = entry.find('=');
+        if (equals == std::string_view::npos) {
+            levels.fill(parseLevel(entry));
+        }
+        else {
+            levels[static_cast<size_t>(parseModule(entry.substr(0, equals)))] = parseLevel(entry.substr(equals + 1));
+        }
+    }
+    for (size_t i = 0; i < levels.size(); ++i) setLevel(static_cast<Module>(i), levels[i]);
+}
+
+std::string_view Logger::toString(const Level level) {
+    return LevelNames[static_cast<size_t>(level)];
+}
+
+std::string_view Logger::toString(const Module module) {
+    return ModuleNames[static_cast<size_t>(module)];
+}
+
+// Multi-producer bounded queue: a slot is free for ring position p when its sequence is p, and holds
+// a message for the writer when its sequence is p + 1.
+void Logger::write(const Level level, const Module module, std::string_view message) {
+    size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &_ring[position & (RingCapacity - 1)];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (difference == 0) {
+            if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        }
+        else if (difference < 0) {
+            _dropped.fetch_add(1, std::memory_order_relaxed); // Full, the writer is behind
+            return;
+        }
+        else {
+            position = _enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->module = module;
+    slot->timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    slot->length = static_cast<uint16_t>(std::min(message.size(), MaxMessageLength));
+    std::copy_n(message.data(), slot->length, slot->text);
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool Logger::drain() {
+    bool wroteAny = false;
+    bool wroteErrors = false;
+    while (true) {
+        Slot& slot = _ring[_dequeuePosition & (RingCapacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != _dequeuePosition + 1) break;
+
+        const std::time_t seconds = static_cast<std::time_t>(slot.timestampMs / 1000);
+        std::tm local{};
+#ifdef _WIN32
+        localtime_s(&local, &seconds);
+#else
+        localtime_r(&seconds, &local);
+#endif
+        const bool isError = slot.level >= Level::Warning;
+        std::FILE* stream = isError ? stderr : stdout;
+        std::fprintf(stream, "%02d:%02d:%02d.%03d [%.*s] [%.*s] %.*s\n",
+            local.tm_hour, local.tm_min, local.tm_sec, static_cast<int>(slot.timestampMs % 1000),
+            static_cast<int>(toString(slot.level).size()), toString(slot.level).data(),
+            static_cast<int>(toString(slot.module).size()), toString(slot.module).data(),
+            static_cast<int>(slot.length), slot.text);
+        wroteErrors = wroteErrors || isError;
+
+        slot.sequence.store(_dequeuePosition + RingCapacity, std::memory_order_release);
+        _dequeuePosition++;
+        wroteAny = true;
+    }
+    if (wroteAny) {
+        std::fflush(stdout);
+        if (wroteErrors) std::fflush(stderr);
+        _writtenPosition.store(_dequeuePosition, std::memory_order_release);
+    }
+    return wroteAny;
+}
+
+void Logger::writerLoop() {
+    while (!_stopping.load()) {
+        if (!drain()) std::this_thread::sleep_for(IdleWait);
+    }
+    // Whatever was queued before shutdown.
+    while (drain()) {}
+}
+
+void Logger::flush() {
+    const size_t target = _enqueuePosition.load(std::memory_order_acquire);
+    while (_writtenPosition.load(std::memory_order_acquire) < target && !_stopping.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
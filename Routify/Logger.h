@@ -0,0 +1,97 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/*
+* Leveled, asynchronous logging.
+* The LOG_* macros check their module's level before formatting anything, so a disabled message costs one
+* relaxed atomic load. Enabled messages are copied into a fixed lock-free ring buffer and written to
+* stdout (debug, info) or stderr (warning, error) by a background thread. When the ring is full, messages
+* are dropped and counted instead of blocking the caller.
+* Levels are set per module from code, or at startup from the ROUTIFY_LOG environment variable, e.g.
+* "debug" or "warning,request=info,genetic=debug".
+*/
+class Logger {
+public:
+    enum class Level : uint8_t { Debug, Info, Warning, Error, Off };
+    enum class Module : uint8_t { General, Server, Request, Graph, Genetic, Timetable, Hub, Executor, Count };
+
+    static constexpr Level DefaultLevel = Level::Info;
+    static constexpr size_t RingCapacity = 4096;        // Must be a power of two
+    static constexpr size_t MaxMessageLength = 256;     // Longer messages are cut
+
+    // The process-wide logger. Call it once at the start of main so it outlives the other singletons.
+    static Logger& shared();
+
+    static bool isEnabled(const Module module, const Level level) {
+        return level >= shared()._levels[static_cast<size_t>(module)].load(std::memory_order_relaxed);
+    }
+
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void setLevel(const Level level);                       // Every module
+    void setLevel(const Module module, const Level level);
+    Level getLevel(const Module module) const;
+
+    // Applies a level spec like "info,graph=debug". Throws std::invalid_argument on an unknown name.
+    void configure(std::string_view spec);
+
+    // Queues a message. Never blocks.
+    void write(const Level level, const Module module, std::string_view message);
+
+    // Waits until everything queued so far has been written.
+    void flush();
+
+    // Messages lost because the ring was full.
+    uint64_t getDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+
+    static std::string_view toString(const Level level);
+    static std::string_view toString(const Module module);
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;   // Ring position the slot holds, see write() and drain()
+        Level level;
+        Module module;
+        uint16_t length;
+        int64_t timestampMs;
+        char text[MaxMessageLength];
+    };
+
+    Logger();
+
+    void writerLoop();
+    bool drain();   // Writes every ready message, returns false if there was none
+
+    std::array<std::atomic<Level>, static_cast<size_t>(Module::Count)> _levels;
+    std::unique_ptr<Slot[]> _ring;
+    std::atomic<size_t> _enqueuePosition = 0;
+    size_t _dequeuePosition = 0;                // Only touched by the writer thread
+    std::atomic<size_t> _writtenPosition = 0;   // Published by the writer thread for flush()
+    std::atomic<uint64_t> _dropped = 0;
+    std::atomic<bool> _stopping = false;
+    std::thread _writer;
+};
+
+#define LOG_AT(level, module, message)                                                                  \
+    do {                                                                                                \
+        if (Logger::isEnabled(Logger::Module::module, Logger::Level::level)) {                          \
+            std::ostringstream logStream_;                                                              \
+            logStream_ << message;                                                                      \
+            Logger::shared().write(Logger::Level::level, Logger::Module::module, logStream_.str());     \
+        }                                                                                               \
+    } while (false)
+
+#define LOG_DEBUG(module, message) LOG_AT(Debug, module, message)
+#define LOG_INFO(module, message) LOG_AT(Info, module, message)
+#define LOG_WARNING(module, message) LOG_AT(Warning, module, message)
+#define LOG_ERROR(module, message) LOG_AT(Error, module, message)
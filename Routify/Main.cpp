@@ -1,10 +1,21 @@
 #include "Graph.h"  
 #include "Server.h"  
-#include <iostream>  
+#include "Executor.h"
+#include "Logger.h"
 #include <chrono>  
+#include <cstdlib>
+#include <algorithm>
 
-int main() {  
+// Usage: Routify.exe [max concurrent GA tasks]. Without it, GA tasks may use every hardware thread.
+// Log levels come from ROUTIFY_LOG, e.g. "info,genetic=debug" (see Logger.h).
+int main(int argc, char* argv[]) {  
 	SetConsoleOutputCP(CP_UTF8);  
+	Logger::shared(); // First, so it's destroyed last and flushes whatever the other singletons log
+	if (argc > 1) {
+		Executor::shared().setConcurrencyLimit(static_cast<size_t>(std::max(0, std::atoi(argv[1]))));
+	}
+	LOG_INFO(General, "GA executor: " << Executor::shared().getWorkerCount() << " workers, running at most "
+		<< Executor::shared().getConcurrencyLimit() << " tasks at once.");
 	auto now = std::chrono::system_clock::now().time_since_epoch();  
 	auto seed = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::seconds>(now).count());  
 	std::mt19937 randomGenerator(seed);
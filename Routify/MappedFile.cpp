@@ -0,0 +1,127 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open " + path + " for mapping.");
+    }
+    _fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        release();
+        throw std::runtime_error("Cannot map empty or unreadable file " + path + ".");
+    }
+    _size = static_cast<size_t>(fileSize.QuadPart);
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        release();
+        throw std::runtime_error("CreateFileMapping failed for " + path + ".");
+    }
+    _mappingHandle = mapping;
+
+    _data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (_data == nullptr) {
+        release();
+        throw std::runtime_error("MapViewOfFile failed for " + path + ".");
+    }
+}
+
+void MappedFile::release() {
+    if (_data) UnmapViewOfFile(_data);
+    if (_mappingHandle) CloseHandle(_mappingHandle);
+    if (_fileHandle) CloseHandle(_fileHandle);
+    _data = nullptr;
+    _mappingHandle = nullptr;
+    _fileHandle = nullptr;
+    _size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _data(std::exchange(other._data, nullptr)),
+    _size(std::exchange(other._size, 0)),
+    _fileHandle(std::exchange(other._fileHandle, nullptr)),
+    _mappingHandle(std::exchange(other._mappingHandle, nullptr)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _fileHandle = std::exchange(other._fileHandle, nullptr);
+        _mappingHandle = std::exchange(other._mappingHandle, nullptr);
+    }
+    return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    _fd = open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to open " + path + " for mapping.");
+    }
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || st.st_size == 0) {
+        release();
+        throw std::runtime_error("Cannot map empty or unreadable file " + path + ".");
+    }
+    _size = static_cast<size_t>(st.st_size);
+
+    void* addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (addr == MAP_FAILED) {
+        release();
+        throw std::runtime_error("mmap failed for " + path + ".");
+    }
+    _data = static_cast<const char*>(addr);
+}
+
+void MappedFile::release() {
+    if (_data) munmap(const_cast<char*>(_data), _size);
+    if (_fd >= 0) close(_fd);
+    _data = nullptr;
+    _fd = -1;
+    _size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _data(std::exchange(other._data, nullptr)),
+    _size(std::exchange(other._size, 0)),
+    _fd(std::exchange(other._fd, -1)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _fd = std::exchange(other._fd, -1);
+    }
+    return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    release();
+}
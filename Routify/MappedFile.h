@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. The view stays valid for the lifetime of the object.
+class MappedFile {
+public:
+    // Maps the file. Throws std::runtime_error if it can't be opened or mapped.
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Returns the start of the mapped bytes.
+    const char* data() const { return _data; }
+
+    // Returns the size of the mapping in bytes.
+    size_t size() const { return _size; }
+
+private:
+    void release();
+
+    const char* _data = nullptr;
+    size_t _size = 0;
+
+#ifdef _WIN32
+    void* _fileHandle = nullptr;
+    void* _mappingHandle = nullptr;
+#else
+    int _fd = -1;
+#endif
+};
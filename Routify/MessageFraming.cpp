@@ -0,0 +1,101 @@
+#include "MessageFraming.h"
+#include <algorithm>
+#include <cstdint>
+
+void MessageFraming::appendFrame(std::string& out, std::string_view payload) {
+    const uint32_t length = static_cast<uint32_t>(payload.size());
+    out.push_back(static_cast<char>((length >> 24) & 0xFF));
+    out.push_back(static_cast<char>((length >> 16) & 0xFF));
+    out.push_back(static_cast<char>((length >> 8) & 0xFF));
+    out.push_back(static_cast<char>(length & 0xFF));
+    out.append(payload);
+}
+
+bool FrameDecoder::feed(const char* data, const size_t size, std::vector<std::string>& messages) {
+    if (size == 0) return true;
+
+    // Frames start with the high byte of the length, which is 0 or 1 for any allowed size, while JSON starts
+    // with '{' or whitespace.
+    if (_mode == Mode::Unknown) {
+        const char first = data[0];
+        const bool looksLikeJson = first == '{' || first == '[' || first == ' ' || first == '\t' || first == '\r' || first == '\n';
+        _mode = looksLikeJson ? Mode::Legacy : Mode::Framed;
+    }
+
+    if (_mode == Mode::Legacy) {
+        // One request per connection, anything but whitespace after it is a protocol error.
+        auto isWhitespace = [](const char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+        if (_legacyDone) return std::all_of(data, data + size, isWhitespace);
+        _buffer.append(data, size);
+        if (scanLegacyRequest()) {
+            const bool onlyWhitespaceAfter = std::all_of(_buffer.begin() + _scanned, _buffer.end(), isWhitespace);
+            _buffer.resize(_scanned);
+            messages.push_back(std::move(_buffer));
+            _buffer.clear();
+            _legacyDone = true;
+            return onlyWhitespaceAfter;
+        }
+        return _buffer.size() <= MessageFraming::MaxMessageSize;
+    }
+
+    _buffer.append(data, size);
+
+    while (_buffer.size() - _consumed >= MessageFraming::HeaderSize) {
+        const auto* header = reinterpret_cast<const unsigned char*>(_buffer.data() + _consumed);
+        const size_t length = (static_cast<size_t>(header[0]) << 24) | (static_cast<size_t>(header[1]) << 16) |
+            (static_cast<size_t>(header[2]) << 8) | static_cast<size_t>(header[3]);
+        if (length > MessageFraming::MaxMessageSize) {
+            return false;
+        }
+        if (_buffer.size() - _consumed < MessageFraming::HeaderSize + length) {
+            break; // Rest of the frame hasn't arrived yet
+        }
+        messages.emplace_back(_buffer, _consumed + MessageFraming::HeaderSize, length);
+        _consumed += MessageFraming::HeaderSize + length;
+    }
+    compact();
+    return true;
+}
+
+bool FrameDecoder::finish(std::vector<std::string>& messages) {
+    if (_mode == Mode::Legacy) {
+        if (_legacyDone) return true;
+        messages.push_back(std::move(_buffer));
+        _buffer.clear();
+        _consumed = 0;
+        _legacyDone = true;
+        return true;
+    }
+    return _buffer.size() == _consumed;
+}
+
+bool FrameDecoder::scanLegacyRequest() {
+    // Brackets inside strings don't count; a value that isn't an object or array only ends with the stream.
+    for (; _scanned < _buffer.size(); ++_scanned) {
+        const char c = _buffer[_scanned];
+        if (_inString) {
+            if (_escaped) _escaped = false;
+            else if (c == '\\') _escaped = true;
+            else if (c == '"') _inString = false;
+        }
+        else if (c == '"') _inString = true;
+        else if (c == '{' || c == '[') ++_depth;
+        else if ((c == '}' || c == ']') && --_depth <= 0) {
+            ++_scanned;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameDecoder::compact() {
+    // Drop returned bytes once they make up most of the buffer, keeping its capacity.
+    if (_consumed == _buffer.size()) {
+        _buffer.clear();
+        _consumed = 0;
+    }
+    else if (_consumed > _buffer.size() / 2) {
+        _buffer.erase(0, _consumed);
+        _consumed = 0;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+/*
+* Wire framing between clients and the server.
+* Framed clients send each message as a 4-byte big-endian length followed by that many bytes of JSON,
+* get replies framed the same way, and may send any number of messages on one connection.
+* Legacy clients (the first byte is JSON, not a length) send a single raw request and get a raw reply
+* before the server closes the connection. The request ends once its JSON object or array is closed,
+* or when they shut down their sending side, whichever comes first.
+*/
+namespace MessageFraming {
+    constexpr size_t HeaderSize = 4;
+    constexpr size_t MaxMessageSize = 16 * 1024 * 1024;
+
+    // Appends payload to out as one frame.
+    void appendFrame(std::string& out, std::string_view payload);
+}
+
+// Splits a received byte stream into messages. One decoder per connection; its buffer is reused.
+class FrameDecoder {
+public:
+    enum class Mode { Unknown, Framed, Legacy };
+
+    // Adds received bytes and appends every completed message to messages.
+    // Returns false on a protocol error (oversized message), after which the connection should be dropped.
+    bool feed(const char* data, const size_t size, std::vector<std::string>& messages);
+
+    // The peer shut down its sending side. Completes a legacy request. Returns false if bytes of an
+    // unfinished frame are left over.
+    bool finish(std::vector<std::string>& messages);
+
+    Mode getMode() const { return _mode; }
+
+    // True once a legacy request was completed: no more messages can come, the connection only owes the reply.
+    bool isDone() const { return _legacyDone; }
+
+    // True while bytes of an unfinished message are buffered.
+    bool hasPartialMessage() const { return _buffer.size() > _consumed; }
+
+private:
+    void compact();
+
+    // Scans the unscanned legacy bytes for the end of the top level JSON object or array.
+    bool scanLegacyRequest();
+
+    Mode _mode = Mode::Unknown;
+    std::string _buffer;
+    size_t _consumed = 0;   // Bytes at the start of _buffer that were already returned
+
+    // Legacy request scanning state, so each byte is looked at once however the request is split up.
+    size_t _scanned = 0;
+    int _depth = 0;
+    bool _inString = false;
+    bool _escaped = false;
+    bool _legacyDone = false;
+};
@@ -0,0 +1,144 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+namespace {
+    constexpr std::string_view StageNames[] = { "request", "queue", "snapping", "seeding", "ga_task", "generation",
+        "formatting", "socket_read", "socket_write" };
+    constexpr std::string_view CounterNames[] = { "requests", "request_errors", "busy_rejections", "cancelled_requests",
+        "connections_accepted", "bytes_received", "bytes_sent" };
+    constexpr std::string_view GaugeNames[] = { "executor_queue_depth", "in_flight_requests", "open_connections" };
+
+    constexpr double Quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+}
+
+static_assert(std::size(StageNames) == static_cast<size_t>(Metrics::Stage::Count), "Every stage needs a name");
+static_assert(std::size(CounterNames) == static_cast<size_t>(Metrics::Counter::Count), "Every counter needs a name");
+static_assert(std::size(GaugeNames) == static_cast<size_t>(Metrics::Gauge::Count), "Every gauge needs a name");
+static_assert(std::has_single_bit(Metrics::SubBucketCount), "SubBucketCount must be a power of two");
+
+// --- Histogram ---
+
+size_t Metrics::Histogram::bucketOf(const uint64_t micros) {
+    if (micros < SubBucketCount) return static_cast<size_t>(micros);
+    // Values in [2^k, 2^(k+1)) with k >= log2(SubBucketCount) keep their top bits: magnitude counts the dropped ones.
+    const uint64_t magnitude = std::bit_width(micros) - std::bit_width(SubBucketCount);
+    if (magnitude > MaxMagnitude - 1) return BucketCount - 1;
+    return static_cast<size_t>((magnitude + 1) * SubBucketCount + ((micros >> magnitude) - SubBucketCount));
+}
+
+uint64_t Metrics::Histogram::bucketUpperBound(const size_t bucket) {
+    if (bucket < SubBucketCount) return bucket;
+    const uint64_t magnitude = bucket / SubBucketCount - 1;
+    const uint64_t top = bucket % SubBucketCount + SubBucketCount;
+    return ((top + 1) << magnitude) - 1;
+}
+
+void Metrics::Histogram::record(const uint64_t micros) {
+    _buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    _sumMicros.fetch_add(micros, std::memory_order_relaxed);
+    uint64_t max = _maxMicros.load(std::memory_order_relaxed);
+    while (micros > max && !_maxMicros.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {}
+}
+
+Metrics::Histogram::Summary Metrics::Histogram::summarize() const {
+    // Buckets are read one by one while others record, so the counts can be off by the few samples in flight.
+    std::vector<uint64_t> counts(BucketCount);
+    uint64_t total = 0;
+    for (size_t i = 0; i < BucketCount; ++i) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    Summary summary;
+    summary.count = total;
+    if (total == 0) return summary;
+    const uint64_t max = _maxMicros.load(std::memory_order_relaxed);
+    summary.sumMs = _sumMicros.load(std::memory_order_relaxed) / 1000.0;
+    summary.meanMs = summary.sumMs / static_cast<double>(total);
+    summary.maxMs = max / 1000.0;
+
+    // A quantile is the upper bound of the bucket holding it, never more than the largest value recorded.
+    double* targets[] = { &summary.p50Ms, &summary.p90Ms, &summary.p99Ms, &summary.p999Ms };
+    size_t bucket = 0;
+    uint64_t seen = 0;
+    for (size_t q = 0; q < std::size(Quantiles); ++q) {
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(Quantiles[q] * total)));
+        while (bucket < BucketCount - 1 && seen + counts[bucket] < rank) seen += counts[bucket++];
+        *targets[q] = std::min(bucketUpperBound(bucket), max) / 1000.0;
+    }
+    return summary;
+}
+
+// --- Metrics ---
+
+Metrics& Metrics::shared() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics() : _started(std::chrono::steady_clock::now()) {}
+
+void Metrics::setGaugeSource(const Gauge gauge, std::function<double()> source) {
+    std::lock_guard<std::mutex> lock(_gaugeMutex);
+    _gaugeSources[static_cast<size_t>(gauge)] = std::move(source);
+}
+
+uint64_t Metrics::getCounter(const Counter counter) const {
+    return _counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+double Metrics::getGauge(const Gauge gauge) const {
+    std::lock_guard<std::mutex> lock(_gaugeMutex);
+    const std::function<double()>& source = _gaugeSources[static_cast<size_t>(gauge)];
+    return source ? source() : 0.0;
+}
+
+Metrics::Histogram::Summary Metrics::summarize(const Stage stage) const {
+    return _histograms[static_cast<size_t>(stage)].summarize();
+}
+
+double Metrics::getUptimeSeconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _started).count();
+}
+
+std::string Metrics::toPrometheus() const {
+    std::ostringstream out;
+    out << "# TYPE routify_uptime_seconds gauge\nroutify_uptime_seconds " << getUptimeSeconds() << "\n";
+    for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i) {
+        const std::string name = "routify_" + std::string(CounterNames[i]) + "_total";
+        out << "# TYPE " << name << " counter\n" << name << " " << getCounter(static_cast<Counter>(i)) << "\n";
+    }
+    for (size_t i = 0; i < static_cast<size_t>(Gauge::Count); ++i) {
+        const std::string name = "routify_" + std::string(GaugeNames[i]);
+        out << "# TYPE " << name << " gauge\n" << name << " " << getGauge(static_cast<Gauge>(i)) << "\n";
+    }
+
+    out << "# TYPE routify_stage_seconds summary\n";
+    for (size_t i = 0; i < static_cast<size_t>(Stage::Count); ++i) {
+        const Histogram::Summary summary = summarize(static_cast<Stage>(i));
+        const std::string label = "stage=\"" + std::string(StageNames[i]) + "\"";
+        const double values[] = { summary.p50Ms, summary.p90Ms, summary.p99Ms, summary.p999Ms };
+        for (size_t q = 0; q < std::size(Quantiles); ++q) {
+            out << "routify_stage_seconds{" << label << ",quantile=\"" << Quantiles[q] << "\"} " << values[q] / 1000.0 << "\n";
+        }
+        out << "routify_stage_seconds_sum{" << label << "} " << summary.sumMs / 1000.0 << "\n";
+        out << "routify_stage_seconds_count{" << label << "} " << summary.count << "\n";
+    }
+    return out.str();
+}
+
+std::string_view Metrics::toString(const Stage stage) {
+    return StageNames[static_cast<size_t>(stage)];
+}
+
+std::string_view Metrics::toString(const Counter counter) {
+    return CounterNames[static_cast<size_t>(counter)];
+}
+
+std::string_view Metrics::toString(const Gauge gauge) {
+    return GaugeNames[static_cast<size_t>(gauge)];
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/*
+* Process-wide counters, gauges and per-stage latency histograms, for dashboards and catching regressions.
+* Recording is lock-free: a histogram is a fixed array of atomic bucket counts on a log-linear scale
+* (16 buckets per power of two of microseconds, like HDR histograms), so quantiles are accurate to about 6%
+* however long the server runs. Gauges are read from callbacks when a snapshot is taken.
+* Served by request type 6, as JSON or in the Prometheus text format.
+*/
+class Metrics {
+public:
+    enum class Stage : uint8_t {
+        Request,        // One request message, from parsing to the encoded reply
+        Queue,          // Waiting for a handler thread
+        Snapping,       // Finding the stations near one endpoint
+        Seeding,        // Building a GA's initial population from diverse shortest paths
+        GaTask,         // One GA run for a start/end station pair
+        Generation,     // One GA generation of one population
+        Formatting,     // Writing a route response
+        SocketRead,     // From the first received byte of a message to the whole message
+        SocketWrite,    // From a reply being queued to the kernel taking its last byte
+        Count
+    };
+
+    enum class Counter : uint8_t { Requests, RequestErrors, BusyRejections, CancelledRequests, ConnectionsAccepted, BytesReceived,
+        BytesSent, Count };
+    enum class Gauge : uint8_t { ExecutorQueueDepth, InFlightRequests, OpenConnections, Count };
+
+    // Buckets below SubBucketCount microseconds are exact, each power of two above is split in SubBucketCount.
+    static constexpr uint64_t SubBucketCount = 16;
+    static constexpr uint64_t MaxMagnitude = 36;                        // Up to about 2^40 us, 12 days
+    static constexpr size_t BucketCount = (MaxMagnitude + 1) * SubBucketCount;
+
+    // Lock-free latency histogram in microseconds.
+    class Histogram {
+    public:
+        struct Summary {
+            uint64_t count = 0;
+            double meanMs = 0.0;
+            double p50Ms = 0.0;
+            double p90Ms = 0.0;
+            double p99Ms = 0.0;
+            double p999Ms = 0.0;
+            double maxMs = 0.0;
+            double sumMs = 0.0;
+        };
+
+        void record(const uint64_t micros);
+        Summary summarize() const;
+
+        static size_t bucketOf(const uint64_t micros);
+        static uint64_t bucketUpperBound(const size_t bucket);     // Largest value the bucket holds
+
+    private:
+        std::array<std::atomic<uint64_t>, BucketCount> _buckets{};
+        std::atomic<uint64_t> _sumMicros = 0;
+        std::atomic<uint64_t> _maxMicros = 0;
+    };
+
+    // Records how long a stage took, from construction to destruction.
+    class Timer {
+    public:
+        explicit Timer(const Stage stage) : _stage(stage), _start(std::chrono::steady_clock::now()) {}
+        ~Timer() { shared().record(_stage, std::chrono::steady_clock::now() - _start); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        Stage _stage;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    static Metrics& shared();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    void record(const Stage stage, const std::chrono::steady_clock::duration elapsed) {
+        _histograms[static_cast<size_t>(stage)].record(static_cast<uint64_t>(
+            std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count())));
+    }
+
+    void increment(const Counter counter, const uint64_t amount = 1) {
+        _counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // Sets where a gauge is read from; an empty function unsets it. The source must stay valid until unset.
+    void setGaugeSource(const Gauge gauge, std::function<double()> source);
+
+    uint64_t getCounter(const Counter counter) const;
+    double getGauge(const Gauge gauge) const;      // 0 when it has no source
+    Histogram::Summary summarize(const Stage stage) const;
+    double getUptimeSeconds() const;
+
+    // Every metric in the Prometheus text exposition format, latencies as summaries in seconds.
+    std::string toPrometheus() const;
+
+    static std::string_view toString(const Stage stage);
+    static std::string_view toString(const Counter counter);
+    static std::string_view toString(const Gauge gauge);
+
+private:
+    Metrics();
+
+    const std::chrono::steady_clock::time_point _started;
+    std::array<Histogram, static_cast<size_t>(Stage::Count)> _histograms;
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)> _counters{};
+
+    mutable std::mutex _gaugeMutex;
+    std::array<std::function<double()>, static_cast<size_t>(Gauge::Count)> _gaugeSources;   // Needs _gaugeMutex
+};
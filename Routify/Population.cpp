@@ -1,253 +1,373 @@
 #include "Population.h"
+#include "Logger.h"
+#include "Metrics.h"
 #include <algorithm>
 #include <random>
 #include <stdexcept>
-#include <iostream>
 #include <numeric>
 #include <limits>
+#include <cmath>
 #include <unordered_set>
 #include <queue>
+#include <functional>
+#include <exception>
+#include <future>
 
 
-// --- BFS Pathfinding Implementation ---
+// --- Seed Pathfinding ---
 namespace {
 
-    struct BfsNode {
-        int stationCode;
-        int parentCode;
-        std::string lineIdFromParent;
-        int lineToFromParent;
-        BfsNode(int c = -1, int p = -1, const std::string& lId = "", int lTo = -1) : stationCode(c), parentCode(p), lineIdFromParent(lId), lineToFromParent(lTo) {}
-    };
+    // Extra cost of an edge per earlier path that used it, in hops. High enough that a path avoids a shared
+    // edge whenever a detour of a few stops exists.
+    constexpr double EdgeReusePenalty = 3.0;
 
-    const Graph::TransportationLine& findLineInGraph(const Graph& graph, int fromCode, const std::string& lineId, int lineTo) {
-        static Graph::TransportationLine dummyLine;
-        try {
-            const auto& lines = graph.getLinesFrom(fromCode);
-            for (const auto& line : lines) { if (line.id == lineId && line.to == lineTo) return line; }
-        }
-        catch (...) {}
-        dummyLine.id = "Error"; return dummyLine;
-    }
+    // Scratch buffers of chunks bred on executor workers. Chunk tasks never wait, so one per thread is enough.
+    thread_local Route::Workspace chunkWorkspace;
 
-    std::vector<Route::VisitedStation> findPathBFS(
+    /*
+    * Penalty method for diverse paths: runs `count` shortest-path searches (one hop costs 1) over dense station
+    * indices, and after each one makes the edges it used more expensive. The first path is a fewest-hops path.
+    * Returns the distinct paths found as visited stations, possibly fewer than count, and stops searching for more
+    * once cancellation fires.
+    */
+    std::vector<std::vector<Route::VisitedStation>> findDiversePaths(
         const Graph& graph,
         int startCode,
-        int endCode)
+        int endCode,
+        int count,
+        const CancellationToken& cancellation)
     {
-        std::vector<Route::VisitedStation> path;
-        std::queue<int> q;
-        std::unordered_map<int, BfsNode> visitedInfo;
-
-        if (!graph.hasStation(startCode) || !graph.hasStation(endCode)) return path;
-
-        q.push(startCode);
-        visitedInfo[startCode] = BfsNode(startCode, -1, "Start", startCode); // Parent code is -1 for start
-
-        int currentCode = -1;
-        bool found = false;
-        while (!q.empty()) {
-            currentCode = q.front(); q.pop();
-            if (currentCode == endCode) { found = true; break; }
-            try {
-                const auto& lines = graph.getLinesFrom(currentCode);
-                for (const auto& line : lines) {
-                    int nextCode = line.to;
-                    if (graph.hasStation(nextCode) && !visitedInfo.contains(nextCode)) {
-                        visitedInfo[nextCode] = BfsNode(nextCode, currentCode, line.id, line.to);
-                        q.push(nextCode);
+        const int startIndex = graph.getStationIndex(startCode);
+        const int endIndex = graph.getStationIndex(endCode);
+        if (startIndex < 0 || endIndex < 0) return {};
+
+        const size_t stationCount = graph.getStationCount();
+        std::vector<int> edgeUses(graph.getEdgeCount(), 0);
+        std::vector<double> cost(stationCount);
+        std::vector<int> parentIndex(stationCount);
+        std::vector<int> edgeFromParent(stationCount);
+        std::vector<std::vector<Route::VisitedStation>> paths;
+
+        using QueueEntry = std::pair<double, int>;
+        for (int attempt = 0; attempt < count; ++attempt) {
+            if (attempt > 0 && cancellation.isCancelled()) break; // The first path is needed to seed at all
+            std::fill(cost.begin(), cost.end(), std::numeric_limits<double>::infinity());
+            std::fill(parentIndex.begin(), parentIndex.end(), -1);
+            std::fill(edgeFromParent.begin(), edgeFromParent.end(), Route::VisitedStation::StartEdge);
+            std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+            cost[startIndex] = 0.0;
+            queue.emplace(0.0, startIndex);
+
+            while (!queue.empty()) {
+                auto [currentCost, currentIndex] = queue.top();
+                queue.pop();
+                if (currentIndex == endIndex) break;
+                if (currentCost > cost[currentIndex]) continue; // Stale entry
+
+                for (const auto& line : graph.getLinesFromIndex(currentIndex)) {
+                    const int nextIndex = line.toIndex;
+                    if (nextIndex < 0) continue;
+                    const int edgeIndex = graph.getEdgeIndex(line);
+                    const double nextCost = currentCost + 1.0 + EdgeReusePenalty * edgeUses[edgeIndex];
+                    if (nextCost < cost[nextIndex]) {
+                        cost[nextIndex] = nextCost;
+                        parentIndex[nextIndex] = currentIndex;
+                        edgeFromParent[nextIndex] = edgeIndex;
+                        queue.emplace(nextCost, nextIndex);
                     }
                 }
             }
-            catch (...) { continue; }
-        }
-
-        // --- Reconstruct Path ---
-        if (found) {
-            std::vector<Route::VisitedStation> reversed_path;
-            int traceCode = endCode;
-
-            while (traceCode != -1) {
-                auto it = visitedInfo.find(traceCode);
-                if (it == visitedInfo.end()) return {};
-                const BfsNode& nodeInfo = it->second; // Info for the current traceCode station
-
-                try {
-                    const Graph::Station& station = graph.getStationByCode(traceCode);
-
-                    // Find the actual line object used
-                    const Graph::TransportationLine& lineUsed =
-                        (nodeInfo.parentCode == -1)
-                        ? Graph::TransportationLine("Start", startCode, 0, Graph::TransportMethod::Walk) // Dummy start line
-                        : findLineInGraph(graph, nodeInfo.parentCode, nodeInfo.lineIdFromParent, nodeInfo.lineToFromParent);
-
-                    if (lineUsed.id == "Error" && nodeInfo.parentCode != -1) return {}; // Line lookup failed
-
-                    reversed_path.push_back(Route::VisitedStation(station, lineUsed, nodeInfo.parentCode));
-                    traceCode = nodeInfo.parentCode; // Move to the parent
-
-                }
-                catch (const std::out_of_range&) { return {}; }
-                catch (const std::exception& e_rec) { std::cerr << "BFS Rec Err: " << e_rec.what() << std::endl; return {}; }
-
-                // Safety break
-                if (reversed_path.size() > graph.getStationCount() + 5) { // Adjusted safety limit
-                    std::cerr << "BFS Error: Path reconstruction loop or excessive length." << std::endl;
-                    return {};
-                }
+            if (cost[endIndex] == std::numeric_limits<double>::infinity()) break; // Unreachable, no use retrying
+
+            // --- Reconstruct Path ---
+            std::vector<Route::VisitedStation> path;
+            for (int traceIndex = endIndex; traceIndex != -1; traceIndex = parentIndex[traceIndex]) {
+                // The start gets StartEdge and parent -1
+                path.push_back(Route::VisitedStation(traceIndex, edgeFromParent[traceIndex], parentIndex[traceIndex]));
+                if (edgeFromParent[traceIndex] >= 0) edgeUses[edgeFromParent[traceIndex]]++;
             }
-            std::reverse(reversed_path.begin(), reversed_path.end());
-            path = std::move(reversed_path);
-        }
-        else { /* No path found */ }
+            std::reverse(path.begin(), path.end());
 
-        return path;
+            const bool isNew = std::none_of(paths.begin(), paths.end(), [&path](const auto& other) {
+                return std::equal(path.begin(), path.end(), other.begin(), other.end(),
+                    [](const Route::VisitedStation& a, const Route::VisitedStation& b) { return a.edgeIndex == b.edgeIndex; });
+            });
+            if (isNew) paths.push_back(std::move(path));
+        }
+        return paths;
     }
 
 } // end anonymous namespace
 
-// --- Population Constructor (No changes needed here, uses the fixed BFS) ---
 Population::Population(const int size, const int startId, const int destinationId, const Graph& graph,
     const Utilities::Coordinates& userCoords,
-    const Utilities::Coordinates& destCoords)
+    const Utilities::Coordinates& destCoords,
+    const double departureTime,
+    std::vector<Route> seedRoutes,
+    const std::optional<uint64_t> seed,
+    const CancellationToken& cancellation)
     : _graph(graph), _startId(startId), _destinationId(destinationId),
-    _userCoords(userCoords), _destCoords(destCoords) // Initialize members
+    _userCoords(userCoords), _destCoords(destCoords), _departureTime(departureTime) // Initialize members
 {
+    Metrics::Timer timer(Metrics::Stage::Seeding);
     if (size <= 0) { throw std::invalid_argument("Population size must be positive."); }
     
-    std::random_device rd; 
-    _gen.seed(rd()); 
+    if (seed) {
+        _seed = *seed;
+    }
+    else {
+        std::random_device rd;
+        _seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
+    _gen.seed(static_cast<std::mt19937::result_type>(deriveSeed(_seed, 0)));
     _routes.reserve(size);
 
     if (!graph.hasStation(startId) || !graph.hasStation(destinationId)) {
         throw std::runtime_error("Population initialization failed: Invalid start/destination ID provided.");
     }
-    std::cout << "Generating initial population (" << size << " routes) using BFS + Mutation..." << std::endl;
-
-    // --- Step 1: Generate Baseline Route using BFS ---
-    std::vector<Route::VisitedStation> bfsPathStations = findPathBFS(_graph, _startId, _destinationId);
-
-    if (bfsPathStations.empty()) {
-        std::cerr << "Error: BFS could not find any path between start (" << startId << ") and destination (" << destinationId << ")." << std::endl;
-        throw std::runtime_error("Population initialization failed: No path exists between stations.");
+    LOG_DEBUG(Genetic, "Generating initial population (" << size << " routes) from " << seedRoutes.size()
+        << " seed routes and diverse paths + Mutation...");
+
+    // --- Step 1: Seeds, given routes first, then diverse shortest paths ---
+    const auto routesNeeded = static_cast<size_t>(size);
+    auto addSeed = [this, routesNeeded](Route& route) {
+        if (_routes.size() >= routesNeeded || !route.isValid(_startId, _destinationId, _graph)) return;
+        if (std::any_of(_routes.begin(), _routes.end(), [&route](const Route& other) { return route.hasSameSteps(other); })) return;
+        _routes.push_back(std::move(route));
+    };
+    for (Route& seed : seedRoutes) {
+        addSeed(seed);
     }
+    const size_t givenSeeds = _routes.size();
 
-    Route baseRoute;
-    for (const auto& vs : bfsPathStations) { baseRoute.addVisitedStation(vs); }
+    for (const auto& path : findDiversePaths(_graph, _startId, _destinationId, DiversePathCount, cancellation)) {
+        Route pathRoute;
+        for (const auto& vs : path) { pathRoute.addVisitedStation(vs); }
+        addSeed(pathRoute);
+    }
 
-    // --- Re-enable Validation ---
-    if (!baseRoute.isValid(_startId, _destinationId, _graph)) {
-        std::cerr << "Error: BFS generated path FAILED validation AFTER FIX! (BFS Path Size: " << bfsPathStations.size() << ")" << std::endl;
-        // Print detailed debug info for the baseRoute if this happens
-        throw std::runtime_error("Population initialization failed: BFS path invalid despite fixes.");
+    if (_routes.empty()) {
+        LOG_DEBUG(Genetic, "No path found between start (" << startId << ") and destination (" << destinationId << ").");
+        throw std::runtime_error("Population initialization failed: No path exists between stations.");
     }
-    _routes.push_back(baseRoute);
-    std::cout << "Generated baseline route via BFS (Length: " << bfsPathStations.size() << " steps)." << std::endl;
+    const size_t seedCount = _routes.size();
+    LOG_DEBUG(Genetic, "Seeded population with " << givenSeeds << " given routes and " << (seedCount - givenSeeds) << " diverse paths.");
 
-    // --- Step 2: Generate Remaining Population by Mutating ---
-    auto routesNeeded = static_cast<size_t>(size);
+    // --- Step 2: Generate Remaining Population by Mutating the seeds in turn ---
     size_t safetyCounter = 0; 
     const size_t maxAttempts = routesNeeded * 10;
     const int minMutationSteps = 5; 
     const int maxMutationSteps = 20;
 
+    Route mutatedRoute;
     while (_routes.size() < routesNeeded && safetyCounter < maxAttempts) {
-        safetyCounter++; Route mutatedRoute = baseRoute;
+        if (safetyCounter % seedCount == 0 && cancellation.isCancelled()) {
+            LOG_DEBUG(Genetic, "Seeding cancelled (" << CancellationToken::toString(cancellation.getReason()) << ").");
+            break;
+        }
+        mutatedRoute = _routes[safetyCounter % seedCount];
+        safetyCounter++;
         std::uniform_int_distribution<> numMutationsDist(minMutationSteps, maxMutationSteps);
         int mutationsToApply = numMutationsDist(_gen);
-        for (int m = 0; m < mutationsToApply; ++m) { mutatedRoute.mutate(1.0, _gen, _startId, _destinationId, _graph); }
+        for (int m = 0; m < mutationsToApply; ++m) { mutatedRoute.mutate(1.0, _gen, _startId, _destinationId, _graph, _workspace); }
         if (mutatedRoute.isValid(_startId, _destinationId, _graph)) { _routes.push_back(mutatedRoute); }
     }
     
-    std::cout << "Generated " << _routes.size() << " initial routes total (using " << safetyCounter << " mutation attempts)." << std::endl;
+    LOG_DEBUG(Genetic, "Generated " << _routes.size() << " initial routes total (using " << safetyCounter << " mutation attempts).");
     
-    if (_routes.empty()) { throw std::runtime_error("Population became empty after mutation phase."); }
-    if (_routes.size() < routesNeeded) { std::cerr << "Warning: Could only generate " << _routes.size() << "/" << size << " valid routes via BFS+Mutation." << std::endl; }
+    if (_routes.size() < routesNeeded) { LOG_DEBUG(Genetic, "Could only generate " << _routes.size() << "/" << size << " valid routes via seeds+Mutation."); }
 }
 
 
 // --- Population Evolution Methods ---
 
+void Population::setParallel(const bool parallel, const Executor::Priority priority) {
+    _parallel = parallel;
+    _priority = priority;
+}
+
+uint64_t Population::deriveSeed(const uint64_t seed, const uint64_t stream) {
+    // splitmix64 over the seed advanced by the stream number
+    uint64_t z = seed + 0x9e3779b97f4a7c15ull * (stream + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+template <typename F>
+void Population::forEachChunk(const size_t count, const size_t chunkSize, F&& task) {
+    const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    if (!_parallel || chunkCount < 2) {
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            task(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize), _workspace);
+        }
+        return;
+    }
+
+    Executor& executor = Executor::shared();
+    const uint64_t group = Executor::newGroup();
+    std::vector<std::future<void>> futures;
+    futures.reserve(chunkCount);
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        const size_t begin = chunk * chunkSize;
+        const size_t end = std::min(count, begin + chunkSize);
+        futures.push_back(executor.submit([&task, chunk, begin, end]() { task(chunk, begin, end, chunkWorkspace); },
+            _priority, group));
+    }
+
+    // Every chunk has to finish before anything is rethrown, they all write into this population.
+    std::exception_ptr failure;
+    for (auto& future : futures) {
+        try {
+            executor.wait(future);
+        }
+        catch (...) {
+            if (!failure) failure = std::current_exception();
+        }
+    }
+    if (failure) std::rethrow_exception(failure);
+}
+
+void Population::breedChunk(const int generation, const size_t chunk, const size_t begin, const size_t end,
+    const size_t survivorCount, const double mutationRate, Route::Workspace& workspace)
+{
+    std::mt19937 gen(static_cast<std::mt19937::result_type>(
+        deriveSeed(deriveSeed(_seed, static_cast<uint64_t>(generation) + 1), chunk)));
+    std::uniform_int_distribution<> parent_dis(0, static_cast<int>(survivorCount - 1));
+    for (size_t i = begin; i < end; ++i) {
+        int idx1 = parent_dis(gen);
+        int idx2 = parent_dis(gen);
+        if (survivorCount > 1 && idx1 == idx2) {
+            idx2 = (idx1 + 1) % survivorCount;
+        }
+
+        // Parents were all scored by selection, so crossover only reads them
+        Route& child = _nextGeneration[i];
+        Route::crossover(_routes[idx1], _routes[idx2], gen, workspace, child);
+        child.mutate(mutationRate, gen, _startId, _destinationId, _graph, workspace);
+    }
+}
+
+void Population::scoreRoutes() {
+    // Each route only touches its own score caches
+    forEachChunk(_routes.size(), ScoreChunkSize, [this](size_t, const size_t begin, const size_t end, Route::Workspace&) {
+        for (size_t i = begin; i < end; ++i) {
+            _routes[i].getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime);
+        }
+    });
+}
+
 // Evolves the population
-void Population::evolve(const int generations, const double mutationRate) {
+Population::EvolveOutcome Population::evolve(const int generations, const double mutationRate, const StopCriteria& criteria) {
+    EvolveOutcome outcome;
     if (_routes.empty()) {
-        std::cerr << "Cannot evolve initial empty population." << std::endl;
-        return;
+        LOG_DEBUG(Genetic, "Cannot evolve initial empty population.");
+        return outcome;
     }
-    std::cout << "Starting evolution..." << std::endl;
+    LOG_DEBUG(Genetic, "Starting evolution" << (_parallel ? " (parallel)..." : "..."));
     const size_t targetSize = _routes.size(); // Maintain original size if possible
     const size_t elitismCount = std::max(static_cast<size_t>(1), static_cast<size_t>(targetSize * 0.1));
 
+    _nextGeneration.resize(targetSize);
+
+    // Best fitness so far, and for how many generations it hasn't improved. NaN fitness never wins std::max.
+    scoreRoutes();
+    double bestSoFar = 0.0;
+    for (const auto& route : _routes) {
+        bestSoFar = std::max(bestSoFar, route.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime));
+    }
+    int stalledGenerations = 0;
+
     for (int genIndex = 0; genIndex < generations; ++genIndex) {
+        if (std::chrono::steady_clock::now() >= criteria.deadline) {
+            outcome.stopReason = RoutingEngine::StopReason::Deadline;
+            LOG_DEBUG(Genetic, "Deadline reached after " << genIndex << " generations.");
+            break;
+        }
+        if (const CancellationToken::Reason reason = criteria.cancellation.getReason(); reason != CancellationToken::Reason::None) {
+            outcome.stopReason = RoutingEngine::toStopReason(reason);
+            LOG_DEBUG(Genetic, "Cancelled (" << CancellationToken::toString(reason) << ") after " << genIndex << " generations.");
+            break;
+        }
+        Metrics::Timer generationTimer(Metrics::Stage::Generation);
+
         // --- Selection ---
-        performSelection();
+        // Survivors are moved to the front of _routes, best first
+        size_t current_pop_size = performSelection();
 
-        if (_routes.empty()) {
-            std::cerr << "Population extinct after selection in generation " << genIndex + 1 << std::endl;
+        if (current_pop_size == 0) {
+            LOG_DEBUG(Genetic, "Population extinct after selection in generation " << genIndex + 1);
             break;
         }
 
         // --- Reproduction ---
-        std::vector<Route> newGeneration;
-        newGeneration.reserve(targetSize); 
+        // Children are written over last generation's routes in the second buffer, reusing their memory
+        size_t newGenerationSize = 0;
 
         // Elitism: Copy the best survivors directly
-        size_t current_pop_size = _routes.size(); // Size *after* selection
         size_t actualElitismCount = std::min(elitismCount, current_pop_size);
         for (size_t i = 0; i < actualElitismCount; ++i) {
-            newGeneration.push_back(_routes[i]);
+            _nextGeneration[newGenerationSize++] = _routes[i];
         }
 
-        // Breeding: Fill the rest using crossover and mutation
-        if (current_pop_size > 0) { // Check if parents exist
-            std::uniform_int_distribution<> parent_dis(0, static_cast<int>(current_pop_size - 1));
-            // Loop until the new generation reaches the target size
-            while (newGeneration.size() < targetSize) {
-                int idx1 = parent_dis(_gen);
-                int idx2 = parent_dis(_gen);
-                if (current_pop_size > 1 && idx1 == idx2) {
-                    idx2 = (idx1 + 1) % current_pop_size;
-                }
-
-                Route child = Route::crossover(_routes[idx1], _routes[idx2], _gen);
-                child.mutate(mutationRate, _gen, _startId, _destinationId, _graph);
-
-                newGeneration.push_back(child);
-
-                // Safety break if loop runs too long (shouldn't happen if targetSize is reached)
-                if (newGeneration.size() > targetSize * 2) {
-                    std::cerr << "Error: Breeding loop exceeded expected size. Breaking." << std::endl;
-                    if (newGeneration.size() > targetSize) newGeneration.resize(targetSize); // Trim excess
-                    break;
-                }
-            }
-        }
+        // Breeding: Fill the rest using crossover and mutation, in chunks with their own random streams
+        const size_t firstChild = newGenerationSize;
+        forEachChunk(targetSize - firstChild, BreedChunkSize,
+            [&](const size_t chunk, const size_t begin, const size_t end, Route::Workspace& workspace) {
+                breedChunk(genIndex, chunk, firstChild + begin, firstChild + end, current_pop_size, mutationRate, workspace);
+            });
 
         // Replace old population with the new one
-        _routes = std::move(newGeneration);
+        std::swap(_routes, _nextGeneration);
+        scoreRoutes();
 
         // --- Reporting ---
         if (!_routes.empty()) {
-            // Find best fitness in the new generation
-            const Route& best_gen_route = *std::max_element(_routes.begin(), _routes.end(),
-                [this](const Route& a, const Route& b) {
-                    return a.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords) <
-                        b.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords);
-                });
-            double best_fitness = best_gen_route.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords);
+            // Find best fitness in the new generation. Survivors reuse their cached fitness.
+            double best_fitness = 0.0;
+            for (const auto& route : _routes) {
+                best_fitness = std::max(best_fitness, route.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime));
+            }
     
             // Print periodically
             if (genIndex == 0 || (genIndex + 1) % 50 == 0 || genIndex == generations - 1) {
-                std::cout << "Generation " << (genIndex + 1) << "/" << generations
+                LOG_DEBUG(Genetic, "Generation " << (genIndex + 1) << "/" << generations
                     << " - Pop Size: " << _routes.size()
-                    << " - Best Fitness: " << best_fitness << std::endl;
+                    << " - Best Fitness: " << best_fitness);
+            }
+
+            if (best_fitness > bestSoFar + criteria.improvementEpsilon * std::abs(bestSoFar)) {
+                stalledGenerations = 0;
             }
+            else {
+                stalledGenerations++;
+            }
+            bestSoFar = std::max(bestSoFar, best_fitness);
         }
         else {
-            std::cout << "Generation " << (genIndex + 1) << " - Population empty after reproduction." << std::endl;
+            LOG_DEBUG(Genetic, "Generation " << (genIndex + 1) << " - Population empty after reproduction.");
+        }
+        outcome.generationsRun = genIndex + 1;
+
+        if (criteria.stallGenerations > 0 && stalledGenerations >= criteria.stallGenerations) {
+            outcome.stopReason = RoutingEngine::StopReason::Stalled;
+            LOG_DEBUG(Genetic, "No improvement for " << stalledGenerations << " generations, stopping at generation " << (genIndex + 1) << ".");
+            break;
+        }
+        if (criteria.targetMinutes > 0.0 && !_routes.empty()) {
+            const double bestMinutes = getBestSolution().calculateFullJourneyTime(_graph, _startId, _destinationId,
+                _userCoords, _destCoords, _departureTime);
+            if (bestMinutes <= criteria.targetMinutes) {
+                outcome.stopReason = RoutingEngine::StopReason::TargetReached;
+                criteria.cancellation.cancel(CancellationToken::Reason::TargetReached);
+                LOG_DEBUG(Genetic, "Best route takes " << bestMinutes << " min, within the " << criteria.targetMinutes
+                    << " min target, stopping at generation " << (genIndex + 1) << ".");
+                break;
+            }
         }
     } // End generation loop
-    std::cout << "Evolution finished." << std::endl;
+    LOG_DEBUG(Genetic, "Evolution finished.");
+    return outcome;
 }
 
 
@@ -258,8 +378,8 @@ const Route& Population::getBestSolution() const {
     }
     auto best_it = std::max_element(_routes.begin(), _routes.end(),
         [this](const Route& a, const Route& b) {
-            return a.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords) <
-                b.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords);
+            return a.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime) <
+                b.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime);
         });
     if (best_it == _routes.end()) {
         throw std::runtime_error("Error: Could not determine best solution (max_element failed).");
@@ -268,24 +388,67 @@ const Route& Population::getBestSolution() const {
 }
 
 
-// Selection: Sorts by fitness (descending) and keeps the top half (at least 1)
-void Population::performSelection() {
-    if (_routes.empty()) return
+std::vector<Route> Population::getBestSolutions(const size_t count) const {
+    std::vector<std::pair<double, size_t>> ranking;
+    ranking.reserve(_routes.size());
+    for (size_t i = 0; i < _routes.size(); ++i) {
+        double fitness = _routes[i].getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime);
+        ranking.emplace_back(std::isnan(fitness) ? -std::numeric_limits<double>::infinity() : fitness, i);
+    }
+    std::sort(ranking.begin(), ranking.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    // Elitism copies the best routes forward, so a population usually holds several copies of each.
+    std::vector<Route> best;
+    for (const auto& [fitness, index] : ranking) {
+        if (best.size() >= count) break;
+        const Route& route = _routes[index];
+        if (std::none_of(best.begin(), best.end(), [&route](const Route& other) { return route.hasSameSteps(other); })) {
+            best.push_back(route);
+        }
+    }
+    return best;
+}
+
+
+void Population::replaceWorst(std::vector<Route> routes) {
+    _ranking.clear();
+    for (size_t i = 0; i < _routes.size(); ++i) {
+        double fitness = _routes[i].getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime);
+        _ranking.emplace_back(std::isnan(fitness) ? -std::numeric_limits<double>::infinity() : fitness, i);
+    }
+    const size_t replaced = std::min(routes.size(), _ranking.size());
+    std::partial_sort(_ranking.begin(), _ranking.begin() + replaced, _ranking.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (size_t i = 0; i < replaced; ++i) {
+        _routes[_ranking[i].second] = std::move(routes[i]);
+    }
+}
 
-    std::sort(_routes.begin(), _routes.end(),
-        [this](const Route& a, const Route& b) {
-            double fitnessA = a.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords);
-            double fitnessB = b.getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords);
-            if (std::isnan(fitnessB)) return true;
-            if (std::isnan(fitnessA)) return false;
-            return fitnessA > fitnessB;
-        });
+
+// Selection: Sorts by fitness (descending) and keeps the top half (at least 1)
+size_t Population::performSelection() {
+    if (_routes.empty()) return 0;
+
+    // Score every route once, then order by the stored scores. NaN fitness sorts last.
+    _ranking.clear();
+    for (size_t i = 0; i < _routes.size(); ++i) {
+        double fitness = _routes[i].getFitness(_startId, _destinationId, _graph, _userCoords, _destCoords, _departureTime);
+        _ranking.emplace_back(std::isnan(fitness) ? -std::numeric_limits<double>::infinity() : fitness, i);
+    }
 
     size_t current_size = _routes.size();
     size_t keepCount = std::max(static_cast<size_t>(1), (current_size + 1) / 2);
 
-    if (keepCount < current_size) {
-        _routes.resize(keepCount);
+    std::partial_sort(_ranking.begin(), _ranking.begin() + keepCount, _ranking.end(),
+        [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    // Reorder by swapping routes through a second buffer, so every route keeps its allocated steps
+    if (_selectionBuffer.size() < keepCount) _selectionBuffer.resize(keepCount);
+    for (size_t i = 0; i < keepCount; ++i) {
+        std::swap(_selectionBuffer[i], _routes[_ranking[i].second]);
+    }
+    for (size_t i = 0; i < keepCount; ++i) {
+        std::swap(_routes[i], _selectionBuffer[i]);
     }
+    return keepCount;
 }
-
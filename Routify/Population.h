@@ -1,26 +1,105 @@
 #pragma once
 #include "Route.h"
 #include "Graph.h"
+#include "RoutingEngine.h"
+#include "Executor.h"
+#include <chrono>
+#include <cstdint>
+#include <optional>
 #include <random>
 
 class Population {
 public:
+    // Number of diverse shortest paths the initial population is seeded from, on top of any seed routes.
+    static constexpr int DiversePathCount = 4;
+
+    // Children bred per random stream, and routes scored per executor task in parallel mode.
+    static constexpr size_t BreedChunkSize = 16;
+    static constexpr size_t ScoreChunkSize = 64;
+
+    // When evolve may stop before running every generation.
+    struct StopCriteria {
+        int stallGenerations = 0;           // Generations without improvement before giving up, 0 never gives up
+        double improvementEpsilon = 0.0;    // Relative gain in best fitness that counts as an improvement
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        CancellationToken cancellation;     // Checked before each generation
+        double targetMinutes = 0.0;         // Stops once the best route takes at most this long, 0 never does.
+                                            // Also cancels `cancellation`, so searches sharing it stop too.
+    };
+
+    struct EvolveOutcome {
+        int generationsRun = 0;
+        RoutingEngine::StopReason stopReason = RoutingEngine::StopReason::Generations;
+    };
+
+    /*
+    * Seeds the population from seedRoutes (typically the elites of an earlier run for the same pair, invalid ones
+    * are dropped) and from DiversePathCount shortest paths found with increasing penalties on already used edges.
+    * The rest of the population are mutations of those seeds.
+    * Without a seed the random generator is seeded from std::random_device.
+    * Routes are scored for leaving at departureTime (minutes since midnight).
+    * Once cancellation fires, seeding stops with the routes it has so far.
+    */
     Population(const int size, const int startId, const int destinationId, const Graph& graph,
         const Utilities::Coordinates& userCoords,
-        const Utilities::Coordinates& destCoords);
-    void evolve(const int generations, const double mutationRate);
+        const Utilities::Coordinates& destCoords,
+        const double departureTime,
+        std::vector<Route> seedRoutes = {},
+        const std::optional<uint64_t> seed = std::nullopt,
+        const CancellationToken& cancellation = {});
+
+    /*
+    * Breeds and scores each generation as executor tasks at the given priority, instead of on the calling thread.
+    * Children are bred in chunks of BreedChunkSize, each with its own generator seeded from the population's seed,
+    * the generation and the chunk, so a seeded run evolves the same way in either mode and on any number of workers.
+    */
+    void setParallel(const bool parallel, const Executor::Priority priority = Executor::Priority::Normal);
+
+    // Mixes a stream number into a seed, for deriving independent generators from one seed.
+    static uint64_t deriveSeed(const uint64_t seed, const uint64_t stream);
+    // Runs up to `generations` generations, or fewer when a stop criterion is met first.
+    EvolveOutcome evolve(const int generations, const double mutationRate, const StopCriteria& criteria);
     const Route& getBestSolution() const;
 
-    void performSelection();
+    // Returns up to count distinct routes, fittest first.
+    std::vector<Route> getBestSolutions(const size_t count) const;
+
+    // Replaces the least fit routes with the given ones (migrants from another island).
+    void replaceWorst(std::vector<Route> routes);
+
+    // Moves the best half of the routes (at least 1) to the front, best first, and returns how many survived.
+    // The rest of the vector is left for the next generation to overwrite.
+    size_t performSelection();
 
 private:
+    // Breeds _nextGeneration[begin, end) from the first survivorCount routes, with chunk's own generator.
+    void breedChunk(const int generation, const size_t chunk, const size_t begin, const size_t end,
+        const size_t survivorCount, const double mutationRate, Route::Workspace& workspace);
+
+    // Computes every route's fitness, so later loops over _routes only read the cached values.
+    void scoreRoutes();
+
+    // Runs task(chunk, begin, end) over [0, count) in chunks of chunkSize, on the executor in parallel mode.
+    template <typename F>
+    void forEachChunk(const size_t count, const size_t chunkSize, F&& task);
+
     const Graph& _graph;
     std::vector<Route> _routes;
 
+    // Buffers reused by every generation, so steady-state evolution doesn't allocate.
+    std::vector<Route> _nextGeneration;             // Double buffer, swapped with _routes after breeding
+    std::vector<Route> _selectionBuffer;
+    std::vector<std::pair<double, size_t>> _ranking;
+    Route::Workspace _workspace;
+
     int _startId;
     int _destinationId;
     Utilities::Coordinates _userCoords;
     Utilities::Coordinates _destCoords;
+    double _departureTime;
 
-    std::mt19937 _gen;
+    uint64_t _seed;
+    std::mt19937 _gen;          // Initial population only, generations draw from per-chunk generators
+    bool _parallel = false;
+    Executor::Priority _priority = Executor::Priority::Normal;
 };
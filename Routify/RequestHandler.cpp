@@ -1,13 +1,24 @@
 #include "RequestHandler.h"
-#include "Population.h"
 #include "Utilities.hpp"
-#include <iostream>
+#include "Logger.h"
+#include "IslandModel.h"
+#include "Metrics.h"
 #include <stdexcept>
 #include <limits>
 #include <algorithm>
 #include <unordered_set>
-#include <thread>
+#include <unordered_map>
+#include <filesystem>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 #include <future>
+#include <bit>
+#include <cmath>
+#include <type_traits>
+#include <chrono>
+#include <cstdlib>
 
 using json = nlohmann::json;
 
@@ -19,68 +30,189 @@ static void to_json(json& j, const Graph::Station& p) {
     };
 }
 
-RequestHandler::RequestHandler() : _graph() {}
+// Appends a number to a packed little-endian array, the layout of the binary fields in isochrone responses.
+template <typename T>
+static void appendLittleEndian(std::string& out, const T number) {
+    using Bits = std::conditional_t<sizeof(T) == 2, uint16_t, uint32_t>;
+    const Bits bits = std::bit_cast<Bits>(number);
+    for (size_t shift = 0; shift < 8 * sizeof(T); shift += 8) {
+        out.push_back(static_cast<char>((bits >> shift) & 0xFF));
+    }
+}
+
+// Prefers the precompiled binary graph, and falls back to parsing the GTFS text files.
+static RequestHandler::GraphSnapshot loadInitialGraph() {
+    if (std::filesystem::exists(Graph::DefaultBinaryGraphFile)) {
+        try {
+            return std::make_shared<const Graph>(Graph::DefaultBinaryGraphFile);
+        }
+        catch (const std::exception& e) {
+            LOG_WARNING(Request, "Failed to load binary graph, parsing GTFS instead: " << e.what());
+        }
+    }
+    return std::make_shared<const Graph>();
+}
 
-void RequestHandler::handleRequest(Socket clientSocket)
+// Reads the admin token from the environment, empty when admin requests are disabled.
+static std::string readAdminToken() {
+    const char* token = std::getenv(RequestHandler::AdminTokenVariable);
+    return token ? token : "";
+}
+
+RequestHandler::RequestHandler() : _graph(loadInitialGraph()), _adminToken(readAdminToken())
 {
-    std::string response_str;
-    std::string received = clientSocket.receiveMessage();
-    std::cout << "Received: " << received << std::endl;
+    // Optional: without labels every "auto" request runs the GA.
+    if (!std::filesystem::exists(HubLabels::DefaultHubLabelFile)) return;
+    try {
+        _hubLabelEngine.setLabels(std::make_shared<const HubLabels>(HubLabels::DefaultHubLabelFile), *getGraphSnapshot());
+    }
+    catch (const std::exception& e) {
+        LOG_WARNING(Request, "Failed to load hub labels, long trips will run the GA: " << e.what());
+    }
+}
+
+RequestHandler::~RequestHandler()
+{
+    // Joined without the lock, the reload takes it to record how it went.
+    std::thread reload;
+    {
+        std::lock_guard<std::mutex> lock(_reloadMutex);
+        reload = std::move(_reloadThread);
+    }
+    if (reload.joinable()) reload.join();
+}
+
+RequestHandler::GraphSnapshot RequestHandler::getGraphSnapshot() const
+{
+    return _graph.load();
+}
+
+void RequestHandler::swapGraphSnapshot(GraphSnapshot newGraph, std::shared_ptr<const HubLabels> labels)
+{
+    if (!newGraph) {
+        throw std::invalid_argument("Cannot swap in an empty graph snapshot.");
+    }
+    // Labels only answer for the graph they were set with, so requests still on the old graph fall back to the GA.
+    if (labels) _hubLabelEngine.setLabels(std::move(labels), *newGraph);
+    else _hubLabelEngine.clearLabels();
+    _graph.store(std::move(newGraph));
+    _routeCache.clear();
+    _geneticEngine.clearEliteRoutes();
+    _graphVersion++;
+}
+
+RouteCache::Stats RequestHandler::getRouteCacheStats() const
+{
+    return _routeCache.getStats();
+}
+
+RequestHandler::Reply RequestHandler::handleMessage(const std::string& received, const PartialReplySink& sendPartial,
+    const CancellationToken& disconnected)
+{
+    // Pin the current snapshot so a concurrent swap can't free the graph mid-request.
+    const GraphSnapshot graph = getGraphSnapshot();
+    Metrics::Timer timer(Metrics::Stage::Request);
+    Metrics::shared().increment(Metrics::Counter::Requests);
+    LOG_DEBUG(Request, "Received: " << received);
 
     if (received.empty()) {
         json error_resp = { {"error", "Empty request received"} };
-        clientSocket.sendMessage(error_resp.dump());
-        return;
+        return { error_resp.dump(), false };
     }
 
+    Reply reply;
+    json requestId;
+    ResponseWriter::Format format = ResponseWriter::Format::PrettyJson;
+    json errorJson;
+    // Every search of this request runs under it, it fires when the client disconnects.
+    const CancellationToken cancellation = CancellationToken::create(disconnected);
     try {
         json request_json = json::parse(received);
-        int type = request_json.value("type", -1);
-        json response_json;
+        if (request_json.is_object() && request_json.contains(RequestIdKey)) {
+            requestId = request_json[RequestIdKey];
+        }
+        format = ResponseWriter::parseFormat(request_json.value(FormatKey, "pretty"));
 
+        // Responses are written straight into the reply buffer.
+        ResponseWriter writer(reply.body, format);
+        if (!requestId.is_null()) writer.setRootField(RequestIdKey, requestId);
+
+        int type = request_json.value("type", -1);
         switch (type) {
-        case 0: response_json = handleGetLines(request_json); break;
-        case 1: response_json = handleGetStationInfo(request_json); break;
-        case 2: response_json = handleFindRouteCoordinates(request_json); break;
-        default: response_json = { {"error", "Invalid request type"} }; break;
+        case 0: writer.value(handleGetLines(request_json, *graph)); break;
+        case 1: writer.value(handleGetStationInfo(request_json, *graph)); break;
+        case 2: handleFindRouteCoordinates(request_json, graph, cancellation, writer); break;
+        case 3: handleBatchRoutes(request_json, graph, requestId, format, sendPartial, cancellation, writer); break;
+        case 4: handleIsochrone(request_json, *graph, writer); break;
+        case 5: writer.value(handleAdmin(request_json)); break;
+        case 6: writer.value(handleMetrics(request_json)); break;
+        default: writer.value(json{ {"error", "Invalid request type"} }); break;
         }
-        response_str = response_json.dump(2);
-
     }
     catch (const json::parse_error& e) {
-        json error_resp = { {"error", "Invalid JSON format"}, {"details", e.what()} };
-        response_str = error_resp.dump(2); std::cerr << "JSON Parse Error: " << e.what() << std::endl;
+        errorJson = { {"error", "Invalid JSON format"}, {"details", e.what()} };
+        LOG_WARNING(Request, "JSON Parse Error: " << e.what());
+    }
+    catch (const std::invalid_argument& e) {
+        errorJson = { {"error", "Invalid request"}, {"details", e.what()} };
+        LOG_WARNING(Request, "Invalid request: " << e.what());
     }
     catch (const std::runtime_error& e) {
-        json error_resp = { {"error", "Processing error during request"}, {"details", e.what()} };
-        response_str = error_resp.dump(2); std::cerr << "Runtime Error: " << e.what() << std::endl;
+        errorJson = { {"error", "Processing error during request"}, {"details", e.what()} };
+        LOG_WARNING(Request, "Runtime Error: " << e.what());
     }
     catch (const std::exception& e) {
-        json error_resp = { {"error", "An unexpected server error occurred"}, {"details", e.what()} };
-        response_str = error_resp.dump(2); std::cerr << "Standard Exception: " << e.what() << std::endl;
+        errorJson = { {"error", "An unexpected server error occurred"}, {"details", e.what()} };
+        LOG_WARNING(Request, "Standard Exception: " << e.what());
     }
     catch (...) {
-        json error_resp = { {"error", "An unknown server error occurred"} };
-        response_str = error_resp.dump(2); std::cerr << "Unknown Error occurred." << std::endl;
+        errorJson = { {"error", "An unknown server error occurred"} };
+        LOG_WARNING(Request, "Unknown Error occurred.");
     }
 
-    std::cout << "Sending Response:\n" << response_str << std::endl;
-    clientSocket.sendMessage(response_str);
-    std::cout << "Response sent!" << std::endl;
-    clientSocket.closeSocket();
-    std::cout << "Socket closed!" << std::endl;
+    if (!errorJson.is_null()) {
+        Metrics::shared().increment(Metrics::Counter::RequestErrors);
+        // Drop whatever was written before the failure.
+        reply.body.clear();
+        ResponseWriter writer(reply.body, format);
+        if (!requestId.is_null()) writer.setRootField(RequestIdKey, requestId);
+        writer.value(errorJson);
+    }
+    reply.tagged = !requestId.is_null();
+    LOG_DEBUG(Request, "Sending response (" << reply.body.size() << " bytes)");
+    return reply;
+}
+
+RequestHandler::Reply RequestHandler::makeErrorReply(const std::string& received, const std::string& error)
+{
+    // Only the request id and format are needed, a malformed request just gets an untagged pretty reply.
+    Reply reply;
+    json request_json = json::parse(received, nullptr, false);
+    ResponseWriter::Format format = ResponseWriter::Format::PrettyJson;
+    json requestId;
+    if (request_json.is_object()) {
+        if (request_json.contains(RequestIdKey)) requestId = request_json[RequestIdKey];
+        try { format = ResponseWriter::parseFormat(request_json.value(FormatKey, "pretty")); }
+        catch (const std::exception&) {}
+    }
+
+    ResponseWriter writer(reply.body, format);
+    if (!requestId.is_null()) writer.setRootField(RequestIdKey, requestId);
+    writer.value(json{ {"error", error} });
+    reply.tagged = !requestId.is_null();
+    return reply;
 }
 
 // --- Helper Handlers for Different Request Types ---
 
 // Handles request type 0: Get lines from a station
-json RequestHandler::handleGetLines(const json& request_json) const {
+json RequestHandler::handleGetLines(const json& request_json, const Graph& graph) const {
     int stationId = request_json.value("stationId", -1);
-    if (stationId == -1 || !_graph.hasStation(stationId)) {
+    if (stationId == -1 || !graph.hasStation(stationId)) {
         return { {"error", "Invalid or missing stationId"} };
     }
 
-    const auto& lines = _graph.getLinesFrom(stationId);
+    const auto lines = graph.getLinesFrom(stationId);
     if (lines.empty()) {
         return { {"stationId", stationId}, {"lines", json::array()}, {"message", "No lines found"} };
     }
@@ -92,7 +224,7 @@ json RequestHandler::handleGetLines(const json& request_json) const {
         lineObj["to_code"] = line.to;
         try {
             // Attempt to add destination station name
-            lineObj["to_name"] = _graph.getStationByCode(line.to).name;
+            lineObj["to_name"] = graph.getStationByCode(line.to).name;
         }
         catch (...) {
             lineObj["to_name"] = "[Station Code Not Found]"; // Handle case where 'to' code might be invalid
@@ -103,13 +235,13 @@ json RequestHandler::handleGetLines(const json& request_json) const {
 }
 
 // Handles request type 1: Get station details
-json RequestHandler::handleGetStationInfo(const json& request_json) const {
+json RequestHandler::handleGetStationInfo(const json& request_json, const Graph& graph) const {
     int stationId = request_json.value("stationId", -1);
-    if (stationId == -1 || !_graph.hasStation(stationId)) {
+    if (stationId == -1 || !graph.hasStation(stationId)) {
         return { {"error", "Invalid or missing stationId"} };
     }
 
-    const Graph::Station& st = _graph.getStationByCode(stationId);
+    const Graph::Station& st = graph.getStationByCode(stationId);
     json stationJson = st;
     
     stationJson["code"] = stationId;
@@ -119,41 +251,62 @@ json RequestHandler::handleGetStationInfo(const json& request_json) const {
 
 
 // --- Top-Level Coordinate Route Handler ---
-json RequestHandler::handleFindRouteCoordinates(const json& request_json) const {
-    std::cout << "Handling Coordinate Route Request..." << std::endl;
+void RequestHandler::handleFindRouteCoordinates(const json& request_json, const GraphSnapshot& snapshot,
+    const CancellationToken& cancellation, ResponseWriter& writer) const
+{
+    LOG_DEBUG(Request, "Handling Coordinate Route Request...");
+    const Graph& graph = *snapshot;
 
     // 1. Extract & Validate Input
     RequestData inputData;
+    inputData.cancellation = cancellation;
     json errorJson = extractAndValidateCoordinateInput(request_json, inputData);
-    if (!errorJson.is_null()) return errorJson;
+    if (!errorJson.is_null()) return writer.value(errorJson);
 
-    // 2. Find Nearby Stations
-    NearbyStations allFoundStations;
-    errorJson = findNearbyStationsForRoute(inputData, allFoundStations);
-    if (!errorJson.is_null()) return errorJson;
-
-    // 3. Select Representative START Stations
+    // 2. Find nearby stations and select representative START stations
     StationList selectedStartStations;
-    selectRepresentativeStations(inputData.startCoords, allFoundStations.startStations, selectedStartStations);
-    if (selectedStartStations.empty()) {
-        return { {"error", "Failed to select representative start stations"} };
-    }
+    errorJson = snapStartStations(inputData.startCoords, inputData.nearbyRadiusKm, graph, selectedStartStations);
+    if (!errorJson.is_null()) return writer.value(errorJson);
 
-    // 4. Select CLOSEST END Station
-    std::optional<Graph::Station> closestEndStationOpt = selectClosestStation(inputData.endCoords, allFoundStations.endStations);
-    if (!closestEndStationOpt.has_value()) {
-        return { {"error", "Failed to select closest end station"} };
-    }
+    // 3-4. Find nearby stations and select the CLOSEST END station
+    std::optional<Graph::Station> closestEndStationOpt;
+    errorJson = snapEndStation(inputData.endCoords, inputData.nearbyRadiusKm, graph, closestEndStationOpt);
+    if (!errorJson.is_null()) return writer.value(errorJson);
     const Graph::Station& closestEndStationPair = closestEndStationOpt.value();
+    chooseAutoEngine(request_json, inputData, graph);
+
+    // 5. Find Best Route (GA), unless the same snapped stations were asked for recently
+    const bool useCache = request_json.value(CacheKey, true);
+    const RouteCache::Key cacheKey = _routeCache.makeKey(selectedStartStations, closestEndStationPair, inputData);
+    std::optional<BestRouteResult> bestResultOpt;
+    if (useCache) {
+        bestResultOpt = _routeCache.find(cacheKey, graph);
+    }
+    if (bestResultOpt.has_value()) {
+        LOG_DEBUG(Request, "Route cache hit for end station " << closestEndStationPair.code);
+    }
+    else {
+        bestResultOpt = findBestRouteToDestination(
+            selectedStartStations,
+            closestEndStationPair,
+            inputData,
+            graph
+        );
+        // A result cut short (deadline, target, disconnect) is worse than what the next request could get, don't keep it.
+        if (useCache && bestResultOpt.has_value() && RoutingEngine::ranToCompletion(bestResultOpt->stopReason)) {
+            _routeCache.insert(cacheKey, snapshot, bestResultOpt.value());
+        }
+    }
 
-    // 5. Find Best Route (GA)
-    std::optional<BestRouteResult> bestResultOpt = findBestRouteToDestination(
-        selectedStartStations,
-        closestEndStationPair,
-        inputData 
-    );
+    // 6. Post-Process Result
+    writeRouteAnswer(bestResultOpt, inputData, graph, writer);
+}
 
-    // 6. Post-Process Result: Compare Direct Walk vs Station Route
+// Compares the station route with walking directly and writes the answer the user gets.
+void RequestHandler::writeRouteAnswer(const std::optional<BestRouteResult>& bestResultOpt, const RequestData& inputData,
+    const Graph& graph, ResponseWriter& writer) const
+{
+    // Compare Direct Walk vs Station Route
     double directWalkTime = 0.0;
     double directWalkDistance = Utilities::calculateHaversineDistance(inputData.startCoords, inputData.endCoords);
     if (Utilities::WALK_SPEED_KPH > 0) {
@@ -164,14 +317,14 @@ json RequestHandler::handleFindRouteCoordinates(const json& request_json) const
     // Case 1: No station route found by GA
     if (!bestResultOpt.has_value()) {
         if (directWalkDistance < MAX_REASONABLE_WALK_KM) {
-            return {
+            return writer.value(json{
                {"status", "Direct walk recommended"}, {"reason", "No public transport route found"},
                {"walk_distance_km", directWalkDistance}, {"walk_time_mins", directWalkTime},
                {"from_coords", {{"lat", inputData.startCoords.latitude}, {"lon", inputData.startCoords.longitude}}},
                {"to_coords", {{"lat", inputData.endCoords.latitude}, {"lon", inputData.endCoords.longitude}}}
-            };
+            });
         }
-        else { return { {"status", "No route found (and direct walk too long)"} }; }
+        else { return writer.value(json{ {"status", "No route found (and direct walk too long)"} }); }
     }
 
     // Case 2: Station route WAS found
@@ -179,17 +332,18 @@ json RequestHandler::handleFindRouteCoordinates(const json& request_json) const
 
     // Calculate total time for the station route using the Route method
     double totalStationRouteTime = bestResult.route.calculateFullJourneyTime(
-        _graph,
+        graph,
         bestResult.startStationCode,
         bestResult.endStationId,
         inputData.startCoords,
-        inputData.endCoords
+        inputData.endCoords,
+        inputData.departureTime
     );
 
     bool onlyWalkingInStationRoute = true;
     if (!bestResult.route.getVisitedStations().empty()) {
         for (const auto& vs : bestResult.route.getVisitedStations()) {
-            if (vs.line.id != "Walk" && vs.line.id != "Start") {
+            if (vs.isRide()) {
                 onlyWalkingInStationRoute = false;
                 break;
             }
@@ -199,50 +353,572 @@ json RequestHandler::handleFindRouteCoordinates(const json& request_json) const
     // Rule 1: Route was only walking between stations
     if (onlyWalkingInStationRoute) {
         if (directWalkDistance < MAX_REASONABLE_WALK_KM) {
-            return {
+            return writer.value(json{
                {"status", "Direct walk recommended"}, {"reason", "Route involved no public transport"},
                 {"walk_distance_km", directWalkDistance}, {"walk_time_mins", directWalkTime},
                {"station_route_alternative_time_mins", totalStationRouteTime},
                {"from_coords", {{"lat", inputData.startCoords.latitude}, {"lon", inputData.startCoords.longitude}}},
                {"to_coords", {{"lat", inputData.endCoords.latitude}, {"lon", inputData.endCoords.longitude}}}
-            };
+            });
         }
         else { /* Handle case where direct walk is too long, but route was only walking */
-            std::cerr << "Warning: Route only involved walking, but direct walk too long. Formatting walk route." << std::endl;
+            LOG_WARNING(Request, "Route only involved walking, but direct walk too long. Formatting walk route.");
         }
     }
 
     // Rule 2: Compare times if public transport was involved
     const double PREFER_WALK_THRESHOLD_MINS = 5.0;
     if (!onlyWalkingInStationRoute && directWalkTime < totalStationRouteTime + PREFER_WALK_THRESHOLD_MINS && directWalkDistance < MAX_REASONABLE_WALK_KM) { /* Return Direct Walk JSON */
-        return {
+        return writer.value(json{
            {"status", "Direct walk recommended"}, {"reason", "Direct walk is faster or comparable"},
            // ... (Direct walk details) ...
             {"walk_distance_km", directWalkDistance}, {"walk_time_mins", directWalkTime},
            {"station_route_alternative_time_mins", totalStationRouteTime},
            {"from_coords", {{"lat", inputData.startCoords.latitude}, {"lon", inputData.startCoords.longitude}}},
            {"to_coords", {{"lat", inputData.endCoords.latitude}, {"lon", inputData.endCoords.longitude}}}
-        };
+        });
     }
 
     // Rule 3: Check final walk distance of the station route
     double finalWalkDist = 0.0;
     try {
-        finalWalkDist = Utilities::calculateHaversineDistance(_graph.getStationByCode(bestResult.endStationId).coordinates, inputData.endCoords);
+        finalWalkDist = Utilities::calculateHaversineDistance(graph.getStationByCode(bestResult.endStationId).coordinates, inputData.endCoords);
     }
     catch (...) {}
     const double MAX_FINAL_WALK_KM = 1.5;
     if (finalWalkDist > MAX_FINAL_WALK_KM) {
-        // Add warning when formatting
-        json response = formatRouteResponse(bestResult, inputData); 
-        response["warning"] = "Route requires a long final walk (" + std::to_string(finalWalkDist) + " km)";
-        return response;
+        return formatRouteResponse(bestResult, inputData, graph, writer,
+            "Route requires a long final walk (" + std::to_string(finalWalkDist) + " km)");
     }
 
-    return formatRouteResponse(bestResult, inputData); 
+    formatRouteResponse(bestResult, inputData, graph, writer);
 }
 
 
+// --- Batch Route Handler ---
+// Handles request type 3: routes for many origin/destination pairs that share the request's parameters
+void RequestHandler::handleBatchRoutes(const json& request_json, const GraphSnapshot& snapshot, const json& requestId,
+    const ResponseWriter::Format format, const PartialReplySink& sendPartial, const CancellationToken& cancellation,
+    ResponseWriter& writer) const
+{
+    const Graph& graph = *snapshot;
+    RequestData batchParams;
+    batchParams.cancellation = cancellation;
+    json errorJson = extractAndValidateRouteParams(request_json, batchParams);
+    if (!errorJson.is_null()) return writer.value(errorJson);
+
+    const auto pairsIt = request_json.find("pairs");
+    if (pairsIt == request_json.end() || !pairsIt->is_array() || pairsIt->empty()) {
+        return writer.value(json{ {"error", "Missing pairs (non-empty array of startLat/startLong/endLat/endLong objects)"} });
+    }
+    if (pairsIt->size() > MaxBatchPairs) {
+        return writer.value(json{ {"error", "Too many pairs (at most " + std::to_string(MaxBatchPairs) + ")"} });
+    }
+    const bool useCache = request_json.value(CacheKey, true);
+    const bool streaming = sendPartial && !requestId.is_null();
+
+    // Each distinct coordinate is snapped once, however many pairs use it. Map nodes never move.
+    struct SnappedOrigin {
+        StationList stations;
+        json error;
+    };
+    struct SnappedDestination {
+        std::optional<Graph::Station> station;
+        json error;
+    };
+    using CoordinateKey = std::pair<double, double>;
+    std::map<CoordinateKey, SnappedOrigin> origins;
+    std::map<CoordinateKey, SnappedDestination> destinations;
+
+    struct BatchPair {
+        RequestData params;
+        json error;                                     // Set if the pair can't be routed
+        const SnappedOrigin* origin = nullptr;
+        const SnappedDestination* destination = nullptr;
+        std::optional<RouteCache::Key> cacheKey;
+        std::optional<BestRouteResult> result;
+    };
+
+    /*
+    * One engine call. Timetable jobs hold every pair leaving from one origin, answered from a single search tree.
+    * GA jobs hold the pairs that snapped to the same stations, which get the same answer.
+    */
+    struct BatchJob {
+        const SnappedOrigin* origin = nullptr;
+        RequestData params;                             // Of the job's first pair
+        std::vector<RoutingEngine::Target> targets;
+        std::vector<std::vector<size_t>> targetPairs;   // The pairs answered by each target
+        std::map<CoordinateKey, size_t> targetIndex;    // Timetable jobs: end coordinates to target
+    };
+
+    std::vector<BatchPair> pairs(pairsIt->size());
+    std::vector<BatchJob> jobs;
+    std::map<CoordinateKey, size_t> timetableJobs;      // Origin coordinates to job
+    std::unordered_map<RouteCache::Key, size_t, RouteCache::KeyHash> geneticJobs;
+    std::vector<size_t> answered;                       // Pairs answered without a search, in order
+    size_t cacheHits = 0;
+
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        BatchPair& pair = pairs[i];
+        pair.params = batchParams;
+        const json& pairJson = (*pairsIt)[i];
+        try {
+            pair.params.startCoords.latitude = pairJson.at("startLat").get<double>();
+            pair.params.startCoords.longitude = pairJson.at("startLong").get<double>();
+            pair.params.endCoords.latitude = pairJson.at("endLat").get<double>();
+            pair.params.endCoords.longitude = pairJson.at("endLong").get<double>();
+        }
+        catch (const json::exception&) {
+            pair.error = { {"error", "Missing or invalid coordinates (startLat/startLong/endLat/endLong)"} };
+        }
+        if (pair.error.is_null() && (!pair.params.startCoords.isValid() || !pair.params.endCoords.isValid())) {
+            pair.error = { {"error", "Invalid coordinates"} };
+        }
+        if (!pair.error.is_null()) {
+            answered.push_back(i);
+            continue;
+        }
+
+        const CoordinateKey startKey{ pair.params.startCoords.latitude, pair.params.startCoords.longitude };
+        const CoordinateKey endKey{ pair.params.endCoords.latitude, pair.params.endCoords.longitude };
+        auto [originIt, newOrigin] = origins.try_emplace(startKey);
+        if (newOrigin) {
+            originIt->second.error = snapStartStations(pair.params.startCoords, batchParams.nearbyRadiusKm, graph, originIt->second.stations);
+        }
+        auto [destinationIt, newDestination] = destinations.try_emplace(endKey);
+        if (newDestination) {
+            destinationIt->second.error = snapEndStation(pair.params.endCoords, batchParams.nearbyRadiusKm, graph, destinationIt->second.station);
+        }
+        pair.origin = &originIt->second;
+        pair.destination = &destinationIt->second;
+        if (!pair.origin->error.is_null() || !pair.destination->error.is_null()) {
+            pair.error = pair.origin->error.is_null() ? pair.destination->error : pair.origin->error;
+            answered.push_back(i);
+            continue;
+        }
+
+        chooseAutoEngine(request_json, pair.params, graph);
+        pair.cacheKey = _routeCache.makeKey(pair.origin->stations, *pair.destination->station, pair.params);
+        if (useCache) {
+            pair.result = _routeCache.find(*pair.cacheKey, graph);
+            if (pair.result.has_value()) {
+                cacheHits++;
+                answered.push_back(i);
+                continue;
+            }
+        }
+
+        // Find the job and target this pair joins, starting new ones as needed.
+        size_t jobIndex = jobs.size();
+        if (batchParams.engine == RoutingEngine::Type::Timetable) {
+            jobIndex = timetableJobs.try_emplace(startKey, jobs.size()).first->second;
+        }
+        else {
+            jobIndex = geneticJobs.try_emplace(*pair.cacheKey, jobs.size()).first->second;
+        }
+        if (jobIndex == jobs.size()) {
+            jobs.emplace_back();
+            jobs.back().origin = pair.origin;
+            jobs.back().params = pair.params;
+        }
+        BatchJob& job = jobs[jobIndex];
+        size_t targetIndex = job.targets.size();
+        if (batchParams.engine == RoutingEngine::Type::Timetable) {
+            targetIndex = job.targetIndex.try_emplace(endKey, job.targets.size()).first->second;
+        }
+        else if (!job.targets.empty()) {
+            targetIndex = 0;
+        }
+        if (targetIndex == job.targets.size()) {
+            job.targets.push_back(RoutingEngine::Target{ *pair.destination->station, pair.params.endCoords });
+            job.targetPairs.emplace_back();
+        }
+        job.targetPairs[targetIndex].push_back(i);
+    }
+    LOG_INFO(Request, "Batch of " << pairs.size() << " pairs: " << origins.size() << " origins, " << destinations.size()
+        << " destinations, " << cacheHits << " cache hits, " << jobs.size() << " searches.");
+
+    // Writes one pair's answer: its error, or the same answer a single route request would get.
+    auto writePairAnswer = [&](const size_t index, ResponseWriter& pairWriter) {
+        const BatchPair& pair = pairs[index];
+        if (!pair.error.is_null()) pairWriter.value(pair.error);
+        else writeRouteAnswer(pair.result, pair.params, graph, pairWriter);
+    };
+    auto streamPair = [&](const size_t index) {
+        std::string body;
+        ResponseWriter pairWriter(body, format);
+        pairWriter.setRootField(RequestIdKey, requestId);
+        pairWriter.setRootField("pair", index);
+        writePairAnswer(index, pairWriter);
+        sendPartial(body);
+    };
+    if (streaming) {
+        for (const size_t index : answered) streamPair(index);
+    }
+
+    // --- Run the searches on the executor, handling each job as it finishes ---
+    std::mutex finishedMutex;
+    std::condition_variable jobFinished;
+    std::deque<size_t> finishedJobs;
+
+    Executor& executor = Executor::shared();
+    const uint64_t batchGroup = Executor::newGroup();
+    std::vector<std::future<void>> futures;
+    futures.reserve(jobs.size());
+    for (size_t jobIndex = 0; jobIndex < jobs.size(); ++jobIndex) {
+        futures.push_back(executor.submit([&, jobIndex]() {
+            BatchJob& job = jobs[jobIndex];
+            try {
+                std::vector<std::optional<BestRouteResult>> results =
+                    getEngine(job.params.engine).findBestRoutes(job.origin->stations, job.targets, job.params, graph);
+                for (size_t t = 0; t < job.targets.size(); ++t) {
+                    const BatchPair& first = pairs[job.targetPairs[t].front()];
+                    if (useCache && results[t].has_value() && RoutingEngine::ranToCompletion(results[t]->stopReason)) {
+                        _routeCache.insert(*first.cacheKey, snapshot, results[t].value());
+                    }
+                    for (const size_t index : job.targetPairs[t]) pairs[index].result = results[t];
+                }
+            }
+            catch (const std::exception& e) {
+                LOG_WARNING(Request, "Batch search failed: " << e.what());
+                for (const auto& targetPairs : job.targetPairs) {
+                    for (const size_t index : targetPairs) {
+                        pairs[index].error = { {"error", "Processing error during request"}, {"details", e.what()} };
+                    }
+                }
+            }
+            catch (...) {
+                LOG_WARNING(Request, "Batch search failed with an unknown error.");
+                for (const auto& targetPairs : job.targetPairs) {
+                    for (const size_t index : targetPairs) pairs[index].error = { {"error", "An unknown server error occurred"} };
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(finishedMutex);
+                finishedJobs.push_back(jobIndex);
+            }
+            jobFinished.notify_one();
+        }, batchParams.priority, batchGroup));
+    }
+
+    for (size_t jobsLeft = jobs.size(); jobsLeft > 0; --jobsLeft) {
+        size_t jobIndex;
+        {
+            std::unique_lock<std::mutex> lock(finishedMutex);
+            jobFinished.wait(lock, [&finishedJobs]() { return !finishedJobs.empty(); });
+            jobIndex = finishedJobs.front();
+            finishedJobs.pop_front();
+        }
+        if (!streaming) continue;
+        for (const auto& targetPairs : jobs[jobIndex].targetPairs) {
+            for (const size_t index : targetPairs) streamPair(index);
+        }
+    }
+    // The tasks reference this frame, make sure every one has returned.
+    for (auto& future : futures) executor.wait(future);
+
+    // --- Summary, with every answer in pair order unless they were streamed ---
+    const size_t routed = static_cast<size_t>(std::count_if(pairs.begin(), pairs.end(),
+        [](const BatchPair& pair) { return pair.error.is_null() && pair.result.has_value(); }));
+    writer.beginObject();
+    writer.field("status", "Batch finished");
+    writer.field("pairs", pairs.size());
+    writer.field("routed", routed);
+    writer.field("origins", origins.size());
+    writer.field("destinations", destinations.size());
+    writer.field("searches", jobs.size());
+    writer.field("cache_hits", cacheHits);
+    if (!streaming) {
+        writer.key("results");
+        writer.beginArray();
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            writer.setNextObjectField("pair", i);
+            writePairAnswer(i, writer);
+        }
+        writer.endArray();
+    }
+    writer.endObject();
+}
+
+
+
+// --- Isochrone Handler ---
+// Handles request type 4: travel time from an origin to every station (or grid cell) reachable within maxMinutes
+void RequestHandler::handleIsochrone(const json& request_json, const Graph& graph, ResponseWriter& writer) const {
+    RequestData inputData;
+    json errorJson = extractAndValidateRouteParams(request_json, inputData);
+    if (!errorJson.is_null()) return writer.value(errorJson);
+
+    double maxMinutes = 30.0;
+    double cellKm = 0.0;    // 0 reports stations instead of grid cells
+    try {
+        if (!request_json.contains("startLat") || !request_json.contains("startLong")) {
+            return writer.value(json{ {"error", "Missing start coordinates (lat/long)"} });
+        }
+        inputData.startCoords.latitude = request_json["startLat"].get<double>();
+        inputData.startCoords.longitude = request_json["startLong"].get<double>();
+        maxMinutes = request_json.value("maxMinutes", maxMinutes);
+        cellKm = request_json.value("cellKm", cellKm);
+    }
+    catch (const json::exception& e) {
+        return writer.value(json{ {"error", "Invalid coordinate or parameter format"}, {"details", e.what()} });
+    }
+    if (!inputData.startCoords.isValid()) {
+        return writer.value(json{ {"error", "Invalid coordinates"} });
+    }
+    if (!(maxMinutes > 0.0 && maxMinutes <= MaxIsochroneMinutes)) {
+        return writer.value(json{ {"error", "Invalid travel time limit (0<maxMinutes<=240)"} });
+    }
+    const double MIN_CELL_KM = 0.05, MAX_CELL_KM = 10.0;
+    if (cellKm != 0.0 && !(cellKm >= MIN_CELL_KM && cellKm <= MAX_CELL_KM)) {
+        return writer.value(json{ {"error", "Invalid grid cell size (cellKm 0 for stations, or 0.05<=cellKm<=10)"} });
+    }
+
+    // Every station in walking range is a source, each reached after its own walk.
+    const StationList startStations = graph.getNearbyStations(inputData.startCoords, inputData.nearbyRadiusKm);
+    if (startStations.empty()) {
+        return writer.value(json{ {"error", "No stations found near start coordinates"} });
+    }
+    const std::vector<float> travelMinutes = _timetableEngine.findTravelTimes(startStations, inputData, maxMinutes, graph);
+
+    // Travel times are whole minutes, rounded up.
+    auto packMinutes = [](std::string& out, const float minutes) {
+        appendLittleEndian(out, static_cast<uint16_t>(std::ceil(minutes)));
+    };
+
+    writer.beginObject();
+    writer.field("status", "Isochrone");
+    writer.key("origin");
+    writer.beginObject();
+    writer.field("lat", inputData.startCoords.latitude);
+    writer.field("lon", inputData.startCoords.longitude);
+    writer.endObject();
+    writer.field("depart_time", inputData.departureTime);
+    writer.field("max_minutes", maxMinutes);
+
+    std::string minutes;
+    if (cellKm == 0.0) {
+        // Columns by station: int32 code, float32 latitude and longitude, uint16 minutes.
+        std::string codes, latitudes, longitudes;
+        size_t count = 0;
+        for (size_t i = 0; i < travelMinutes.size(); ++i) {
+            if (std::isinf(travelMinutes[i])) continue;
+            const Graph::Station& station = graph.getStationByIndex(static_cast<int>(i));
+            appendLittleEndian(codes, static_cast<int32_t>(station.code));
+            appendLittleEndian(latitudes, static_cast<float>(station.coordinates.latitude));
+            appendLittleEndian(longitudes, static_cast<float>(station.coordinates.longitude));
+            packMinutes(minutes, travelMinutes[i]);
+            count++;
+        }
+        writer.field("count", count);
+        writer.key("stations");
+        writer.binary(codes);
+        writer.key("latitudes");
+        writer.binary(latitudes);
+        writer.key("longitudes");
+        writer.binary(longitudes);
+    }
+    else {
+        // Cells of a grid anchored at the origin, with the fastest time to any station inside each.
+        // Columns by cell: int16 row (north) and column (east) offsets from the origin's cell, uint16 minutes.
+        const double KM_PER_DEGREE = 111.32;
+        const double cellLat = cellKm / KM_PER_DEGREE;
+        const double cellLon = cellKm / (KM_PER_DEGREE * std::max(0.01, std::cos(inputData.startCoords.latitude * 3.14159265358979323846 / 180.0)));
+        std::map<std::pair<int16_t, int16_t>, float> cells;
+        for (size_t i = 0; i < travelMinutes.size(); ++i) {
+            if (std::isinf(travelMinutes[i])) continue;
+            const Utilities::Coordinates& coords = graph.getStationByIndex(static_cast<int>(i)).coordinates;
+            const double row = std::floor((coords.latitude - inputData.startCoords.latitude) / cellLat);
+            const double col = std::floor((coords.longitude - inputData.startCoords.longitude) / cellLon);
+            if (std::abs(row) > INT16_MAX || std::abs(col) > INT16_MAX) continue;
+            auto [it, inserted] = cells.try_emplace({ static_cast<int16_t>(row), static_cast<int16_t>(col) }, travelMinutes[i]);
+            if (!inserted) it->second = std::min(it->second, travelMinutes[i]);
+        }
+        std::string rows, cols;
+        for (const auto& [cell, cellMinutes] : cells) {
+            appendLittleEndian(rows, cell.first);
+            appendLittleEndian(cols, cell.second);
+            packMinutes(minutes, cellMinutes);
+        }
+        writer.field("cell_km", cellKm);
+        writer.field("count", cells.size());
+        writer.key("rows");
+        writer.binary(rows);
+        writer.key("cols");
+        writer.binary(cols);
+    }
+    writer.key("minutes");
+    writer.binary(minutes);
+    writer.endObject();
+}
+
+
+// --- Admin Handler ---
+// Handles request type 5: "reload" (the default action) builds a new graph in the background and swaps it in,
+// "status" reports on the last reload. Both need the admin token.
+json RequestHandler::handleAdmin(const json& request_json) {
+    if (_adminToken.empty()) {
+        return json{ {"error", "Admin requests are disabled"} };
+    }
+    if (request_json.value("token", std::string()) != _adminToken) {
+        return json{ {"error", "Invalid admin token"} };
+    }
+
+    const std::string action = request_json.value("action", std::string("reload"));
+    if (action == "status") return getReloadStatus();
+    if (action != "reload") {
+        return json{ {"error", "Invalid admin action (reload or status)"} };
+    }
+
+    ReloadSource source;
+    const std::string sourceName = request_json.value("source", std::string("binary"));
+    if (sourceName != "binary" && sourceName != "gtfs") {
+        return json{ {"error", "Invalid reload source (binary or gtfs)"} };
+    }
+    source.binary = sourceName == "binary";
+    source.path = request_json.value("path", source.binary ? Graph::DefaultBinaryGraphFile : Graph::DefaultGTFSDirectory);
+    source.deltaPath = request_json.value("delta", std::string());
+    source.buildHubLabels = request_json.value("hubLabels", false);
+
+    // Checked up front so a typo is answered right away instead of failing in the background.
+    const std::filesystem::path path(source.path);
+    if (source.binary) {
+        if (!source.deltaPath.empty()) {
+            return json{ {"error", "A delta can only be applied to a GTFS feed"} };
+        }
+        if (!std::filesystem::is_regular_file(path)) {
+            return json{ {"error", "Binary graph file not found"}, {"path", source.path} };
+        }
+    }
+    else if (!std::filesystem::exists(path / Graph::GTFSStopsFileName) || !std::filesystem::exists(path / Graph::GTFSLinesFileName)) {
+        return json{ {"error", "GTFS feed files not found"}, {"path", source.path} };
+    }
+    if (!source.deltaPath.empty() && !std::filesystem::is_directory(source.deltaPath)) {
+        return json{ {"error", "Delta feed directory not found"}, {"delta", source.deltaPath} };
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_reloadMutex);
+        if (_reloadStatus.state == "running") {
+            return json{ {"error", "A graph reload is already running"} };
+        }
+        if (_reloadThread.joinable()) _reloadThread.join();     // The previous reload has finished
+        _reloadStatus = ReloadStatus{ "running", source };
+        _reloadThread = std::thread(&RequestHandler::runReload, this, source);
+    }
+    LOG_INFO(Request, "Reloading the graph from " << sourceName << " " << source.path
+        << (source.deltaPath.empty() ? "" : " with delta " + source.deltaPath) << ".");
+    return getReloadStatus();
+}
+
+void RequestHandler::runReload(const ReloadSource& source) {
+    const auto started = std::chrono::steady_clock::now();
+    std::string error;
+    try {
+        GraphSnapshot graph = source.binary
+            ? std::make_shared<const Graph>(source.path)
+            : std::make_shared<const Graph>(source.path, source.deltaPath);
+        if (graph->getStationCount() == 0) {
+            throw std::runtime_error("The new graph has no stations.");
+        }
+
+        // Labels GraphCompiler wrote next to a binary graph are used when they belong to it.
+        std::shared_ptr<const HubLabels> labels;
+        const std::filesystem::path labelPath = std::filesystem::path(source.path).replace_extension(".hubs");
+        if (source.buildHubLabels) {
+            labels = std::make_shared<const HubLabels>(*graph);
+        }
+        else if (source.binary && std::filesystem::exists(labelPath)) {
+            try {
+                labels = std::make_shared<const HubLabels>(labelPath.string());
+                if (!labels->isFor(*graph)) {
+                    LOG_WARNING(Request, "Hub labels " << labelPath.string() << " belong to another graph, long trips will run the GA.");
+                    labels.reset();
+                }
+            }
+            catch (const std::exception& e) {
+                LOG_WARNING(Request, "Failed to load hub labels, long trips will run the GA: " << e.what());
+            }
+        }
+        swapGraphSnapshot(std::move(graph), std::move(labels));
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (error.empty()) {
+        LOG_INFO(Request, "Graph reloaded in " << seconds << "s.");
+    }
+    else {
+        LOG_WARNING(Request, "Graph reload failed, keeping the current graph: " << error);
+    }
+    std::lock_guard<std::mutex> lock(_reloadMutex);
+    _reloadStatus.state = error.empty() ? "done" : "failed";
+    _reloadStatus.error = error;
+    _reloadStatus.seconds = seconds;
+}
+
+json RequestHandler::getReloadStatus() const {
+    const GraphSnapshot graph = getGraphSnapshot();
+    json status = {
+        {"status", "Graph reload"},
+        {"graph_version", _graphVersion.load()},
+        {"stations", graph->getStationCount()},
+        {"hub_labels", _hubLabelEngine.hasLabelsFor(*graph)}
+    };
+    std::lock_guard<std::mutex> lock(_reloadMutex);
+    status["state"] = _reloadStatus.state;
+    if (_reloadStatus.state == "idle") return status;
+    status["source"] = _reloadStatus.source.binary ? "binary" : "gtfs";
+    status["path"] = _reloadStatus.source.path;
+    if (!_reloadStatus.source.deltaPath.empty()) status["delta"] = _reloadStatus.source.deltaPath;
+    if (_reloadStatus.state != "running") status["seconds"] = _reloadStatus.seconds;
+    if (!_reloadStatus.error.empty()) status["error"] = _reloadStatus.error;
+    return status;
+}
+
+
+// --- Metrics Handler ---
+// Handles request type 6: counters, gauges and stage latencies, as JSON or as Prometheus text with "prometheus": true
+json RequestHandler::handleMetrics(const json& request_json) const {
+    const Metrics& metrics = Metrics::shared();
+    if (request_json.value("prometheus", false)) {
+        return json{ {"prometheus", metrics.toPrometheus()} };
+    }
+
+    json counters = json::object();
+    for (size_t i = 0; i < static_cast<size_t>(Metrics::Counter::Count); ++i) {
+        const auto counter = static_cast<Metrics::Counter>(i);
+        counters[std::string(Metrics::toString(counter))] = metrics.getCounter(counter);
+    }
+    json gauges = json::object();
+    for (size_t i = 0; i < static_cast<size_t>(Metrics::Gauge::Count); ++i) {
+        const auto gauge = static_cast<Metrics::Gauge>(i);
+        gauges[std::string(Metrics::toString(gauge))] = metrics.getGauge(gauge);
+    }
+    json stages = json::object();
+    for (size_t i = 0; i < static_cast<size_t>(Metrics::Stage::Count); ++i) {
+        const auto stage = static_cast<Metrics::Stage>(i);
+        const Metrics::Histogram::Summary summary = metrics.summarize(stage);
+        stages[std::string(Metrics::toString(stage))] = {
+            {"count", summary.count}, {"mean", summary.meanMs}, {"p50", summary.p50Ms}, {"p90", summary.p90Ms},
+            {"p99", summary.p99Ms}, {"p999", summary.p999Ms}, {"max", summary.maxMs}
+        };
+    }
+    const RouteCache::Stats cache = getRouteCacheStats();
+    return json{
+        {"status", "Metrics"},
+        {"uptime_seconds", metrics.getUptimeSeconds()},
+        {"counters", counters},
+        {"gauges", gauges},
+        {"latency_ms", stages},
+        {"route_cache", { {"hits", cache.hits}, {"misses", cache.misses}, {"evictions", cache.evictions},
+            {"entries", cache.entries}, {"bytes", cache.bytes} }},
+        {"log_dropped", Logger::shared().getDroppedCount()}
+    };
+}
+
 
 // --- PRIVATE HELPER FUNCTIONS ---
 
@@ -260,13 +936,80 @@ json RequestHandler::extractAndValidateCoordinateInput(const json& request_json,
         if (!inputData.startCoords.isValid() || !inputData.endCoords.isValid()) {
             return { {"error", "Invalid coordinates" } };
         }
+    }
+    catch (const json::exception& e) {
+        return { {"error", "Invalid coordinate or parameter format"}, {"details", e.what()} };
+    }
+    return extractAndValidateRouteParams(request_json, inputData);
+}
+
+// Helper 1b: Extract and validate everything but the coordinates, shared by single and batch requests
+json RequestHandler::extractAndValidateRouteParams(const json& request_json, RequestData& inputData) const {
+    try {
         // Extract optional GA params
-        inputData.generations = request_json.value("gen", 200);
+        inputData.generations = request_json.value("gen", 100);
         inputData.mutationRate = request_json.value("mut", 0.3);
         inputData.populationSize = request_json.value("popSize", 100);
         if (inputData.populationSize <= 1 || inputData.generations <= 0 || inputData.mutationRate < 0.0 || inputData.mutationRate > 1.0) {
             return { {"error", "Invalid GA parameters (popSize>1, gen>0, 0<=mut<=1)"} };
         }
+        inputData.stallGenerations = request_json.value("stallGen", inputData.stallGenerations);
+        inputData.improvementEpsilon = request_json.value("improveEps", inputData.improvementEpsilon);
+        if (inputData.stallGenerations < 0 || inputData.improvementEpsilon < 0.0) {
+            return { {"error", "Invalid GA stopping criteria (stallGen>=0, improveEps>=0)"} };
+        }
+        // 0 islands means one per executor worker. Validated as asked, then capped so every island has two routes.
+        inputData.islands = request_json.value("islands", inputData.islands);
+        inputData.migrationInterval = request_json.value("migrationInterval", inputData.migrationInterval);
+        inputData.migrants = request_json.value("migrants", inputData.migrants);
+        if (inputData.islands < 0 || inputData.islands > IslandModel::MaxIslands ||
+            inputData.migrationInterval <= 0 || inputData.migrants < 0) {
+            return { {"error", "Invalid island settings (0<=islands<=64, migrationInterval>0, migrants>=0)"} };
+        }
+        if (inputData.islands == 0) {
+            inputData.islands = static_cast<int>(std::max<size_t>(1, Executor::shared().getWorkerCount()));
+        }
+        inputData.islands = std::clamp(inputData.islands, 1, std::min(IslandModel::MaxIslands, inputData.populationSize / 2));
+        if (request_json.contains("budgetMs")) {
+            const int budgetMs = request_json["budgetMs"].get<int>();
+            if (budgetMs <= 0) {
+                return { {"error", "Invalid time budget (budgetMs>0)"} };
+            }
+            inputData.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budgetMs);
+        }
+        inputData.targetMinutes = request_json.value("targetMinutes", inputData.targetMinutes);
+        if (inputData.targetMinutes < 0.0) {
+            return { {"error", "Invalid target time (targetMinutes>=0)"} };
+        }
+        if (request_json.contains("seed")) {
+            if (!request_json["seed"].is_number_unsigned()) {
+                return { {"error", "Invalid seed (non-negative integer)"} };
+            }
+            inputData.seed = request_json["seed"].get<uint64_t>();
+        }
+        // "auto" starts out as the GA, chooseAutoEngine may switch it once the stations are known.
+        std::string engineName = request_json.value("engine", "auto");
+        if (engineName == "ga" || engineName == "auto") inputData.engine = RoutingEngine::Type::Genetic;
+        else if (engineName == "timetable") inputData.engine = RoutingEngine::Type::Timetable;
+        else if (engineName == "hub") inputData.engine = RoutingEngine::Type::HubLabels;
+        else return { {"error", "Unknown routing engine (expected \"auto\", \"ga\", \"timetable\" or \"hub\")"} };
+
+        inputData.departureTime = request_json.value("departTime", Utilities::minutesSinceMidnightNow());
+        if (inputData.departureTime < 0 || inputData.departureTime >= 48 * 60) {
+            return { {"error", "Invalid departure time (minutes since midnight, 0<=departTime<2880)"} };
+        }
+
+        inputData.nearbyRadiusKm = request_json.value("radius", Graph::DefaultNearbyDistanceKm);
+        const double MAX_NEARBY_RADIUS_KM = 5.0;
+        if (inputData.nearbyRadiusKm <= 0.0 || inputData.nearbyRadiusKm > MAX_NEARBY_RADIUS_KM) {
+            return { {"error", "Invalid station search radius (0<radius<=5 km)"} };
+        }
+
+        std::string priorityName = request_json.value("priority", "normal");
+        if (priorityName == "high") inputData.priority = Executor::Priority::High;
+        else if (priorityName == "normal") inputData.priority = Executor::Priority::Normal;
+        else if (priorityName == "low") inputData.priority = Executor::Priority::Low;
+        else return { {"error", "Unknown priority (expected \"high\", \"normal\" or \"low\")"} };
     }
     catch (const json::exception& e) {
         return { {"error", "Invalid coordinate or parameter format"}, {"details", e.what()} };
@@ -277,206 +1020,146 @@ json RequestHandler::extractAndValidateCoordinateInput(const json& request_json,
     return json(); // Return null json on success
 }
 
-// Helper 2: Find Nearby Stations
-json RequestHandler::findNearbyStationsForRoute(const RequestData& inputData, NearbyStations& foundStations) const {
-    std::cout << "Finding nearby stations for start: " << inputData.startCoords.latitude << "," << inputData.startCoords.longitude << std::endl;
-    foundStations.startStations = _graph.getNearbyStations(Utilities::Coordinates(inputData.startCoords.latitude, inputData.startCoords.longitude));
-    if (foundStations.startStations.empty()) {
-        return { {"error", "No stations found near start coordinates"} };
+// Helper 1c: Send long "auto" trips to the hub labels, which answer them in a fraction of a GA run
+void RequestHandler::chooseAutoEngine(const json& request_json, RequestData& inputData, const Graph& graph) const
+{
+    if (request_json.value("engine", "auto") != "auto") return;
+    const double tripKm = Utilities::calculateHaversineDistance(inputData.startCoords, inputData.endCoords);
+    if (tripKm >= HubLabelMinTripKm && _hubLabelEngine.hasLabelsFor(graph)) {
+        LOG_DEBUG(Request, "Routing " << tripKm << " km trip with hub labels.");
+        inputData.engine = RoutingEngine::Type::HubLabels;
     }
+}
 
-    std::cout << "Finding nearby stations for end: " << inputData.endCoords.latitude << "," << inputData.endCoords.longitude << std::endl;
-    foundStations.endStations = _graph.getNearbyStations(Utilities::Coordinates(inputData.endCoords.latitude, inputData.endCoords.longitude));
-    if (foundStations.endStations.empty()) {
-        return { {"error", "No stations found near end coordinates"} };
+// Helper 2: Find the stations near the start and pick the representative ones
+json RequestHandler::snapStartStations(const Utilities::Coordinates& coords, const double radiusKm, const Graph& graph,
+    StationList& selected) const
+{
+    Metrics::Timer timer(Metrics::Stage::Snapping);
+    LOG_DEBUG(Request, "Finding nearby stations for start: " << coords.latitude << "," << coords.longitude);
+    const StationList nearby = graph.getNearbyStations(coords, radiusKm);
+    if (nearby.empty()) {
+        return { {"error", "No stations found near start coordinates"} };
     }
-
-    std::cout << "Found " << foundStations.startStations.size() << " start candidates and "
-        << foundStations.endStations.size() << " end candidates." << std::endl;
+    selectRepresentativeStations(coords, nearby, selected);
+    if (selected.empty()) {
+        return { {"error", "Failed to select representative start stations"} };
+    }
+    LOG_DEBUG(Request, "Selected " << selected.size() << " of " << nearby.size() << " start candidates.");
     return json(); // Return null json on success
 }
 
-RequestHandler::GaTaskResult RequestHandler::runSingleGaTask(
-    const int startId,
-    const int endId,
-    const RequestHandler::RequestData& gaParams,
-    const Graph& graph)
+// Helper 3: Find the stations near the end and pick the closest one
+json RequestHandler::snapEndStation(const Utilities::Coordinates& coords, const double radiusKm, const Graph& graph,
+    std::optional<Graph::Station>& endStation) const
 {
-    RequestHandler::GaTaskResult result;
-    result.startStationId = startId;
-    result.endStationId = endId;
-
-    try {
-        Population pop(gaParams.populationSize, startId, endId, graph,
-            gaParams.startCoords, gaParams.endCoords);
-
-        pop.evolve(gaParams.generations, gaParams.mutationRate);
-
-        // getBestSolution internally uses coords for fitness comparison during evolution
-        const Route& pairBestRoute = pop.getBestSolution();
-
-        double fitness = pairBestRoute.getFitness(startId, endId, graph,
-            gaParams.startCoords, gaParams.endCoords);
-
-        // Check validity and fitness
-        if (pairBestRoute.isValid(startId, endId, graph) && fitness > 0.0 && !std::isnan(fitness)) {
-            result.route = pairBestRoute;   // Copy the valid route
-            result.fitness = fitness;
-            result.success = true;
-            // std::cout << "  [Thread " << std::this_thread::get_id() << "] Success. Fitness: " << fitness << std::endl;
-        }
-        else {
-            std::cerr << "  [Thread " << std::this_thread::get_id() << "] GA produced invalid/zero fitness route for pair (" << startId << " -> " << endId << ") Fitness: " << fitness << std::endl;
-            result.success = false;
-        }
-    }
-    catch (const std::runtime_error& ga_error) {
-        std::cerr << "  [Thread " << std::this_thread::get_id() << "] GA Runtime Error pair (" << startId << " -> " << endId << "): " << ga_error.what() << std::endl;
-        result.success = false;
-    }
-    catch (const std::exception& e) {
-        std::cerr << "  [Thread " << std::this_thread::get_id() << "] GA Exception pair (" << startId << " -> " << endId << "): " << e.what() << std::endl;
-        result.success = false;
+    Metrics::Timer timer(Metrics::Stage::Snapping);
+    LOG_DEBUG(Request, "Finding nearby stations for end: " << coords.latitude << "," << coords.longitude);
+    const StationList nearby = graph.getNearbyStations(coords, radiusKm);
+    if (nearby.empty()) {
+        return { {"error", "No stations found near end coordinates"} };
     }
-    catch (...) {
-        std::cerr << "  [Thread " << std::this_thread::get_id() << "] Unknown GA Error pair (" << startId << " -> " << endId << ")" << std::endl;
-        result.success = false;
+    endStation = selectClosestStation(coords, nearby);
+    if (!endStation.has_value()) {
+        return { {"error", "Failed to select closest end station"} };
     }
-
-    return result;
+    return json(); // Return null json on success
 }
 
-// Helper 4: Iterate through pairs and find the best route
+// Helper 4: Find the best route with the engine selected by the request
 std::optional<RequestHandler::BestRouteResult> RequestHandler::findBestRouteToDestination(
     const StationList& selectedStartStations,
     const Graph::Station& endStationPair,
-    const RequestData& gaParams) const
+    const RequestData& gaParams,
+    const Graph& graph) const
 {
-    BestRouteResult overallBest;
-    overallBest.fitness = -1.0;
-    int endCode = endStationPair.code;
-
-    std::vector<std::future<GaTaskResult>> futures;
-
-    std::cout << "Launching GA tasks asynchronously for " << selectedStartStations.size() << " start stations..." << std::endl;
-
-    // --- Launch Phase ---
-    for (const auto& startPair : selectedStartStations) {
-        int startCode = startPair.code;
-        if (startCode == endCode) {
-            std::cout << "  Skipping GA task for start=end station: " << startCode << std::endl;
-            continue;
-        }
-
-        futures.push_back(
-            std::async(std::launch::async, runSingleGaTask, startCode, endCode, gaParams, std::cref(_graph))
-        );
-        std::cout << "  Launched GA task for pair (" << startCode << " -> " << endCode << ")" << std::endl;
-    }
-
-    if (futures.empty()) {
-        std::cout << "No GA tasks were launched." << std::endl;
-        return std::nullopt; // No tasks to run
-    }
-
-    std::cout << "Waiting for " << futures.size() << " GA tasks to complete..." << std::endl;
-
-    // --- Collect Results Phase ---
-    for (size_t i = 0; i < futures.size(); ++i) {
-        try {
-            GaTaskResult currentResult = futures[i].get();
-
-            std::cout << "  Task completed for start station " << currentResult.startStationId << ". Success: " << currentResult.success << ", Fitness: " << currentResult.fitness << std::endl;
-
-            // Check if this result is valid and better than the current overall best
-            if (currentResult.success && currentResult.fitness > overallBest.fitness) {
-                overallBest.fitness = currentResult.fitness;
-                overallBest.route = std::move(currentResult.route); 
-                overallBest.startStationCode = currentResult.startStationId; 
-                overallBest.endStationId = currentResult.endStationId;     
-                std::cout << "    *** New overall best route found! Start: " << overallBest.startStationCode << ", Fitness: " << overallBest.fitness << " ***" << std::endl;
-            }
-            else if (!currentResult.success) {
-                std::cout << "    Task for start station " << currentResult.startStationId << " failed or produced invalid result." << std::endl;
-            }
-
-        }
-        catch (const std::exception& e) {
-            std::cerr << "  Exception caught while getting result from future #" << i << ": " << e.what() << std::endl;
-        }
-        catch (...) {
-            std::cerr << "  Unknown exception caught while getting result from future #" << i << "." << std::endl;
-        }
-    } // End of collecting results
-
-    std::cout << "Finished collecting results. Overall best fitness found: " << overallBest.fitness << std::endl;
+    return getEngine(gaParams.engine).findBestRoute(selectedStartStations, endStationPair, gaParams, graph);
+}
 
-    // Check if a valid route was actually found (fitness > 0 and startId assigned)
-    if (overallBest.fitness > 0.0 && overallBest.startStationCode != -1) {
-        return overallBest; // Return the best result found across all threads
-    }
-    else {
-        std::cout << "No valid route found across all successful GA tasks." << std::endl;
-        return std::nullopt; // No valid route found
+const RoutingEngine& RequestHandler::getEngine(const RoutingEngine::Type type) const {
+    switch (type) {
+    case RoutingEngine::Type::Timetable: return _timetableEngine;
+    case RoutingEngine::Type::HubLabels: return _hubLabelEngine;
+    case RoutingEngine::Type::Genetic:
+    default: return _geneticEngine;
     }
 }
 
 // Helper: Format the successful route response JSON
-json RequestHandler::formatRouteResponse(const BestRouteResult& bestResult, const RequestData& inputData) const {
-    json resultJson;
-    resultJson["status"] = "Route found";
+void RequestHandler::formatRouteResponse(const BestRouteResult& bestResult, const RequestData& inputData, const Graph& graph,
+    ResponseWriter& writer, std::string_view warning) const {
+    Metrics::Timer timer(Metrics::Stage::Formatting);
+    writer.beginObject();
+    writer.field("status", "Route found");
+    if (!warning.empty()) writer.field("warning", warning);
 
     // Populate From/To Station Info
-    json fromStationJson, toStationJson;
-    bool startOk = RequestHandler::getStationInfo(_graph, bestResult.startStationCode, fromStationJson); 
-    bool endOk = RequestHandler::getStationInfo(_graph, bestResult.endStationId, toStationJson); 
-    resultJson["from_station"] = fromStationJson; 
-    resultJson["to_station"] = toStationJson;
+    writer.key("from_station");
+    RequestHandler::writeStationInfo(writer, graph, bestResult.startStationCode);
+    writer.key("to_station");
+    RequestHandler::writeStationInfo(writer, graph, bestResult.endStationId);
 
     // Populate Summary
-    resultJson["summary"] = { 
-        {"fitness", bestResult.fitness}, 
-        {"time_mins", bestResult.route.calculateFullJourneyTime( 
-            _graph, bestResult.startStationCode, bestResult.endStationId,
-            inputData.startCoords, inputData.endCoords)},
-        {"cost", bestResult.route.getTotalCost(_graph)}, 
-        {"transfers", bestResult.route.getTransferCount()} 
-    }; 
+    writer.key("summary");
+    writer.beginObject();
+    writer.field("fitness", bestResult.fitness);
+    writer.field("time_mins", bestResult.route.calculateFullJourneyTime(
+        graph, bestResult.startStationCode, bestResult.endStationId,
+        inputData.startCoords, inputData.endCoords, inputData.departureTime));
+    writer.field("cost", bestResult.route.getTotalCost(graph));
+    writer.field("transfers", bestResult.route.getTransferCount(graph));
+    writer.field("engine", RoutingEngine::toString(inputData.engine));
+    if (bestResult.stopReason != RoutingEngine::StopReason::None) {
+        writer.field("stop_reason", RoutingEngine::toString(bestResult.stopReason));
+        writer.field("generations", bestResult.generations);
+    }
+    if (bestResult.arrivalTime >= 0) {
+        writer.field("departure_time_mins", inputData.departureTime);
+        writer.field("arrival_time_mins", bestResult.arrivalTime);
+    }
+    writer.endObject();
 
     // Build Detailed Steps
-    resultJson["detailed_steps"] = json::array(); 
     const auto& visitedStations = bestResult.route.getVisitedStations(); 
     const Graph::Station* segmentStartStationPtr = nullptr; 
-    try { segmentStartStationPtr = &_graph.getStationByCode(bestResult.startStationCode); } 
+    try { segmentStartStationPtr = &graph.getStationByCode(bestResult.startStationCode); } 
     catch (...)  {  } 
 
+    // Routes only store indices, resolve the lines taken once for the whole response
+    std::vector<Graph::TransportationLine> linesTaken;
+    linesTaken.reserve(visitedStations.size());
+    for (const auto& vs : visitedStations) {
+        linesTaken.push_back(Route::getLineTaken(vs, graph));
+    }
+
+    writer.key("detailed_steps");
+    writer.beginArray();
     for (size_t i = 0; i < visitedStations.size(); ++i) {
-        const auto& currentVs = visitedStations[i];
-        const auto& lineTaken = currentVs.line;
-        json stepJson;
-        stepJson["segment_index"] = i;
-        stepJson["line_id"] = lineTaken.id;
-
-        json segmentStartJson, segmentEndJson;
-        if (segmentStartStationPtr) { RequestHandler::getStationInfo(_graph, segmentStartStationPtr->code, segmentStartJson); }
-        RequestHandler::getStationInfo(_graph, currentVs.station.code, segmentEndJson);
-        stepJson["from"] = segmentStartJson;
-        stepJson["to"] = segmentEndJson;
+        const Graph::Station& currentStation = graph.getStationByIndex(visitedStations[i].stationIndex);
+        const auto& lineTaken = linesTaken[i];
+        writer.beginObject();
+        writer.field("segment_index", i);
+        writer.field("line_id", lineTaken.id);
 
         // Determine codes needed for intermediate stops helper
         int segmentStartCode = segmentStartStationPtr ? segmentStartStationPtr->code : -1;
-        int segmentEndCode = currentVs.station.code;
+        int segmentEndCode = currentStation.code;
 
-        RequestHandler::addIntermediateStops(stepJson, lineTaken, segmentStartCode, segmentEndCode, _graph);
-        RequestHandler::addActionDetails(stepJson, i, visitedStations, lineTaken);
+        writer.key("from");
+        if (segmentStartStationPtr) { RequestHandler::writeStationInfo(writer, graph, segmentStartCode); }
+        else { writer.null(); }
+        writer.key("to");
+        RequestHandler::writeStationInfo(writer, graph, segmentEndCode);
 
-        resultJson["detailed_steps"].push_back(stepJson);
+        RequestHandler::addIntermediateStops(writer, lineTaken, segmentStartCode, segmentEndCode, graph);
+        RequestHandler::addActionDetails(writer, i, linesTaken);
+        writer.endObject();
 
         // Update pointer for the next segment's start station
-        segmentStartStationPtr = &currentVs.station;
+        segmentStartStationPtr = &currentStation;
     }
-
-    return resultJson; 
+    writer.endArray();
+    writer.endObject();
 }
 
 std::optional<Graph::Station> RequestHandler::selectClosestStation(
@@ -511,17 +1194,20 @@ std::optional<Graph::Station> RequestHandler::selectClosestStation(
     }
 }
 
-bool RequestHandler::getStationInfo(const Graph& graph, const int stationId, json& stationJson) {
+void RequestHandler::writeStationInfo(ResponseWriter& writer, const Graph& graph, const int stationId) {
+    writer.beginObject();
     try {
         const Graph::Station& station = graph.getStationByCode(stationId);
-        stationJson["name"] = station.name; stationJson["code"] = stationId;
-        stationJson["lat"] = station.coordinates.latitude; stationJson["long"] = station.coordinates.longitude;
-        return true;
+        writer.field("code", stationId);
+        writer.field("lat", station.coordinates.latitude);
+        writer.field("long", station.coordinates.longitude);
+        writer.field("name", station.name);
     }
     catch (const std::exception&) {
-        stationJson["error"] = "Station info lookup failed"; stationJson["code"] = stationId;
-        return false;
+        writer.field("code", stationId);
+        writer.field("error", "Station info lookup failed");
     }
+    writer.endObject();
 }
 
 void RequestHandler::selectRepresentativeStations(
@@ -532,7 +1218,7 @@ void RequestHandler::selectRepresentativeStations(
 {
     selected.clear();
     if (allNearby.empty()) {
-        std::cerr << "Warning: No nearby stations provided to selectRepresentativeStations." << std::endl;
+        LOG_WARNING(Request, "No nearby stations provided to selectRepresentativeStations.");
         return;
     }
 
@@ -560,7 +1246,7 @@ void RequestHandler::selectRepresentativeStations(
     const Graph::Station& closestStation = stationsWithDistance[0].second;
     selected.push_back(closestStation);
     selectedIds.insert(closestStation.code);
-    std::cout << "  Selected S1 (Closest): ID " << closestStation.code << " (Dist: " << stationsWithDistance[0].first << ")" << std::endl;
+    LOG_DEBUG(Request, "Selected S1 (Closest): ID " << closestStation.code << " (Dist: " << stationsWithDistance[0].first << ")");
 
 
     // Handle cases with fewer than 3 stations
@@ -573,10 +1259,10 @@ void RequestHandler::selectRepresentativeStations(
     if (!selectedIds.contains(furthestStationPair.code)) {
         selected.push_back(furthestStationPair);
         selectedIds.insert(furthestStationPair.code);
-        std::cout << "  Selected SN (Furthest): ID " << furthestStationPair.code << " (Dist: " << stationsWithDistance.back().first << ")" << std::endl;
+        LOG_DEBUG(Request, "Selected SN (Furthest): ID " << furthestStationPair.code << " (Dist: " << stationsWithDistance.back().first << ")");
     }
     else {
-        std::cout << "  SN (Furthest) is the same as S1, skipping." << std::endl;
+        LOG_DEBUG(Request, "SN (Furthest) is the same as S1, skipping.");
     }
 
 
@@ -587,7 +1273,7 @@ void RequestHandler::selectRepresentativeStations(
         if (!selectedIds.contains(secondClosest.code)) {
             selected.push_back(secondClosest);
             selectedIds.insert(secondClosest.code);
-            std::cout << "  Selected S2 (Second Closest) as fallback for SN: ID " << secondClosest.code << std::endl;
+            LOG_DEBUG(Request, "Selected S2 (Second Closest) as fallback for SN: ID " << secondClosest.code);
         }
     }
 
@@ -635,10 +1321,10 @@ void RequestHandler::selectRepresentativeStations(
         if (!selectedIds.contains(Sk.code)) {
             selected.push_back(Sk);
             selectedIds.insert(Sk.code);
-            std::cout << "  Selected SK (Most Different from S1): ID " << Sk.code << " (Dist from S1: " << max_dist_from_S1 << ")" << std::endl;
+            LOG_DEBUG(Request, "Selected SK (Most Different from S1): ID " << Sk.code << " (Dist from S1: " << max_dist_from_S1 << ")");
         }
         else {
-            std::cout << "  SK candidate ID " << Sk.code << " was already selected?" << std::endl;
+            LOG_DEBUG(Request, "SK candidate ID " << Sk.code << " was already selected?");
         }
 
     }
@@ -649,7 +1335,7 @@ void RequestHandler::selectRepresentativeStations(
         const Graph::Station& secondClosest = stationsWithDistance[1].second;
         if (!selectedIds.contains(secondClosest.code)) {
             selected.push_back(secondClosest);
-            std::cout << "  Selected S2 (Second Closest) as fallback for SK: ID " << secondClosest.code << std::endl;
+            LOG_DEBUG(Request, "Selected S2 (Second Closest) as fallback for SK: ID " << secondClosest.code);
         }
     }
 
@@ -659,92 +1345,52 @@ void RequestHandler::selectRepresentativeStations(
 
 } // End of selectRepresentativeStations
 
-std::vector<Graph::Station> RequestHandler::reconstructIntermediateStops(
-    const int segmentStartCode,
-    const int segmentEndCode,
-    const std::string& lineId,
-    const Graph& graph)
-{
-    std::vector<Graph::Station> intermediatePath;
-    std::unordered_set<int> visitedInSegment;
-    int currentCode = segmentStartCode;
-    visitedInSegment.insert(currentCode);
-    const int MAX_INTERMEDIATE_STEPS = 100;
-    int steps = 0;
-
-    while (currentCode != segmentEndCode && steps < MAX_INTERMEDIATE_STEPS) {
-        steps++;
-        bool foundNext = false;
-        try {
-            const auto& linesFromCurrent = graph.getLinesFrom(currentCode);
-            const Graph::TransportationLine* nextLine = nullptr;
-            for (const auto& line : linesFromCurrent) {
-                if (line.id == lineId && (!visitedInSegment.contains(line.to) || line.to == segmentEndCode)) {
-                    nextLine = &line;
-                    break;
-                }
-            }
-            if (nextLine != nullptr) {
-                currentCode = nextLine->to;
-                visitedInSegment.insert(currentCode);
-                if (currentCode != segmentEndCode) {
-                    intermediatePath.push_back(graph.getStationByCode(currentCode));
-                }
-                foundNext = true;
-            }
-            else {
-                break;
-            }
-        }
-        catch (const std::exception& e) {
-            break;
-        }
-        if (!foundNext) break;
-    }
-    return intermediatePath;
-}
-
-
 void RequestHandler::addIntermediateStops(
-    json& stepJson, const Graph::TransportationLine& lineTaken,
+    ResponseWriter& writer, const Graph::TransportationLine& lineTaken,
     const int segmentStartCode, const int segmentEndCode, const Graph& graph)
 {
     bool isPublic = lineTaken.id != "Walk" && lineTaken.id != "Start";
-    stepJson["intermediate_stops"] = json::array();
+    std::span<const int> segment;
+    std::string error;
 
     if (isPublic && segmentStartCode != segmentEndCode) {
-        try {
-            auto pathStations = RequestHandler::reconstructIntermediateStops(
-                segmentStartCode,
-                segmentEndCode,
-                lineTaken.id,
-                graph
-            );
-
-            if (pathStations.size() > 0) {
-                for (const auto& st : pathStations) {
-                    stepJson["intermediate_stops"].push_back({
-                        {"code", st.code}, {"name", st.name},
-                        {"lat", st.coordinates.latitude}, {"long", st.coordinates.longitude}
-                        });
-                }
-            }
-        }
-        catch (const std::exception& e) {
-            stepJson["intermediate_stops_error"] = e.what();
+        const int lineIndex = (lineTaken.lineIndex >= 0) ? lineTaken.lineIndex : graph.findLineIndex(lineTaken.id);
+        segment = graph.getLineSegment(lineIndex, graph.getStationIndex(segmentStartCode), graph.getStationIndex(segmentEndCode));
+        if (segment.empty()) {
+            error = "No pattern of line " + std::string(lineTaken.id) + " goes from " + std::to_string(segmentStartCode) +
+                " to " + std::to_string(segmentEndCode);
         }
     }
+    // The segment includes both ends, which are listed as actions already.
+    const auto intermediate = (segment.size() > 2) ? segment.subspan(1, segment.size() - 2) : std::span<const int>();
+
+    writer.key("intermediate_stops");
+    writer.beginArray();
+    for (const int index : intermediate) {
+        const Graph::Station& st = graph.getStationByIndex(index);
+        writer.beginObject();
+        writer.field("code", st.code);
+        writer.field("lat", st.coordinates.latitude);
+        writer.field("long", st.coordinates.longitude);
+        writer.field("name", st.name);
+        writer.endObject();
+    }
+    writer.endArray();
+    if (!error.empty()) {
+        writer.field("intermediate_stops_error", error);
+    }
 }
 
 void RequestHandler::addActionDetails(
-    json& stepJson,
+    ResponseWriter& writer,
     size_t i,
-    const std::vector<Route::VisitedStation>& visitedStations,
-    const Graph::TransportationLine& lineTaken)
+    const std::vector<Graph::TransportationLine>& linesTaken)
 {
+    const Graph::TransportationLine& lineTaken = linesTaken[i];
+
     // --- Determine Basic Segment Properties ---
     bool isStartPointOfRoute = (i == 0); 
-    bool isEndPointOfRoute = ((i + 1) == visitedStations.size());
+    bool isEndPointOfRoute = ((i + 1) == linesTaken.size());
 
     // Check if the line taken for this step is public transport
     bool currentStepIsPublic = lineTaken.id != "Walk" && lineTaken.id != "Start";
@@ -752,7 +1398,7 @@ void RequestHandler::addActionDetails(
     // --- Determine if a Transfer Happens After This Step ---
     bool isTransferPoint = false;
     if (!isEndPointOfRoute) {
-        const auto& nextLine = visitedStations[i + 1].line; 
+        const auto& nextLine = linesTaken[i + 1]; 
         bool nextStepIsPublic = nextLine.id != "Walk" && nextLine.id != "Start";
 
         // Transfer conditions:
@@ -786,12 +1432,12 @@ void RequestHandler::addActionDetails(
             actionDesc = "Transfer";
         }
         else {
-            actionDesc = "Continue on " + lineTaken.id;
+            actionDesc = "Continue on " + std::string(lineTaken.id);
         }
     }
-    stepJson["action_description"] = actionDesc;
+    writer.field("action_description", actionDesc);
 
     // --- Determine if Start/End Stations of This Segment are Action Points ---
-    stepJson["to_is_action_point"] = isEndPointOfRoute || isTransferPoint;
-    stepJson["from_is_action_point"] = isStartPointOfRoute;
+    writer.field("to_is_action_point", isEndPointOfRoute || isTransferPoint);
+    writer.field("from_is_action_point", isStartPointOfRoute);
 }
\ No newline at end of file
@@ -1,93 +1,189 @@
 #pragma once
 #include "Graph.h"
-#include "Socket.h"
 #include "Route.h"
+#include "GeneticRoutingEngine.h"
+#include "TimetableRoutingEngine.h"
+#include "HubLabelRoutingEngine.h"
+#include "ResponseWriter.h"
+#include "RouteCache.h"
+#include "CancellationToken.h"
 #include "json.hpp"
 #include <optional> 
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <string_view>
+#include <mutex>
+#include <thread>
 
 using json = nlohmann::json;
 
 class RequestHandler {
 public:
+    // Read-only graph shared by every request. Requests hold their own reference for their whole lifetime.
+    using GraphSnapshot = std::shared_ptr<const Graph>;
+
     RequestHandler();
-    void handleRequest(Socket clientSocket);
+
+    // Waits for a graph reload that is still running.
+    ~RequestHandler();
+
+    // Shared by every connection thread, so it must never be copied.
+    RequestHandler(const RequestHandler&) = delete;
+    RequestHandler& operator=(const RequestHandler&) = delete;
+
+    // Requests may carry this key with any JSON value; the response echoes it so clients that keep several
+    // requests in flight on one connection can match responses that arrive out of order.
+    static constexpr const char* RequestIdKey = "requestId";
+
+    // Optional request key choosing the response encoding, see ResponseWriter::parseFormat. Defaults to pretty JSON.
+    static constexpr const char* FormatKey = "format";
+
+    // Response to one request message.
+    struct Reply {
+        std::string body;       // Encoded in the format the request asked for
+        bool tagged = false;    // The request had a request id, so the reply doesn't have to keep request order
+    };
+
+    // Sends one extra message ahead of the reply, already encoded. Must be safe to call from the handling thread.
+    using PartialReplySink = std::function<void(std::string_view body)>;
+
+    // Most origin/destination pairs one batch request (type 3) may hold.
+    static constexpr size_t MaxBatchPairs = 10000;
+
+    // Longest travel time an isochrone request (type 4) may ask for, in minutes.
+    static constexpr double MaxIsochroneMinutes = 240.0;
+
+    // Environment variable holding the token admin requests (type 5) must carry as "token". Unset disables them.
+    static constexpr const char* AdminTokenVariable = "ROUTIFY_ADMIN_TOKEN";
+
+    // Route requests with the "auto" engine (the default) this far apart (aerial km) are answered from the hub
+    // labels when they are loaded for the current graph. Shorter ones run the GA.
+    static constexpr double HubLabelMinTripKm = 20.0;
+
+    // Answers one request message. Never throws. Batch requests that carry a request id stream each pair's answer
+    // through sendPartial, when given, and reply with a summary; otherwise the reply holds every answer.
+    // Route searches stop early once disconnected fires, the client is gone and the reply will be dropped.
+    Reply handleMessage(const std::string& received, const PartialReplySink& sendPartial = {},
+        const CancellationToken& disconnected = {});
+
+    // Builds an error reply for a request that won't be handled, tagged with the request's id if it has one.
+    static Reply makeErrorReply(const std::string& received, const std::string& error);
+
+    // Returns the graph snapshot currently used for new requests.
+    GraphSnapshot getGraphSnapshot() const;
+
+    // Atomically replaces the graph and empties the route cache and the GA's elite routes. The hub labels belong to
+    // the old graph and are replaced by labels of the new one, or dropped. Requests already running keep using the
+    // snapshot they started with. Throws std::invalid_argument if the labels were built from another graph.
+    void swapGraphSnapshot(GraphSnapshot newGraph, std::shared_ptr<const HubLabels> labels = nullptr);
+
+    // Optional boolean request key; false skips the route cache for that request, both reading and filling it.
+    static constexpr const char* CacheKey = "cache";
+
+    RouteCache::Stats getRouteCacheStats() const;
 
 private:
     using StationList = std::vector<Graph::Station>;
     
     // --- Helper Structs  ---
-    struct RequestData {
-        Utilities::Coordinates startCoords; 
-        Utilities::Coordinates endCoords; 
-        int generations = 1000;
-        double mutationRate = 0.3;
-        int populationSize = 100;
-    };
+    using RequestData = RoutingEngine::Params;
+    using BestRouteResult = RoutingEngine::Result;
 
-    struct NearbyStations {
+    struct SelectedStations {
         StationList startStations;
         StationList endStations;
     };
 
-    struct BestRouteResult {
-        Route route;
-        double fitness = -1.0;
-        int startStationCode = -1;
-        int endStationId = -1;
-    };
+    // --- Private Debug Helper Methods ---
+    json handleGetLines(const json& request_json, const Graph& graph) const;
+    json handleGetStationInfo(const json& request_json, const Graph& graph) const;
 
-    struct SelectedStations {
-        StationList startStations;
-        StationList endStations;
+    // --- Genetic Algorithm Request Helpers ---
+    void handleFindRouteCoordinates(const json& request_json, const GraphSnapshot& snapshot,
+        const CancellationToken& cancellation, ResponseWriter& writer) const; // Top level
+    json extractAndValidateCoordinateInput(const json& request_json, RequestData& inputData) const;
+    json extractAndValidateRouteParams(const json& request_json, RequestData& inputData) const;
+    void chooseAutoEngine(const json& request_json, RequestData& inputData, const Graph& graph) const;
+    json snapStartStations(const Utilities::Coordinates& coords, const double radiusKm, const Graph& graph, StationList& selected) const;
+    json snapEndStation(const Utilities::Coordinates& coords, const double radiusKm, const Graph& graph,
+        std::optional<Graph::Station>& endStation) const;
+
+    // Direct walk or station route, whichever the user should take, written as one response object.
+    void writeRouteAnswer(const std::optional<BestRouteResult>& bestResultOpt, const RequestData& inputData,
+        const Graph& graph, ResponseWriter& writer) const;
+
+    // --- Batch Request ---
+    void handleBatchRoutes(const json& request_json, const GraphSnapshot& snapshot, const json& requestId,
+        const ResponseWriter::Format format, const PartialReplySink& sendPartial, const CancellationToken& cancellation,
+        ResponseWriter& writer) const;
+
+    // --- Isochrone Request ---
+    void handleIsochrone(const json& request_json, const Graph& graph, ResponseWriter& writer) const;
+
+    // --- Admin Request ---
+    json handleAdmin(const json& request_json);
+
+    // What a graph reload builds the new graph from.
+    struct ReloadSource {
+        bool binary = true;             // A precompiled graph file, or a GTFS feed directory
+        std::string path;
+        std::string deltaPath;          // Delta feed directory applied to a GTFS feed, empty for none
+        bool buildHubLabels = false;    // Build labels for the new graph instead of looking for them next to it
     };
 
-    struct GaTaskResult {
-        Route route;
-        double fitness = -1.0;
-        bool success = false;       // Indicate if GA completed successfully and produced a valid route
-        int startStationId = -1;    // Store which start station this result is for
-        int endStationId = -1;
+    struct ReloadStatus {
+        std::string state = "idle";     // idle, running, done or failed
+        ReloadSource source{};
+        std::string error{};
+        double seconds = 0.0;           // How long the last finished reload took
     };
 
-    // --- Private Debug Helper Methods ---
-    json handleGetLines(const json& request_json) const;
-    json handleGetStationInfo(const json& request_json) const;
+    // Builds a graph and swaps it in. Runs on _reloadThread.
+    void runReload(const ReloadSource& source);
+    json getReloadStatus() const;
 
-    // --- Genetic Algorithm Request Helpers ---
-    json handleFindRouteCoordinates(const json& request_json) const; // Top level
-    json extractAndValidateCoordinateInput(const json& request_json, RequestData& inputData) const;
-    json findNearbyStationsForRoute(const RequestData& inputData, NearbyStations& foundStations) const; 
+    // --- Metrics Request ---
+    json handleMetrics(const json& request_json) const;
 
-    static bool getStationInfo(const Graph& graph, const int stationCode, json& stationJson);
+    static void writeStationInfo(ResponseWriter& writer, const Graph& graph, const int stationCode);
 
-    // Helper for finding best route
+    // Helper for finding best route, using the engine the request asked for
     std::optional<BestRouteResult> findBestRouteToDestination(
         const StationList& selectedStartStations,
         const Graph::Station& endStationPair,
-        const RequestData& gaParams) const;
+        const RequestData& gaParams,
+        const Graph& graph) const;
 
     // Additional Helpers
     std::optional<Graph::Station> selectClosestStation(const Utilities::Coordinates& c, const StationList& allNearby) const;
     void selectRepresentativeStations(const Utilities::Coordinates& c, const StationList& allNearby, StationList& selected) const;
-    static RequestHandler::GaTaskResult runSingleGaTask(const int startId, const int endId, const RequestHandler::RequestData& gaParams, const Graph& graph);
 
-    json formatRouteResponse(const BestRouteResult& bestResult, const RequestData& inputData) const;
-
-    static std::vector<Graph::Station> reconstructIntermediateStops(
-        const int segmentStartCode,
-        const int segmentEndCode,
-        const std::string& lineId,
-        const Graph& graph);
+    // Streams the route response, the biggest one by far, without building a DOM.
+    void formatRouteResponse(const BestRouteResult& bestResult, const RequestData& inputData, const Graph& graph,
+        ResponseWriter& writer, std::string_view warning = {}) const;
 
     static void addIntermediateStops(
-        json& stepJson, const Graph::TransportationLine& lineTaken,
+        ResponseWriter& writer, const Graph::TransportationLine& lineTaken,
         const int segmentStartCode, const int segmentEndCode, const Graph& graph);
 
     static void addActionDetails(
-        json& stepJson, size_t i,
-        const std::vector<Route::VisitedStation>& visitedStations,
-		const Graph::TransportationLine& lineTaken);
+        ResponseWriter& writer, size_t i,
+        const std::vector<Graph::TransportationLine>& linesTaken);
+
+    const RoutingEngine& getEngine(const RoutingEngine::Type type) const;
 
     // Member Variables
-    Graph _graph;
+    std::atomic<GraphSnapshot> _graph;
+    GeneticRoutingEngine _geneticEngine;
+    TimetableRoutingEngine _timetableEngine;
+    HubLabelRoutingEngine _hubLabelEngine;
+    mutable RouteCache _routeCache;                     // Synchronized internally
+    std::atomic<uint64_t> _graphVersion{ 0 };          // Bumped by every swap
+    const std::string _adminToken;
+
+    // One graph reload runs at a time.
+    mutable std::mutex _reloadMutex;
+    ReloadStatus _reloadStatus;                         // Needs _reloadMutex
+    std::thread _reloadThread;                          // Needs _reloadMutex
 };
\ No newline at end of file
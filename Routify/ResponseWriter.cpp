@@ -0,0 +1,299 @@
+#include "ResponseWriter.h"
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    // CBOR major types and simple values (RFC 8949).
+    constexpr uint8_t CborUnsigned = 0;
+    constexpr uint8_t CborNegative = 1;
+    constexpr uint8_t CborBytes = 2;
+    constexpr uint8_t CborText = 3;
+    constexpr char CborIndefiniteArray = static_cast<char>(0x9F);
+    constexpr char CborIndefiniteMap = static_cast<char>(0xBF);
+    constexpr char CborBreak = static_cast<char>(0xFF);
+    constexpr char CborFalse = static_cast<char>(0xF4);
+    constexpr char CborTrue = static_cast<char>(0xF5);
+    constexpr char CborNull = static_cast<char>(0xF6);
+    constexpr char CborDouble = static_cast<char>(0xFB);
+
+    constexpr size_t PrettyIndent = 2;
+}
+
+ResponseWriter::Format ResponseWriter::parseFormat(std::string_view name) {
+    if (name == "pretty") return Format::PrettyJson;
+    if (name == "json") return Format::Json;
+    if (name == "cbor") return Format::Cbor;
+    throw std::invalid_argument("Unknown response format: " + std::string(name));
+}
+
+ResponseWriter::ResponseWriter(std::string& out, const Format format) : _out(out), _format(format) {}
+
+void ResponseWriter::setRootField(std::string_view name, nlohmann::json value) {
+    _rootFields.emplace_back(name, std::move(value));
+}
+
+void ResponseWriter::setNextObjectField(std::string_view name, nlohmann::json value) {
+    _nextObjectFields.emplace_back(name, std::move(value));
+}
+
+void ResponseWriter::beginObject() { beginScope(true); }
+void ResponseWriter::endObject() { endScope(); }
+void ResponseWriter::beginArray() { beginScope(false); }
+void ResponseWriter::endArray() { endScope(); }
+
+void ResponseWriter::beginScope(const bool isObject) {
+    beforeValue();
+    if (_format == Format::Cbor) {
+        _out.push_back(isObject ? CborIndefiniteMap : CborIndefiniteArray);
+    }
+    else {
+        _out.push_back(isObject ? '{' : '[');
+    }
+    _scopes.push_back({ isObject });
+
+    if (!isObject) return;
+    // Moved out first: writing a json object value opens a scope of its own.
+    if (_scopes.size() == 1 && !_rootFields.empty()) {
+        auto fields = std::move(_rootFields);
+        _rootFields.clear();
+        for (const auto& [name, fieldValue] : fields) field(name, fieldValue);
+    }
+    if (!_nextObjectFields.empty()) {
+        auto fields = std::move(_nextObjectFields);
+        _nextObjectFields.clear();
+        for (const auto& [name, fieldValue] : fields) field(name, fieldValue);
+    }
+}
+
+void ResponseWriter::endScope() {
+    const Scope scope = _scopes.back();
+    _scopes.pop_back();
+    if (_format == Format::Cbor) {
+        _out.push_back(CborBreak);
+        return;
+    }
+    if (_format == Format::PrettyJson && !scope.empty) {
+        newline(_scopes.size());
+    }
+    _out.push_back(scope.isObject ? '}' : ']');
+}
+
+void ResponseWriter::key(std::string_view name) {
+    Scope& scope = _scopes.back();
+    if (_format == Format::Cbor) {
+        writeCborHead(CborText, name.size());
+        _out.append(name);
+    }
+    else {
+        if (!scope.empty) _out.push_back(',');
+        if (_format == Format::PrettyJson) newline(_scopes.size());
+        writeEscaped(name);
+        _out.append(_format == Format::PrettyJson ? ": " : ":");
+    }
+    scope.empty = false;
+    _afterKey = true;
+}
+
+// Writes the separator and indentation that come before an array element. Object members got theirs from key().
+void ResponseWriter::beforeValue() {
+    if (_scopes.empty()) return;
+    if (_afterKey) {
+        _afterKey = false;
+        return;
+    }
+    Scope& scope = _scopes.back();
+    if (_format != Format::Cbor) {
+        if (!scope.empty) _out.push_back(',');
+        if (_format == Format::PrettyJson) newline(_scopes.size());
+    }
+    scope.empty = false;
+}
+
+void ResponseWriter::newline(const size_t depth) {
+    _out.push_back('\n');
+    _out.append(depth * PrettyIndent, ' ');
+}
+
+void ResponseWriter::value(std::string_view text) {
+    beforeValue();
+    if (_format == Format::Cbor) {
+        writeCborHead(CborText, text.size());
+        _out.append(text);
+    }
+    else {
+        writeEscaped(text);
+    }
+}
+
+void ResponseWriter::binary(std::string_view bytes) {
+    beforeValue();
+    if (_format == Format::Cbor) {
+        writeCborHead(CborBytes, bytes.size());
+        _out.append(bytes);
+        return;
+    }
+
+    static constexpr char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    _out.reserve(_out.size() + 4 * ((bytes.size() + 2) / 3) + 2);
+    _out.push_back('"');
+    size_t i = 0;
+    for (; i + 3 <= bytes.size(); i += 3) {
+        const uint32_t group = (static_cast<uint8_t>(bytes[i]) << 16) | (static_cast<uint8_t>(bytes[i + 1]) << 8) |
+            static_cast<uint8_t>(bytes[i + 2]);
+        _out.push_back(Alphabet[(group >> 18) & 0x3F]);
+        _out.push_back(Alphabet[(group >> 12) & 0x3F]);
+        _out.push_back(Alphabet[(group >> 6) & 0x3F]);
+        _out.push_back(Alphabet[group & 0x3F]);
+    }
+    if (i < bytes.size()) {
+        const bool two = i + 1 < bytes.size();
+        const uint32_t group = (static_cast<uint8_t>(bytes[i]) << 16) | (two ? static_cast<uint8_t>(bytes[i + 1]) << 8 : 0);
+        _out.push_back(Alphabet[(group >> 18) & 0x3F]);
+        _out.push_back(Alphabet[(group >> 12) & 0x3F]);
+        _out.push_back(two ? Alphabet[(group >> 6) & 0x3F] : '=');
+        _out.push_back('=');
+    }
+    _out.push_back('"');
+}
+
+void ResponseWriter::value(double number) {
+    beforeValue();
+    if (_format == Format::Cbor) {
+        _out.push_back(CborDouble);
+        const uint64_t bits = std::bit_cast<uint64_t>(number);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            _out.push_back(static_cast<char>((bits >> shift) & 0xFF));
+        }
+        return;
+    }
+    if (!std::isfinite(number)) {
+        _out.append("null"); // Same as json::dump
+        return;
+    }
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    std::string_view written(buffer, end - buffer);
+    _out.append(written);
+    if (written.find_first_of(".e") == std::string_view::npos) {
+        _out.append(".0"); // Keep it a float for readers that care, like json::dump does
+    }
+}
+
+void ResponseWriter::value(bool flag) {
+    beforeValue();
+    if (_format == Format::Cbor) _out.push_back(flag ? CborTrue : CborFalse);
+    else _out.append(flag ? "true" : "false");
+}
+
+void ResponseWriter::null() {
+    beforeValue();
+    if (_format == Format::Cbor) _out.push_back(CborNull);
+    else _out.append("null");
+}
+
+void ResponseWriter::value(const nlohmann::json& document) {
+    switch (document.type()) {
+    case nlohmann::json::value_t::object:
+        beginObject();
+        for (const auto& [name, member] : document.items()) {
+            key(name);
+            value(member);
+        }
+        endObject();
+        break;
+    case nlohmann::json::value_t::array:
+        beginArray();
+        for (const auto& element : document) value(element);
+        endArray();
+        break;
+    case nlohmann::json::value_t::string:
+        value(std::string_view(document.get_ref<const std::string&>()));
+        break;
+    case nlohmann::json::value_t::boolean:
+        value(document.get<bool>());
+        break;
+    case nlohmann::json::value_t::number_integer:
+        value(document.get<int64_t>());
+        break;
+    case nlohmann::json::value_t::number_unsigned:
+        value(document.get<uint64_t>());
+        break;
+    case nlohmann::json::value_t::number_float:
+        value(document.get<double>());
+        break;
+    default:
+        null();
+        break;
+    }
+}
+
+void ResponseWriter::writeInteger(int64_t number) {
+    if (number >= 0) {
+        writeUnsigned(static_cast<uint64_t>(number));
+        return;
+    }
+    beforeValue();
+    if (_format == Format::Cbor) {
+        writeCborHead(CborNegative, static_cast<uint64_t>(-(number + 1)));
+        return;
+    }
+    char buffer[24];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    _out.append(buffer, end - buffer);
+}
+
+void ResponseWriter::writeUnsigned(uint64_t number) {
+    beforeValue();
+    if (_format == Format::Cbor) {
+        writeCborHead(CborUnsigned, number);
+        return;
+    }
+    char buffer[24];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    _out.append(buffer, end - buffer);
+}
+
+void ResponseWriter::writeEscaped(std::string_view text) {
+    static constexpr char Hex[] = "0123456789abcdef";
+    _out.push_back('"');
+    for (const char c : text) {
+        switch (c) {
+        case '"': _out.append("\\\""); break;
+        case '\\': _out.append("\\\\"); break;
+        case '\b': _out.append("\\b"); break;
+        case '\f': _out.append("\\f"); break;
+        case '\n': _out.append("\\n"); break;
+        case '\r': _out.append("\\r"); break;
+        case '\t': _out.append("\\t"); break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                _out.append("\\u00");
+                _out.push_back(Hex[(c >> 4) & 0xF]);
+                _out.push_back(Hex[c & 0xF]);
+            }
+            else {
+                _out.push_back(c); // UTF-8 passes through unchanged
+            }
+            break;
+        }
+    }
+    _out.push_back('"');
+}
+
+void ResponseWriter::writeCborHead(const uint8_t majorType, const uint64_t argument) {
+    const char type = static_cast<char>(majorType << 5);
+    if (argument < 24) {
+        _out.push_back(static_cast<char>(type | argument));
+        return;
+    }
+    int bytes;
+    if (argument <= 0xFF) { _out.push_back(type | 24); bytes = 1; }
+    else if (argument <= 0xFFFF) { _out.push_back(type | 25); bytes = 2; }
+    else if (argument <= 0xFFFFFFFFull) { _out.push_back(type | 26); bytes = 4; }
+    else { _out.push_back(type | 27); bytes = 8; }
+    for (int i = bytes - 1; i >= 0; --i) {
+        _out.push_back(static_cast<char>((argument >> (8 * i)) & 0xFF));
+    }
+}
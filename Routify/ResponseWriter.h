@@ -0,0 +1,82 @@
+#pragma once
+#include "json.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <concepts>
+
+/*
+* Serializes a response straight into an output buffer, without building a json DOM first.
+* Writes pretty JSON (the default, laid out like json::dump(2)), compact JSON, or CBOR. CBOR maps and
+* arrays use indefinite lengths, so nothing has to be counted before it's written.
+*/
+class ResponseWriter {
+public:
+    enum class Format { PrettyJson, Json, Cbor };
+
+    // Parses the "format" field of a request: "pretty", "json" or "cbor". Throws std::invalid_argument otherwise.
+    static Format parseFormat(std::string_view name);
+
+    // Appends to out, which is typically the reply buffer handed to the connection.
+    ResponseWriter(std::string& out, const Format format);
+
+    // Adds a member to the top-level object as soon as it's opened, e.g. the request id. May be called several times.
+    void setRootField(std::string_view name, nlohmann::json value);
+
+    // Adds a member to the next object opened at any depth, e.g. the index of a batch item inside a results array.
+    void setNextObjectField(std::string_view name, nlohmann::json value);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    // Starts the next member of the current object.
+    void key(std::string_view name);
+
+    void value(std::string_view text);
+    void value(const char* text) { value(std::string_view(text)); }
+    void value(const std::string& text) { value(std::string_view(text)); }
+    void value(double number);
+    void value(bool flag);
+    template <std::integral T>
+    void value(T number) {
+        if constexpr (std::is_signed_v<T>) writeInteger(static_cast<int64_t>(number));
+        else writeUnsigned(static_cast<uint64_t>(number));
+    }
+    void value(const nlohmann::json& document); // Small DOMs, e.g. error responses
+
+    // Raw bytes: a CBOR byte string, or a base64 string (RFC 4648, padded) in JSON.
+    void binary(std::string_view bytes);
+    void null();
+
+    // key(name) followed by value(v).
+    template <typename T>
+    void field(std::string_view name, const T& v) {
+        key(name);
+        value(v);
+    }
+
+private:
+    struct Scope {
+        bool isObject;
+        bool empty = true;
+    };
+
+    void beginScope(const bool isObject);
+    void endScope();
+    void beforeValue();
+    void newline(const size_t depth);
+    void writeInteger(int64_t number);
+    void writeUnsigned(uint64_t number);
+    void writeEscaped(std::string_view text);
+    void writeCborHead(const uint8_t majorType, const uint64_t argument);
+
+    std::string& _out;
+    Format _format;
+    std::vector<Scope> _scopes;
+    bool _afterKey = false;     // A key was written and its value comes next
+    std::vector<std::pair<std::string, nlohmann::json>> _rootFields;
+    std::vector<std::pair<std::string, nlohmann::json>> _nextObjectFields;
+};
@@ -1,12 +1,12 @@
 #include "Route.h"
 #include "Graph.h"
 #include "Utilities.hpp"
-#include <iostream>
+#include "Logger.h"
 #include <ctime>
 #include <algorithm>
 #include <stdexcept>
 #include <limits>
-#include <unordered_set>
+#include <cmath>
 
 namespace {
     bool isPublicTransport(Graph::TransportMethod method) {
@@ -18,6 +18,7 @@ namespace {
     double calculateEstimatedSegmentTime(
         const Graph::Station* prevStationPtr,
         const Route::VisitedStation& currentVs,
+        const Graph& graph,
         double walkSpeedKph,
         double publicTransportSpeedKph)
     {
@@ -26,17 +27,17 @@ namespace {
         }
 
         const Utilities::Coordinates& startCoords = prevStationPtr->coordinates;
-        const Utilities::Coordinates& endCoords = currentVs.station.coordinates;
-        const auto& lineTaken = currentVs.line;
+        const Utilities::Coordinates& endCoords = graph.getStationByIndex(currentVs.stationIndex).coordinates;
 
         double distance = Utilities::calculateHaversineDistance(startCoords, endCoords);
         double segmentTime = 0.0;
 
         // Merged conditions
-        if (lineTaken.id == "Walk" && walkSpeedKph > 0) {
+        if (currentVs.isWalk() && walkSpeedKph > 0) {
             segmentTime = (distance / walkSpeedKph) * 60.0;
         }
-        else if (isPublicTransport(lineTaken.type) && distance > 0 && publicTransportSpeedKph > 0) {
+        else if (currentVs.isRide() && isPublicTransport(graph.getEdge(currentVs.edgeIndex).type) &&
+            distance > 0 && publicTransportSpeedKph > 0) {
             segmentTime = (distance / publicTransportSpeedKph) * 60.0;
         }
 
@@ -46,11 +47,23 @@ namespace {
 
         return segmentTime;
     }
+
+    // Fare bracket for the aerial distance covered by public transport.
+    double calculateFare(const bool usedPublicTransport, const double publicTransportAerialDistance) {
+        if (!usedPublicTransport) { return 0.0; }
+        if (publicTransportAerialDistance <= 15.0) return 6.0;
+        else if (publicTransportAerialDistance <= 40.0) return 12.5;
+        else if (publicTransportAerialDistance <= 120.0) return 17.0;
+        else if (publicTransportAerialDistance <= 225.0) return 28.5;
+        else return 84.24;
+    }
 }
 
 // Add a visited station step
 void Route::addVisitedStation(const VisitedStation& vs) {
     this->_stations.push_back(vs);
+    _fitnessCache.hasValue = false; // The new step has no score yet
+    _validity.hasValue = false;
 }
 
 // Calculate total travel time from line segments
@@ -66,7 +79,7 @@ double Route::getTotalTime(const Graph& graph, int routeStartId) const {
         prevStationPtr = &graph.getStationByCode(routeStartId);
     }
     catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
+        LOG_WARNING(Genetic, "Failed to get start station " << routeStartId << " for journey time. " << e.what());
         return 0.0; 
     }
 
@@ -75,10 +88,11 @@ double Route::getTotalTime(const Graph& graph, int routeStartId) const {
         totalEstimatedTime += calculateEstimatedSegmentTime(
             prevStationPtr,
             i,
+            graph,
             Utilities::WALK_SPEED_KPH,
             Utilities::ASSUMED_PUBLIC_TRANSPORT_SPEED_KPH
         );
-        prevStationPtr = &i.station;
+        prevStationPtr = &graph.getStationByIndex(i.stationIndex);
     }
 
     return totalEstimatedTime;
@@ -97,171 +111,135 @@ double Route::getTotalCost(const Graph& graph) const {
     double totalPublicTransportAerialDistance = 0.0;
     bool usedPublicTransport = false;
 
-    int firstStationId = -1;
-    if (!_stations.empty()) {
-        firstStationId = _stations[0].station.code;
-        if (firstStationId == -1) {
-            std::cerr << "Critical Error [getTotalCost]: First station in route has invalid code (-1)." << std::endl;
-            return 0.0;
-        }
-    }
-    else {
-        std::cerr << "Critical Error [getTotalCost]: Route is empty, cannot determine first station." << std::endl;
+    const int firstStationIndex = _stations[0].stationIndex;
+    if (firstStationIndex < 0) {
+        LOG_ERROR(Genetic, "getTotalCost: First station in route has invalid index (-1).");
         return 0.0;
     }
 
-
     // Iterate through the route segments defined by VisitedStation entries
     for (size_t i = 1; i < _stations.size(); ++i) {
         const auto& currentVs = _stations[i];
-        const auto& lineTaken = currentVs.line;
+        if (!currentVs.isRide()) continue;
+        const auto& lineTaken = graph.getEdge(currentVs.edgeIndex);
 
         if (isPublicTransport(lineTaken.type)) {
             usedPublicTransport = true;
 
-            // Determine the start and end station IDs for this segment
-            int segmentStartId = currentVs.prevStationCode;
-            int segmentEndId = lineTaken.to; // The station ID where this line segment ends
+            // Determine the start and end stations for this segment
+            int segmentStartIndex = currentVs.prevStationIndex;
+            int segmentEndIndex = lineTaken.toIndex; // The station where this line segment ends
 
             // If it's the first segment, the 'previous' station is the overall start station
-            if (segmentStartId == -1 && i == 1) {
-                segmentStartId = firstStationId; // Use the ID we determined earlier
+            if (segmentStartIndex == -1 && i == 1) {
+                segmentStartIndex = firstStationIndex;
             }
-            else if (segmentStartId == -1) {
-                std::cerr << "Warning [getTotalCost]: Invalid prevStationCode (-1) for non-first segment index " << i << "." << std::endl;
+            else if (segmentStartIndex == -1) {
+                LOG_WARNING(Genetic, "getTotalCost: Invalid prevStationIndex (-1) for non-first segment index " << i << ".");
                 continue;
             }
 
-            // Check if segment is valid (start and end are different and valid IDs)
-            if (segmentStartId != segmentEndId && segmentStartId != -1 && segmentEndId != -1) {
-                try {
-                    // Get the Station objects for start and end of the segment
-                    const Graph::Station& startSegStation = graph.getStationByCode(segmentStartId);
-                    const Graph::Station& endSegStation = graph.getStationByCode(segmentEndId);
-
-                    // Calculate direct aerial distance between the start and end stations of this segment
-                    totalPublicTransportAerialDistance += Utilities::calculateHaversineDistance(
-                        startSegStation.coordinates,
-                        endSegStation.coordinates);
-
-                }
-                catch (const std::out_of_range& oor) {
-                    std::cerr << "Warning [getTotalCost]: Failed station lookup for segment "
-                        << segmentStartId << " -> " << segmentEndId << ". " << oor.what() << std::endl;
-                    continue;
-                }
-                catch (const std::exception& e) {
-                    std::cerr << "Error [getTotalCost]: Exception calculating distance for segment "
-                        << segmentStartId << " -> " << segmentEndId << ": " << e.what() << std::endl;
-                    continue;
-                }
+            // Check if segment is valid (start and end are different and valid stations)
+            if (segmentStartIndex != segmentEndIndex && segmentEndIndex != -1) {
+                // Calculate direct aerial distance between the start and end stations of this segment
+                totalPublicTransportAerialDistance += Utilities::calculateHaversineDistance(
+                    graph.getStationByIndex(segmentStartIndex).coordinates,
+                    graph.getStationByIndex(segmentEndIndex).coordinates);
             }
         }
     }
 
     // --- Fare Calculation ---
-    if (!usedPublicTransport) { return 0.0; }
-    if (totalPublicTransportAerialDistance <= 15.0) return 6.0;
-    else if (totalPublicTransportAerialDistance <= 40.0) return 12.5;
-    else if (totalPublicTransportAerialDistance <= 120.0) return 17.0;
-    else if (totalPublicTransportAerialDistance <= 225.0) return 28.5;
-    else return 84.24;
+    return calculateFare(usedPublicTransport, totalPublicTransportAerialDistance);
 }
 
 // Calculate number of transfers (line changes)
-int Route::getTransferCount() const {
+int Route::getTransferCount(const Graph& graph) const {
     if (_stations.size() < 2) return 0;
     int vehicleBoardings = 0;
-    for (size_t i = 1; i < _stations.size(); ++i) {
+    int prevLineIndex = -1; // Line of the previous step, -1 when it wasn't public transport
+    for (size_t i = 0; i < _stations.size(); ++i) {
         const auto& currentVs = _stations[i];
-        const auto& prevVs = _stations[i - 1];
-        Graph::TransportMethod currentMethod = currentVs.line.type;
-        const std::string& currentLineId = currentVs.line.id;
-        Graph::TransportMethod prevMethod = prevVs.line.type;
-        const std::string& prevLineId = prevVs.line.id;
-        if (isPublicTransport(currentMethod) && 
-            (!isPublicTransport(prevMethod) || (currentLineId != prevLineId))) {
+        int currentLineIndex = -1;
+        if (currentVs.isRide()) {
+            const auto& line = graph.getEdge(currentVs.edgeIndex);
+            if (isPublicTransport(line.type)) currentLineIndex = line.lineIndex;
+        }
+        if (i > 0 && currentLineIndex != -1 && currentLineIndex != prevLineIndex) {
             vehicleBoardings++;
         }
+        prevLineIndex = currentLineIndex;
     }
     return std::max(0, vehicleBoardings - 1);
 }
 
+Graph::TransportationLine Route::getLineTaken(const VisitedStation& vs, const Graph& graph) {
+    if (vs.isRide()) {
+        return graph.getEdge(vs.edgeIndex);
+    }
+
+    const Graph::Station& station = graph.getStationByIndex(vs.stationIndex);
+    double travelTime = 0.0;
+    if (vs.isWalk() && vs.prevStationIndex >= 0) {
+        travelTime = calculateWalkTime(graph.getStationByIndex(vs.prevStationIndex).coordinates, station.coordinates);
+    }
+    Graph::TransportationLine line(vs.isWalk() ? "Walk" : "Start", station.code, travelTime, Graph::TransportMethod::Walk);
+    line.toIndex = station.index;
+    return line;
+}
+
 // Get a copy of the visited stations vector
 const std::vector<Route::VisitedStation>& Route::getVisitedStations() const {
     return this->_stations;
 }
 
+bool Route::hasSameSteps(const Route& other) const {
+    return std::equal(_stations.begin(), _stations.end(), other._stations.begin(), other._stations.end(),
+        [](const VisitedStation& a, const VisitedStation& b) {
+            return a.stationIndex == b.stationIndex && a.edgeIndex == b.edgeIndex && a.prevStationIndex == b.prevStationIndex;
+        });
+}
+
+size_t Route::getMemoryUsage() const {
+    return _stations.capacity() * sizeof(VisitedStation) + _stepScores.capacity() * sizeof(StepScore);
+}
+
 bool Route::isValid(const int startId, const int destinationId, const Graph& graph) const {
+    const ValidityCache& cache = _validity;
+    if (cache.hasValue && cache.startId == startId && cache.destinationId == destinationId && cache.graph == &graph) {
+        return cache.valid;
+    }
+    const bool valid = checkValidity(startId, destinationId, graph);
+    _validity = { true, valid, startId, destinationId, &graph };
+    return valid;
+}
+
+bool Route::checkValidity(const int startId, const int destinationId, const Graph& graph) const {
     if (_stations.empty()) return false;
 
     // Check Start Station
-    try {
-        // Ensure first VisitedStation's internal station matches the graph's station for startId
-        if (_stations.front().station != graph.getStationByCode(startId)) {
-            return false;
-        }
-        // Also check the stored previous code for the start station (should be -1 or similar)
-        if (_stations.front().prevStationCode != -1) {
-            return false;
-        }
+    // Ensure the first step is the graph's station for startId, and that it has no previous station
+    const int startIndex = graph.getStationIndex(startId);
+    if (startIndex < 0 || _stations.front().stationIndex != startIndex) {
+        return false;
+    }
+    if (_stations.front().prevStationIndex != -1) {
+        return false;
     }
-    catch (const std::runtime_error&) { return false; }
-    catch (const std::out_of_range&) { return false; }
 
     // Handle special case: start == end
     if (_stations.size() == 1) { return (startId == destinationId); }
 
-    // Check End Station (using line.to of last step)
-    if (_stations.back().line.to != destinationId) {
+    // Check End Station
+    const int destinationIndex = graph.getStationIndex(destinationId);
+    if (destinationIndex < 0 || _stations.back().stationIndex != destinationIndex) {
         return false;
     }
-    // Also check that the last station object matches the graph's station for destinationId
-    try {
-        if (_stations.back().station != graph.getStationByCode(destinationId)) {
-            return false;
-        }
-    }
-    catch (...) { return false; }
-
 
     // --- Check Transitions ---
+    updateStepScores(startId, graph);
     for (size_t i = 1; i < _stations.size(); ++i) {
-        const auto& vs = _stations[i];
-        const auto& line_taken = vs.line;
-        int current_station_code = line_taken.to;
-        int prev_station_code = vs.prevStationCode;
-
-        if (prev_station_code == -1 && i > 0) {
-            return false;
-        }
-
-        try {
-            if (graph.getStationByCode(current_station_code) != vs.station) {
-                return false;
-            }
-        }
-        catch (...) { return false; }
-
-        if (line_taken.id == "Start") { continue; }
-        if (line_taken.id == "Walk") { continue; }
-
-        bool line_found_at_source = false;
-        try {
-            if (!graph.hasStation(prev_station_code)) {
-                return false;
-            }
-            const auto& lines_from_prev = graph.getLinesFrom(prev_station_code);
-            for (const auto& available_line : lines_from_prev) {
-                if (available_line.id == line_taken.id && available_line.to == current_station_code) {
-                    line_found_at_source = true;
-                    break;
-                }
-            }
-        }
-        catch (const std::out_of_range&) { return false; }
-
-        if (!line_found_at_source) {
+        if (!_stepScores[i].validTransition) {
             return false;
         }
     }
@@ -273,46 +251,76 @@ bool Route::isValid(const int startId, const int destinationId, const Graph& gra
 // --- getFitness - Higher is better ---
 double Route::getFitness(int startId, int destinationId, const Graph& graph,
     const Utilities::Coordinates& userCoords,
-    const Utilities::Coordinates& destCoords) const
+    const Utilities::Coordinates& destCoords,
+    const double departureTime) const
+{
+    const FitnessCache& cache = _fitnessCache;
+    if (cache.hasValue && cache.startId == startId && cache.destinationId == destinationId && cache.graph == &graph &&
+        cache.userCoords.latitude == userCoords.latitude && cache.userCoords.longitude == userCoords.longitude &&
+        cache.destCoords.latitude == destCoords.latitude && cache.destCoords.longitude == destCoords.longitude &&
+        cache.departureTime == departureTime) {
+        return cache.fitness;
+    }
+
+    const double fitness = evaluateFitness(startId, destinationId, graph, userCoords, destCoords, departureTime);
+    _fitnessCache = { true, startId, destinationId, &graph, userCoords, destCoords, departureTime, fitness };
+    return fitness;
+}
+
+double Route::evaluateFitness(int startId, int destinationId, const Graph& graph,
+    const Utilities::Coordinates& userCoords,
+    const Utilities::Coordinates& destCoords,
+    const double departureTime) const
 {
     // --- Initial Checks ---
     if (_stations.empty() || !isValid(startId, destinationId, graph)) {
         return 0.0;
     }
+    updateStepScores(startId, graph);
 
     // --- Calculate Initial & Final Walk Times ---
     double initialWalkTime = 0.0;
     double finalWalkTime = 0.0;
     double totalWalkTime = 0.0;
 
-    try { initialWalkTime = calculateWalkTime(userCoords, _stations.front().station.coordinates); }
+    try { initialWalkTime = calculateWalkTime(userCoords, graph.getStationByIndex(_stations.front().stationIndex).coordinates); }
     catch (...) {  }
     try {
-        const Graph::Station& lastSt = _stations.back().station;
+        const Graph::Station& lastSt = graph.getStationByIndex(_stations.back().stationIndex);
         if (lastSt.code == destinationId) finalWalkTime = calculateWalkTime(lastSt.coordinates, destCoords);
         else finalWalkTime = calculateWalkTime(graph.getStationByCode(destinationId).coordinates, destCoords);
     }
     catch (...) {  }
 
-    // --- Get Estimated Station-to-Station Time ---
-    double totalStationToStationTime = getTotalTime(graph, startId);
-
-    // --- Calculate Total Raw Walk Time ---
-    totalWalkTime = initialWalkTime + finalWalkTime;
-    for (size_t i = 0; i < _stations.size(); ++i) {
-        if (_stations[i].line.id == "Walk") {
-            try {
-                int prevCode = _stations[i].prevStationCode;
-                const auto& prevSt = (i == 0 || prevCode == -1) ? graph.getStationByCode(startId) : graph.getStationByCode(prevCode);
-                totalWalkTime += calculateWalkTime(prevSt.coordinates, _stations[i].station.coordinates);
-            }
-            catch (...) {  }
+    // --- Sum the Per-Step Terms ---
+    double totalStationToStationTime = 0.0;
+    double stepWalkTime = 0.0;
+    double publicTransportAerialDistance = 0.0;
+    bool usedPublicTransport = false;
+    int vehicleBoardings = 0;
+    for (size_t i = 0; i < _stepScores.size(); ++i) {
+        const StepScore& step = _stepScores[i];
+        totalStationToStationTime += step.segmentTime;
+        stepWalkTime += step.walkTime;
+        if (i == 0) continue; // The first step doesn't count for the fare or the boardings
+
+        publicTransportAerialDistance += step.publicDistance;
+        usedPublicTransport = usedPublicTransport || step.publicTransport;
+        const StepScore& prevStep = _stepScores[i - 1];
+        if (step.publicTransport && (!prevStep.publicTransport || step.lineIndex != prevStep.lineIndex)) {
+            vehicleBoardings++;
         }
     }
 
+    // --- Calculate Total Raw Walk Time ---
+    totalWalkTime = initialWalkTime + finalWalkTime + stepWalkTime;
+
+    // --- Wait for each vehicle, following the timetables from the departure time ---
+    const double waitTime = calculateWaitTime(graph, departureTime + initialWalkTime);
+
     // --- Calculate Other Components ---
-    double totalCost = getTotalCost(graph);
-    int transfers = getTransferCount();
+    double totalCost = calculateFare(usedPublicTransport, publicTransportAerialDistance);
+    int transfers = std::max(0, vehicleBoardings - 1);
 
     // --- Define weights/penalties ---
     const double time_weight = 1.0;
@@ -321,7 +329,7 @@ double Route::getFitness(int startId, int destinationId, const Graph& graph,
     const double walk_penalty_factor = 2.0;
 
     // --- Calculate Score ---
-    double baseTime = initialWalkTime + totalStationToStationTime + finalWalkTime;
+    double baseTime = initialWalkTime + totalStationToStationTime + waitTime + finalWalkTime;
     double score = (time_weight * baseTime) +
         (walk_penalty_factor - 1.0) * totalWalkTime +
         (cost_weight * totalCost) + (transfers * transfer_penalty);
@@ -331,24 +339,116 @@ double Route::getFitness(int startId, int destinationId, const Graph& graph,
     return 1.0 / score;
 }
 
+// --- Step Scores ---
+void Route::updateStepScores(const int startId, const Graph& graph) const {
+    if (_scoredStartId != startId || _scoredGraph != &graph) {
+        _stepScores.clear();
+        _scoredStartId = startId;
+        _scoredGraph = &graph;
+    }
+    if (!graph.hasStation(startId)) return;
+
+    const Graph::Station& startStation = graph.getStationByCode(startId);
+    _stepScores.resize(_stations.size());
+    for (size_t i = 0; i < _stations.size(); ++i) {
+        if (!_stepScores[i].scored) {
+            _stepScores[i] = scoreStep(i, startStation, graph);
+        }
+    }
+}
+
+// Same terms as getTotalTime, getTotalCost, the walk sum of getFitness and the transition check of isValid, for one step.
+Route::StepScore Route::scoreStep(const size_t i, const Graph::Station& startStation, const Graph& graph) const {
+    StepScore score;
+    score.scored = true;
+
+    const VisitedStation& vs = _stations[i];
+    const int stationCount = static_cast<int>(graph.getStationCount());
+    const int prevIndex = vs.prevStationIndex;
+    if (vs.stationIndex < 0 || vs.stationIndex >= stationCount || prevIndex >= stationCount ||
+        (i > 0 && (_stations[i - 1].stationIndex < 0 || _stations[i - 1].stationIndex >= stationCount))) {
+        return score; // Not a station of this graph (e.g. a seed route from an older graph), never valid
+    }
+    const Graph::Station& station = graph.getStationByIndex(vs.stationIndex);
+
+    const Graph::Station& prevStation = (i == 0) ? startStation : graph.getStationByIndex(_stations[i - 1].stationIndex);
+    score.segmentTime = calculateEstimatedSegmentTime(&prevStation, vs, graph,
+        Utilities::WALK_SPEED_KPH, Utilities::ASSUMED_PUBLIC_TRANSPORT_SPEED_KPH);
+
+    if (vs.isWalk()) {
+        const Graph::Station& walkStart = (i == 0 || prevIndex == -1) ? startStation : graph.getStationByIndex(prevIndex);
+        score.walkTime = calculateWalkTime(walkStart.coordinates, station.coordinates);
+    }
+
+    const Graph::TransportationLine* lineTaken = vs.isRide() && static_cast<size_t>(vs.edgeIndex) < graph.getEdgeCount()
+        ? &graph.getEdge(vs.edgeIndex) : nullptr;
+    if (lineTaken && isPublicTransport(lineTaken->type)) {
+        score.publicTransport = true;
+        score.lineIndex = lineTaken->lineIndex;
+    }
+
+    // The first step is checked against the start station by isValid, and doesn't count for the fare.
+    if (i == 0) {
+        score.validTransition = true;
+        return score;
+    }
+
+    if (score.publicTransport) {
+        int segmentStartIndex = (prevIndex == -1 && i == 1) ? _stations[0].stationIndex : prevIndex;
+        int segmentEndIndex = lineTaken->toIndex;
+        if (segmentStartIndex != segmentEndIndex && segmentStartIndex >= 0 && segmentEndIndex >= 0) {
+            score.publicDistance = Utilities::calculateHaversineDistance(
+                graph.getStationByIndex(segmentStartIndex).coordinates,
+                graph.getStationByIndex(segmentEndIndex).coordinates);
+        }
+    }
+
+    // Start and walk steps can go anywhere; a ride has to use an edge of the previous station that ends here.
+    score.validTransition = prevIndex != -1;
+    if (vs.isRide()) {
+        score.validTransition = score.validTransition && lineTaken &&
+            graph.isEdgeFrom(prevIndex, vs.edgeIndex) && lineTaken->toIndex == vs.stationIndex;
+    }
+    else if (!vs.isWalk() && !vs.isStart()) {
+        score.validTransition = false;
+    }
+    return score;
+}
+
+void Route::invalidateAllScores() {
+    _stepScores.clear();
+    _fitnessCache.hasValue = false;
+    _validity.hasValue = false;
+}
+
 // --- generatePathSegment ---
-bool Route::generatePathSegment(const int segmentStartId, const int segmentEndId, const Graph& graph, std::mt19937& gen, std::vector<VisitedStation>& segment) {
+bool Route::generatePathSegment(const int segmentStartIndex, const int segmentEndIndex, const Graph& graph, std::mt19937& gen, Workspace& workspace) {
+    auto& segment = workspace.segment;
+    auto& validLines = workspace.validLines;
+    auto& weights = workspace.weights;
     segment.clear();
-    int currentCode = segmentStartId;
+    int currentIndex = segmentStartIndex;
     const int maxSteps = 75;
     int steps = 0;
     const double epsilon = 1e-6;
-    std::unordered_set<int> visitedCodesSegment;
 
     try {
-        if (!graph.hasStation(segmentStartId) || !graph.hasStation(segmentEndId)) return false;
-        const Graph::Station& destStation = graph.getStationByCode(segmentEndId);
+        const int stationCount = static_cast<int>(graph.getStationCount());
+        if (segmentStartIndex < 0 || segmentStartIndex >= stationCount || segmentEndIndex < 0 || segmentEndIndex >= stationCount) return false;
+        const Graph::Station& destStation = graph.getStationByIndex(segmentEndIndex);
         double destLat = destStation.coordinates.latitude; double destLon = destStation.coordinates.longitude;
-        visitedCodesSegment.insert(currentCode);
 
-        while (currentCode != segmentEndId && steps < maxSteps) {
-            if (!graph.hasStation(currentCode)) return false;
-            const Graph::Station& currentStation = graph.getStationByCode(currentCode);
+        // Start a new visited set. Stamps only need resetting when the counter wraps around.
+        auto& visitedStamps = workspace.visitedStamps;
+        if (visitedStamps.size() != static_cast<size_t>(stationCount) || ++workspace.visitStamp == 0) {
+            visitedStamps.assign(stationCount, 0);
+            workspace.visitStamp = 1;
+        }
+        const unsigned int stamp = workspace.visitStamp;
+        visitedStamps[currentIndex] = stamp;
+
+        while (currentIndex != segmentEndIndex && steps < maxSteps) {
+            const Graph::Station& currentStation = graph.getStationByIndex(currentIndex);
 			double curLat = currentStation.coordinates.latitude; double curLon = currentStation.coordinates.longitude;
             double distanceToSegmentEnd = Utilities::calculateHaversineDistance(
                 Utilities::Coordinates(curLat, curLon),
@@ -356,20 +456,19 @@ bool Route::generatePathSegment(const int segmentStartId, const int segmentEndId
             );
             if (const double MAX_WALKING_DISTANCE_SEGMENT = 0.5;
                 distanceToSegmentEnd < MAX_WALKING_DISTANCE_SEGMENT) {
-                Graph::TransportationLine walkingEdge("Walk", segmentEndId, (distanceToSegmentEnd / 5.0) * 60.0, Graph::TransportMethod::Walk);
-                segment.push_back(VisitedStation(destStation, walkingEdge, currentCode));
-                currentCode = segmentEndId;
+                segment.push_back(VisitedStation(segmentEndIndex, VisitedStation::WalkEdge, currentIndex));
+                currentIndex = segmentEndIndex;
                 break;
             }
 
-            const auto& availableLines = graph.getLinesFrom(currentCode);
+            const auto availableLines = graph.getLinesFromIndex(currentIndex);
             if (availableLines.empty()) return false;
 
-            std::vector<const Graph::TransportationLine*> validLines; std::vector<double> weights;
+            validLines.clear(); weights.clear();
             for (const auto& line : availableLines) {
-                int nextCode = line.to;
-                if (graph.hasStation(nextCode) && !visitedCodesSegment.contains(nextCode)) {
-                    const Graph::Station& nextStation = graph.getStationByCode(nextCode);
+                int nextIndex = line.toIndex;
+                if (nextIndex >= 0 && visitedStamps[nextIndex] != stamp) {
+                    const Graph::Station& nextStation = graph.getStationByIndex(nextIndex);
 					double nextLat = nextStation.coordinates.latitude; double nextLon = nextStation.coordinates.longitude;
                     double distToDest = Utilities::calculateHaversineDistance(
                         Utilities::Coordinates(nextLat, nextLon),
@@ -379,37 +478,46 @@ bool Route::generatePathSegment(const int segmentStartId, const int segmentEndId
                 }
             }
             if (validLines.empty()) return false;
-            std::vector<double> probabilities; double sumInverseWeights = 0.0;
-            for (double w : weights) { sumInverseWeights += 1.0 / std::max(w, epsilon); }
+            double sumInverseWeights = 0.0;
+            for (double& w : weights) { w = 1.0 / std::max(w, epsilon); sumInverseWeights += w; }
             const Graph::TransportationLine* chosenLinePtr = nullptr;
             if (sumInverseWeights <= epsilon) {
                 std::uniform_int_distribution<> uniform_dis(0, static_cast<int>(validLines.size() - 1)); chosenLinePtr = validLines[uniform_dis(gen)];
             }
-            else { // Weighted Choice
-                for (double w : weights) { probabilities.push_back((1.0 / std::max(w, epsilon)) / sumInverseWeights); }
-                std::discrete_distribution<> dist(probabilities.begin(), probabilities.end()); chosenLinePtr = validLines[dist(gen)];
+            else { // Weighted Choice, by walking the cumulative inverse weights (std::discrete_distribution would allocate)
+                double pick = std::uniform_real_distribution<>(0.0, sumInverseWeights)(gen);
+                size_t chosen = 0;
+                while (chosen + 1 < weights.size() && pick >= weights[chosen]) { pick -= weights[chosen]; chosen++; }
+                chosenLinePtr = validLines[chosen];
             }
 
             // Add the chosen step to the segment
-            const Graph::Station& nextStation = graph.getStationByCode(chosenLinePtr->to);
-            segment.push_back(VisitedStation(nextStation, *chosenLinePtr, currentCode));
-            currentCode = chosenLinePtr->to; // Move to the next station
-            visitedCodesSegment.insert(currentCode);
+            segment.push_back(VisitedStation(chosenLinePtr->toIndex, graph.getEdgeIndex(*chosenLinePtr), currentIndex));
+            currentIndex = chosenLinePtr->toIndex; // Move to the next station
+            visitedStamps[currentIndex] = stamp;
             steps++;
         }
-        return (currentCode == segmentEndId);
+        return (currentIndex == segmentEndIndex);
 
     }
     catch (...) { return false; }
 }
 
 // --- Mutate ---
-void Route::mutate(const double mutationRate, std::mt19937& gen, const int startId, const int destinationId, const Graph& graph) {
+void Route::mutate(const double mutationRate, std::mt19937& gen, const int startId, const int destinationId, const Graph& graph,
+    Workspace& workspace) {
     std::uniform_real_distribution<> prob_dis(0.0, 1.0);
     if (prob_dis(gen) >= mutationRate) {
         return; 
     }
 
+    // Both mutation types keep the ends and only add graph edges and walks, so a valid route stays valid.
+    const bool wasValid = _validity.isValidFor(startId, destinationId, graph);
+    auto keepValidity = [&]() {
+        _fitnessCache.hasValue = false;
+        _validity.hasValue = wasValid;
+    };
+
     // --- Choose Mutation Type ---
     // e.g., 80% chance regenerate segment, 20% chance try walk replacement
     std::uniform_real_distribution<> type_dis(0.0, 1.0);
@@ -421,16 +529,18 @@ void Route::mutate(const double mutationRate, std::mt19937& gen, const int start
 
         std::uniform_int_distribution<> index_dis(1, static_cast<int>(_stations.size() - 1));
         int restart_index = index_dis(gen);
-        int segment_start_code;
-        try { segment_start_code = _stations[restart_index - 1].station.code; }
-        catch (...) { return; } // Abort if prev station lookup fails
+        int segment_start_index = _stations[restart_index - 1].stationIndex;
 
-        std::vector<VisitedStation> new_segment;
-        bool success = generatePathSegment(segment_start_code, destinationId, graph, gen, new_segment);
+        const auto& new_segment = workspace.segment;
+        bool success = generatePathSegment(segment_start_index, graph.getStationIndex(destinationId), graph, gen, workspace);
 
         if (success && !new_segment.empty()) {
             _stations.resize(restart_index);
             _stations.insert(_stations.end(), new_segment.begin(), new_segment.end());
+
+            // Steps before the restart point keep their scores
+            _stepScores.resize(std::min(_stepScores.size(), static_cast<size_t>(restart_index)));
+            keepValidity();
         }
     }
     // --- Mutation Type 2: Try Walking Replacement ---
@@ -450,22 +560,13 @@ void Route::mutate(const double mutationRate, std::mt19937& gen, const int start
         size_t legs_to_replace = seg_len_dis(gen);
         size_t idx2 = idx1 + legs_to_replace; // Index of the station *at the end* of the segment
 
-        // Get relevant stations and codes
+        // Get relevant stations. The walk starts where the step at idx1 arrived.
         const VisitedStation& before_segment_vs = _stations[idx1];
         const VisitedStation& segment_end_vs = _stations[idx2];
-        int before_segment_code = before_segment_vs.prevStationCode; // Code before station idx1
-        if (idx1 == 0) { // Special case if idx1 is the first station (shouldn't happen with distribution starting at 1, but safety)
-            try { before_segment_code = before_segment_vs.station.code; }
-            catch (...) { return; }
-        }
-        else {
-            before_segment_code = _stations[idx1].prevStationCode;
-        }
+        const int before_segment_index = before_segment_vs.stationIndex;
 
-        int segment_end_code = segment_end_vs.line.to; // The 'to' code of the line that reached the segment end station
-
-		auto before_station_coords = before_segment_vs.station.coordinates;
-		auto end_station_coords = segment_end_vs.station.coordinates;
+		auto before_station_coords = graph.getStationByIndex(before_segment_vs.stationIndex).coordinates;
+		auto end_station_coords = graph.getStationByIndex(segment_end_vs.stationIndex).coordinates;
 
         // Calculate direct walking distance
         double walk_dist = Utilities::calculateHaversineDistance(
@@ -475,10 +576,7 @@ void Route::mutate(const double mutationRate, std::mt19937& gen, const int start
 
         if (walk_dist < MAX_WALK_REPLACE_DISTANCE) {
             // Walking is feasible, create the walk step
-            double walk_time = (walk_dist / Utilities::WALK_SPEED_KPH) * 60.0; // time in minutes
-
-            Graph::TransportationLine walkLine("Walk", segment_end_code, walk_time, Graph::TransportMethod::Walk);
-            VisitedStation walkStep(segment_end_vs.station, walkLine, before_segment_code); // Walk ends at station idx2, came from station idx1
+            VisitedStation walkStep(segment_end_vs.stationIndex, VisitedStation::WalkEdge, before_segment_index); // Walk ends at station idx2
 
             // --- Replace the segment ---
             // Erase the stations within the segment being replaced (from idx1+1 up to idx2)
@@ -496,6 +594,16 @@ void Route::mutate(const double mutationRate, std::mt19937& gen, const int start
                 _stations.erase(erase_start, erase_end);
                 // Insert the single walk step *after* idx1
                 _stations.insert(_stations.begin() + idx1 + 1, walkStep);
+
+                // Only the walk step needs scoring; the steps after it still start from the station at idx2
+                if (_stepScores.size() > idx2) {
+                    _stepScores.erase(_stepScores.begin() + idx1 + 1, _stepScores.begin() + idx2 + 1);
+                    _stepScores.insert(_stepScores.begin() + idx1 + 1, StepScore{});
+                }
+                else {
+                    _stepScores.resize(std::min(_stepScores.size(), idx1 + 1));
+                }
+                keepValidity();
             }
         }
     }
@@ -503,22 +611,23 @@ void Route::mutate(const double mutationRate, std::mt19937& gen, const int start
 
 
 // Crossover function (single-point based on common station)
-Route Route::crossover(const Route& parent1, const Route& parent2, std::mt19937& gen) {
+void Route::crossover(const Route& parent1, const Route& parent2, std::mt19937& gen, Workspace& workspace, Route& child) {
     const auto& visited1 = parent1.getVisitedStations();
     const auto& visited2 = parent2.getVisitedStations();
 
     // Basic checks for valid crossover
     if (visited1.size() <= 2 || visited2.size() <= 2) {
         // Not enough intermediate points, return one parent
-        return parent1;
+        child = parent1;
+        return;
     }
 
     // Find common intermediate stations
-    std::vector<std::pair<size_t, size_t>> commonIndices;
+    auto& commonIndices = workspace.commonIndices;
+    commonIndices.clear();
     for (size_t i = 1; i < visited1.size() - 1; ++i) { // Exclude start/end
         for (size_t j = 1; j < visited2.size() - 1; ++j) { // Exclude start/end
-            // Use Station's operator==
-            if (visited1[i].station == visited2[j].station) {
+            if (visited1[i].stationIndex == visited2[j].stationIndex) {
                 commonIndices.push_back({ i, j });
             }
         }
@@ -527,23 +636,35 @@ Route Route::crossover(const Route& parent1, const Route& parent2, std::mt19937&
     if (!commonIndices.empty()) {
         // Choose a random common station pair
         std::uniform_int_distribution<> common_dis(0, static_cast<int>(commonIndices.size() - 1));
-        const auto& [idx1, idx2] = commonIndices[common_dis(gen)];
-
-        // Create child route by combining segments
-        Route childRoute;
-        // Segment from parent1 up to (and including) the common station
-        for (size_t k = 0; k <= idx1; ++k) {
-            childRoute.addVisitedStation(visited1[k]);
-        }
-        // Segment from parent2 *after* the common station to the end
-        for (size_t k = idx2 + 1; k < visited2.size(); ++k) {
-            childRoute.addVisitedStation(visited2[k]);
+        const auto [idx1, idx2] = commonIndices[common_dis(gen)];
+
+        // Create child route by combining segments:
+        // parent1 up to (and including) the common station, then parent2 *after* the common station to the end
+        child._stations.assign(visited1.begin(), visited1.begin() + idx1 + 1);
+        child._stations.insert(child._stations.end(), visited2.begin() + idx2 + 1, visited2.end());
+        child._fitnessCache.hasValue = false;
+
+        // The second half rides on from the common station and ends where parent2 does, so a child of two routes
+        // valid for the same pair is valid for it too.
+        const ValidityCache& validity1 = parent1._validity;
+        child._validity = validity1;
+        child._validity.hasValue = validity1.hasValue && validity1.valid && validity1.graph &&
+            parent2._validity.isValidFor(validity1.startId, validity1.destinationId, *validity1.graph);
+
+        // Both halves keep their step scores: the step after the common station starts from the same station in both parents.
+        const auto& scores1 = parent1._stepScores;
+        const auto& scores2 = parent2._stepScores;
+        child._scoredStartId = parent1._scoredStartId;
+        child._scoredGraph = parent1._scoredGraph;
+        child._stepScores.assign(scores1.begin(), scores1.begin() + std::min(scores1.size(), idx1 + 1));
+        if (scores1.size() > idx1 && scores2.size() == visited2.size() &&
+            parent1._scoredStartId == parent2._scoredStartId && parent1._scoredGraph == parent2._scoredGraph) {
+            child._stepScores.insert(child._stepScores.end(), scores2.begin() + idx2 + 1, scores2.end());
         }
-        return childRoute;
     }
     else {
         std::uniform_int_distribution<> parent_choice(0, 1);
-        return (parent_choice(gen) == 0) ? parent1 : parent2;
+        child = (parent_choice(gen) == 0) ? parent1 : parent2;
     }
 }
 
@@ -552,7 +673,8 @@ double Route::calculateFullJourneyTime(
     int routeStartId,
     int routeEndId,
     const Utilities::Coordinates& userCoords,
-    const Utilities::Coordinates& destCoords) const
+    const Utilities::Coordinates& destCoords,
+    const double departureTime) const
 {
     double initialWalkTime = 0.0;
     double finalWalkTime = 0.0;
@@ -563,11 +685,15 @@ double Route::calculateFullJourneyTime(
         initialWalkTime = calculateWalkTime(userCoords, startStation.coordinates);
     }
     catch (const std::exception& e) {
-        std::cerr << "Warning: Failed to get start station " << routeStartId << " for initial walk time. " << e.what() << std::endl;
+        LOG_WARNING(Genetic, "Failed to get start station " << routeStartId << " for initial walk time. " << e.what());
     }
 
-    // Calculate Station-to-Station Time (using existing method)
+    // Calculate Station-to-Station Time (using existing method), with the waits for each boarding
     double stationToStationTime = getTotalTime(graph, routeStartId);
+    if (graph.hasStation(routeStartId)) {
+        updateStepScores(routeStartId, graph);
+        stationToStationTime += calculateWaitTime(graph, departureTime + initialWalkTime);
+    }
 
     // Calculate Final Walk
     try {
@@ -575,7 +701,7 @@ double Route::calculateFullJourneyTime(
         finalWalkTime = calculateWalkTime(endStation.coordinates, destCoords);
     }
     catch (const std::exception& e) {
-        std::cerr << "Warning: Failed to get end station " << routeEndId << " for final walk time. " << e.what() << std::endl;
+        LOG_WARNING(Genetic, "Failed to get end station " << routeEndId << " for final walk time. " << e.what());
     }
 
     // Basic checks for NaN or negative values from components
@@ -586,20 +712,45 @@ double Route::calculateFullJourneyTime(
     return initialWalkTime + stationToStationTime + finalWalkTime;
 }
 
+double Route::calculateWaitTime(const Graph& graph, double clock) const {
+    constexpr double MinutesPerDay = 24 * 60;
+    double waitTime = 0.0;
+    for (size_t i = 0; i < _stepScores.size() && i < _stations.size(); ++i) {
+        const StepScore& step = _stepScores[i];
+        const bool boards = step.publicTransport &&
+            (i == 0 || !_stepScores[i - 1].publicTransport || _stepScores[i - 1].lineIndex != step.lineIndex);
+        if (boards) {
+            // The arrival times of a ride's edge are the line's stops at the station it's boarded from.
+            const Graph::TransportationLine& line = graph.getEdge(_stations[i].edgeIndex);
+            if (!line.arrivalTimes.empty()) {
+                double departure = line.nextArrivalAtOrAfter(clock);
+                if (departure < 0) {
+                    const double first = line.arrivalTimes.front();
+                    departure = first + MinutesPerDay * std::max(1.0, std::ceil((clock - first) / MinutesPerDay));
+                }
+                waitTime += departure - clock;
+                clock = departure;
+            }
+        }
+        clock += step.segmentTime;
+    }
+    return waitTime;
+}
+
 double Route::calculateWalkTime(const Utilities::Coordinates& c1, const Utilities::Coordinates& c2) {
     if (!c1.isValid() || !c2.isValid()) {
-        std::cerr << "Warning: Invalid coordinates passed to calculateWalkTime." << std::endl;
+        LOG_WARNING(Genetic, "Invalid coordinates passed to calculateWalkTime.");
         return 0.0; // Cannot calculate time for invalid coords
     }
     double dist = Utilities::calculateHaversineDistance(c1, c2);
 
     // Handle potential issues with distance or speed
     if (dist < 0 || std::isnan(dist)) {
-        std::cerr << "Warning: Invalid distance (" << dist << ") in calculateWalkTime." << std::endl;
+        LOG_WARNING(Genetic, "Invalid distance (" << dist << ") in calculateWalkTime.");
         return 0.0; // Distance cannot be negative
     }
     if (Utilities::WALK_SPEED_KPH <= 0 || std::isnan(Utilities::WALK_SPEED_KPH)) {
-        std::cerr << "Error: Invalid WALK_SPEED_KPH (" << Utilities::WALK_SPEED_KPH << ")." << std::endl;
+        LOG_ERROR(Genetic, "Invalid WALK_SPEED_KPH (" << Utilities::WALK_SPEED_KPH << ").");
         // Return a large value to penalize? Or 0? Let's return 0 for now.
         return 0.0;
     }
@@ -609,7 +760,7 @@ double Route::calculateWalkTime(const Utilities::Coordinates& c1, const Utilitie
 
     double time = (dist / Utilities::WALK_SPEED_KPH) * 60.0; // minutes
     if (std::isnan(time) || time < 0) {
-        std::cerr << "Warning: Calculated walk time is invalid (" << time << ")." << std::endl;
+        LOG_WARNING(Genetic, "Calculated walk time is invalid (" << time << ").");
         return 0.0;
     }
     return time;
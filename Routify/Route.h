@@ -4,16 +4,42 @@
 
 class Route {
 public:
+    /*
+    * One step (gene) of a route, stored as indices into the graph so routes are cheap to copy.
+    * Resolve it with Graph::getStationByIndex and getLineTaken when the full objects are needed.
+    */
     struct VisitedStation {
-        Graph::Station station;
-        Graph::TransportationLine line;
-        int prevStationCode;
+        static constexpr int StartEdge = -1;    // The first station of the route, no line taken.
+        static constexpr int WalkEdge = -2;     // Walked from the previous station.
 
-        VisitedStation(const Graph::Station& s, const Graph::TransportationLine& l, const int prevCode)
-            : station(s), line(l), prevStationCode(prevCode) {
+        int stationIndex;       // Dense index of the station reached.
+        int edgeIndex;          // Graph edge taken to reach the station, or StartEdge / WalkEdge.
+        int prevStationIndex;   // Dense index of the station it was reached from, -1 for the start.
+
+        VisitedStation(const int stationIdx, const int edgeIdx, const int prevStationIdx)
+            : stationIndex(stationIdx), edgeIndex(edgeIdx), prevStationIndex(prevStationIdx) {
         }
 
-        VisitedStation() : prevStationCode(-1) {}
+        VisitedStation() : stationIndex(-1), edgeIndex(StartEdge), prevStationIndex(-1) {}
+
+        bool isWalk() const { return edgeIndex == WalkEdge; }
+        bool isStart() const { return edgeIndex == StartEdge; }
+        bool isRide() const { return edgeIndex >= 0; }
+    };
+
+    /*
+    * Scratch buffers for mutation and crossover. A GA run owns one and passes it to every call,
+    * so they reuse the same memory across all generations instead of allocating on every step.
+    */
+    struct Workspace {
+        std::vector<const Graph::TransportationLine*> validLines;
+        std::vector<double> weights;
+        std::vector<VisitedStation> segment;
+        std::vector<std::pair<size_t, size_t>> commonIndices;
+
+        // A station was visited by the current path segment if its stamp equals visitStamp.
+        std::vector<unsigned int> visitedStamps;
+        unsigned int visitStamp = 0;
     };
 
     Route() = default;
@@ -34,13 +60,27 @@ public:
     double getTotalCost(const Graph& graph) const;
 
     // Returns the transportation.
-    int getTransferCount() const;
+    int getTransferCount(const Graph& graph) const;
+
+    // Builds the line a step took. Start and walk steps get a synthetic "Start" / "Walk" line.
+    static Graph::TransportationLine getLineTaken(const VisitedStation& vs, const Graph& graph);
     
     // Returns the visited stations vector.
     const std::vector<VisitedStation>& getVisitedStations() const;
-    std::vector<VisitedStation>& getMutableVisitedStations() { return _stations; }
+    // Callers may change any step through this, so it drops every cached score.
+    std::vector<VisitedStation>& getMutableVisitedStations() { invalidateAllScores(); return _stations; }
+
+    // Checks if two routes take exactly the same steps.
+    bool hasSameSteps(const Route& other) const;
+
+    // Approximate heap memory held by the route, including its score caches.
+    size_t getMemoryUsage() const;
 
-    // Checks if the route is valid
+    /*
+    * Checks if the route goes from startId to destinationId, every ride on an edge of the station before it.
+    * The result is cached. mutate and crossover only build routes out of graph edges that keep the ends, so their
+    * results inherit a valid parent's check and are never re-checked.
+    */
     bool isValid(const int startId, const int destinationId, const Graph& graph) const;
 
     /*
@@ -48,34 +88,104 @@ public:
     */
 
     // Gives the route a fitness score, describing how good it is at solving the requested problem.
+    // Leaving at departureTime (minutes since midnight), every boarding waits for the line's next arrival.
     double getFitness(const int startId, const int destinationId, const Graph& graph,
         const Utilities::Coordinates& userCoords, // User's actual location
-        const Utilities::Coordinates& destCoords) const; // Clicked destination
+        const Utilities::Coordinates& destCoords, // Clicked destination
+        const double departureTime) const;
 
 	// Mutates the route by regenerating a segment or replacing it with a walk.
-    void mutate(const double mutationRate, std::mt19937& gen, const int startId, const int destinationId, const Graph& graph);
+    void mutate(const double mutationRate, std::mt19937& gen, const int startId, const int destinationId, const Graph& graph,
+        Workspace& workspace);
 
-    // Combines two routes together to create a better one
-    static Route crossover(const Route& parent1, const Route& parent2, std::mt19937& gen);
+    // Combines two routes together to create a better one. Writes into child, reusing its memory.
+    static void crossover(const Route& parent1, const Route& parent2, std::mt19937& gen, Workspace& workspace, Route& child);
 
     /*
 	*  --- End of Genetic Algorithm Methods ---
     */
 
-    // Calculates walk time between two coordinates based on WALK_SPEED_KPH
+    // Calculates the door to door time: the walks, the estimated rides and the waits for each boarding.
     double calculateFullJourneyTime(
         const Graph& graph,
         int routeStartId,
         int routeEndId,
         const Utilities::Coordinates& userCoords,
-        const Utilities::Coordinates& destCoords) const;
+        const Utilities::Coordinates& destCoords,
+        const double departureTime) const;
 
 private:
-    // Helper for mutation 
-    static bool generatePathSegment(const int segmentStartId, const int segmentEndId, const Graph& graph, std::mt19937& gen, std::vector<VisitedStation>& segment);
+    // Helper for mutation. The segment is left in workspace.segment.
+    static bool generatePathSegment(const int segmentStartIndex, const int segmentEndIndex, const Graph& graph, std::mt19937& gen, Workspace& workspace);
 
     // Calculates the approximate time it would take to walk between two coordinates
     static double calculateWalkTime(const Utilities::Coordinates& c1, const Utilities::Coordinates& c2);
 
+    // Minutes spent waiting for vehicles when reaching the first station at the given time, following the
+    // estimated ride times. Lines without service left that day wait for their first arrival the next day.
+    // Needs up to date step scores.
+    double calculateWaitTime(const Graph& graph, double clock) const;
+
+    // --- Score caching ---
+    // Every fitness term except the transfer count only depends on a step and the station before it,
+    // so terms are cached per step and only steps touched by mutate/crossover are recomputed.
+    struct StepScore {
+        bool scored = false;
+        bool validTransition = false;   // The line into this step exists in the graph
+        bool publicTransport = false;
+        int lineIndex = -1;             // Interned line id of public transport steps, for the transfer count
+        double segmentTime = 0.0;       // Estimated time from the previous station (getTotalTime term)
+        double walkTime = 0.0;          // Walking time of "Walk" steps
+        double publicDistance = 0.0;    // Aerial distance of public transport steps, used for the fare
+    };
+
+    // The last computed fitness, with the request parameters it was computed for.
+    struct FitnessCache {
+        bool hasValue = false;
+        int startId = -1;
+        int destinationId = -1;
+        const Graph* graph = nullptr;
+        Utilities::Coordinates userCoords;
+        Utilities::Coordinates destCoords;
+        double departureTime = 0.0;
+        double fitness = 0.0;
+    };
+
+    // The last full validity check, with the pair and graph it was made for.
+    struct ValidityCache {
+        bool hasValue = false;
+        bool valid = false;
+        int startId = -1;
+        int destinationId = -1;
+        const Graph* graph = nullptr;
+
+        bool isValidFor(const int start, const int destination, const Graph& g) const {
+            return hasValue && valid && startId == start && destinationId == destination && graph == &g;
+        }
+    };
+
+    // _stepScores[i] belongs to _stations[i]. It may be shorter than _stations; missing steps aren't scored yet.
+    // Scores every step that isn't scored yet. Step scores are relative to a start station and graph,
+    // so asking for a different pair drops them all first.
+    void updateStepScores(const int startId, const Graph& graph) const;
+    StepScore scoreStep(const size_t i, const Graph::Station& startStation, const Graph& graph) const;
+
+    // Computes the fitness from the step scores. getFitness caches its result.
+    double evaluateFitness(const int startId, const int destinationId, const Graph& graph,
+        const Utilities::Coordinates& userCoords,
+        const Utilities::Coordinates& destCoords,
+        const double departureTime) const;
+
+    void invalidateAllScores();
+
+    // The uncached check behind isValid. Brings the step scores up to date.
+    bool checkValidity(const int startId, const int destinationId, const Graph& graph) const;
+
     std::vector<VisitedStation> _stations;
+
+    mutable std::vector<StepScore> _stepScores;
+    mutable int _scoredStartId = -1;
+    mutable const Graph* _scoredGraph = nullptr;
+    mutable FitnessCache _fitnessCache;
+    mutable ValidityCache _validity;
 };
@@ -0,0 +1,120 @@
+#include "RouteCache.h"
+#include <functional>
+#include <stdexcept>
+
+RouteCache::RouteCache(const size_t maxBytes, const std::chrono::steady_clock::duration timeToLive, const int timeBucketMinutes)
+    : _maxBytes(maxBytes), _timeToLive(timeToLive), _timeBucketMinutes(timeBucketMinutes) {
+    if (timeBucketMinutes <= 0) {
+        throw std::invalid_argument("Route cache time buckets must be at least a minute long.");
+    }
+}
+
+RouteCache::Key RouteCache::makeKey(const std::vector<Graph::Station>& startStations, const Graph::Station& endStation,
+    const RoutingEngine::Params& params) const
+{
+    Key key;
+    key.startStations.reserve(startStations.size());
+    for (const Graph::Station& station : startStations) {
+        key.startStations.push_back(station.code);
+    }
+    key.endStation = endStation.code;
+    key.engine = params.engine;
+    const int bucketMinutes = (params.engine == RoutingEngine::Type::Timetable) ? 1 : _timeBucketMinutes;
+    // Hub label routes ignore the departure time altogether.
+    if (params.engine != RoutingEngine::Type::HubLabels) key.departureBucket = params.departureTime / bucketMinutes;
+    if (params.engine == RoutingEngine::Type::Genetic) {
+        key.generations = params.generations;
+        key.mutationRate = params.mutationRate;
+        key.populationSize = params.populationSize;
+        key.stallGenerations = params.stallGenerations;
+        key.improvementEpsilon = params.improvementEpsilon;
+        key.islands = params.islands;
+        if (params.islands > 1) {
+            key.migrationInterval = params.migrationInterval;
+            key.migrants = params.migrants;
+        }
+        key.seed = params.seed;
+    }
+    return key;
+}
+
+size_t RouteCache::KeyHash::operator()(const Key& key) const {
+    size_t hash = 0;
+    auto combine = [&hash](const size_t value) {
+        hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    };
+    for (const int code : key.startStations) combine(std::hash<int>{}(code));
+    combine(std::hash<int>{}(key.endStation));
+    combine(std::hash<int>{}(static_cast<int>(key.engine)));
+    combine(std::hash<int>{}(key.departureBucket));
+    combine(std::hash<int>{}(key.generations));
+    combine(std::hash<double>{}(key.mutationRate));
+    combine(std::hash<int>{}(key.populationSize));
+    combine(std::hash<int>{}(key.stallGenerations));
+    combine(std::hash<double>{}(key.improvementEpsilon));
+    combine(std::hash<int>{}(key.islands));
+    combine(std::hash<int>{}(key.migrationInterval));
+    combine(std::hash<int>{}(key.migrants));
+    combine(std::hash<std::optional<uint64_t>>{}(key.seed));
+    return hash;
+}
+
+std::optional<RouteCache::Result> RouteCache::find(const Key& key, const Graph& graph) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+        _misses++;
+        return std::nullopt;
+    }
+    const EntryList::iterator entry = it->second;
+    if (entry->graph.get() != &graph || entry->expiresAt <= std::chrono::steady_clock::now()) {
+        erase(entry);
+        _misses++;
+        return std::nullopt;
+    }
+    _entries.splice(_entries.begin(), _entries, entry);
+    _hits++;
+    return entry->result;
+}
+
+void RouteCache::insert(const Key& key, GraphSnapshot graph, const Result& result) {
+    // The entry, the key copy held by the index, and the heap memory behind both and behind the route.
+    const size_t bytes = sizeof(Entry) + sizeof(Key) + 2 * key.startStations.size() * sizeof(int) +
+        result.route.getMemoryUsage();
+    if (bytes > _maxBytes) return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it != _index.end()) erase(it->second);
+
+    _entries.push_front(Entry{ key, result, std::move(graph), std::chrono::steady_clock::now() + _timeToLive, bytes });
+    _index.emplace(key, _entries.begin());
+    _bytes += bytes;
+
+    while (_bytes > _maxBytes) {
+        erase(std::prev(_entries.end()));
+        _evictions++;
+    }
+}
+
+void RouteCache::clear() {
+    EntryList dropped;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _index.clear();
+        dropped.swap(_entries);
+        _bytes = 0;
+    }
+    // Freed here, outside the lock: an entry may hold the last reference to an old graph.
+}
+
+RouteCache::Stats RouteCache::getStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return Stats{ _hits, _misses, _evictions, _entries.size(), _bytes };
+}
+
+void RouteCache::erase(EntryList::iterator entry) {
+    _bytes -= entry->bytes;
+    _index.erase(entry->key);
+    _entries.erase(entry);
+}
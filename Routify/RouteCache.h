@@ -0,0 +1,105 @@
+#pragma once
+#include "RoutingEngine.h"
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/*
+* LRU cache of route results, shared by every request.
+* Entries are keyed on the snapped start/end stations, the engine and its parameters and a departure time
+* bucket, so requests for the same corridor at about the same time skip the search. Entries expire after a
+* time to live and the least recently used ones are dropped once the cache holds more than its byte budget.
+* Each entry keeps the graph snapshot it was computed on alive, and only answers lookups on that graph.
+*/
+class RouteCache {
+public:
+    using Result = RoutingEngine::Result;
+    using GraphSnapshot = std::shared_ptr<const Graph>;
+
+    static constexpr size_t DefaultMaxBytes = 64 * 1024 * 1024;
+    static constexpr std::chrono::seconds DefaultTimeToLive{ 10 * 60 };
+    static constexpr int DefaultTimeBucketMinutes = 5;     // GA departures this close share an entry
+
+    struct Key {
+        std::vector<int> startStations;     // Station codes, in selection order
+        int endStation = -1;
+        RoutingEngine::Type engine = RoutingEngine::Type::Genetic;
+        int departureBucket = 0;
+        int generations = 0;
+        double mutationRate = 0.0;
+        int populationSize = 0;
+        int stallGenerations = 0;
+        double improvementEpsilon = 0.0;
+        int islands = 0;
+        int migrationInterval = 0;
+        int migrants = 0;
+        std::optional<uint64_t> seed;
+
+        bool operator==(const Key& other) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;     // Dropped for space, expired entries aren't counted
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    explicit RouteCache(const size_t maxBytes = DefaultMaxBytes,
+        const std::chrono::steady_clock::duration timeToLive = DefaultTimeToLive,
+        const int timeBucketMinutes = DefaultTimeBucketMinutes);
+
+    RouteCache(const RouteCache&) = delete;
+    RouteCache& operator=(const RouteCache&) = delete;
+
+    // Builds the key of a request. Timetable answers are exact to the minute, so they get one-minute buckets;
+    // hub label answers don't depend on the departure time at all.
+    Key makeKey(const std::vector<Graph::Station>& startStations, const Graph::Station& endStation,
+        const RoutingEngine::Params& params) const;
+
+    // Returns a copy of the cached result, since routes keep mutable score caches that can't be shared across threads.
+    std::optional<Result> find(const Key& key, const Graph& graph);
+
+    void insert(const Key& key, GraphSnapshot graph, const Result& result);
+
+    // Drops every entry. Called when the graph is swapped.
+    void clear();
+
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        Key key;
+        Result result;
+        GraphSnapshot graph;
+        std::chrono::steady_clock::time_point expiresAt;
+        size_t bytes;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    // Removes an entry. Needs _mutex.
+    void erase(EntryList::iterator entry);
+
+    const size_t _maxBytes;
+    const std::chrono::steady_clock::duration _timeToLive;
+    const int _timeBucketMinutes;
+
+    mutable std::mutex _mutex;
+    EntryList _entries;                                                 // Most recently used first
+    std::unordered_map<Key, EntryList::iterator, KeyHash> _index;
+    size_t _bytes = 0;
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+    uint64_t _evictions = 0;
+};
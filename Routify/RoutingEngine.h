@@ -0,0 +1,132 @@
+#pragma once
+#include "Graph.h"
+#include "Route.h"
+#include "Executor.h"
+#include "CancellationToken.h"
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*
+* Interface for the algorithms that answer a route request.
+* An engine gets the candidate start stations picked near the user, the destination station and the
+* request parameters, and returns its best route (or nothing). Engines hold no per-request state,
+* so one instance serves every request concurrently.
+*/
+class RoutingEngine {
+public:
+    enum class Type { Genetic, Timetable, HubLabels };
+
+    // Engine name, as used by the "engine" request key.
+    static const char* toString(const Type type) {
+        switch (type) {
+        case Type::Timetable: return "timetable";
+        case Type::HubLabels: return "hub";
+        case Type::Genetic:
+        default: return "ga";
+        }
+    }
+
+    // Why a search stopped. None for engines that always run to completion.
+    enum class StopReason { None, Generations, Stalled, Deadline, Cancelled, TargetReached };
+
+    static const char* toString(const StopReason reason) {
+        switch (reason) {
+        case StopReason::Generations: return "generations";
+        case StopReason::Stalled: return "stalled";
+        case StopReason::Deadline: return "deadline";
+        case StopReason::Cancelled: return "cancelled";
+        case StopReason::TargetReached: return "target";
+        case StopReason::None:
+        default: return "none";
+        }
+    }
+
+    // The stop reason of a search ended by a cancelled token.
+    static StopReason toStopReason(const CancellationToken::Reason reason) {
+        switch (reason) {
+        case CancellationToken::Reason::Deadline: return StopReason::Deadline;
+        case CancellationToken::Reason::TargetReached: return StopReason::TargetReached;
+        case CancellationToken::Reason::Disconnected: return StopReason::Cancelled;
+        case CancellationToken::Reason::None:
+        default: return StopReason::None;
+        }
+    }
+
+    // True if a search stopping this way gave its best answer. Results cut short depend on the request, so
+    // they aren't worth caching for others.
+    static bool ranToCompletion(const StopReason reason) {
+        return reason == StopReason::None || reason == StopReason::Generations || reason == StopReason::Stalled;
+    }
+
+    // Parameters of a route request.
+    struct Params {
+        Utilities::Coordinates startCoords;
+        Utilities::Coordinates endCoords;
+        Type engine = Type::Genetic;
+        int departureTime = 0;                                  // Minutes since midnight
+        double nearbyRadiusKm = Graph::DefaultNearbyDistanceKm; // Station search radius around start/end
+        Executor::Priority priority = Executor::Priority::Normal; // Scheduling priority of the request's tasks
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // Answer by then
+        CancellationToken cancellation;                         // The request's, fires when its client is gone
+        double targetMinutes = 0.0;                             // A door to door time that's good enough, 0 for none
+
+        // Genetic engine parameters
+        int generations = 100;
+        double mutationRate = 0.3;
+        int populationSize = 100;
+        int stallGenerations = 25;          // Stop after this many generations without improvement, 0 never stops early
+        double improvementEpsilon = 1e-4;   // Relative gain in best fitness that counts as an improvement
+        int islands = 1;                    // Sub-populations per start station (island model), 1 runs a single population
+        int migrationInterval = 10;         // Generations between island migrations
+        int migrants = 2;                   // Routes each island sends per migration
+        std::optional<uint64_t> seed;       // Makes the run reproducible, random when unset
+    };
+
+    struct Result {
+        Route route;
+        double fitness = -1.0;
+        int startStationCode = -1;
+        int endStationId = -1;
+        double arrivalTime = -1.0;  // Minutes since midnight at the end station, -1 if the engine doesn't track time
+        StopReason stopReason = StopReason::None;
+        int generations = 0;        // Generations the GA ran for the returned route
+    };
+
+    // One destination of a one-to-many search: the snapped end station and the coordinates the user asked for.
+    struct Target {
+        Graph::Station station;
+        Utilities::Coordinates coords;
+    };
+
+    virtual ~RoutingEngine() = default;
+
+    // Finds the best route from any of the start stations to the end station.
+    virtual std::optional<Result> findBestRoute(
+        const std::vector<Graph::Station>& startStations,
+        const Graph::Station& endStation,
+        const Params& params,
+        const Graph& graph) const = 0;
+
+    /*
+    * Finds the best route from the start stations to each target, in target order. params.endCoords is ignored,
+    * each target brings its own. Engines that can answer several destinations from one search override this;
+    * the default runs findBestRoute once per target.
+    */
+    virtual std::vector<std::optional<Result>> findBestRoutes(
+        const std::vector<Graph::Station>& startStations,
+        const std::vector<Target>& targets,
+        const Params& params,
+        const Graph& graph) const
+    {
+        std::vector<std::optional<Result>> results;
+        results.reserve(targets.size());
+        Params targetParams = params;
+        for (const Target& target : targets) {
+            targetParams.endCoords = target.coords;
+            results.push_back(findBestRoute(startStations, target.station, targetParams, graph));
+        }
+        return results;
+    }
+};
@@ -1,39 +1,65 @@
 #include "Server.h"
-#include <iostream>
+#include "Logger.h"
+#include "Metrics.h"
+#include "Executor.h"
 #include <cstring>
+#include <algorithm>
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
 
-Server::Server(const int port)
+Server::Server(const int port, const size_t handlerCount, const size_t maxInFlight)
     : serverSocket(),
     port(port),
-    running(false)
+    running(false),
+    handlerCount(std::max<size_t>(1, handlerCount)),
+    maxInFlight(std::max<size_t>(1, maxInFlight)),
+    inFlightRequests(0)
 {
 }
 
 Server::~Server() {
-    running = false;
-    // Close the server socket to unblock any waiting accept call.
-    serverSocket.closeSocket();
-    // Wait for all threads to finish.
-    for (auto& t : threads) {
+    // The gauges read this server.
+    Metrics& metrics = Metrics::shared();
+    metrics.setGaugeSource(Metrics::Gauge::ExecutorQueueDepth, {});
+    metrics.setGaugeSource(Metrics::Gauge::InFlightRequests, {});
+    metrics.setGaugeSource(Metrics::Gauge::OpenConnections, {});
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        running = false;
+    }
+    pendingAvailable.notify_all();
+    if (eventLoop) {
+        eventLoop->stop();
+    }
+    // Handlers finish their current request and exit.
+    for (auto& t : handlerThreads) {
         if (t.joinable()) {
             t.join();
         }
     }
+    eventLoop.reset();
+    serverSocket.closeSocket();
     WSACleanup();
 }
 
+size_t Server::getInFlightRequests() const {
+    return inFlightRequests.load();
+}
+
+size_t Server::getOpenConnections() const {
+    return eventLoop ? eventLoop->getOpenConnectionCount() : 0;
+}
+
 bool Server::initSocket() const {
     if (!serverSocket.isValid()) {
-        std::cerr << "Failed to create server socket." << std::endl;
+        LOG_ERROR(Server, "Failed to create server socket.");
         return false;
     }
     int opt = 1;
     if (setsockopt(serverSocket.getSocketDescriptor(), SOL_SOCKET, SO_REUSEADDR,
         reinterpret_cast<const char*>(&opt), sizeof(opt)) < 0) {
-        std::cerr << "setsockopt failed" << std::endl;
+        LOG_ERROR(Server, "setsockopt failed");
         return false;
     }
     return true;
@@ -48,49 +74,81 @@ bool Server::bindSocket() const {
 
     if (bind(serverSocket.getSocketDescriptor(), reinterpret_cast<sockaddr*>(&serverAddr),
         sizeof(serverAddr)) < 0) {
-        std::cerr << "Bind failed" << std::endl;
+        LOG_ERROR(Server, "Bind failed");
         return false;
     }
     return true;
 }
 
 bool Server::listenSocket() const {
-    if (listen(serverSocket.getSocketDescriptor(), 10) < 0) {
-        std::cerr << "Listen failed" << std::endl;
+    if (listen(serverSocket.getSocketDescriptor(), SOMAXCONN) < 0) {
+        LOG_ERROR(Server, "Listen failed");
         return false;
     }
-    std::cout << "Server is listening on port " << port << "..." << std::endl;
+    LOG_INFO(Server, "Server is listening on port " << port << "...");
     return true;
 }
 
-void Server::acceptConnections() {
-    while (running) {
-        sockaddr_in clientAddr;
-        int clientAddrSize = sizeof(clientAddr);
-        // Accept an incoming connection
-        SOCKET clientDescriptor = accept(serverSocket.getSocketDescriptor(),
-            reinterpret_cast<sockaddr*>(&clientAddr),
-            &clientAddrSize);
-        if (clientDescriptor == INVALID_SOCKET) {
-            int error = WSAGetLastError();
+void Server::onMessage(EventLoop::MessageId id, std::string message) {
+    // Shed load instead of letting the queue grow without bound.
+    if (inFlightRequests.load() >= maxInFlight) {
+        LOG_WARNING(Server, "Server busy (" << maxInFlight << " requests in flight), rejecting request.");
+        Metrics::shared().increment(Metrics::Counter::BusyRejections);
+        RequestHandler::Reply reply = RequestHandler::makeErrorReply(message, "Server busy, try again later");
+        eventLoop->send(id, reply.body, !reply.tagged);
+        return;
+    }
+
+    // Queue the request for the handler pool.
+    inFlightRequests++;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pendingRequests.push_back({ id, std::move(message), std::chrono::steady_clock::now(), eventLoop->getDisconnectToken(id) });
+    }
+    pendingAvailable.notify_one();
+}
+
+void Server::handleRequests() {
+    while (true) {
+        PendingRequest request;
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            pendingAvailable.wait(lock, [this]() { return !running || !pendingRequests.empty(); });
             if (!running) {
-                break;
-            }
-            // If no connection is pending, sleep briefly to avoid a tight loop.
-            if (error == WSAEWOULDBLOCK) {
-                continue;
+                return;
             }
-            std::cerr << "Accept failed with error: " << error << std::endl;
-            Sleep(10);
-            continue;
+            request = std::move(pendingRequests.front());
+            pendingRequests.pop_front();
         }
-        std::cout << "Accepted connection from " << inet_ntoa(clientAddr.sin_addr) << std::endl;
+        Metrics::shared().record(Metrics::Stage::Queue, std::chrono::steady_clock::now() - request.queuedAt);
 
-        // Wrap the accepted socket in our Socket class.
-        Socket clientSocket(clientDescriptor);
-
-        // Spawn a new thread to handle the client.
-        threads.emplace_back(std::thread(&RequestHandler::handleRequest, handler, clientSocket));
+        // The handler is shared, never copied.
+        RequestHandler::Reply reply;
+        if (request.disconnected.isCancelled()) {
+            // Gave up while queued. Still replied to, a half closed connection waits for it before closing.
+            LOG_DEBUG(Server, "Client of a queued request disconnected, skipping it.");
+            Metrics::shared().increment(Metrics::Counter::CancelledRequests);
+            reply = RequestHandler::makeErrorReply(request.message, "Client disconnected");
+            eventLoop->send(request.id, reply.body, !reply.tagged);
+            inFlightRequests--;
+            continue;
+        }
+        try {
+            // Partial replies (batch results) can only be told apart on framed connections.
+            RequestHandler::PartialReplySink sendPartial;
+            if (eventLoop->canSendPartial(request.id)) {
+                sendPartial = [this, id = request.id](std::string_view body) { eventLoop->sendPartial(id, body); };
+            }
+            reply = handler.handleMessage(request.message, sendPartial, request.disconnected);
+            if (request.disconnected.isCancelled()) Metrics::shared().increment(Metrics::Counter::CancelledRequests);
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR(Server, "Request handler failed: " << e.what());
+            reply = RequestHandler::makeErrorReply(request.message, "An unexpected server error occurred");
+        }
+        // Tagged replies are matched by id, so they don't wait behind slower requests on the same connection.
+        eventLoop->send(request.id, reply.body, !reply.tagged);
+        inFlightRequests--;
     }
 }
 
@@ -102,6 +160,19 @@ void Server::start() {
     if (!listenSocket())
         return;
 
+    eventLoop = std::make_unique<EventLoop>(serverSocket.getSocketDescriptor(),
+        [this](EventLoop::MessageId id, std::string message) { onMessage(id, std::move(message)); });
+
+    Metrics& metrics = Metrics::shared();
+    metrics.setGaugeSource(Metrics::Gauge::ExecutorQueueDepth,
+        []() { return static_cast<double>(Executor::shared().getQueuedTaskCount()); });
+    metrics.setGaugeSource(Metrics::Gauge::InFlightRequests, [this]() { return static_cast<double>(getInFlightRequests()); });
+    metrics.setGaugeSource(Metrics::Gauge::OpenConnections, [this]() { return static_cast<double>(getOpenConnections()); });
+
     running = true;
-    acceptConnections();
+    handlerThreads.reserve(handlerCount);
+    for (size_t i = 0; i < handlerCount; ++i) {
+        handlerThreads.emplace_back(&Server::handleRequests, this);
+    }
+    eventLoop->run();
 }
@@ -1,25 +1,67 @@
 #pragma once
 #include "Socket.h"
+#include "EventLoop.h"
 #include "RequestHandler.h"
 #include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
 
+/*
+* Serves clients through an EventLoop, which handles the sockets, and answers their messages on a fixed
+* pool of handler threads. Requests beyond maxInFlight (queued + being handled) are answered with a busy
+* error right away, so threads and queued requests stay bounded however many clients are connected.
+*/
 class Server {
 public:
-    explicit Server(const int port);
+    static constexpr size_t DefaultHandlerCount = 16;
+    static constexpr size_t DefaultMaxInFlight = 256;
+
+    explicit Server(const int port, const size_t handlerCount = DefaultHandlerCount, const size_t maxInFlight = DefaultMaxInFlight);
 
     virtual ~Server();
 
     void start();
 
+    // Number of received requests that are queued or being handled.
+    size_t getInFlightRequests() const;
+
+    // Number of client connections currently open.
+    size_t getOpenConnections() const;
+
 private:
+    // A message received on a connection, waiting for a handler thread.
+    struct PendingRequest {
+        EventLoop::MessageId id;
+        std::string message;
+        std::chrono::steady_clock::time_point queuedAt;
+        CancellationToken disconnected;     // The connection's, see EventLoop::getDisconnectToken
+    };
+
     bool initSocket() const;
     bool bindSocket() const;
     bool listenSocket() const;
-    void acceptConnections();
+    void handleRequests();
+
+    // Called by the event loop for every complete message.
+    void onMessage(EventLoop::MessageId id, std::string message);
 
     Socket serverSocket;
     int port;
-    bool running;
-    std::vector<std::thread> threads;
+    std::atomic<bool> running;
+    size_t handlerCount;
+    size_t maxInFlight;
+
+    std::unique_ptr<EventLoop> eventLoop;
+    std::vector<std::thread> handlerThreads;
+    std::deque<PendingRequest> pendingRequests;
+    std::mutex pendingMutex;
+    std::condition_variable pendingAvailable;
+    std::atomic<size_t> inFlightRequests;
+
     RequestHandler handler;
 };
\ No newline at end of file
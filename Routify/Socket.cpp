@@ -1,8 +1,8 @@
 #include "Socket.h"
+#include "Logger.h"
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <cstring> 
-#include <iostream>
 
 #pragma comment(lib, "Ws2_32.lib")
 
@@ -10,12 +10,12 @@ Socket::Socket() : sockfd(INVALID_SOCKET), ownsSocket(true) {
     WSADATA wsaData;
     int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
     if (result != 0) {
-        std::cerr << "WSAStartup failed with error: " << result << std::endl;
+        LOG_ERROR(Server, "WSAStartup failed with error: " << result);
     }
     // Create a TCP socket.
     sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd == INVALID_SOCKET) {
-        std::cerr << "Error creating socket: " << WSAGetLastError() << std::endl;
+        LOG_ERROR(Server, "Error creating socket: " << WSAGetLastError());
     }
 }
 
@@ -23,7 +23,7 @@ Socket::Socket(SOCKET socketDescriptor) : sockfd(socketDescriptor), ownsSocket(f
     WSADATA wsaData;
     int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
     if (result != 0) {
-        std::cerr << "WSAStartup failed with error: " << result << std::endl;
+        LOG_ERROR(Server, "WSAStartup failed with error: " << result);
     }
 }
 
@@ -40,21 +40,31 @@ bool Socket::isValid() const {
 bool Socket::sendMessage(const std::string& message) const {
     if (!isValid())
         return false;
-    int sent = send(sockfd, message.c_str(), static_cast<int>(message.size()), 0);
-    return sent != SOCKET_ERROR;
+    // send may write only part of the message, keep going until all of it is out.
+    size_t offset = 0;
+    while (offset < message.size()) {
+        int sent = send(sockfd, message.data() + offset, static_cast<int>(message.size() - offset), 0);
+        if (sent == SOCKET_ERROR || sent == 0)
+            return false;
+        offset += static_cast<size_t>(sent);
+    }
+    return true;
 }
 
 std::string Socket::receiveMessage(const int bufferSize) const {
-    if (!isValid())
-        return "";
-    char* buffer = new char[bufferSize + 1];
-    std::memset(buffer, 0, bufferSize + 1);
-    int bytesReceived = recv(sockfd, buffer, bufferSize, 0);
     std::string message;
-    if (bytesReceived > 0) {
-        message = std::string(buffer, bytesReceived);
+    if (!isValid())
+        return message;
+    // Read until the peer shuts down its side, so messages longer than one buffer aren't truncated.
+    size_t received = 0;
+    while (true) {
+        message.resize(received + bufferSize);
+        int bytesReceived = recv(sockfd, message.data() + received, bufferSize, 0);
+        if (bytesReceived <= 0)
+            break;
+        received += static_cast<size_t>(bytesReceived);
     }
-    delete[] buffer;
+    message.resize(received);
     return message;
 }
 
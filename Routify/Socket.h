@@ -14,10 +14,10 @@ public:
     // Check if the socket is valid.
     bool isValid() const;
 
-    // Send a message over the socket.
+    // Send the whole message over the socket, across as many writes as needed.
     bool sendMessage(const std::string& message) const;
 
-    // Receive a message from the socket.
+    // Receive everything the peer sends until it shuts down its side, reading bufferSize bytes at a time.
     std::string receiveMessage(const int bufferSize = 1024) const;
 
     // Retrieve the underlying socket descriptor.
@@ -0,0 +1,113 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const double KmPerDegreeLatitude = 111.32;
+
+    // Upper bound on cells per axis, so a few stray coordinates can't blow up the grid.
+    const int MaxCellsPerAxis = 2048;
+}
+
+void SpatialIndex::build(const std::vector<Utilities::Coordinates>& points) {
+    _entries.clear();
+    _cellStart.clear();
+    _rows = _columns = 0;
+
+    double minLat = 90.0, maxLat = -90.0, minLon = 180.0, maxLon = -180.0;
+    for (const auto& p : points) {
+        if (!p.isValid()) continue;
+        minLat = std::min(minLat, p.latitude); maxLat = std::max(maxLat, p.latitude);
+        minLon = std::min(minLon, p.longitude); maxLon = std::max(maxLon, p.longitude);
+    }
+    if (minLat > maxLat) return; // No valid points
+
+    _minLatitude = minLat;
+    _minLongitude = minLon;
+    double span = std::max(maxLat - minLat, maxLon - minLon);
+    _cellSizeDegrees = std::max(0.01, span / MaxCellsPerAxis);
+    _rows = static_cast<int>((maxLat - minLat) / _cellSizeDegrees) + 1;
+    _columns = static_cast<int>((maxLon - minLon) / _cellSizeDegrees) + 1;
+
+    // Counting sort of the points into their cells.
+    std::vector<size_t> counts(static_cast<size_t>(_rows) * _columns + 1, 0);
+    for (const auto& p : points) {
+        if (!p.isValid()) continue;
+        counts[static_cast<size_t>(rowOf(p.latitude)) * _columns + columnOf(p.longitude) + 1]++;
+    }
+    for (size_t c = 1; c < counts.size(); ++c) {
+        counts[c] += counts[c - 1];
+    }
+    _cellStart = counts;
+
+    _entries.resize(_cellStart.back());
+    for (size_t i = 0; i < points.size(); ++i) {
+        const auto& p = points[i];
+        if (!p.isValid()) continue;
+        size_t cell = static_cast<size_t>(rowOf(p.latitude)) * _columns + columnOf(p.longitude);
+        _entries[counts[cell]++] = Entry{ p, static_cast<int>(i) };
+    }
+}
+
+int SpatialIndex::rowOf(const double latitude) const {
+    int row = static_cast<int>(std::floor((latitude - _minLatitude) / _cellSizeDegrees));
+    return std::clamp(row, 0, _rows - 1);
+}
+
+int SpatialIndex::columnOf(const double longitude) const {
+    int column = static_cast<int>(std::floor((longitude - _minLongitude) / _cellSizeDegrees));
+    return std::clamp(column, 0, _columns - 1);
+}
+
+std::vector<SpatialIndex::Hit> SpatialIndex::queryRadius(const Utilities::Coordinates& location, const double radiusKm) const {
+    std::vector<Hit> hits;
+    if (_entries.empty() || !location.isValid() || radiusKm <= 0.0) return hits;
+
+    // Bounding box of the search circle, in degrees.
+    double latDelta = radiusKm / KmPerDegreeLatitude;
+    double cosLat = std::cos(location.latitude * M_PI / 180.0);
+    double lonDelta = (cosLat > 1e-6) ? radiusKm / (KmPerDegreeLatitude * cosLat) : 360.0;
+
+    double maxLatitude = _minLatitude + _rows * _cellSizeDegrees;
+    double maxLongitude = _minLongitude + _columns * _cellSizeDegrees;
+    if (location.latitude + latDelta < _minLatitude || location.latitude - latDelta > maxLatitude ||
+        location.longitude + lonDelta < _minLongitude || location.longitude - lonDelta > maxLongitude) {
+        return hits; // Search circle is entirely outside the grid
+    }
+
+    int rowBegin = rowOf(location.latitude - latDelta), rowEnd = rowOf(location.latitude + latDelta);
+    int colBegin = columnOf(location.longitude - lonDelta), colEnd = columnOf(location.longitude + lonDelta);
+
+    for (int row = rowBegin; row <= rowEnd; ++row) {
+        size_t rowOffset = static_cast<size_t>(row) * _columns;
+        // Cells of a row are adjacent, so the whole column range is one contiguous run of entries.
+        size_t begin = _cellStart[rowOffset + colBegin];
+        size_t end = _cellStart[rowOffset + colEnd + 1];
+        for (size_t e = begin; e < end; ++e) {
+            double distance = Utilities::calculateHaversineDistance(_entries[e].coordinates, location);
+            if (distance <= radiusKm) {
+                hits.emplace_back(distance, _entries[e].index);
+            }
+        }
+    }
+
+    std::sort(hits.begin(), hits.end());
+    return hits;
+}
+
+std::vector<SpatialIndex::Hit> SpatialIndex::queryNearest(const Utilities::Coordinates& location, const size_t k, const double maxRadiusKm) const {
+    if (k == 0) return {};
+
+    // Grow the search circle until it holds k points. Everything within the radius is found,
+    // so the k closest of those are the k closest overall.
+    double radiusKm = std::min(maxRadiusKm, _cellSizeDegrees * KmPerDegreeLatitude);
+    std::vector<Hit> hits;
+    while (true) {
+        hits = queryRadius(location, radiusKm);
+        if (hits.size() >= k || radiusKm >= maxRadiusKm) break;
+        radiusKm = std::min(maxRadiusKm, radiusKm * 2.0);
+    }
+
+    if (hits.size() > k) hits.resize(k);
+    return hits;
+}
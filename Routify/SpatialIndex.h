@@ -0,0 +1,45 @@
+#pragma once
+#include "Utilities.hpp"
+#include <vector>
+#include <utility>
+
+/*
+* Uniform latitude/longitude grid over a fixed set of points, built once and queried read-only.
+* Points are bucketed by cell and stored contiguously per cell, so a query only scans the cells
+* that overlap its search circle instead of every point.
+*/
+class SpatialIndex {
+public:
+    // A point index and its distance (km) from the query location.
+    using Hit = std::pair<double, int>;
+
+    SpatialIndex() = default;
+
+    // Indexes the points. A point's position in the vector is the index reported by queries.
+    // Points with invalid coordinates are skipped.
+    void build(const std::vector<Utilities::Coordinates>& points);
+
+    // Returns every point within radiusKm of the location, sorted by distance.
+    std::vector<Hit> queryRadius(const Utilities::Coordinates& location, const double radiusKm) const;
+
+    // Returns up to k points closest to the location, sorted by distance. Never looks further than maxRadiusKm.
+    std::vector<Hit> queryNearest(const Utilities::Coordinates& location, const size_t k, const double maxRadiusKm) const;
+
+private:
+    struct Entry {
+        Utilities::Coordinates coordinates;
+        int index;
+    };
+
+    int rowOf(const double latitude) const;
+    int columnOf(const double longitude) const;
+
+    double _minLatitude = 0.0;
+    double _minLongitude = 0.0;
+    double _cellSizeDegrees = 0.01;     // ~1.1 km of latitude.
+    int _rows = 0;
+    int _columns = 0;
+
+    std::vector<size_t> _cellStart;     // Entries of cell c are [_cellStart[c], _cellStart[c + 1]).
+    std::vector<Entry> _entries;
+};
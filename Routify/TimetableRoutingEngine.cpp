@@ -0,0 +1,191 @@
+#include "TimetableRoutingEngine.h"
+#include "Utilities.hpp"
+#include "Logger.h"
+#include <queue>
+#include <limits>
+#include <algorithm>
+
+namespace {
+    const double Unreached = std::numeric_limits<double>::infinity();
+
+    // Best known arrival at a station, and how it was reached.
+    struct Label {
+        double arrival = Unreached;
+        int parentIndex = -1;                                   // -1 for start stations
+        const Graph::TransportationLine* line = nullptr;        // Line ridden from the parent, nullptr for walks and starts
+        bool walked = false;
+        bool settled = false;
+    };
+
+    double walkMinutes(const Utilities::Coordinates& from, const Utilities::Coordinates& to) {
+        return (Utilities::calculateHaversineDistance(from, to) / Utilities::WALK_SPEED_KPH) * 60.0;
+    }
+
+    // When a vehicle of the line that left `from` at departureTime reaches the line's next stop.
+    double arrivalAtNextStop(const Graph& graph, const Graph::Station& from, const Graph::TransportationLine& line, int departureTime) {
+        for (const auto& nextLine : graph.getLinesFromIndex(line.toIndex)) {
+            if (nextLine.lineIndex != line.lineIndex) continue;
+            int arrival = nextLine.nextArrivalAtOrAfter(departureTime);
+            if (arrival != -1) return arrival;
+            break;
+        }
+        // The next stop has no matching time (e.g. end of the line), estimate from distance instead.
+        double distance = Utilities::calculateHaversineDistance(from.coordinates, graph.getStationByIndex(line.toIndex).coordinates);
+        return departureTime + (distance / Utilities::ASSUMED_PUBLIC_TRANSPORT_SPEED_KPH) * 60.0;
+    }
+
+    /*
+    * Time-dependent Dijkstra from the start stations, filling labels (one per station, all unreached).
+    * Stops once targetsLeft of the stations flagged in isTarget are settled, or at the first arrival after
+    * maxArrival; without targets it settles everything reachable by then.
+    */
+    void runSearch(const Graph& graph, const std::vector<Graph::Station>& startStations, const RoutingEngine::Params& params,
+        const double maxArrival, const std::vector<char>* isTarget, size_t targetsLeft, std::vector<Label>& labels)
+    {
+        using QueueEntry = std::pair<double, int>; // (arrival, station index)
+        std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>> queue;
+
+        auto relax = [&](int index, double arrival, int parentIndex, const Graph::TransportationLine* line, bool walked) {
+            Label& label = labels[index];
+            if (label.settled || arrival >= label.arrival || arrival > maxArrival) return;
+            label.arrival = arrival;
+            label.parentIndex = parentIndex;
+            label.line = line;
+            label.walked = walked;
+            queue.emplace(arrival, index);
+        };
+
+        // Every start station is a source, reached by walking from the user's location.
+        for (const auto& start : startStations) {
+            int index = graph.getStationIndex(start.code);
+            if (index < 0) continue;
+            relax(index, params.departureTime + walkMinutes(params.startCoords, start.coordinates), -1, nullptr, false);
+        }
+
+        while (!queue.empty()) {
+            auto [arrival, current] = queue.top(); queue.pop();
+            Label& here = labels[current];
+            if (here.settled || arrival > here.arrival) continue;
+            here.settled = true;
+            if (isTarget != nullptr && (*isTarget)[current] && --targetsLeft == 0) break;
+
+            // Ride: board each line at its next arrival here, get off at its next stop.
+            const Graph::Station& station = graph.getStationByIndex(current);
+            for (const auto& line : station.lines) {
+                if (line.toIndex < 0) continue;
+                bool changesLine = here.walked || (here.line != nullptr && here.line->lineIndex != line.lineIndex);
+                int departure = line.nextArrivalAtOrAfter(
+                    here.arrival + (changesLine ? TimetableRoutingEngine::MinTransferMinutes : 0.0));
+                if (departure == -1) continue; // No more service today
+                relax(line.toIndex, arrivalAtNextStop(graph, station, line, departure), current, &line, false);
+            }
+
+            // Walk: transfer to stations nearby. Two walks in a row are never useful, so skip after a walk.
+            if (!here.walked) {
+                for (const auto& nearby : graph.getNearbyStations(station.coordinates, TimetableRoutingEngine::MaxTransferWalkKm)) {
+                    if (nearby.index == current) continue;
+                    relax(nearby.index, here.arrival + walkMinutes(station.coordinates, nearby.coordinates), current, nullptr, true);
+                }
+            }
+        }
+    }
+
+    // Follows the parents from the target back to a start station and builds the route and its result.
+    std::optional<RoutingEngine::Result> reconstructRoute(const std::vector<Label>& labels, const RoutingEngine::Target& target,
+        const RoutingEngine::Params& params, const Graph& graph)
+    {
+        const Graph::Station& endStation = target.station;
+        const int endIndex = graph.getStationIndex(endStation.code);
+        if (endIndex < 0 || labels[endIndex].arrival == Unreached) {
+            LOG_DEBUG(Timetable, "Timetable search found no connection to station " << endStation.code << ".");
+            return std::nullopt;
+        }
+
+        std::vector<int> chain;
+        for (int index = endIndex; index != -1; index = labels[index].parentIndex) {
+            chain.push_back(index);
+            if (chain.size() > graph.getStationCount()) return std::nullopt; // Safety against parent cycles
+        }
+        std::reverse(chain.begin(), chain.end());
+
+        const Graph::Station& firstStation = graph.getStationByIndex(chain.front());
+        Route route;
+        route.addVisitedStation(Route::VisitedStation(firstStation.index, Route::VisitedStation::StartEdge, -1));
+
+        for (size_t i = 1; i < chain.size(); ++i) {
+            const Label& label = labels[chain[i]];
+            const int edgeIndex = label.walked ? Route::VisitedStation::WalkEdge : graph.getEdgeIndex(*label.line);
+            route.addVisitedStation(Route::VisitedStation(chain[i], edgeIndex, chain[i - 1]));
+        }
+
+        RoutingEngine::Result result;
+        result.route = std::move(route);
+        result.startStationCode = firstStation.code;
+        result.endStationId = endStation.code;
+        result.arrivalTime = labels[endIndex].arrival;
+        result.fitness = result.route.getFitness(result.startStationCode, result.endStationId, graph, params.startCoords, target.coords,
+            params.departureTime);
+        LOG_DEBUG(Timetable, "Timetable search reached station " << endStation.code << " at minute " << result.arrivalTime
+            << " (" << chain.size() << " stops).");
+        return result;
+    }
+}
+
+std::optional<RoutingEngine::Result> TimetableRoutingEngine::findBestRoute(
+    const std::vector<Graph::Station>& startStations,
+    const Graph::Station& endStation,
+    const Params& params,
+    const Graph& graph) const
+{
+    return findBestRoutes(startStations, { Target{ endStation, params.endCoords } }, params, graph).front();
+}
+
+std::vector<std::optional<RoutingEngine::Result>> TimetableRoutingEngine::findBestRoutes(
+    const std::vector<Graph::Station>& startStations,
+    const std::vector<Target>& targets,
+    const Params& params,
+    const Graph& graph) const
+{
+    std::vector<std::optional<Result>> results(targets.size());
+    if (startStations.empty()) return results;
+
+    // The search stops once every target station is settled; labels don't depend on the target.
+    std::vector<char> isTarget(graph.getStationCount(), 0);
+    size_t targetsLeft = 0;
+    for (const Target& target : targets) {
+        const int index = graph.getStationIndex(target.station.code);
+        if (index >= 0 && !isTarget[index]) {
+            isTarget[index] = 1;
+            targetsLeft++;
+        }
+    }
+    if (targetsLeft == 0) return results;
+
+    std::vector<Label> labels(graph.getStationCount());
+    runSearch(graph, startStations, params, Unreached, &isTarget, targetsLeft, labels);
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        results[i] = reconstructRoute(labels, targets[i], params, graph);
+    }
+    return results;
+}
+
+std::vector<float> TimetableRoutingEngine::findTravelTimes(
+    const std::vector<Graph::Station>& startStations,
+    const Params& params,
+    const double maxMinutes,
+    const Graph& graph) const
+{
+    std::vector<Label> labels(graph.getStationCount());
+    runSearch(graph, startStations, params, params.departureTime + maxMinutes, nullptr, 0, labels);
+
+    std::vector<float> minutes(labels.size(), std::numeric_limits<float>::infinity());
+    size_t reached = 0;
+    for (size_t i = 0; i < labels.size(); ++i) {
+        if (!labels[i].settled) continue;
+        minutes[i] = static_cast<float>(labels[i].arrival - params.departureTime);
+        reached++;
+    }
+    LOG_DEBUG(Timetable, "Travel time search reached " << reached << " stations within " << maxMinutes << " minutes.");
+    return minutes;
+}
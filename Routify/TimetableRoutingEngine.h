@@ -0,0 +1,40 @@
+#pragma once
+#include "RoutingEngine.h"
+
+/*
+* Deterministic earliest-arrival search over the timetables (time-dependent Dijkstra).
+* Boarding a line waits for its next arrival at the station, riding it takes until the line's next
+* arrival at the following stop, and short walks connect nearby stations. Returns the same answer for
+* the same request every time, usually in milliseconds.
+*/
+class TimetableRoutingEngine : public RoutingEngine {
+public:
+    std::optional<Result> findBestRoute(
+        const std::vector<Graph::Station>& startStations,
+        const Graph::Station& endStation,
+        const Params& params,
+        const Graph& graph) const override;
+
+    // One search from the start stations serves every target; it runs until all of them are reached.
+    std::vector<std::optional<Result>> findBestRoutes(
+        const std::vector<Graph::Station>& startStations,
+        const std::vector<Target>& targets,
+        const Params& params,
+        const Graph& graph) const override;
+
+    /*
+    * One-to-all search: minutes from params.departureTime (including the walk from params.startCoords) until each
+    * station is reached, indexed by dense station index. Stations not reached within maxMinutes are infinity.
+    */
+    std::vector<float> findTravelTimes(
+        const std::vector<Graph::Station>& startStations,
+        const Params& params,
+        const double maxMinutes,
+        const Graph& graph) const;
+
+    // Minimum time (minutes) to change between lines at a station.
+    static constexpr double MinTransferMinutes = 2.0;
+
+    // Longest walk (km) between two stations considered as a transfer.
+    static constexpr double MaxTransferWalkKm = 0.4;
+};
@@ -1,6 +1,7 @@
 #pragma once
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <ctime>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -49,4 +50,17 @@ namespace Utilities {
         return R * c; // Distance in kilometers
     }
 
+    // --- Local Time ---
+    // Minutes since local midnight right now, e.g. 90 at 1:30.
+    inline int minutesSinceMidnightNow() {
+        std::time_t now = std::time(nullptr);
+        std::tm local{};
+#ifdef _WIN32
+        localtime_s(&local, &now);
+#else
+        localtime_r(&now, &local);
+#endif
+        return local.tm_hour * 60 + local.tm_min;
+    }
+
 } // namespace Utilities
\ No newline at end of file
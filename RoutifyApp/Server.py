@@ -1,7 +1,9 @@
 import os
 import socket
 import json
-import time
+import struct
+import threading
+import itertools
 from flask import Flask, send_from_directory, abort, Response, request, jsonify
 import mimetypes
 
@@ -9,6 +11,109 @@ CPP_BACKEND_HOST = 'localhost'
 CPP_BACKEND_PORT = 8200
 SOCKET_TIMEOUT = 360.0
 SOCKET_BUFFER_SIZE = 4096
+BACKEND_POOL_SIZE = 4       # Persistent connections kept open to the C++ backend
+REQUEST_ID_KEY = 'requestId'
+RESPONSE_FORMAT_KEY = 'format'
+
+
+class BackendConnection:
+    """
+    One long-lived framed connection to the C++ backend. Requests are sent as a 4-byte big-endian length
+    followed by the JSON, tagged with a request id; a reader thread hands each response to the request
+    waiting on its id, so many requests can be in flight at once and finish in any order.
+    """
+
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, port))
+        self.reader = self.sock.makefile('rb', buffering=SOCKET_BUFFER_SIZE)
+        self.send_lock = threading.Lock()
+        self.pending = {}   # request id -> [threading.Event, response or exception]
+        self.pending_lock = threading.Lock()
+        self.alive = True
+        threading.Thread(target=self._read_responses, daemon=True).start()
+
+    def request(self, payload, request_id, timeout):
+        waiter = [threading.Event(), None]
+        with self.pending_lock:
+            if not self.alive: raise ConnectionError("Backend connection is closed")
+            self.pending[request_id] = waiter
+        try:
+            # Compact JSON replies: the proxy parses them anyway, so pretty-printing would only cost bytes.
+            tagged = dict(payload, **{REQUEST_ID_KEY: request_id, RESPONSE_FORMAT_KEY: 'json'})
+            body = json.dumps(tagged, separators=(',', ':')).encode('utf-8')
+            try:
+                with self.send_lock:
+                    self.sock.sendall(struct.pack('>I', len(body)) + body)
+            except OSError as e:
+                self.close(e); raise
+            if not waiter[0].wait(timeout):
+                raise socket.timeout(f"No response within {timeout}s")
+        finally:
+            with self.pending_lock: self.pending.pop(request_id, None)
+        if isinstance(waiter[1], Exception): raise waiter[1]
+        return waiter[1]
+
+    def close(self, error=None):
+        with self.pending_lock:
+            self.alive = False
+            waiters = list(self.pending.values()); self.pending.clear()
+        for waiter in waiters:
+            waiter[1] = error or ConnectionError("Backend connection closed"); waiter[0].set()
+        try: self.sock.close()
+        except OSError: pass
+
+    def _receive_exactly(self, count):
+        data = self.reader.read(count)
+        if len(data) < count: raise ConnectionError("Backend closed the connection")
+        return data
+
+    def _read_responses(self):
+        try:
+            while True:
+                length = struct.unpack('>I', self._receive_exactly(4))[0]
+                response = json.loads(self._receive_exactly(length).decode('utf-8'))
+                request_id = response.pop(REQUEST_ID_KEY, None) if isinstance(response, dict) else None
+                with self.pending_lock: waiter = self.pending.get(request_id)
+                if waiter is None:
+                    print(f"Warning: dropping backend response for unknown request id {request_id}")
+                    continue
+                waiter[1] = response; waiter[0].set()
+        except Exception as e:
+            print(f"Backend connection lost: {e}")
+            self.close(e if isinstance(e, (OSError, ValueError)) else ConnectionError(str(e)))
+
+
+class BackendPool:
+    """A few persistent connections shared by all Flask threads, reopened on demand when one drops."""
+
+    def __init__(self, host, port, size):
+        self.host, self.port = host, port
+        self.connections = [None] * size
+        self.lock = threading.Lock()
+        self.next_slot = itertools.count()
+        self.request_ids = itertools.count(1)
+
+    def _connection(self, slot):
+        with self.lock:
+            connection = self.connections[slot]
+            if connection is None or not connection.alive:
+                print(f"Connecting to C++ backend at {self.host}:{self.port} (pool slot {slot})...")
+                connection = self.connections[slot] = BackendConnection(self.host, self.port)
+            return connection
+
+    def request(self, payload, timeout=SOCKET_TIMEOUT):
+        slot = next(self.next_slot) % len(self.connections)
+        request_id = next(self.request_ids)
+        connection = self._connection(slot)
+        try:
+            return connection.request(payload, request_id, timeout)
+        except ConnectionError:
+            # The connection dropped (e.g. the backend restarted). Requests are read-only, so retry once on a fresh one.
+            if connection.alive: raise
+            return self._connection(slot).request(payload, request_id, timeout)
+
+
+backend_pool = BackendPool(CPP_BACKEND_HOST, CPP_BACKEND_PORT, BACKEND_POOL_SIZE)
 
 app = Flask(__name__, static_folder=None)
 APP_ROOT = os.path.dirname(os.path.abspath(__file__))
@@ -109,54 +214,20 @@ def proxy_route_request():
     print(f"Frontend Payload (parsed): {json.dumps(frontend_payload)}")
 
     # --- Communicate with C++ Backend ---
-    backend_response_str = None
     error_message = None
     status_code = 500
     parsed_backend_json = None # Store successfully parsed JSON here
 
-    try:
-        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
-            sock.settimeout(SOCKET_TIMEOUT)
-            print(f"Connecting to C++ backend (Timeout: {SOCKET_TIMEOUT}s)...")
-            sock.connect((CPP_BACKEND_HOST, CPP_BACKEND_PORT))
-            print("Connected.")
-            payload_str = json.dumps(frontend_payload)
-            print(f"Sending to C++ backend ({len(payload_str)} bytes)...")
-            sock.sendall(payload_str.encode('utf-8'))
-            print("Payload sent.")
-            try:
-                sock.shutdown(socket.SHUT_WR)
-                print("Socket write shutdown signaled.")
-            except OSError as shut_err: print(f"Warning: Socket shutdown(SHUT_WR) failed: {shut_err}")
-
-            print("Waiting for response from C++ backend...")
-            chunks = []; total_bytes_received = 0; start_time = time.time(); receive_error = None
+    # The pooled connection outlives this request, so the backend can't tell when we stop waiting: give it the same budget.
+    frontend_payload.setdefault('budgetMs', int(SOCKET_TIMEOUT * 1000))
 
-            while True:
-                try:
-                    chunk = sock.recv(SOCKET_BUFFER_SIZE)
-                    if not chunk: print("Backend closed connection gracefully."); break
-                    else: chunks.append(chunk); total_bytes_received += len(chunk)
-                except socket.timeout: receive_error = f"Timeout ({SOCKET_TIMEOUT}s)..."; status_code = 504; break
-                except socket.error as sock_err:
-                     if sock_err.winerror == 10054 and total_bytes_received > 0: print(f"Warning: WinError 10054 after receiving {total_bytes_received} bytes. Assuming complete."); break
-                     else: receive_error = f"Socket error receiving data: {sock_err}..."; status_code = 502; break
-                except Exception as e: receive_error = f"Unexpected error during receive: {e}..."; status_code = 500; break
-
-            if not receive_error or (receive_error and "Timeout" not in receive_error and total_bytes_received > 0):
-                 if total_bytes_received > 0:
-                    backend_response_bytes = b"".join(chunks)
-                    try:
-                        backend_response_str = backend_response_bytes.decode('utf-8')
-                        print(f"Full response received ({total_bytes_received} bytes) decoded.")
-                        try: parsed_backend_json = json.loads(backend_response_str); print("Backend response parsed as valid JSON.")
-                        except json.JSONDecodeError as json_parse_err: error_message = f"Backend invalid JSON: {json_parse_err}..."; status_code = 502; print(f"Error: {error_message}")
-                    except UnicodeDecodeError as decode_err: error_message = f"Failed UTF-8 decode: {decode_err}"; status_code = 502; print(f"Error: {error_message}")
-                 elif not receive_error: error_message = "Backend closed connection without sending data."; status_code = 502; print(f"Error: {error_message}")
-            else: error_message = receive_error
-
-    except socket.timeout: error_message = f"Connection timed out ({SOCKET_TIMEOUT}s)..."; status_code = 504; print(f"Error: {error_message}")
-    except socket.error as sock_err: error_message = f"Socket error connecting/sending...: {sock_err}"; status_code = 502; print(f"Error: {error_message}")
+    try:
+        print(f"Sending to C++ backend over pooled connection (Timeout: {SOCKET_TIMEOUT}s)...")
+        parsed_backend_json = backend_pool.request(frontend_payload)
+        print("Backend response received.")
+    except socket.timeout as e: error_message = f"Timeout waiting for backend: {e}"; status_code = 504; print(f"Error: {error_message}")
+    except ValueError as parse_err: error_message = f"Backend invalid JSON: {parse_err}..."; status_code = 502; print(f"Error: {error_message}")
+    except OSError as sock_err: error_message = f"Socket error communicating with backend: {sock_err}"; status_code = 502; print(f"Error: {error_message}")
     except Exception as e: error_message = f"Unexpected error during backend communication: {e}"; status_code = 500; print(f"Error: {error_message}")
 
     # --- Return Response to Frontend ---
@@ -171,6 +242,19 @@ def proxy_route_request():
         return jsonify({"error": "Unknown error", "details": "Failed to obtain a valid response from backend service."}), 500
 
 
+# --- Metrics Route ---
+@app.route('/metrics')
+def proxy_metrics():
+    """Exposes the C++ backend's metrics in the Prometheus text format, for scraping."""
+    try:
+        backend_json = backend_pool.request({'type': 6, 'prometheus': True})
+    except OSError as sock_err:
+        return Response(f"Backend unavailable: {sock_err}\n", status=502, mimetype='text/plain')
+    if 'prometheus' not in backend_json:
+        return Response(f"Backend error: {backend_json.get('error', 'no metrics')}\n", status=502, mimetype='text/plain')
+    return Response(backend_json['prometheus'], mimetype='text/plain; version=0.0.4')
+
+
 if __name__ == '__main__':
     mimetypes.add_type('application/javascript', '.js')
     mimetypes.add_type('text/css', '.css')
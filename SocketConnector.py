@@ -21,7 +21,10 @@ with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
     }
 
     s.sendall(json.dumps(request).encode())
-    data = s.recv(4096)
+    s.shutdown(socket.SHUT_WR)  # Ends the request; the server replies and then closes the connection
+    data = b''
+    while chunk := s.recv(4096):
+        data += chunk
 
     try:
         response = json.loads(data.decode())